@@ -178,12 +178,15 @@ typedef unsigned char   u_char;
 
 /* Profile variables.  Constants are named KRB5_CONF_STRING, where STRING
  * matches the variable name.  Keep these alphabetized. */
+#define KRB5_CONF_ACCEPTOR_PAC_CACHE           "acceptor_pac_cache"
 #define KRB5_CONF_ACL_FILE                     "acl_file"
 #define KRB5_CONF_ADMIN_SERVER                 "admin_server"
 #define KRB5_CONF_ALLOW_WEAK_CRYPTO            "allow_weak_crypto"
+#define KRB5_CONF_ASYNC                        "async"
 #define KRB5_CONF_AUTH_TO_LOCAL                "auth_to_local"
 #define KRB5_CONF_AUTH_TO_LOCAL_NAMES          "auth_to_local_names"
 #define KRB5_CONF_CANONICALIZE                 "canonicalize"
+#define KRB5_CONF_CCACHE_READ_CACHE            "ccache_read_cache"
 #define KRB5_CONF_CCACHE_TYPE                  "ccache_type"
 #define KRB5_CONF_CLOCKSKEW                    "clockskew"
 #define KRB5_CONF_DATABASE_NAME                "database_name"
@@ -229,8 +232,10 @@ typedef unsigned char   u_char;
 #define KRB5_CONF_IPROP_SLAVE_POLL             "iprop_slave_poll"
 #define KRB5_CONF_K5LOGIN_AUTHORITATIVE        "k5login_authoritative"
 #define KRB5_CONF_K5LOGIN_DIRECTORY            "k5login_directory"
+#define KRB5_CONF_KADMIND_COMMIT_DELAY         "kadmind_commit_delay"
 #define KRB5_CONF_KADMIND_LISTEN               "kadmind_listen"
 #define KRB5_CONF_KADMIND_PORT                 "kadmind_port"
+#define KRB5_CONF_KADMIND_THREADS              "kadmind_threads"
 #define KRB5_CONF_KCM_MACH_SERVICE             "kcm_mach_service"
 #define KRB5_CONF_KCM_SOCKET                   "kcm_socket"
 #define KRB5_CONF_KDC                          "kdc"
@@ -1182,6 +1187,22 @@ k5_plugin_register_dyn(krb5_context context, int interface_id,
 void
 k5_plugin_free_context(krb5_context context);
 
+/* Initialize and release the process-wide cache of loaded dynamic modules;
+ * used by the library initializer and finalizer. */
+int
+k5_plugin_cache_initialize(void);
+
+void
+k5_plugin_cache_finalize(void);
+
+/* Initialize and release the process-wide cache of verified PACs; used by
+ * the library initializer and finalizer. */
+int
+k5_pac_cache_initialize(void);
+
+void
+k5_pac_cache_finalize(void);
+
 enum dns_canonhost {
     CANONHOST_FALSE = 0,
     CANONHOST_TRUE = 1,
@@ -1249,6 +1270,13 @@ struct _krb5_context {
     krb5_boolean allow_weak_crypto;
     krb5_boolean ignore_acceptor_hostname;
     enum dns_canonhost dns_canonicalize_hostname;
+    krb5_boolean ccache_read_cache;
+    krb5_boolean acceptor_pac_cache;
+
+    /* Keys last used by krb5_pac_sign(), kept so that derived keys and
+     * cipher state can be reused across PACs. */
+    krb5_key pac_server_key;
+    krb5_key pac_privsvr_key;
 
     krb5_trace_callback trace_callback;
     void *trace_callback_data;
@@ -1377,6 +1405,27 @@ krb5_error_code
 encode_krb5_enc_kdc_rep_part(const krb5_enc_kdc_rep_part *rep,
                              krb5_data **code);
 
+/*
+ * Sized encoders compute the exact length of an encoding and then write it
+ * into a caller-supplied buffer of that length, such as the plaintext region
+ * of a ciphertext buffer.
+ */
+krb5_error_code
+encode_krb5_enc_tkt_part_length(const krb5_enc_tkt_part *rep,
+                                size_t *len_out);
+
+krb5_error_code
+encode_krb5_enc_tkt_part_into(const krb5_enc_tkt_part *rep, uint8_t *out,
+                              size_t len);
+
+krb5_error_code
+encode_krb5_enc_kdc_rep_part_length(const krb5_enc_kdc_rep_part *rep,
+                                    size_t *len_out);
+
+krb5_error_code
+encode_krb5_enc_kdc_rep_part_into(const krb5_enc_kdc_rep_part *rep,
+                                  uint8_t *out, size_t len);
+
 /* yes, the translation is identical to that used for KDC__REP */
 krb5_error_code
 encode_krb5_as_rep(const krb5_kdc_rep *rep, krb5_data **code);
@@ -1718,6 +1767,61 @@ decode_utf8_strings(const krb5_data *, krb5_data ***);
 krb5_error_code
 decode_krb5_secure_cookie(const krb5_data *, krb5_secure_cookie **);
 
+/*
+ * Arena decoding.  The following decoders allocate everything in the result
+ * from an arena, so that decoding a message costs a small, constant number of
+ * heap allocations and the result is released in one call.  Objects decoded
+ * into an arena must not be freed with the krb5_free_* functions, and must not
+ * be partially transferred into heap-allocated objects; they remain valid
+ * until the arena is reset or freed.  An arena may be reused for successive
+ * messages by resetting it after each one.
+ */
+typedef struct k5_asn1_arena_st k5_asn1_arena;
+
+krb5_error_code
+k5_asn1_arena_create(k5_asn1_arena **arena_out);
+
+/* Release all objects decoded into arena, keeping memory for reuse. */
+void
+k5_asn1_arena_reset(k5_asn1_arena *arena);
+
+void
+k5_asn1_arena_free(k5_asn1_arena *arena);
+
+krb5_error_code
+decode_krb5_as_req_arena(k5_asn1_arena *, const krb5_data *,
+                         krb5_kdc_req **);
+
+krb5_error_code
+decode_krb5_tgs_req_arena(k5_asn1_arena *, const krb5_data *,
+                          krb5_kdc_req **);
+
+krb5_error_code
+decode_krb5_as_rep_arena(k5_asn1_arena *, const krb5_data *,
+                         krb5_kdc_rep **);
+
+krb5_error_code
+decode_krb5_tgs_rep_arena(k5_asn1_arena *, const krb5_data *,
+                          krb5_kdc_rep **);
+
+krb5_error_code
+decode_krb5_ap_req_arena(k5_asn1_arena *, const krb5_data *, krb5_ap_req **);
+
+krb5_error_code
+decode_krb5_authenticator_arena(k5_asn1_arena *, const krb5_data *,
+                                krb5_authenticator **);
+
+krb5_error_code
+decode_krb5_ticket_arena(k5_asn1_arena *, const krb5_data *, krb5_ticket **);
+
+krb5_error_code
+decode_krb5_enc_tkt_part_arena(k5_asn1_arena *, const krb5_data *,
+                               krb5_enc_tkt_part **);
+
+krb5_error_code
+decode_krb5_padata_sequence_arena(k5_asn1_arena *, const krb5_data *,
+                                  krb5_pa_data ***);
+
 struct _krb5_key_data;          /* kdb.h */
 
 struct ldap_seqof_key_data {
@@ -1752,6 +1856,16 @@ krb5int_ldap_decode_sequence_of_keys(const krb5_data *in,
 krb5_error_code
 krb5_encrypt_tkt_part(krb5_context, const krb5_keyblock *, krb5_ticket *);
 
+/*
+ * Allocate cipher->ciphertext to hold the encryption of len bytes of
+ * plaintext with enctype, and set up iov (header, data, padding, trailer)
+ * within it.  The caller writes the plaintext into iov[1].data and encrypts
+ * in place with krb5_c_encrypt_iov(), avoiding a separate plaintext buffer.
+ */
+krb5_error_code
+k5_alloc_enc_data_iov(krb5_context context, krb5_enctype enctype, size_t len,
+                      krb5_enc_data *cipher, krb5_crypto_iov iov[4]);
+
 krb5_error_code
 krb5_encode_kdc_rep(krb5_context, krb5_msgtype, const krb5_enc_kdc_rep_part *,
                     int using_subkey, const krb5_keyblock *, krb5_kdc_rep *,
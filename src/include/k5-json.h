@@ -215,4 +215,35 @@ long long k5_json_number_value(k5_json_number number);
 int k5_json_encode(k5_json_value val, char **json_out);
 int k5_json_decode(const char *str, k5_json_value *val_out);
 
+/*
+ * Streaming JSON encoding
+ *
+ * A k5_json_writer appends JSON text directly to a k5buf, for callers which
+ * would otherwise build a value tree only to encode it.  Values inside an
+ * object must be written with a key; array elements and the top-level value
+ * are written with a null key.  The caller is responsible for balancing
+ * begin and end calls.  Allocation failures are reported through the k5buf
+ * status.
+ */
+
+struct k5buf;
+
+struct k5_json_writer {
+    struct k5buf *buf;
+    int first;
+};
+
+void k5_json_writer_init(struct k5_json_writer *w, struct k5buf *buf);
+void k5_json_write_begin_object(struct k5_json_writer *w, const char *key);
+void k5_json_write_end_object(struct k5_json_writer *w);
+void k5_json_write_begin_array(struct k5_json_writer *w, const char *key);
+void k5_json_write_end_array(struct k5_json_writer *w);
+void k5_json_write_string(struct k5_json_writer *w, const char *key,
+                          const char *str);
+void k5_json_write_string_len(struct k5_json_writer *w, const char *key,
+                              const void *str, size_t len);
+void k5_json_write_number(struct k5_json_writer *w, const char *key,
+                          long long number);
+void k5_json_write_bool(struct k5_json_writer *w, const char *key, int b);
+
 #endif /* K5_JSON_H */
@@ -129,6 +129,10 @@ void krb5int_trace(krb5_context context, const char *fmt, ...);
 #define TRACE_CC_SET_CONFIG(c, cache, princ, key, data)               \
     TRACE(c, "Storing config in {ccache} for {princ}: {str}: {data}", \
           cache, princ, key, data)
+#define TRACE_CC_SNAPSHOT_READ(c, cache)                        \
+    TRACE(c, "Reading snapshot of ccache {ccache}", cache)
+#define TRACE_CC_SNAPSHOT_REUSE(c, cache)                       \
+    TRACE(c, "Using cached snapshot of ccache {ccache}", cache)
 #define TRACE_CC_STORE(c, cache, creds)                         \
     TRACE(c, "Storing {creds} in {ccache}", creds, cache)
 #define TRACE_CC_STORE_TKT(c, cache, creds)                     \
@@ -293,6 +297,8 @@ void krb5int_trace(krb5_context context, const char *fmt, ...);
     TRACE(c, "PAC checksum verification failed: {kerr}", err)
 #define TRACE_MSPAC_DISCARD_UNVERF(c)           \
     TRACE(c, "Filtering out unverified MS PAC")
+#define TRACE_MSPAC_VERIFY_CACHED(c)                                    \
+    TRACE(c, "Using cached PAC verification for ticket")
 
 #define TRACE_PREAUTH_CONFLICT(c, name1, name2, patype)                 \
     TRACE(c, "Preauth module {str} conflicts with module {str} for pa " \
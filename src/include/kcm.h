@@ -55,7 +55,14 @@
  * and time offsets are stored as 32-bit big-endian integers.  Names are
  * marshalled as zero-terminated strings.  Principals and credentials are
  * marshalled in the v4 FILE ccache format.  UUIDs are 16 bytes.  UUID lists
- * are not delimited, so nothing can come after them.
+ * are not delimited, so nothing can come after them.  Name lists, returned
+ * by GET_CACHE_LIST and including only initialized caches, are likewise not
+ * delimited.  Counts and lengths are 32-bit big-endian integers.
+ *
+ * Servers which do not implement the MIT or local extensions are expected to
+ * reply to them with KRB5_FCC_INTERNAL (Heimdal) or KRB5_CC_IO (older
+ * versions of sssd); clients fall back to the older per-UUID operations in
+ * that case.
  */
 
 /* Opcodes without comments are currently unused in the MIT client
@@ -89,7 +96,17 @@ typedef enum kcm_opcode {
     KCM_OP_HAVE_NTLM_CRED,
     KCM_OP_DEL_NTLM_CRED,
     KCM_OP_DO_NTLM_AUTH,
-    KCM_OP_GET_NTLM_USER_LIST
+    KCM_OP_GET_NTLM_USER_LIST,
+
+    /* MIT extensions */
+    KCM_OP_MIT_EXTENSION_BASE = 13000,
+    KCM_OP_GET_CRED_LIST,       /*    (name) -> (count, count*{len, cred}) */
+    KCM_OP_REPLACE,
+
+    /* Local extensions.  These lie outside the ranges used by Heimdal and
+     * MIT, and must be renumbered if upstream assigns an equivalent. */
+    KCM_OP_LOCAL_EXTENSION_BASE = 0xF000,
+    KCM_OP_GET_CACHE_LIST       /*        () -> (name, ...)                */
 } kcm_opcode;
 
 #endif /* KCM_H */
@@ -134,6 +134,8 @@
 #define KRB5_DB_ITER_WRITE      0x00000001
 #define KRB5_DB_ITER_REV        0x00000002
 #define KRB5_DB_ITER_RECURSE    0x00000004
+/* The callback only needs the princ field of each entry. */
+#define KRB5_DB_ITER_NAMES_ONLY 0x00000008
 
 /* String attribute names recognized by krb5 */
 #define KRB5_KDB_SK_SESSION_ENCTYPES            "session_enctypes"
@@ -385,13 +387,40 @@ krb5_error_code krb5_db_rename_principal ( krb5_context kcontext,
 /*
  * Iterate over principals in the KDB.  If the callback may write to the DB,
  * the caller must get an exclusive lock with krb5_db_lock before iterating,
- * and release it with krb5_db_unlock after iterating.
+ * and release it with krb5_db_unlock after iterating.  If match_entry is not
+ * NULL, it is a glob pattern and the module may skip principals whose names
+ * cannot match it; the callback must still check the names it receives.
  */
 krb5_error_code krb5_db_iterate ( krb5_context kcontext,
                                   char *match_entry,
                                   int (*func) (krb5_pointer, krb5_db_entry *),
                                   krb5_pointer func_arg, krb5_flags iterflags );
 
+/*
+ * Return the length of the literal prefix of the glob pattern match_entry, up
+ * to the first wildcard, escape, or regular expression operator character
+ * (since kadm5 translates the glob into a regular expression which may treat
+ * characters such as "+" and "|" as operators).  Every principal name matching
+ * match_entry begins with this prefix, so a module with ordered keys can
+ * iterate over only the keys beginning with it.
+ */
+size_t krb5_db_match_prefix_len(const char *match_entry);
+
+/*
+ * Iterate over principals as krb5_db_iterate does, but in ascending order of
+ * unparsed principal name, beginning after start (or at the first principal
+ * if start is NULL).  The callback may end the iteration by returning a
+ * nonzero value, which is returned by this function.  Return
+ * KRB5_PLUGIN_OP_NOTSUPP if the module cannot iterate in name order; the
+ * caller can then fall back to krb5_db_iterate.
+ */
+krb5_error_code krb5_db_iterate_from(krb5_context kcontext, char *match_entry,
+                                     const char *start,
+                                     int (*func)(krb5_pointer,
+                                                 krb5_db_entry *),
+                                     krb5_pointer func_arg,
+                                     krb5_flags iterflags);
+
 
 krb5_error_code krb5_db_store_master_key  ( krb5_context kcontext,
                                             char *keyfile,
@@ -1084,8 +1113,12 @@ typedef struct _kdb_vftabl {
     /*
      * Optional: For each principal entry in the database, invoke func with the
      * argments func_arg and the entry data.  If match_entry is specified, the
-     * module may narrow the iteration to principal names matching that regular
-     * expression; a module may alternatively ignore match_entry.
+     * module may narrow the iteration to principal names matching that glob
+     * pattern (for instance, to names beginning with the prefix given by
+     * krb5_db_match_prefix_len()); a module may alternatively ignore
+     * match_entry.  If iterflags includes KRB5_DB_ITER_NAMES_ONLY, the module
+     * may pass entries with only the princ field set, which need not be
+     * decoded from the stored record.
      */
     krb5_error_code (*iterate)(krb5_context kcontext,
                                char *match_entry,
@@ -1427,6 +1460,23 @@ typedef struct _kdb_vftabl {
                                               krb5_db_entry **entry_out);
 
     /* End of minor version 1 for major version 7. */
+
+    /*
+     * Optional: Like iterate, but visit principals in ascending byte order of
+     * their unparsed names, beginning with the first name which sorts after
+     * start.  If iterflags cannot be honored in that order (for instance,
+     * because the database is not ordered by name), return
+     * KRB5_PLUGIN_OP_NOTSUPP.  A callback may stop the iteration early by
+     * returning a nonzero value, which is returned to the caller.
+     */
+    krb5_error_code (*iterate_from)(krb5_context kcontext, char *match_entry,
+                                    const char *start,
+                                    int (*func)(krb5_pointer,
+                                                krb5_db_entry *),
+                                    krb5_pointer func_arg,
+                                    krb5_flags iterflags);
+
+    /* End of minor version 2 for major version 7. */
 } kdb_vftabl;
 
 #endif /* !defined(_WIN32) */
@@ -25,9 +25,10 @@ extern "C" {
     ((char *)(ulog) + sizeof(kdb_hlog_t) + (i) * ulog->kdb_block)
 
 /*
- * Current DB version #
+ * Current DB version #.  Version 2 ulogs store each entry with kdb_commit set
+ * in its XDR encoding, so that the encoding can be served to replicas as is.
  */
-#define KDB_VERSION     1
+#define KDB_VERSION     2
 
 /*
  * DB log states
@@ -58,12 +59,28 @@ extern "C" {
 /*
  * Prototype declarations
  */
+/*
+ * A kdb_incr_result_t whose updates are kept in their stored XDR encoding
+ * rather than decoded.  result.updates.kdb_ulog_t_len gives the number of
+ * updates; result.updates.kdb_ulog_t_val is unused.  Encodes the same as
+ * kdb_incr_result_t.
+ */
+typedef struct kdb_incr_raw_result {
+    kdb_incr_result_t result;
+    krb5_data updates;
+} kdb_incr_raw_result_t;
+
 krb5_error_code ulog_map(krb5_context context, const char *logname,
                          uint32_t entries);
 krb5_error_code ulog_init_header(krb5_context context);
 krb5_error_code ulog_add_update(krb5_context context, kdb_incr_update_t *upd);
 krb5_error_code ulog_get_entries(krb5_context context, const kdb_last_t *last,
                                  kdb_incr_result_t *ulog_handle);
+krb5_error_code ulog_get_raw_entries(krb5_context context,
+                                     const kdb_last_t *last,
+                                     kdb_incr_raw_result_t *res);
+void ulog_free_raw_entries(kdb_incr_raw_result_t *res);
+bool_t xdr_kdb_incr_raw_result_t(XDR *xdrs, kdb_incr_raw_result_t *objp);
 krb5_error_code ulog_replay(krb5_context context, kdb_incr_result_t *incr_ret,
                             char **db_args);
 krb5_error_code ulog_conv_2logentry(krb5_context context, krb5_db_entry *entry,
@@ -76,6 +93,9 @@ update_status_t ulog_get_sno_status(krb5_context context,
                                     const kdb_last_t *last);
 krb5_error_code ulog_get_last(krb5_context context, kdb_last_t *last_out);
 krb5_error_code ulog_set_last(krb5_context context, const kdb_last_t *last);
+void ulog_defer_sync(krb5_context context, krb5_boolean defer);
+void ulog_abort_deferred(krb5_context context);
+void ulog_sync(krb5_context context);
 void ulog_fini(krb5_context context);
 
 typedef struct kdb_hlog {
@@ -104,6 +124,10 @@ typedef struct _kdb_log_context {
     kdb_hlog_t      *ulog;
     uint32_t        ulogentries;
     int             ulogfd;
+    unsigned int    defer_sync;     /* Nesting depth of deferred syncs */
+    krb5_boolean    unsynced;       /* Updates stored since the last sync */
+    kdb_hlog_t      pending;        /* Header including unsynced updates */
+    krb5_boolean    defer_failed;   /* Discard updates when deferral ends */
 } kdb_log_context;
 
 #ifdef  __cplusplus
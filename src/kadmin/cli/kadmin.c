@@ -992,14 +992,17 @@ unlock_princ(kadm5_principal_ent_t princ, long *mask, const char *caller)
 }
 
 /*
- * Parse addprinc or modprinc arguments.  Some output fields may be
- * filled in on error.
+ * Parse the options of an addprinc or modprinc style command, whose last
+ * argument is an operand.  Attributes are set in oprinc->attributes and
+ * cleared in *clear_attrs, or in oprinc->attributes if clear_attrs is NULL.
+ * Some output fields may be filled in on error.
  */
 static int
-kadmin_parse_princ_args(int argc, char *argv[], kadm5_principal_ent_t oprinc,
-                        long *mask, char **pass, krb5_boolean *randkey,
-                        krb5_boolean *nokey, krb5_key_salt_tuple **ks_tuple,
-                        int *n_ks_tuple, char *caller)
+kadmin_parse_princ_opts(int argc, char *argv[], kadm5_principal_ent_t oprinc,
+                        krb5_flags *clear_attrs, long *mask, char **pass,
+                        krb5_boolean *randkey, krb5_boolean *nokey,
+                        krb5_key_salt_tuple **ks_tuple, int *n_ks_tuple,
+                        char *caller)
 {
     int i;
     time_t now, date, interval;
@@ -1113,6 +1116,7 @@ kadmin_parse_princ_args(int argc, char *argv[], kadm5_principal_ent_t oprinc,
             continue;
         }
         retval = krb5_flagspec_to_mask(argv[i], &oprinc->attributes,
+                                       (clear_attrs != NULL) ? clear_attrs :
                                        &oprinc->attributes);
         if (retval)
             return -1;
@@ -1121,7 +1125,25 @@ kadmin_parse_princ_args(int argc, char *argv[], kadm5_principal_ent_t oprinc,
     }
     if (i != argc - 1)
         return -1;
-    retval = kadmin_parse_name(argv[i], &oprinc->principal);
+    return 0;
+}
+
+/*
+ * Parse addprinc or modprinc arguments.  Some output fields may be
+ * filled in on error.
+ */
+static int
+kadmin_parse_princ_args(int argc, char *argv[], kadm5_principal_ent_t oprinc,
+                        long *mask, char **pass, krb5_boolean *randkey,
+                        krb5_boolean *nokey, krb5_key_salt_tuple **ks_tuple,
+                        int *n_ks_tuple, char *caller)
+{
+    krb5_error_code retval;
+
+    if (kadmin_parse_princ_opts(argc, argv, oprinc, NULL, mask, pass, randkey,
+                                nokey, ks_tuple, n_ks_tuple, caller))
+        return -1;
+    retval = kadmin_parse_name(argv[argc - 1], &oprinc->principal);
     if (retval) {
         com_err(caller, retval, _("while parsing principal"));
         return -1;
@@ -1385,6 +1407,237 @@ cleanup:
     free(ks_tuple);
 }
 
+/* Number of principals sent to the server in one batch request. */
+#define PRINC_BATCH_SIZE 256
+
+/*
+ * Read up to PRINC_BATCH_SIZE principal names, one per line, from fp into
+ * princs and their canonical forms into names.  Blank lines are skipped and
+ * names which do not parse are reported.  Return the number of names read,
+ * which is zero at the end of the file.
+ */
+static int
+read_princ_batch(FILE *fp, char *caller, krb5_principal *princs, char **names)
+{
+    krb5_error_code retval;
+    char line[BUFSIZ], *start, *end;
+    int n = 0;
+
+    while (n < PRINC_BATCH_SIZE && fgets(line, sizeof(line), fp) != NULL) {
+        for (start = line; isspace((unsigned char)*start); start++);
+        end = start + strlen(start);
+        while (end > start && isspace((unsigned char)end[-1]))
+            end--;
+        *end = '\0';
+        if (*start == '\0')
+            continue;
+
+        retval = kadmin_parse_name(start, &princs[n]);
+        if (retval) {
+            com_err(caller, retval, _("while parsing principal \"%s\""),
+                    start);
+            continue;
+        }
+        retval = krb5_unparse_name(context, princs[n], &names[n]);
+        if (retval) {
+            com_err(caller, retval, _("while canonicalizing principal"));
+            krb5_free_principal(context, princs[n]);
+            continue;
+        }
+        n++;
+    }
+    return n;
+}
+
+/* Open the file of principal names for a batch command; "-" means stdin. */
+static FILE *
+open_princ_file(const char *filename, char *caller)
+{
+    FILE *fp;
+
+    if (strcmp(filename, "-") == 0)
+        return stdin;
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+        com_err(caller, errno, _("while opening %s"), filename);
+    return fp;
+}
+
+static void
+kadmin_addprincs_usage()
+{
+    error(_("usage: add_principals [options] namefile\n"));
+    error(_("\toptions are as for add_principal, except that -pw is not "
+            "allowed\n"));
+}
+
+static void
+kadmin_modprincs_usage()
+{
+    error(_("usage: modify_principals [options] namefile\n"));
+    error(_("\toptions are as for modify_principal\n"));
+}
+
+void
+kadmin_addprincs(int argc, char *argv[])
+{
+    kadm5_principal_ent_rec tmpl, recs[PRINC_BATCH_SIZE];
+    krb5_principal princs[PRINC_BATCH_SIZE];
+    char *names[PRINC_BATCH_SIZE], *pass;
+    long mask, masks[PRINC_BATCH_SIZE];
+    kadm5_ret_t results[PRINC_BATCH_SIZE];
+    krb5_boolean randkey = FALSE, nokey = FALSE;
+    int i, n, n_ks_tuple = 0;
+    krb5_key_salt_tuple *ks_tuple = NULL;
+    krb5_error_code retval, code;
+    FILE *fp = NULL;
+
+    memset(&tmpl, 0, sizeof(tmpl));
+    if (kadmin_parse_princ_opts(argc, argv, &tmpl, NULL, &mask, &pass,
+                                &randkey, &nokey, &ks_tuple, &n_ks_tuple,
+                                "add_principals") || pass != NULL) {
+        kadmin_addprincs_usage();
+        goto cleanup;
+    }
+
+    if (mask & KADM5_POLICY) {
+        /* Warn if the specified policy does not exist. */
+        if (!script_mode && !policy_exists(tmpl.policy)) {
+            fprintf(stderr, _("WARNING: policy \"%s\" does not exist\n"),
+                    tmpl.policy);
+        }
+    } else if (!(mask & KADM5_POLICY_CLR)) {
+        /* If the policy "default" exists, assign it. */
+        if (policy_exists("default")) {
+            if (!script_mode) {
+                fprintf(stderr, _("NOTICE: no policy specified; "
+                                  "assigning \"default\"\n"));
+            }
+            tmpl.policy = "default";
+            mask |= KADM5_POLICY;
+        } else if (!script_mode) {
+            fprintf(stderr, _("WARNING: no policy specified; "
+                              "defaulting to no policy\n"));
+        }
+    }
+    /* Don't send KADM5_POLICY_CLR to the server. */
+    mask &= ~KADM5_POLICY_CLR;
+    if (nokey)
+        mask |= KADM5_KEY_DATA;
+    mask |= KADM5_PRINCIPAL;
+
+    fp = open_princ_file(argv[argc - 1], "add_principals");
+    if (fp == NULL)
+        goto cleanup;
+
+    /* Principals are created with random keys unless -nokey was given. */
+    while ((n = read_princ_batch(fp, "add_principals", princs, names)) > 0) {
+        for (i = 0; i < n; i++) {
+            recs[i] = tmpl;
+            recs[i].principal = princs[i];
+            masks[i] = mask;
+        }
+        retval = kadm5_create_principals(handle, n, recs, masks, n_ks_tuple,
+                                         ks_tuple, NULL, results);
+        for (i = 0; i < n; i++) {
+            code = retval ? retval : results[i];
+            if (code) {
+                com_err("add_principals", code, _("while creating \"%s\"."),
+                        names[i]);
+            } else {
+                info(_("Principal \"%s\" created.\n"), names[i]);
+            }
+            krb5_free_principal(context, princs[i]);
+            free(names[i]);
+        }
+    }
+
+cleanup:
+    if (fp != NULL && fp != stdin)
+        fclose(fp);
+    free(ks_tuple);
+    kadmin_free_tl_data(&tmpl.n_tl_data, &tmpl.tl_data);
+}
+
+void
+kadmin_modprincs(int argc, char *argv[])
+{
+    kadm5_principal_ent_rec tmpl, oldprinc, recs[PRINC_BATCH_SIZE];
+    krb5_principal princs[PRINC_BATCH_SIZE];
+    char *names[PRINC_BATCH_SIZE], *pass;
+    long mask, masks[PRINC_BATCH_SIZE];
+    kadm5_ret_t results[PRINC_BATCH_SIZE];
+    krb5_boolean randkey = FALSE, nokey = FALSE;
+    krb5_flags clear_attrs = ~(krb5_flags)0;
+    int i, j, n, m, idx[PRINC_BATCH_SIZE], n_ks_tuple = 0;
+    krb5_key_salt_tuple *ks_tuple = NULL;
+    krb5_error_code retval, code;
+    FILE *fp = NULL;
+
+    memset(&tmpl, 0, sizeof(tmpl));
+    retval = kadmin_parse_princ_opts(argc, argv, &tmpl, &clear_attrs, &mask,
+                                     &pass, &randkey, &nokey, &ks_tuple,
+                                     &n_ks_tuple, "modify_principals");
+    if (retval || ks_tuple != NULL || randkey || nokey || pass) {
+        kadmin_modprincs_usage();
+        goto cleanup;
+    }
+    if (mask & KADM5_POLICY) {
+        /* Warn if the specified policy does not exist. */
+        if (!script_mode && !policy_exists(tmpl.policy)) {
+            fprintf(stderr, _("WARNING: policy \"%s\" does not exist\n"),
+                    tmpl.policy);
+        }
+    }
+
+    fp = open_princ_file(argv[argc - 1], "modify_principals");
+    if (fp == NULL)
+        goto cleanup;
+
+    while ((n = read_princ_batch(fp, "modify_principals", princs,
+                                 names)) > 0) {
+        for (i = m = 0; i < n; i++) {
+            recs[m] = tmpl;
+            recs[m].principal = princs[i];
+            masks[m] = mask;
+            if (mask & KADM5_ATTRIBUTES) {
+                /* Apply the attribute changes to the current attributes. */
+                retval = kadm5_get_principal(handle, princs[i], &oldprinc,
+                                             KADM5_ATTRIBUTES);
+                if (retval) {
+                    com_err("modify_principals", retval,
+                            _("while getting \"%s\"."), names[i]);
+                    continue;
+                }
+                recs[m].attributes = (oldprinc.attributes & clear_attrs) |
+                    tmpl.attributes;
+                kadm5_free_principal_ent(handle, &oldprinc);
+            }
+            idx[m++] = i;
+        }
+        retval = kadm5_modify_principals(handle, m, recs, masks, results);
+        for (j = 0; j < m; j++) {
+            code = retval ? retval : results[j];
+            if (code) {
+                com_err("modify_principals", code,
+                        _("while modifying \"%s\"."), names[idx[j]]);
+            } else {
+                info(_("Principal \"%s\" modified.\n"), names[idx[j]]);
+            }
+        }
+        for (i = 0; i < n; i++) {
+            krb5_free_principal(context, princs[i]);
+            free(names[i]);
+        }
+    }
+
+cleanup:
+    if (fp != NULL && fp != stdin)
+        fclose(fp);
+    free(ks_tuple);
+    kadmin_free_tl_data(&tmpl.n_tl_data, &tmpl.tl_data);
+}
+
 void
 kadmin_getprinc(int argc, char *argv[])
 {
@@ -29,6 +29,7 @@
  */
 
 #include <k5-int.h>
+#include <k5-input.h>
 #include <kadm5/admin.h>
 #include <kadm5/server_internal.h>
 #include <kdb.h>
@@ -638,6 +639,38 @@ process_tl_data(const char *fname, FILE *filep, int lineno,
     return 0;
 }
 
+/* Return the kadm5 mask bits indicated by the tagged data of a loaded
+ * principal entry. */
+static krb5_ui_4
+tl_data_mask(krb5_tl_data *tl_data)
+{
+    krb5_tl_data *tl;
+    krb5_ui_4 mask = KADM5_TL_DATA;
+    XDR xdrs;
+    osa_princ_ent_rec osa_princ_ent;
+
+    for (tl = tl_data; tl; tl = tl->tl_data_next) {
+        if (tl->tl_data_type != KRB5_TL_KADM_DATA)
+            continue;
+
+        /* Assuming aux_attributes will always be there */
+        mask |= KADM5_AUX_ATTRIBUTES;
+
+        /* test for an actual policy reference */
+        memset(&osa_princ_ent, 0, sizeof(osa_princ_ent));
+        xdrmem_create(&xdrs, (char *)tl->tl_data_contents, tl->tl_data_length,
+                      XDR_DECODE);
+        if (xdr_osa_princ_ent_rec(&xdrs, &osa_princ_ent)) {
+            if ((osa_princ_ent.aux_attributes & KADM5_POLICY) &&
+                osa_princ_ent.policy != NULL)
+                mask |= KADM5_POLICY;
+            kdb_free_entry(NULL, NULL, &osa_princ_ent);
+        }
+        xdr_destroy(&xdrs);
+    }
+    return mask;
+}
+
 /* Read a beta 7 entry and add it to the database.  Return -1 for end of file,
  * 0 for success and 1 for failure. */
 static int
@@ -650,7 +683,6 @@ process_k5beta7_princ(krb5_context context, const char *fname, FILE *filep,
     unsigned int u1, u2, u3, u4, u5;
     char *name = NULL;
     krb5_key_data *kp = NULL, *kd;
-    krb5_tl_data *tl;
     krb5_error_code ret;
 
     dbentry = calloc(1, sizeof(*dbentry));
@@ -729,32 +761,7 @@ process_k5beta7_princ(krb5_context context, const char *fname, FILE *filep,
     if (dbentry->n_tl_data) {
         if (process_tl_data(fname, filep, *linenop, dbentry->tl_data))
             goto fail;
-        for (tl = dbentry->tl_data; tl; tl = tl->tl_data_next) {
-            /* test to set mask fields */
-            if (tl->tl_data_type == KRB5_TL_KADM_DATA) {
-                XDR xdrs;
-                osa_princ_ent_rec osa_princ_ent;
-
-                /*
-                 * Assuming aux_attributes will always be
-                 * there
-                 */
-                dbentry->mask |= KADM5_AUX_ATTRIBUTES;
-
-                /* test for an actual policy reference */
-                memset(&osa_princ_ent, 0, sizeof(osa_princ_ent));
-                xdrmem_create(&xdrs, (char *)tl->tl_data_contents,
-                              tl->tl_data_length, XDR_DECODE);
-                if (xdr_osa_princ_ent_rec(&xdrs, &osa_princ_ent)) {
-                    if ((osa_princ_ent.aux_attributes & KADM5_POLICY) &&
-                        osa_princ_ent.policy != NULL)
-                        dbentry->mask |= KADM5_POLICY;
-                    kdb_free_entry(NULL, NULL, &osa_princ_ent);
-                }
-                xdr_destroy(&xdrs);
-            }
-        }
-        dbentry->mask |= KADM5_TL_DATA;
+        dbentry->mask |= tl_data_mask(dbentry->tl_data);
     }
 
     /* Get the key data. */
@@ -1031,6 +1038,631 @@ process_r1_11_record(krb5_context context, const char *fname, FILE *filep,
                           process_k5beta7_princ, process_r1_11_policy);
 }
 
+/*
+ * The binary dump format consists of a text header line (the version line, or
+ * an iprop header) followed by length-prefixed records:
+ *
+ *      type (1 byte) length (4 bytes) contents (length bytes)
+ *
+ * All integers are big-endian and all byte strings are preceded by a four-byte
+ * length.  Principal records contain the principal name in structured form so
+ * that they can be decoded without a krb5 context; policy records contain the
+ * same fields as the release 1.11 text format.  Since record boundaries can be
+ * found without parsing record contents, the loader reads a batch of records
+ * at a time, decodes the batch in parallel threads, and then stores the
+ * decoded entries in dump order.
+ */
+
+#define BINARY_PRINC_RECORD 'P'
+#define BINARY_POLICY_RECORD 'T'
+#define BINARY_RECORD_HEADER_LEN 5
+#define BINARY_RECORD_MAX (16 * 1024 * 1024)
+#define BINARY_LOAD_BATCH 1024
+#define BINARY_LOAD_MAX_THREADS 8
+
+static void
+put16(struct k5buf *buf, uint16_t num)
+{
+    uint8_t n[2];
+
+    store_16_be(num, n);
+    k5_buf_add_len(buf, n, 2);
+}
+
+static void
+put32(struct k5buf *buf, uint32_t num)
+{
+    uint8_t n[4];
+
+    store_32_be(num, n);
+    k5_buf_add_len(buf, n, 4);
+}
+
+static void
+put_bytes(struct k5buf *buf, const void *data, size_t len)
+{
+    put32(buf, len);
+    k5_buf_add_len(buf, data, len);
+}
+
+static void
+put_binary_tl_data(struct k5buf *buf, krb5_tl_data *tl_data)
+{
+    krb5_tl_data *tl;
+    int count = 0;
+
+    for (tl = tl_data; tl != NULL; tl = tl->tl_data_next)
+        count++;
+    put16(buf, count);
+    for (tl = tl_data; tl != NULL; tl = tl->tl_data_next) {
+        put16(buf, tl->tl_data_type);
+        put16(buf, tl->tl_data_length);
+        k5_buf_add_len(buf, tl->tl_data_contents, tl->tl_data_length);
+    }
+}
+
+/* Write the contents of buf to fp as a binary dump record of type type. */
+static krb5_error_code
+write_binary_record(FILE *fp, int type, struct k5buf *buf)
+{
+    uint8_t hdr[BINARY_RECORD_HEADER_LEN];
+
+    if (k5_buf_status(buf) != 0)
+        return ENOMEM;
+    if (buf->len > BINARY_RECORD_MAX)
+        return EINVAL;
+    hdr[0] = type;
+    store_32_be(buf->len, hdr + 1);
+    if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+        fwrite(buf->data, 1, buf->len, fp) != buf->len)
+        return EIO;
+    return 0;
+}
+
+static krb5_error_code
+dump_binary_princ(krb5_context context, krb5_db_entry *entry,
+                  const char *name, FILE *fp, krb5_boolean verbose,
+                  krb5_boolean omit_nra)
+{
+    krb5_error_code ret;
+    krb5_principal princ = entry->princ;
+    krb5_key_data *kd;
+    struct k5buf buf;
+    int i, j;
+
+    k5_buf_init_dynamic(&buf);
+    put32(&buf, princ->type);
+    put_bytes(&buf, princ->realm.data, princ->realm.length);
+    put32(&buf, princ->length);
+    for (i = 0; i < princ->length; i++)
+        put_bytes(&buf, princ->data[i].data, princ->data[i].length);
+
+    put16(&buf, entry->len);
+    put32(&buf, entry->attributes);
+    put32(&buf, entry->max_life);
+    put32(&buf, entry->max_renewable_life);
+    put32(&buf, entry->expiration);
+    put32(&buf, entry->pw_expiration);
+    put32(&buf, omit_nra ? 0 : entry->last_success);
+    put32(&buf, omit_nra ? 0 : entry->last_failed);
+    put32(&buf, omit_nra ? 0 : entry->fail_auth_count);
+    put_binary_tl_data(&buf, entry->tl_data);
+
+    put16(&buf, entry->n_key_data);
+    for (i = 0; i < entry->n_key_data; i++) {
+        kd = &entry->key_data[i];
+        put16(&buf, kd->key_data_ver);
+        put16(&buf, kd->key_data_kvno);
+        for (j = 0; j < kd->key_data_ver; j++) {
+            put16(&buf, kd->key_data_type[j]);
+            put_bytes(&buf, kd->key_data_contents[j],
+                      kd->key_data_length[j]);
+        }
+    }
+    put_bytes(&buf, entry->e_data, entry->e_length);
+
+    ret = write_binary_record(fp, BINARY_PRINC_RECORD, &buf);
+    k5_buf_free(&buf);
+    if (ret) {
+        com_err(progname, ret, _("while writing %s"), name);
+        return ret;
+    }
+
+    if (verbose)
+        fprintf(stderr, "%s\n", name);
+
+    return 0;
+}
+
+static void
+dump_binary_policy(void *data, osa_policy_ent_t entry)
+{
+    struct dump_args *arg = data;
+    const char *keysalts = entry->allowed_keysalts;
+    struct k5buf buf;
+
+    k5_buf_init_dynamic(&buf);
+    put_bytes(&buf, entry->name, strlen(entry->name));
+    put32(&buf, entry->pw_min_life);
+    put32(&buf, entry->pw_max_life);
+    put32(&buf, entry->pw_min_length);
+    put32(&buf, entry->pw_min_classes);
+    put32(&buf, entry->pw_history_num);
+    put32(&buf, entry->pw_max_fail);
+    put32(&buf, entry->pw_failcnt_interval);
+    put32(&buf, entry->pw_lockout_duration);
+    put32(&buf, entry->attributes);
+    put32(&buf, entry->max_life);
+    put32(&buf, entry->max_renewable_life);
+    put_bytes(&buf, keysalts, (keysalts != NULL) ? strlen(keysalts) : 0);
+    put_binary_tl_data(&buf, entry->tl_data);
+
+    (void)write_binary_record(arg->ofile, BINARY_POLICY_RECORD, &buf);
+    k5_buf_free(&buf);
+}
+
+/* Read a length-prefixed byte string from in into a zero-terminated copy. */
+static krb5_error_code
+get_binary_data(struct k5input *in, krb5_data *data_out)
+{
+    krb5_error_code ret;
+    const unsigned char *contents;
+    size_t len;
+
+    len = k5_input_get_uint32_be(in);
+    contents = k5_input_get_bytes(in, len);
+    if (contents == NULL)
+        return EINVAL;
+    data_out->data = k5memdup0(contents, len, &ret);
+    if (data_out->data == NULL)
+        return ret;
+    data_out->magic = KV5M_DATA;
+    data_out->length = len;
+    return 0;
+}
+
+/* Read a length-prefixed byte string from in into an allocated copy, leaving
+ * *out and *len_out unset if the string is empty. */
+static krb5_error_code
+get_binary_octets(struct k5input *in, unsigned char **out, size_t *len_out)
+{
+    krb5_error_code ret;
+    const unsigned char *contents;
+    size_t len;
+
+    len = k5_input_get_uint32_be(in);
+    contents = k5_input_get_bytes(in, len);
+    if (contents == NULL)
+        return EINVAL;
+    if (len > 0) {
+        *out = k5memdup(contents, len, &ret);
+        if (*out == NULL)
+            return ret;
+        *len_out = len;
+    }
+    return 0;
+}
+
+static krb5_error_code
+get_binary_tl_data(struct k5input *in, krb5_int16 *count_out,
+                   krb5_tl_data **list_out)
+{
+    krb5_error_code ret;
+    krb5_tl_data *tl, **tlp = list_out;
+    const unsigned char *contents;
+    int i, count;
+
+    count = k5_input_get_uint16_be(in);
+    if (count > INT16_MAX)
+        return EINVAL;
+    *count_out = count;
+    for (i = 0; i < count; i++) {
+        tl = k5alloc(sizeof(*tl), &ret);
+        if (tl == NULL)
+            return ret;
+        *tlp = tl;
+        tlp = &tl->tl_data_next;
+        tl->tl_data_type = k5_input_get_uint16_be(in);
+        tl->tl_data_length = k5_input_get_uint16_be(in);
+        contents = k5_input_get_bytes(in, tl->tl_data_length);
+        if (contents == NULL)
+            return EINVAL;
+        if (tl->tl_data_length > 0) {
+            tl->tl_data_contents = k5memdup(contents, tl->tl_data_length,
+                                            &ret);
+            if (tl->tl_data_contents == NULL)
+                return ret;
+        }
+    }
+    return 0;
+}
+
+static krb5_error_code
+get_binary_princ(struct k5input *in, krb5_principal *princ_out)
+{
+    krb5_error_code ret;
+    krb5_principal princ;
+    uint32_t i, ncomps;
+
+    princ = k5alloc(sizeof(*princ), &ret);
+    if (princ == NULL)
+        return ret;
+    *princ_out = princ;
+    princ->magic = KV5M_PRINCIPAL;
+    princ->type = k5_input_get_uint32_be(in);
+    ret = get_binary_data(in, &princ->realm);
+    if (ret)
+        return ret;
+
+    /* Each component takes at least four bytes. */
+    ncomps = k5_input_get_uint32_be(in);
+    if (in->status || ncomps > in->len / 4)
+        return EINVAL;
+    princ->data = k5calloc(ncomps, sizeof(*princ->data), &ret);
+    if (princ->data == NULL)
+        return ret;
+    for (i = 0; i < ncomps; i++) {
+        ret = get_binary_data(in, &princ->data[i]);
+        if (ret)
+            return ret;
+        princ->length++;
+    }
+    return 0;
+}
+
+/*
+ * Decode a binary principal record into a new DB entry.  This function runs in
+ * decoding threads and cannot use a krb5 context, so on failure *entry_out may
+ * be set to a partially decoded entry for the caller to free.
+ */
+static krb5_error_code
+decode_binary_princ(const unsigned char *rec, size_t len,
+                    krb5_db_entry **entry_out)
+{
+    krb5_error_code ret;
+    krb5_db_entry *entry;
+    krb5_key_data *kd;
+    struct k5input in;
+    size_t klen;
+    int i, j, n_key_data;
+
+    *entry_out = entry = k5alloc(sizeof(*entry), &ret);
+    if (entry == NULL)
+        return ret;
+
+    k5_input_init(&in, rec, len);
+    ret = get_binary_princ(&in, &entry->princ);
+    if (ret)
+        return ret;
+
+    entry->len = k5_input_get_uint16_be(&in);
+    entry->attributes = k5_input_get_uint32_be(&in);
+    entry->max_life = k5_input_get_uint32_be(&in);
+    entry->max_renewable_life = k5_input_get_uint32_be(&in);
+    entry->expiration = k5_input_get_uint32_be(&in);
+    entry->pw_expiration = k5_input_get_uint32_be(&in);
+    entry->last_success = k5_input_get_uint32_be(&in);
+    entry->last_failed = k5_input_get_uint32_be(&in);
+    entry->fail_auth_count = k5_input_get_uint32_be(&in);
+    entry->mask = KADM5_LOAD | KADM5_PRINCIPAL | KADM5_ATTRIBUTES |
+        KADM5_MAX_LIFE | KADM5_MAX_RLIFE | KADM5_PRINC_EXPIRE_TIME |
+        KADM5_LAST_SUCCESS | KADM5_LAST_FAILED | KADM5_FAIL_AUTH_COUNT;
+
+    ret = get_binary_tl_data(&in, &entry->n_tl_data, &entry->tl_data);
+    if (ret)
+        return ret;
+    if (entry->n_tl_data > 0)
+        entry->mask |= tl_data_mask(entry->tl_data);
+
+    n_key_data = k5_input_get_uint16_be(&in);
+    if (n_key_data > INT16_MAX)
+        return EINVAL;
+    if (n_key_data > 0) {
+        entry->key_data = k5calloc(n_key_data, sizeof(*entry->key_data),
+                                   &ret);
+        if (entry->key_data == NULL)
+            return ret;
+        entry->mask |= KADM5_KEY_DATA;
+    }
+    for (i = 0; i < n_key_data; i++) {
+        kd = &entry->key_data[i];
+        entry->n_key_data++;
+        kd->key_data_ver = k5_input_get_uint16_be(&in);
+        kd->key_data_kvno = k5_input_get_uint16_be(&in);
+        if (kd->key_data_ver < 0 ||
+            kd->key_data_ver > KRB5_KDB_V1_KEY_DATA_ARRAY)
+            return EINVAL;
+        for (j = 0; j < kd->key_data_ver; j++) {
+            kd->key_data_type[j] = k5_input_get_uint16_be(&in);
+            klen = 0;
+            ret = get_binary_octets(&in, &kd->key_data_contents[j], &klen);
+            if (ret)
+                return ret;
+            if (klen > UINT16_MAX)
+                return EINVAL;
+            kd->key_data_length[j] = klen;
+        }
+    }
+
+    klen = 0;
+    ret = get_binary_octets(&in, &entry->e_data, &klen);
+    if (ret)
+        return ret;
+    if (klen > UINT16_MAX)
+        return EINVAL;
+    entry->e_length = klen;
+
+    if (in.status)
+        return in.status;
+    return (in.len != 0) ? EINVAL : 0;
+}
+
+/* Decode a binary policy record into a new policy entry.  As with principal
+ * records, *pol_out may be set on failure. */
+static krb5_error_code
+decode_binary_policy(const unsigned char *rec, size_t len,
+                     osa_policy_ent_t *pol_out)
+{
+    krb5_error_code ret;
+    osa_policy_ent_t pol;
+    struct k5input in;
+    krb5_data d;
+
+    *pol_out = pol = k5alloc(sizeof(*pol), &ret);
+    if (pol == NULL)
+        return ret;
+
+    k5_input_init(&in, rec, len);
+    ret = get_binary_data(&in, &d);
+    if (ret)
+        return ret;
+    pol->name = d.data;
+    pol->pw_min_life = k5_input_get_uint32_be(&in);
+    pol->pw_max_life = k5_input_get_uint32_be(&in);
+    pol->pw_min_length = k5_input_get_uint32_be(&in);
+    pol->pw_min_classes = k5_input_get_uint32_be(&in);
+    pol->pw_history_num = k5_input_get_uint32_be(&in);
+    pol->pw_max_fail = k5_input_get_uint32_be(&in);
+    pol->pw_failcnt_interval = k5_input_get_uint32_be(&in);
+    pol->pw_lockout_duration = k5_input_get_uint32_be(&in);
+    pol->attributes = k5_input_get_uint32_be(&in);
+    pol->max_life = k5_input_get_uint32_be(&in);
+    pol->max_renewable_life = k5_input_get_uint32_be(&in);
+
+    ret = get_binary_data(&in, &d);
+    if (ret)
+        return ret;
+    if (d.length > 0)
+        pol->allowed_keysalts = d.data;
+    else
+        free(d.data);
+
+    ret = get_binary_tl_data(&in, &pol->n_tl_data, &pol->tl_data);
+    if (ret)
+        return ret;
+
+    if (in.status)
+        return in.status;
+    return (in.len != 0) ? EINVAL : 0;
+}
+
+/* A batch of binary dump records.  The record contents are stored back to back
+ * in data; recs indexes them and holds the decoding results. */
+struct binary_record {
+    int type;
+    size_t offset;
+    size_t len;
+    krb5_error_code ret;
+    krb5_db_entry *princ;
+    osa_policy_ent_t policy;
+};
+
+struct binary_batch {
+    struct k5buf data;
+    struct binary_record recs[BINARY_LOAD_BATCH];
+    int nrecs;
+    k5_mutex_t lock;
+    int next;
+};
+
+/* Read up to BINARY_LOAD_BATCH records from fp into batch.  Set *eof_out if
+ * the end of the dump was reached.  Return 0 on success, 1 on failure. */
+static int
+read_binary_batch(const char *fname, FILE *fp, int lineno,
+                  struct binary_batch *batch, krb5_boolean *eof_out)
+{
+    unsigned char hdr[BINARY_RECORD_HEADER_LEN], *space;
+    struct binary_record *rec;
+    size_t nread, len;
+
+    *eof_out = FALSE;
+    while (batch->nrecs < BINARY_LOAD_BATCH) {
+        lineno++;
+        nread = fread(hdr, 1, sizeof(hdr), fp);
+        if (nread == 0 && feof(fp)) {
+            *eof_out = TRUE;
+            break;
+        }
+        if (nread != sizeof(hdr)) {
+            load_err(fname, lineno, _("cannot read record header"));
+            return 1;
+        }
+        len = load_32_be(hdr + 1);
+        if (len > BINARY_RECORD_MAX) {
+            load_err(fname, lineno, _("record length too large"));
+            return 1;
+        }
+        space = k5_buf_get_space(&batch->data, len);
+        if (space == NULL)
+            return 1;
+        if (fread(space, 1, len, fp) != len) {
+            load_err(fname, lineno, _("cannot read record contents"));
+            return 1;
+        }
+        rec = &batch->recs[batch->nrecs++];
+        rec->type = hdr[0];
+        rec->offset = batch->data.len - len;
+        rec->len = len;
+    }
+    return 0;
+}
+
+/* Decode records from batch until none are left to claim. */
+static void *
+decode_binary_worker(void *arg)
+{
+    struct binary_batch *batch = arg;
+    struct binary_record *rec;
+    const unsigned char *contents;
+    int i;
+
+    for (;;) {
+        k5_mutex_lock(&batch->lock);
+        i = batch->next++;
+        k5_mutex_unlock(&batch->lock);
+        if (i >= batch->nrecs)
+            break;
+
+        rec = &batch->recs[i];
+        contents = (unsigned char *)batch->data.data + rec->offset;
+        if (rec->type == BINARY_PRINC_RECORD)
+            rec->ret = decode_binary_princ(contents, rec->len, &rec->princ);
+        else if (rec->type == BINARY_POLICY_RECORD)
+            rec->ret = decode_binary_policy(contents, rec->len, &rec->policy);
+        else
+            rec->ret = EINVAL;
+    }
+    return NULL;
+}
+
+/* Decode the records of batch, using up to nthreads threads including the
+ * calling one. */
+static void
+decode_binary_batch(struct binary_batch *batch, int nthreads)
+{
+#ifdef HAVE_PTHREAD
+    pthread_t threads[BINARY_LOAD_MAX_THREADS];
+    int i, nstarted = 0;
+
+    for (i = 1; i < nthreads && i * 16 < batch->nrecs; i++) {
+        if (pthread_create(&threads[nstarted], NULL, decode_binary_worker,
+                           batch) != 0)
+            break;
+        nstarted++;
+    }
+    decode_binary_worker(batch);
+    for (i = 0; i < nstarted; i++)
+        pthread_join(threads[i], NULL);
+#else
+    decode_binary_worker(batch);
+#endif
+}
+
+/* Return the number of threads to use for decoding binary dump records. */
+static int
+binary_load_threads(void)
+{
+    long n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n < 1)
+        return 1;
+    return (n > BINARY_LOAD_MAX_THREADS) ? BINARY_LOAD_MAX_THREADS : n;
+}
+
+/* Store a decoded binary record into the database.  Return 0 on success, 1 on
+ * failure. */
+static int
+store_binary_record(krb5_context context, const char *fname, int lineno,
+                    krb5_boolean verbose, struct binary_record *rec)
+{
+    krb5_error_code ret;
+    char *name = NULL;
+
+    if (rec->ret) {
+        load_err(fname, lineno, (rec->type == BINARY_PRINC_RECORD) ?
+                 _("cannot decode principal record") :
+                 (rec->type == BINARY_POLICY_RECORD) ?
+                 _("cannot decode policy record") :
+                 _("unknown record type"));
+        return 1;
+    }
+
+    if (rec->policy != NULL) {
+        ret = krb5_db_create_policy(context, rec->policy);
+        if (ret)
+            ret = krb5_db_put_policy(context, rec->policy);
+        if (ret) {
+            com_err(progname, ret, _("while creating policy"));
+            return 1;
+        }
+        if (verbose)
+            fprintf(stderr, "created policy %s\n", rec->policy->name);
+        return 0;
+    }
+
+    ret = krb5_db_put_principal(context, rec->princ);
+    if ((ret || verbose) &&
+        krb5_unparse_name(context, rec->princ->princ, &name) != 0)
+        name = NULL;
+    if (ret) {
+        com_err(progname, ret, _("while storing %s"),
+                (name != NULL) ? name : "?");
+    } else if (verbose && name != NULL) {
+        fprintf(stderr, "%s\n", name);
+    }
+    krb5_free_unparsed_name(context, name);
+    return ret ? 1 : 0;
+}
+
+/* Read, decode, and store a batch of binary dump records.  Return -1 if the
+ * end of the dump was reached, 0 for success with more records to come, and 1
+ * for failure. */
+static int
+process_binary_records(krb5_context context, const char *fname, FILE *filep,
+                       krb5_boolean verbose, int *linenop)
+{
+    struct binary_batch *batch;
+    struct binary_record *rec;
+    krb5_boolean eof;
+    int i, retval = 1;
+
+    batch = calloc(1, sizeof(*batch));
+    if (batch == NULL)
+        return 1;
+    k5_buf_init_dynamic(&batch->data);
+    if (k5_mutex_init(&batch->lock) != 0) {
+        free(batch);
+        return 1;
+    }
+
+    if (read_binary_batch(fname, filep, *linenop, batch, &eof))
+        goto cleanup;
+
+    decode_binary_batch(batch, binary_load_threads());
+
+    for (i = 0; i < batch->nrecs; i++) {
+        (*linenop)++;
+        if (store_binary_record(context, fname, *linenop, verbose,
+                                &batch->recs[i]))
+            goto cleanup;
+    }
+    retval = eof ? -1 : 0;
+
+cleanup:
+    for (i = 0; i < batch->nrecs; i++) {
+        rec = &batch->recs[i];
+        krb5_db_free_principal(context, rec->princ);
+        krb5_db_free_policy(context, rec->policy);
+    }
+    k5_buf_free(&batch->data);
+    k5_mutex_destroy(&batch->lock);
+    free(batch);
+    return retval;
+}
+
 dump_version beta7_version = {
     "Kerberos version 5",
     "kdb5_util load_dump version 4\n",
@@ -1071,6 +1703,16 @@ dump_version r1_11_version = {
     dump_r1_11_policy,
     process_r1_11_record,
 };
+dump_version binary_version = {
+    "Kerberos version 5 release 1.18 binary",
+    "kdb5_util load_dump version 8\n",
+    0,
+    0,
+    0,
+    dump_binary_princ,
+    dump_binary_policy,
+    process_binary_records,
+};
 dump_version iprop_version = {
     "Kerberos iprop version",
     "iprop",
@@ -1091,6 +1733,16 @@ dump_version ipropx_1_version = {
     dump_r1_11_policy,
     process_r1_11_record,
 };
+dump_version ipropx_2_version = {
+    "Kerberos iprop binary version",
+    "ipropx",
+    0,
+    1,
+    1,
+    dump_binary_princ,
+    dump_binary_policy,
+    process_binary_records,
+};
 
 /* Read the dump header.  Return 1 on success, 0 if the file is not a
  * recognized iprop dump format. */
@@ -1113,6 +1765,8 @@ parse_iprop_header(char *buf, dump_version **dv, kdb_last_t *last)
             *dv = &iprop_version;
         } else if (u[0] == IPROPX_VERSION_1) {
             *dv = &ipropx_1_version;
+        } else if (u[0] == IPROPX_VERSION_2) {
+            *dv = &ipropx_2_version;
         } else {
             fprintf(stderr, _("%s: Unknown iprop dump version %d\n"), progname,
                     u[0]);
@@ -1134,13 +1788,14 @@ parse_iprop_header(char *buf, dump_version **dv, kdb_last_t *last)
     return 1;
 }
 
-/* Return true if the serial number and timestamp in an existing dump file is
- * in the ulog. */
+/* Return true if an existing dump file is in the format dump and its serial
+ * number and timestamp are in the ulog. */
 static krb5_boolean
-current_dump_sno_in_ulog(krb5_context context, const char *ifile)
+current_dump_sno_in_ulog(krb5_context context, const char *ifile,
+                         dump_version *dump)
 {
     update_status_t status;
-    dump_version *junk;
+    dump_version *dv;
     kdb_last_t last;
     char buf[BUFSIZ], *r;
     FILE *f;
@@ -1154,7 +1809,7 @@ current_dump_sno_in_ulog(krb5_context context, const char *ifile)
     if (r == NULL)
         return errno ? -1 : 0;
 
-    if (!parse_iprop_header(buf, &junk, &last))
+    if (!parse_iprop_header(buf, &dv, &last) || dv != dump)
         return 0;
 
     status = ulog_get_sno_status(context, &last);
@@ -1163,7 +1818,7 @@ current_dump_sno_in_ulog(krb5_context context, const char *ifile)
 
 /*
  * usage is:
- *      dump_db [-b7] [-r13] [-r18] [-verbose] [-mkey_convert]
+ *      dump_db [-b7] [-r13] [-r18] [-binary] [-verbose] [-mkey_convert]
  *              [-new_mkey_file mkey_file] [-rev] [-recurse]
  *              [filename [principals...]]
  */
@@ -1204,11 +1859,20 @@ dump_db(int argc, char **argv)
             dump = &r1_3_version;
         } else if (!strcmp(argv[aindex], "-r18")) {
             dump = &r1_8_version;
+        } else if (!strcmp(argv[aindex], "-binary")) {
+            dump = &binary_version;
         } else if (!strncmp(argv[aindex], "-i", 2)) {
             if (log_ctx && log_ctx->iproprole) {
                 /* ipropx_version is the maximum version acceptable. */
                 ipropx_version = atoi(argv[aindex] + 2);
-                dump = ipropx_version ? &ipropx_1_version : &iprop_version;
+                if (ipropx_version > IPROPX_VERSION)
+                    ipropx_version = IPROPX_VERSION;
+                if (ipropx_version == IPROPX_VERSION_2)
+                    dump = &ipropx_2_version;
+                else if (ipropx_version == IPROPX_VERSION_1)
+                    dump = &ipropx_1_version;
+                else
+                    dump = &iprop_version;
                 /*
                  * dump_sno is used to indicate if the serial number should be
                  * populated in the output file to be used later by iprop for
@@ -1260,7 +1924,7 @@ dump_db(int argc, char **argv)
                       "use only for iprop dumps"));
             goto error;
         }
-        if (current_dump_sno_in_ulog(util_context, ofile))
+        if (current_dump_sno_in_ulog(util_context, ofile, dump))
             return;
     }
 
@@ -1355,7 +2019,7 @@ dump_db(int argc, char **argv)
             goto error;
         }
         if (ipropx_version)
-            fprintf(f, " %u", IPROPX_VERSION);
+            fprintf(f, " %u", ipropx_version);
         fprintf(f, " %u", last.last_sno);
         fprintf(f, " %u", last.last_time.seconds);
         fprintf(f, " %u", last.last_time.useconds);
@@ -1412,7 +2076,28 @@ restore_dump(krb5_context context, char *dumpfile, FILE *f,
 }
 
 /*
- * Usage: load_db [-b7] [-r13] [-r18] [-verbose] [-update] [-hash] filename
+ * Return true if the end-of-dump marker can be read from end_fd.  kpropd
+ * writes the marker after it has received the whole dump, so if kpropd dies
+ * during a streamed transfer, the end of the dump input is not mistaken for
+ * the end of the dump.
+ */
+static krb5_boolean
+read_end_marker(int end_fd)
+{
+    char c;
+    ssize_t n;
+
+    do {
+        n = read(end_fd, &c, 1);
+    } while (n < 0 && errno == EINTR);
+    return n == 1;
+}
+
+/*
+ * Usage: load_db [-b7] [-r13] [-r18] [-verbose] [-update] [-hash]
+ *                [-endfd fd] filename
+ *
+ * -endfd is used by kpropd for streamed loads.
  */
 void
 load_db(int argc, char **argv)
@@ -1421,7 +2106,7 @@ load_db(int argc, char **argv)
     FILE *f = NULL;
     char *dumpfile = NULL, *dbname, buf[BUFSIZ];
     dump_version *load = NULL;
-    int aindex;
+    int aindex, end_fd = -1;
     kdb_log_context *log_ctx;
     kdb_last_t last;
     krb5_boolean db_locked = FALSE, temp_db_created = FALSE;
@@ -1459,6 +2144,8 @@ load_db(int argc, char **argv)
                 com_err(progname, ENOMEM, _("while parsing options"));
                 goto error;
             }
+        } else if (!strcmp(argv[aindex], "-endfd") && aindex + 1 < argc) {
+            end_fd = atoi(argv[++aindex]);
         } else {
             break;
         }
@@ -1466,6 +2153,8 @@ load_db(int argc, char **argv)
     if (argc - aindex != 1)
         usage();
     dumpfile = argv[aindex];
+    if (strcmp(dumpfile, "-") == 0)
+        dumpfile = NULL;
 
     /* Open the dumpfile. */
     if (dumpfile != NULL) {
@@ -1502,6 +2191,8 @@ load_db(int argc, char **argv)
             load = &r1_8_version;
         } else if (strcmp(buf, r1_11_version.header) == 0) {
             load = &r1_11_version;
+        } else if (strcmp(buf, binary_version.header) == 0) {
+            load = &binary_version;
         } else {
             fprintf(stderr, _("%s: dump header bad in %s\n"), progname,
                     dumpfile);
@@ -1578,6 +2269,12 @@ load_db(int argc, char **argv)
         goto error;
     }
 
+    if (end_fd != -1 && !read_end_marker(end_fd)) {
+        fprintf(stderr, _("%s: end of dump not confirmed for %s\n"), progname,
+                dumpfile);
+        goto error;
+    }
+
     if (db_locked && (ret = krb5_db_unlock(util_context))) {
         com_err(progname, ret, _("while unlocking database"));
         goto error;
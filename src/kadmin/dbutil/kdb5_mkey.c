@@ -638,12 +638,25 @@ cleanup_return:
     return;
 }
 
+/* Number of principals re-encrypted and stored under one database lock by
+ * update_princ_encryption -j, and the maximum number of threads it uses. */
+#define UPDATE_ENC_BATCH 256
+#define UPDATE_ENC_MAX_THREADS 16
+
+/* Interval in seconds between progress reports for update_princ_encryption
+ * -j. */
+#define UPDATE_ENC_PROGRESS_INTERVAL 10
+
 struct update_enc_mkvno {
     unsigned int re_match_count;
     unsigned int already_current;
     unsigned int updated;
     unsigned int dry_run : 1;
     unsigned int verbose : 1;
+    int nthreads;               /* 0 to update entries while iterating */
+    char **pending;             /* names of principals to update */
+    unsigned int npending;
+    unsigned int pending_alloc;
 #ifdef SOLARIS_REGEXPS
     char *expbuf;
 #endif
@@ -739,6 +752,26 @@ static int glob_to_regexp(char *glob, char *realm, char **regexp)
     return 0;
 }
 
+/* Append name to the list of principals to be updated, taking ownership of
+ * it.  Return 0 on success or ENOMEM. */
+static int
+add_pending(struct update_enc_mkvno *p, char *name)
+{
+    char **newptr;
+    unsigned int newalloc;
+
+    if (p->npending == p->pending_alloc) {
+        newalloc = (p->pending_alloc == 0) ? 64 : p->pending_alloc * 2;
+        newptr = realloc(p->pending, newalloc * sizeof(*p->pending));
+        if (newptr == NULL)
+            return ENOMEM;
+        p->pending = newptr;
+        p->pending_alloc = newalloc;
+    }
+    p->pending[p->npending++] = name;
+    return 0;
+}
+
 static int
 update_princ_encryption_1(void *cb, krb5_db_entry *ent)
 {
@@ -796,6 +829,16 @@ update_princ_encryption_1(void *cb, krb5_db_entry *ent)
         goto skip;
     } else if (p->verbose)
         printf(_("updating: %s\n"), pname);
+    if (p->nthreads > 0) {
+        /* Defer the update to update_pending(). */
+        if (add_pending(p, pname) != 0) {
+            com_err(progname, ENOMEM, _("while processing principal '%s'"),
+                    pname);
+            goto fail;
+        }
+        pname = NULL;
+        goto skip;
+    }
     retval = master_key_convert (util_context, ent);
     if (retval) {
         com_err(progname, retval,
@@ -834,6 +877,337 @@ egress:
     return result;
 }
 
+/*
+ * update_princ_encryption -j first iterates over the database without a write
+ * lock, collecting the names of principals which need to be updated.  It then
+ * processes those principals in batches: each batch is fetched and stored
+ * under one exclusive database lock (so that a DB2 database is synced once per
+ * batch rather than once per principal), and the key data in each batch is
+ * re-encrypted by up to nthreads threads.  Each additional thread uses its own
+ * krb5 context with a read-only database handle and master key list, since a
+ * krb5 context may only be used by one thread at a time.  Since principals
+ * already using the new master key are skipped, an interrupted run can be
+ * resumed by running the command again.
+ */
+
+struct update_enc_batch {
+    krb5_db_entry *ents[UPDATE_ENC_BATCH];
+    char *names[UPDATE_ENC_BATCH];
+    krb5_error_code rets[UPDATE_ENC_BATCH];
+    int nents;
+    krb5_timestamp now;
+    k5_mutex_t lock;
+    int next;
+};
+
+struct update_enc_worker {
+    struct update_enc_batch *batch;
+    krb5_context context;
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+#endif
+};
+
+/* Re-encrypt entries from the worker's batch until none are left to claim. */
+static void *
+update_enc_worker(void *arg)
+{
+    struct update_enc_worker *w = arg;
+    struct update_enc_batch *batch = w->batch;
+    krb5_db_entry *ent;
+    krb5_error_code ret;
+    int i;
+
+    for (;;) {
+        k5_mutex_lock(&batch->lock);
+        i = batch->next++;
+        k5_mutex_unlock(&batch->lock);
+        if (i >= batch->nents)
+            break;
+
+        ent = batch->ents[i];
+        ret = master_key_convert(w->context, ent);
+        if (!ret) {
+            ret = krb5_dbe_update_mod_princ_data(w->context, ent, batch->now,
+                                                 master_princ);
+        }
+        ent->mask |= KADM5_KEY_DATA;
+        batch->rets[i] = ret;
+    }
+    return NULL;
+}
+
+/* Re-encrypt the entries of batch using nworkers workers.  The first worker
+ * runs in the calling thread. */
+static void
+update_enc_batch(struct update_enc_batch *batch,
+                 struct update_enc_worker *workers, int nworkers)
+{
+    int i, nstarted;
+
+    for (i = 0; i < nworkers; i++)
+        workers[i].batch = batch;
+#ifdef HAVE_PTHREAD
+    for (nstarted = 1; nstarted < nworkers && nstarted < batch->nents;
+         nstarted++) {
+        if (pthread_create(&workers[nstarted].thread, NULL, update_enc_worker,
+                           &workers[nstarted]) != 0)
+            break;
+    }
+    update_enc_worker(&workers[0]);
+    for (i = 1; i < nstarted; i++)
+        pthread_join(workers[i].thread, NULL);
+#else
+    update_enc_worker(&workers[0]);
+#endif
+}
+
+/*
+ * Return true if the realm's database module can be opened a second time for
+ * a worker context.  LMDB does not permit an environment to be opened more
+ * than once in a process, so re-encryption is done serially for klmdb.
+ */
+static krb5_boolean
+worker_contexts_allowed(void)
+{
+    char *module = NULL, *lib = NULL;
+    krb5_boolean result = FALSE;
+
+    if (profile_get_string(util_context->profile, KDB_REALM_SECTION,
+                           global_params.realm, KDB_MODULE_POINTER,
+                           global_params.realm, &module) != 0)
+        goto cleanup;
+    if (profile_get_string(util_context->profile, KDB_MODULE_SECTION, module,
+                           KDB_LIB_POINTER, "db2", &lib) != 0)
+        goto cleanup;
+    result = (strcmp(lib, "klmdb") != 0);
+
+cleanup:
+    profile_release_string(module);
+    profile_release_string(lib);
+    return result;
+}
+
+/* Create a context for a re-encryption thread, with its own database handle
+ * and master key list. */
+static krb5_error_code
+open_worker_context(krb5_context *ctx_out)
+{
+    krb5_error_code ret;
+    krb5_context ctx;
+    krb5_boolean opened = FALSE;
+
+    *ctx_out = NULL;
+    ret = krb5_copy_context(util_context, &ctx);
+    if (ret)
+        return ret;
+    ret = krb5_set_default_realm(ctx, global_params.realm);
+    if (ret)
+        goto cleanup;
+    ret = krb5_db_open(ctx, db5util_db_args,
+                       KRB5_KDB_OPEN_RO | KRB5_KDB_SRV_TYPE_ADMIN);
+    if (ret)
+        goto cleanup;
+    opened = TRUE;
+    ret = krb5_db_fetch_mkey_list(ctx, master_princ, &master_keyblock);
+    if (ret)
+        goto cleanup;
+
+    *ctx_out = ctx;
+    ctx = NULL;
+
+cleanup:
+    if (ctx != NULL) {
+        if (opened)
+            krb5_db_fini(ctx);
+        krb5_free_context(ctx);
+    }
+    return ret;
+}
+
+/* Set up workers[0] to use util_context and create contexts for up to
+ * nthreads - 1 more.  Return the number of usable workers. */
+static int
+open_workers(struct update_enc_worker *workers, int nthreads)
+{
+    krb5_error_code ret;
+    int n = 1;
+
+    workers[0].context = util_context;
+#ifdef HAVE_PTHREAD
+    if (nthreads > 1 && !worker_contexts_allowed())
+        nthreads = 1;
+    for (; n < nthreads; n++) {
+        ret = open_worker_context(&workers[n].context);
+        if (ret) {
+            com_err(progname, ret,
+                    _("while opening database for re-encryption thread"));
+            break;
+        }
+    }
+#endif
+    return n;
+}
+
+static void
+close_workers(struct update_enc_worker *workers, int nworkers)
+{
+    int i;
+
+    for (i = 1; i < nworkers; i++) {
+        krb5_db_fini(workers[i].context);
+        krb5_free_context(workers[i].context);
+    }
+}
+
+/* Fetch the principal entry for name into *ent_out if it still exists and
+ * does not yet use the new master key.  Set *ent_out to NULL if the entry
+ * should be skipped.  Return 0 on success, 1 on failure. */
+static int
+fetch_pending(struct update_enc_mkvno *p, const char *name,
+              krb5_db_entry **ent_out)
+{
+    krb5_error_code retval;
+    krb5_principal princ = NULL;
+    krb5_db_entry *ent = NULL;
+    krb5_kvno mkvno;
+    int result = 1;
+
+    *ent_out = NULL;
+    retval = krb5_parse_name(util_context, name, &princ);
+    if (retval) {
+        com_err(progname, retval, _("while parsing principal name '%s'"),
+                name);
+        goto cleanup;
+    }
+    retval = krb5_db_get_principal(util_context, princ, 0, &ent);
+    if (retval == KRB5_KDB_NOENTRY) {
+        /* The principal was deleted after we scanned the database. */
+        result = 0;
+        goto cleanup;
+    } else if (retval) {
+        com_err(progname, retval, _("while getting principal '%s'"), name);
+        goto cleanup;
+    }
+    retval = krb5_dbe_get_mkvno(util_context, ent, &mkvno);
+    if (retval) {
+        com_err(progname, retval,
+                _("determining master key used for principal '%s'"), name);
+        goto cleanup;
+    }
+    if (mkvno == new_mkvno) {
+        /* The principal was updated after we scanned the database. */
+        p->already_current++;
+    } else {
+        *ent_out = ent;
+        ent = NULL;
+    }
+    result = 0;
+
+cleanup:
+    krb5_db_free_principal(util_context, ent);
+    krb5_free_principal(util_context, princ);
+    return result;
+}
+
+/* Re-encrypt and store the principals named in p->pending. */
+static void
+update_pending(struct update_enc_mkvno *p)
+{
+    struct update_enc_batch *batch;
+    struct update_enc_worker workers[UPDATE_ENC_MAX_THREADS];
+    krb5_error_code retval;
+    krb5_boolean locked;
+    krb5_db_entry *ent;
+    unsigned int start, i;
+    time_t last_report = time(NULL), t;
+    int n, nworkers;
+
+    batch = calloc(1, sizeof(*batch));
+    if (batch == NULL) {
+        com_err(progname, ENOMEM, _("while allocating update batch"));
+        exit_status++;
+        return;
+    }
+    if (k5_mutex_init(&batch->lock) != 0) {
+        com_err(progname, ENOMEM, _("while allocating update batch"));
+        exit_status++;
+        free(batch);
+        return;
+    }
+    nworkers = open_workers(workers, p->nthreads);
+
+    for (start = 0; start < p->npending; start += UPDATE_ENC_BATCH) {
+        retval = krb5_db_lock(util_context, KRB5_DB_LOCKMODE_EXCLUSIVE);
+        if (retval && retval != KRB5_PLUGIN_OP_NOTSUPP) {
+            com_err(progname, retval, _("while locking database"));
+            exit_status++;
+            break;
+        }
+        locked = (retval == 0);
+
+        batch->nents = batch->next = 0;
+        for (i = start; i < p->npending && i < start + UPDATE_ENC_BATCH;
+             i++) {
+            if (fetch_pending(p, p->pending[i], &ent) != 0)
+                exit_status++;
+            if (ent == NULL)
+                continue;
+            batch->names[batch->nents] = p->pending[i];
+            batch->ents[batch->nents++] = ent;
+        }
+
+        retval = krb5_timeofday(util_context, &batch->now);
+        if (retval) {
+            com_err(progname, retval, _("while getting current time"));
+            exit_status++;
+            n = 0;
+        } else {
+            update_enc_batch(batch, workers, nworkers);
+            n = batch->nents;
+        }
+
+        /* Store the entries in scan order from this thread. */
+        for (i = 0; i < (unsigned int)n; i++) {
+            retval = batch->rets[i];
+            if (retval) {
+                com_err(progname, retval,
+                        _("error re-encrypting key for principal '%s'"),
+                        batch->names[i]);
+                exit_status++;
+                continue;
+            }
+            retval = krb5_db_put_principal(util_context, batch->ents[i]);
+            if (retval) {
+                com_err(progname, retval, _("while updating principal '%s' "
+                                            "key data in the database"),
+                        batch->names[i]);
+                exit_status++;
+                continue;
+            }
+            p->updated++;
+        }
+        for (i = 0; i < (unsigned int)batch->nents; i++)
+            krb5_db_free_principal(util_context, batch->ents[i]);
+
+        if (locked)
+            krb5_db_unlock(util_context);
+
+        t = time(NULL);
+        if (t - last_report >= UPDATE_ENC_PROGRESS_INTERVAL &&
+            start + UPDATE_ENC_BATCH < p->npending) {
+            printf(_("%u of %u principals re-encrypted\n"), p->updated,
+                   p->npending);
+            fflush(stdout);
+            last_report = t;
+        }
+    }
+
+    close_workers(workers, nworkers);
+    k5_mutex_destroy(&batch->lock);
+    free(batch);
+}
+
 extern int are_you_sure (const char *, ...)
 #if !defined(__cplusplus) && (__GNUC__ > 2)
     __attribute__((__format__(__printf__, 1, 2)))
@@ -875,12 +1249,22 @@ kdb5_update_princ_encryption(int argc, char *argv[])
     krb5_keyblock *act_mkey;
     krb5_keylist_node *master_keylist = krb5_db_mkey_list_alias(util_context);
     krb5_flags iterflags = 0;
+    long nthreads;
+    char *ep;
+    unsigned int i;
 
-    while ((optchar = getopt(argc, argv, "fnv")) != -1) {
+    while ((optchar = getopt(argc, argv, "fj:nv")) != -1) {
         switch (optchar) {
         case 'f':
             force = 1;
             break;
+        case 'j':
+            nthreads = strtol(optarg, &ep, 10);
+            if (*optarg == '\0' || *ep != '\0' || nthreads < 1)
+                usage();
+            data.nthreads = (nthreads > UPDATE_ENC_MAX_THREADS) ?
+                UPDATE_ENC_MAX_THREADS : nthreads;
+            break;
         case 'n':
             data.dry_run = 1;
             break;
@@ -978,7 +1362,9 @@ kdb5_update_princ_encryption(int argc, char *argv[])
         }
     }
 
-    if (!data.dry_run) {
+    if (data.dry_run) {
+        data.nthreads = 0;
+    } else if (data.nthreads == 0) {
         /* Grab a write lock so we don't have to upgrade to a write lock and
          * reopen the DB while iterating. */
         iterflags = KRB5_DB_ITER_WRITE;
@@ -992,6 +1378,8 @@ kdb5_update_princ_encryption(int argc, char *argv[])
         com_err(progname, retval, _("trying to process principal database"));
         exit_status++;
     }
+    if (retval == 0 && data.npending > 0)
+        update_pending(&data);
     if (data.dry_run) {
         printf(_("%u principals processed: %u would be updated, %u already "
                  "current\n"),
@@ -1007,6 +1395,9 @@ cleanup:
 #ifdef POSIX_REGEXPS
     regfree(&data.preg);
 #endif
+    for (i = 0; i < data.npending; i++)
+        krb5_free_unparsed_name(util_context, data.pending[i]);
+    free(data.pending);
     memset(&new_master_keyblock, 0, sizeof(new_master_keyblock));
     krb5_dbe_free_actkvno_list(util_context, actkvno_list);
 }
@@ -85,7 +85,7 @@ void usage()
               "\tcreate  [-s]\n"
               "\tdestroy [-f]\n"
               "\tstash   [-f keyfile]\n"
-              "\tdump    [-old|-b6|-b7|-r13|-r18] [-verbose]\n"
+              "\tdump    [-old|-b6|-b7|-r13|-r18|-binary] [-verbose]\n"
               "\t        [-mkey_convert] [-new_mkey_file mkey_file]\n"
               "\t        [-rev] [-recurse] [filename [princs...]]\n"
               "\tload    [-old|-b6|-b7|-r13|-r18] [-verbose] [-update] "
@@ -96,7 +96,8 @@ void usage()
               "\tlist_mkeys\n"));
     /* avoid a string length compiler warning */
     fprintf(stderr,
-            _("\tupdate_princ_encryption [-f] [-n] [-v] [princ-pattern]\n"
+            _("\tupdate_princ_encryption [-f] [-n] [-v] [-j nthreads]\n"
+              "\t                        [princ-pattern]\n"
               "\tpurge_mkeys [-f] [-n] [-v]\n"
               "\ttabdump [-H] [-c] [-e] [-n] [-o outfile] dumptype\n"
               "\nwhere,\n\t[-x db_args]* - any number of database specific "
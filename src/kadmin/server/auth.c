@@ -42,6 +42,10 @@ typedef struct {
 
 static auth_handle *handles;
 
+/* Serializes module calls, as kadmind may check requests from several
+ * threads. */
+static k5_mutex_t auth_lock = K5_MUTEX_PARTIAL_INITIALIZER;
+
 void
 auth_fini(krb5_context context)
 {
@@ -68,6 +72,9 @@ auth_init(krb5_context context, const char *acl_file)
     auth_handle h = NULL;
     const int intf = PLUGIN_INTERFACE_KADM5_AUTH;
 
+    ret = k5_mutex_finish_init(&auth_lock);
+    if (ret)
+        return ret;
     ret = k5_plugin_register(context, intf, "acl", kadm5_auth_acl_initvt);
     if (ret)
         goto cleanup;
@@ -185,16 +192,20 @@ auth(krb5_context context, int opcode, krb5_const_principal client,
     krb5_boolean authorized = FALSE;
     auth_handle *hp, h;
 
+    k5_mutex_lock(&auth_lock);
     for (hp = handles; *hp != NULL; hp++) {
         h = *hp;
 
         ret = call_module(context, h, opcode, client, p1, p2, s1, s2,
                           polent, mask);
-        if (!ret)
+        if (!ret) {
             authorized = TRUE;
-        else if (ret != KRB5_PLUGIN_NO_HANDLE)
-            return FALSE;
+        } else if (ret != KRB5_PLUGIN_NO_HANDLE) {
+            authorized = FALSE;
+            break;
+        }
     }
+    k5_mutex_unlock(&auth_lock);
 
     return authorized;
 }
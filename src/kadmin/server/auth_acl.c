@@ -25,6 +25,7 @@
  */
 
 #include "k5-int.h"
+#include "k5-hashtab.h"
 #include <syslog.h>
 #include <kadm5/admin.h>
 #include <krb5/kadm5_auth_plugin.h>
@@ -62,6 +63,8 @@ struct acl_op_table {
 
 struct acl_entry {
     struct acl_entry *next;
+    struct acl_entry *bnext;    /* next entry in the same index bucket */
+    int seq;                    /* position in the ACL file */
     krb5_principal client;
     uint32_t op_allowed;
     krb5_principal target;
@@ -88,8 +91,34 @@ struct wildstate {
     const krb5_data *backref[9];
 };
 
+/* A list of ACL entries in file order.  Literal buckets also record the
+ * client principal key they are indexed under. */
+struct acl_bucket {
+    struct acl_bucket *next;
+    struct acl_entry *entries;
+    struct acl_entry **tail;
+    char *key;
+    size_t keylen;
+};
+
+/*
+ * ACL entries are compiled into an index when the file is loaded.  Entries
+ * whose client principal has no wildcards are found by a hash lookup on the
+ * client principal.  Entries with wildcard client principals are kept in
+ * buckets by number of components, since a principal can only match one of
+ * the same length, and entries with a client of "*" are kept separately.  A
+ * lookup merges the three candidate buckets in file order, so the first
+ * matching entry is the same as in a linear scan.
+ */
 struct acl_state {
-    struct acl_entry *list;
+    struct acl_entry *list;     /* all entries in file order */
+    struct k5_hashtab *index;   /* literal client principal -> bucket */
+    struct acl_bucket *buckets; /* literal buckets, for freeing */
+    struct acl_bucket *wild;    /* wildcard entries by number of components */
+    int nwild;
+    struct acl_bucket any;      /* entries with a client of "*" */
+    unsigned long nlookups;
+    unsigned long nexamined;
 };
 
 /*
@@ -369,17 +398,162 @@ parse_line(krb5_context context, const char *line, const char *fname)
     return entry;
 }
 
-/* Free all ACL entries. */
+/* Free all ACL entries and the index. */
 static void
 free_acl_entries(struct acl_state *state)
 {
     struct acl_entry *entry, *next;
+    struct acl_bucket *b, *bnext;
 
     for (entry = state->list; entry != NULL; entry = next) {
         next = entry->next;
         free_acl_entry(entry);
     }
     state->list = NULL;
+
+    if (state->index != NULL)
+        k5_hashtab_free(state->index);
+    state->index = NULL;
+    for (b = state->buckets; b != NULL; b = bnext) {
+        bnext = b->next;
+        free(b->key);
+        free(b);
+    }
+    state->buckets = NULL;
+    free(state->wild);
+    state->wild = NULL;
+    state->nwild = 0;
+    state->any.entries = NULL;
+    state->any.tail = NULL;
+}
+
+/* Return true if princ contains no wildcard components. */
+static krb5_boolean
+is_literal(krb5_const_principal princ)
+{
+    int i;
+
+    if (data_eq_string(princ->realm, "*"))
+        return FALSE;
+    for (i = 0; i < princ->length; i++) {
+        if (data_eq_string(princ->data[i], "*"))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+add_key_data(struct k5buf *buf, const krb5_data *d)
+{
+    uint8_t len[4];
+
+    store_32_be(d->length, len);
+    k5_buf_add_len(buf, len, 4);
+    k5_buf_add_len(buf, d->data, d->length);
+}
+
+/* Place the index key for princ in buf, which must be initialized: the realm
+ * and the components, each preceded by its length. */
+static void
+make_key(krb5_const_principal princ, struct k5buf *buf)
+{
+    int i;
+
+    add_key_data(buf, &princ->realm);
+    for (i = 0; i < princ->length; i++)
+        add_key_data(buf, &princ->data[i]);
+}
+
+static void
+bucket_append(struct acl_bucket *b, struct acl_entry *entry)
+{
+    if (b->tail == NULL)
+        b->tail = &b->entries;
+    entry->bnext = NULL;
+    *b->tail = entry;
+    b->tail = &entry->bnext;
+}
+
+/* Add entry to the literal bucket for its client principal, creating the
+ * bucket if necessary. */
+static krb5_error_code
+index_literal(struct acl_state *state, struct acl_entry *entry)
+{
+    krb5_error_code ret;
+    struct acl_bucket *b;
+    struct k5buf buf;
+
+    k5_buf_init_dynamic(&buf);
+    make_key(entry->client, &buf);
+    if (k5_buf_status(&buf) != 0)
+        return ENOMEM;
+
+    b = k5_hashtab_get(state->index, buf.data, buf.len);
+    if (b != NULL) {
+        k5_buf_free(&buf);
+        bucket_append(b, entry);
+        return 0;
+    }
+
+    b = k5alloc(sizeof(*b), &ret);
+    if (b == NULL) {
+        k5_buf_free(&buf);
+        return ret;
+    }
+    b->key = buf.data;
+    b->keylen = buf.len;
+    if (k5_hashtab_add(state->index, b->key, b->keylen, b) != 0) {
+        free(b->key);
+        free(b);
+        return ENOMEM;
+    }
+    b->next = state->buckets;
+    state->buckets = b;
+    bucket_append(b, entry);
+    return 0;
+}
+
+/* Compile the loaded entries into the index, and log its shape. */
+static krb5_error_code
+build_index(struct acl_state *state, const char *fname)
+{
+    krb5_error_code ret;
+    struct acl_entry *entry;
+    int n = 0, nliteral = 0, maxlen = -1;
+
+    for (entry = state->list; entry != NULL; entry = entry->next) {
+        entry->seq = n++;
+        if (entry->client != NULL && !is_literal(entry->client) &&
+            entry->client->length > maxlen)
+            maxlen = entry->client->length;
+    }
+
+    ret = k5_hashtab_create(NULL, 64, &state->index);
+    if (ret)
+        return ret;
+    state->nwild = maxlen + 1;
+    if (state->nwild > 0) {
+        state->wild = k5calloc(state->nwild, sizeof(*state->wild), &ret);
+        if (state->wild == NULL)
+            return ret;
+    }
+
+    for (entry = state->list; entry != NULL; entry = entry->next) {
+        if (entry->client == NULL) {
+            bucket_append(&state->any, entry);
+        } else if (is_literal(entry->client)) {
+            ret = index_literal(state, entry);
+            if (ret)
+                return ret;
+            nliteral++;
+        } else {
+            bucket_append(&state->wild[entry->client->length], entry);
+        }
+    }
+
+    krb5_klog_syslog(LOG_INFO, _("%s: %d ACL entries, %d indexed by client "
+                                 "principal"), fname, n, nliteral);
+    return 0;
 }
 
 /* Open and parse the ACL file. */
@@ -431,7 +605,11 @@ load_acl_file(krb5_context context, const char *fname, struct acl_state *state)
     }
 
     fclose(fp);
-    return 0;
+
+    ret = build_index(state, fname);
+    if (ret)
+        free_acl_entries(state);
+    return ret;
 }
 
 /*
@@ -491,18 +669,48 @@ match_princ(krb5_const_principal p1, krb5_const_principal p2,
     return TRUE;
 }
 
-/* Find an ACL entry matching principal and target_principal.  Return NULL if
- * none is found. */
+/* Find the first ACL entry matching principal and target_principal.  Return
+ * NULL if none is found. */
 static struct acl_entry *
 find_entry(struct acl_state *state, krb5_const_principal client,
            krb5_const_principal target)
 {
-    struct acl_entry *entry;
+    struct acl_entry *entry, *cand[3] = { NULL, NULL, NULL };
+    struct acl_bucket *b;
     struct wildstate ws;
+    struct k5buf buf;
+    int i, best;
+
+    /* cand[0] holds entries whose client is known to match. */
+    k5_buf_init_dynamic(&buf);
+    make_key(client, &buf);
+    if (k5_buf_status(&buf) == 0) {
+        b = k5_hashtab_get(state->index, buf.data, buf.len);
+        if (b != NULL)
+            cand[0] = b->entries;
+    }
+    k5_buf_free(&buf);
+    if (client->length < state->nwild)
+        cand[1] = state->wild[client->length].entries;
+    cand[2] = state->any.entries;
+
+    state->nlookups++;
+    for (;;) {
+        /* Take the candidate which comes first in the file. */
+        best = -1;
+        for (i = 0; i < 3; i++) {
+            if (cand[i] != NULL &&
+                (best == -1 || cand[i]->seq < cand[best]->seq))
+                best = i;
+        }
+        if (best == -1)
+            return NULL;
+        entry = cand[best];
+        cand[best] = entry->bnext;
+        state->nexamined++;
 
-    for (entry = state->list; entry != NULL; entry = entry->next) {
         memset(&ws, 0, sizeof(ws));
-        if (entry->client != NULL) {
+        if (best != 0 && entry->client != NULL) {
             if (!match_princ(entry->client, client, FALSE, &ws))
                 continue;
         }
@@ -516,8 +724,6 @@ find_entry(struct acl_state *state, krb5_const_principal client,
 
         return entry;
     }
-
-    return NULL;
 }
 
 /* Return true if op is permitted for this principal.  Set *rs_out (if not
@@ -553,8 +759,9 @@ acl_init(krb5_context context, const char *acl_file,
     *data_out = NULL;
     if (acl_file == NULL)
         return KRB5_PLUGIN_NO_HANDLE;
-    state = malloc(sizeof(*state));
-    state->list = NULL;
+    state = k5alloc(sizeof(*state), &ret);
+    if (state == NULL)
+        return ret;
     ret = load_acl_file(context, acl_file, state);
     if (ret) {
         free(state);
@@ -567,10 +774,14 @@ acl_init(krb5_context context, const char *acl_file,
 static void
 acl_fini(krb5_context context, kadm5_auth_moddata data)
 {
-    if (data == NULL)
+    struct acl_state *state = (struct acl_state *)data;
+
+    if (state == NULL)
         return;
-    free_acl_entries((struct acl_state *)data);
-    free(data);
+    krb5_klog_syslog(LOG_INFO, _("ACL lookups: %lu, entries examined: %lu"),
+                     state->nlookups, state->nexamined);
+    free_acl_entries(state);
+    free(state);
 }
 
 static krb5_error_code
@@ -23,6 +23,9 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #include <kdb_log.h>
 #include "auth.h"
 #include "misc.h"
@@ -143,10 +146,15 @@ iprop_acl_check(krb5_context context, const char *client_name)
     return result;
 }
 
-kdb_incr_result_t *
-iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
+/*
+ * Service IPROP_GET_UPDATES.  The updates are copied out of the ulog in their
+ * stored XDR encodings and sent as is, instead of being decoded and then
+ * encoded again for every replica.
+ */
+static kdb_incr_raw_result_t *
+get_updates_raw(kdb_last_t *arg, struct svc_req *rqstp)
 {
-    static kdb_incr_result_t ret;
+    static kdb_incr_raw_result_t ret;
     char *whoami = "iprop_get_updates_1";
     int kret;
     kadm5_server_handle_t handle = global_server_handle;
@@ -154,7 +162,8 @@ iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
     char obuf[256] = {0};
 
     /* default return code */
-    ret.ret = UPDATE_ERROR;
+    memset(&ret, 0, sizeof(ret));
+    ret.result.ret = UPDATE_ERROR;
 
     DPRINT("%s: start, last_sno=%lu\n", whoami,
 	    (unsigned long)arg->last_sno);
@@ -189,7 +198,7 @@ iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
 	   service_name);
 
     if (!iprop_acl_check(handle->context, client_name)) {
-	ret.ret = UPDATE_PERM_DENIED;
+	ret.result.ret = UPDATE_PERM_DENIED;
 
 	DPRINT("%s: PERMISSION DENIED: clprinc=`%s'\n\tsvcprinc=`%s'\n",
 		whoami, client_name, service_name);
@@ -200,18 +209,18 @@ iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
 	goto out;
     }
 
-    kret = ulog_get_entries(handle->context, arg, &ret);
+    kret = ulog_get_raw_entries(handle->context, arg, &ret);
 
-    if (ret.ret == UPDATE_OK) {
+    if (ret.result.ret == UPDATE_OK) {
 	(void) snprintf(obuf, sizeof (obuf),
 			_("%s; Incoming SerialNo=%lu; Outgoing SerialNo=%lu"),
-			replystr(ret.ret),
+			replystr(ret.result.ret),
 			(unsigned long)arg->last_sno,
-			(unsigned long)ret.lastentry.last_sno);
+			(unsigned long)ret.result.lastentry.last_sno);
     } else {
 	(void) snprintf(obuf, sizeof (obuf),
 			_("%s; Incoming SerialNo=%lu; Outgoing SerialNo=N/A"),
-			replystr(ret.ret),
+			replystr(ret.result.ret),
 			(unsigned long)arg->last_sno);
     }
 
@@ -228,6 +237,435 @@ iprop_get_updates_1_svc(kdb_last_t *arg, struct svc_req *rqstp)
 		     client_name, service_name,
 		     client_addr(rqstp->rq_xprt));
 
+out:
+    if (nofork)
+	debprret(whoami, ret.result.ret, ret.result.lastentry.last_sno);
+    free(client_name);
+    free(service_name);
+    return (&ret);
+}
+
+/*
+ * Long-poll support for IPROP_WAIT_UPDATES.  A request from a replica which
+ * is already up to date is parked instead of being answered.  Parked requests
+ * are answered as soon as the ulog has updates past the replica's last entry,
+ * or when their timeouts expire.  Where inotify is available, the ulog file
+ * is watched for the timestamp change each writer makes after publishing
+ * updates (whether the writer is this process or another one, such as
+ * kadmin.local), and a one-shot timer covers the earliest deadline.  The
+ * watch is removed when no requests are parked.  Elsewhere, the ulog is polled while requests are parked.  While a request
+ * is parked, its transport's destroy operation is wrapped so that the
+ * request is forgotten if the connection goes away.
+ */
+
+#define IPROP_WAIT_MAX		300	/* cap on the requested wait (seconds) */
+#define IPROP_WAIT_CHECK_MS	100	/* ulog poll interval without inotify */
+
+struct iprop_waiter {
+    struct iprop_waiter *next;
+    SVCXPRT *xprt;
+    struct xp_ops *orig_ops;
+    struct xp_ops ops;
+    kdb_last_t last;
+    time_t deadline;
+    char *client_name;
+    char *service_name;
+};
+
+static struct iprop_waiter *waiters;
+static verto_ctx *wait_ctx;
+static verto_ev *wait_ev;
+static char *wait_logfile;
+#ifdef HAVE_SYS_INOTIFY_H
+static verto_ev *watch_ev;
+static int watch_wd = -1;
+#endif
+
+static void arm_wait_timer(void);
+
+/* Return the link pointing to the waiter for xprt, or to the terminating null
+ * pointer if there is none. */
+static struct iprop_waiter **
+find_waiter(SVCXPRT *xprt)
+{
+    struct iprop_waiter **wp;
+
+    for (wp = &waiters; *wp != NULL; wp = &(*wp)->next) {
+	if ((*wp)->xprt == xprt)
+	    break;
+    }
+    return wp;
+}
+
+/* Restore the transport operations of an unlinked waiter and free it. */
+static void
+free_waiter(struct iprop_waiter *w)
+{
+    w->xprt->xp_ops = w->orig_ops;
+    free(w->client_name);
+    free(w->service_name);
+    free(w);
+}
+
+/* Transport destroy wrapper for connections with a parked request. */
+static void
+waiter_destroy(SVCXPRT *xprt)
+{
+    struct iprop_waiter **wp = find_waiter(xprt), *w = *wp;
+
+    if (w != NULL) {
+	DPRINT("iprop_wait_updates_1: connection closed, client=%s\n",
+	       w->client_name);
+	*wp = w->next;
+	free_waiter(w);
+	arm_wait_timer();
+    }
+    SVC_DESTROY(xprt);
+}
+
+/* Forget any parked request for xprt without answering it. */
+static void
+cancel_wait(SVCXPRT *xprt)
+{
+    struct iprop_waiter **wp = find_waiter(xprt), *w = *wp;
+
+    if (w != NULL) {
+	*wp = w->next;
+	free_waiter(w);
+	arm_wait_timer();
+    }
+}
+
+static void
+log_wait_result(char *whoami, const kdb_last_t *in,
+		const kdb_incr_result_t *res, const char *client_name,
+		const char *service_name, SVCXPRT *xprt)
+{
+    char obuf[256];
+
+    if (res->ret == UPDATE_OK || res->ret == UPDATE_NIL) {
+	(void) snprintf(obuf, sizeof (obuf),
+			_("%s; Incoming SerialNo=%lu; Outgoing SerialNo=%lu"),
+			replystr(res->ret), (unsigned long)in->last_sno,
+			(unsigned long)res->lastentry.last_sno);
+    } else {
+	(void) snprintf(obuf, sizeof (obuf),
+			_("%s; Incoming SerialNo=%lu; Outgoing SerialNo=N/A"),
+			replystr(res->ret), (unsigned long)in->last_sno);
+    }
+    DPRINT("%s: request %s\n\tclprinc=`%s'\n\tsvcprinc=`%s'\n",
+	   whoami, obuf, client_name, service_name);
+    krb5_klog_syslog(LOG_NOTICE, LOG_DONE, whoami, obuf, "success",
+		     client_name, service_name, client_addr(xprt));
+}
+
+/* Fill in res for a replica whose last entry was checked against the ulog
+ * with result status. */
+static void
+set_wait_result(krb5_context context, update_status_t status,
+		kdb_incr_result_t *res)
+{
+    memset(res, 0, sizeof(*res));
+    res->ret = status;
+    if (status != UPDATE_ERROR && ulog_get_last(context, &res->lastentry))
+	res->ret = UPDATE_ERROR;
+}
+
+static void check_waiters(verto_ctx *ctx, verto_ev *ev);
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/* Watch callback: the ulog file was changed.  Drain the events and check the
+ * parked requests. */
+static void
+ulog_changed(verto_ctx *ctx, verto_ev *ev)
+{
+    int fd = verto_get_fd(ev);
+    union {
+	struct inotify_event event;
+	char buf[4096];
+    } u;
+    const struct inotify_event *event;
+    ssize_t len;
+    char *p;
+
+    while ((len = read(fd, u.buf, sizeof(u.buf))) > 0) {
+	for (p = u.buf; p < u.buf + len; p += sizeof(*event) + event->len) {
+	    event = (const struct inotify_event *)p;
+	    /* The file was removed or replaced; watch_ulog() will watch it
+	     * again when the timer is next armed. */
+	    if ((event->mask & IN_IGNORED) && event->wd == watch_wd)
+		watch_wd = -1;
+	}
+    }
+    check_waiters(ctx, ev);
+}
+
+/* Start watching the ulog file if we are not already.  Return false if it
+ * cannot be watched. */
+static krb5_boolean
+watch_ulog(void)
+{
+    int fd;
+
+    if (watch_ev == NULL) {
+	fd = inotify_init();
+	if (fd == -1)
+	    return FALSE;
+	set_cloexec_fd(fd);
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+	    close(fd);
+	    return FALSE;
+	}
+	watch_ev = verto_add_io(wait_ctx,
+				VERTO_EV_FLAG_PERSIST | VERTO_EV_FLAG_IO_READ |
+				VERTO_EV_FLAG_IO_CLOSE_FD, ulog_changed, fd);
+	if (watch_ev == NULL) {
+	    close(fd);
+	    return FALSE;
+	}
+    }
+    if (watch_wd == -1) {
+	watch_wd = inotify_add_watch(verto_get_fd(watch_ev), wait_logfile,
+				     IN_MODIFY | IN_ATTRIB);
+    }
+    return watch_wd != -1;
+}
+
+/* Stop watching the ulog file, so that writes to it made while no requests
+ * are parked do not wake us up. */
+static void
+unwatch_ulog(void)
+{
+    if (watch_wd != -1) {
+	(void)inotify_rm_watch(verto_get_fd(watch_ev), watch_wd);
+	watch_wd = -1;
+    }
+}
+
+#else /* !HAVE_SYS_INOTIFY_H */
+
+static krb5_boolean
+watch_ulog(void)
+{
+    return FALSE;
+}
+
+static void
+unwatch_ulog(void)
+{
+}
+
+#endif /* !HAVE_SYS_INOTIFY_H */
+
+/* Arm the timer for the next check of the parked requests: at the earliest
+ * deadline if the ulog is watched, or after the poll interval if not.  If no
+ * requests are parked, stop watching the ulog instead. */
+static void
+arm_wait_timer(void)
+{
+    struct iprop_waiter *w;
+    time_t earliest, now = time(NULL);
+    time_t interval = IPROP_WAIT_CHECK_MS;
+
+    if (wait_ev != NULL) {
+	verto_del(wait_ev);
+	wait_ev = NULL;
+    }
+    if (waiters == NULL) {
+	unwatch_ulog();
+	return;
+    }
+
+    if (watch_ulog()) {
+	earliest = waiters->deadline;
+	for (w = waiters->next; w != NULL; w = w->next) {
+	    if (w->deadline < earliest)
+		earliest = w->deadline;
+	}
+	interval = (earliest > now) ? (earliest - now) * 1000 : 0;
+    }
+    wait_ev = verto_add_timeout(wait_ctx, VERTO_EV_FLAG_NONE, check_waiters,
+				interval);
+}
+
+/*
+ * Answer parked requests for which the ulog has new updates, or whose
+ * timeouts have expired.  Other changes in status are left for the timeout
+ * to report, so that a transient ulog reset (such as on a replica which is
+ * itself being resynced) does not send all waiting replicas for a full
+ * resync.
+ */
+static void
+check_waiters(verto_ctx *ctx, verto_ev *ev)
+{
+    kadm5_server_handle_t handle = global_server_handle;
+    struct iprop_waiter **wp, *w;
+    kdb_incr_result_t res;
+    update_status_t status;
+    time_t now = time(NULL);
+    char *whoami = "iprop_wait_updates_1";
+
+    /* The one-shot timer is freed by verto once this callback returns. */
+    if (ev == wait_ev)
+	wait_ev = NULL;
+
+    wp = &waiters;
+    while ((w = *wp) != NULL) {
+	status = ulog_get_sno_status(handle->context, &w->last);
+	if (status != UPDATE_OK && now < w->deadline) {
+	    wp = &w->next;
+	    continue;
+	}
+	*wp = w->next;
+	w->xprt->xp_ops = w->orig_ops;
+	set_wait_result(handle->context, status, &res);
+	log_wait_result(whoami, &w->last, &res, w->client_name,
+			w->service_name, w->xprt);
+	if (!svc_sendreply(w->xprt, xdr_kdb_incr_result_t, (caddr_t)&res)) {
+	    krb5_klog_syslog(LOG_ERR, _("RPC svc_sendreply failed (%s)"),
+			     whoami);
+	}
+	if (nofork)
+	    debprret(whoami, res.ret, res.lastentry.last_sno);
+	free_waiter(w);
+    }
+
+    arm_wait_timer();
+}
+
+/* Park the request on xprt until the ulog has updates past last or timeout
+ * seconds pass.  On success, take ownership of client_name and
+ * service_name. */
+static krb5_boolean
+park_request(SVCXPRT *xprt, const kdb_last_t *last, uint32_t timeout,
+	     char *client_name, char *service_name)
+{
+    struct iprop_waiter *w;
+
+    if (wait_ctx == NULL)
+	return FALSE;
+
+    w = calloc(1, sizeof(*w));
+    if (w == NULL)
+	return FALSE;
+    w->xprt = xprt;
+    w->orig_ops = xprt->xp_ops;
+    w->ops = *xprt->xp_ops;
+    w->ops.xp_destroy = waiter_destroy;
+    w->last = *last;
+    w->deadline = time(NULL) + timeout;
+    w->client_name = client_name;
+    w->service_name = service_name;
+    xprt->xp_ops = &w->ops;
+    w->next = waiters;
+    waiters = w;
+
+    arm_wait_timer();
+    if (wait_ev == NULL) {
+	waiters = w->next;
+	w->client_name = w->service_name = NULL;
+	free_waiter(w);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+krb5_error_code
+iprop_wait_init(verto_ctx *ctx, const char *logfile)
+{
+    wait_logfile = strdup(logfile);
+    if (wait_logfile == NULL)
+	return ENOMEM;
+    wait_ctx = ctx;
+    return 0;
+}
+
+void
+iprop_wait_fini(void)
+{
+    struct iprop_waiter *w;
+
+    while ((w = waiters) != NULL) {
+	waiters = w->next;
+	free_waiter(w);
+    }
+    if (wait_ev != NULL)
+	verto_del(wait_ev);
+    wait_ev = NULL;
+#ifdef HAVE_SYS_INOTIFY_H
+    if (watch_ev != NULL)
+	verto_del(watch_ev);
+    watch_ev = NULL;
+    watch_wd = -1;
+#endif
+    free(wait_logfile);
+    wait_logfile = NULL;
+    wait_ctx = NULL;
+}
+
+kdb_incr_result_t *
+iprop_wait_updates_1_svc(kdb_wait_t *arg, struct svc_req *rqstp)
+{
+    static kdb_incr_result_t ret;
+    char *whoami = "iprop_wait_updates_1";
+    kadm5_server_handle_t handle = global_server_handle;
+    char *client_name = NULL, *service_name = NULL;
+    update_status_t status;
+    uint32_t timeout;
+
+    memset(&ret, 0, sizeof(ret));
+    ret.ret = UPDATE_ERROR;
+
+    DPRINT("%s: start, last_sno=%lu, timeout=%lu\n", whoami,
+	   (unsigned long)arg->last.last_sno, (unsigned long)arg->timeout);
+
+    if (!handle) {
+	krb5_klog_syslog(LOG_ERR, _("%s: server handle is NULL"), whoami);
+	goto out;
+    }
+
+    {
+	gss_buffer_desc client_desc, service_desc;
+
+	if (setup_gss_names(rqstp, &client_desc, &service_desc) < 0) {
+	    krb5_klog_syslog(LOG_ERR, _("%s: setup_gss_names failed"),
+			     whoami);
+	    goto out;
+	}
+	client_name = buf_to_string(&client_desc);
+	service_name = buf_to_string(&service_desc);
+	if (client_name == NULL || service_name == NULL) {
+	    krb5_klog_syslog(LOG_ERR,
+			     _("%s: out of memory recording principal names"),
+			     whoami);
+	    goto out;
+	}
+    }
+
+    if (!iprop_acl_check(handle->context, client_name)) {
+	ret.ret = UPDATE_PERM_DENIED;
+	krb5_klog_syslog(LOG_NOTICE, LOG_UNAUTH, whoami,
+			 client_name, service_name,
+			 client_addr(rqstp->rq_xprt));
+	goto out;
+    }
+
+    status = ulog_get_sno_status(handle->context, &arg->last);
+    timeout = (arg->timeout < IPROP_WAIT_MAX) ? arg->timeout : IPROP_WAIT_MAX;
+    if (status == UPDATE_NIL && timeout > 0 &&
+	park_request(rqstp->rq_xprt, &arg->last, timeout, client_name,
+		     service_name)) {
+	DPRINT("%s: waiting up to %lu seconds, client=%s\n", whoami,
+	       (unsigned long)timeout, client_name);
+	/* The reply will be sent by check_waiters(). */
+	return NULL;
+    }
+
+    set_wait_result(handle->context, status, &ret);
+    log_wait_result(whoami, &arg->last, &ret, client_name, service_name,
+		    rqstp->rq_xprt);
+
 out:
     if (nofork)
 	debprret(whoami, ret.ret, ret.lastentry.last_sno);
@@ -533,12 +971,16 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 {
     union {
 	kdb_last_t iprop_get_updates_1_arg;
+	kdb_wait_t iprop_wait_updates_1_arg;
     } argument;
     void *result;
     bool_t (*_xdr_argument)(), (*_xdr_result)();
     void *(*local)(/* union XXX *, struct svc_req * */);
     char *whoami = "krb5_iprop_prog_1";
 
+    /* A new request means the client has given up on any parked one. */
+    cancel_wait(transp);
+
     if (!check_iprop_rpcsec_auth(rqstp)) {
 	krb5_klog_syslog(LOG_ERR, _("authentication attempt failed: %s, RPC "
 				    "authentication flavor %d"),
@@ -556,8 +998,8 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 
     case IPROP_GET_UPDATES:
 	_xdr_argument = xdr_kdb_last_t;
-	_xdr_result = xdr_kdb_incr_result_t;
-	local = (void *(*)()) iprop_get_updates_1_svc;
+	_xdr_result = xdr_kdb_incr_raw_result_t;
+	local = (void *(*)()) get_updates_raw;
 	break;
 
     case IPROP_FULL_RESYNC:
@@ -572,6 +1014,12 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 	local = (void *(*)()) iprop_full_resync_ext_1_svc;
 	break;
 
+    case IPROP_WAIT_UPDATES:
+	_xdr_argument = xdr_kdb_wait_t;
+	_xdr_result = xdr_kdb_incr_result_t;
+	local = (void *(*)()) iprop_wait_updates_1_svc;
+	break;
+
     default:
 	krb5_klog_syslog(LOG_ERR,
 			 _("RPC unknown request: %d (%s)"),
@@ -604,16 +1052,7 @@ krb5_iprop_prog_1(struct svc_req *rqstp,
 	exit(1);
     }
 
-    if (rqstp->rq_proc == IPROP_GET_UPDATES) {
-	/* LINTED */
-	kdb_incr_result_t *r = (kdb_incr_result_t *)result;
-
-	if (r->ret == UPDATE_OK) {
-	    ulog_free_entries(r->updates.kdb_ulog_t_val,
-			      r->updates.kdb_ulog_t_len);
-	    r->updates.kdb_ulog_t_val = NULL;
-	    r->updates.kdb_ulog_t_len = 0;
-	}
-    }
+    if (rqstp->rq_proc == IPROP_GET_UPDATES)
+	ulog_free_raw_entries((kdb_incr_raw_result_t *)result);
 
 }
@@ -14,11 +14,680 @@
 #include <adm_proto.h>
 #include "misc.h"
 #include "kadm5/server_internal.h"
+#include <kdb_log.h>
 
 extern void *global_server_handle;
 
 static int check_rpcsec_auth(struct svc_req *);
 
+union kadm_1_argument {
+     cprinc_arg create_principal_2_arg;
+     dprinc_arg delete_principal_2_arg;
+     mprinc_arg modify_principal_2_arg;
+     rprinc_arg rename_principal_2_arg;
+     gprinc_arg get_principal_2_arg;
+     chpass_arg chpass_principal_2_arg;
+     chrand_arg chrand_principal_2_arg;
+     cpol_arg create_policy_2_arg;
+     dpol_arg delete_policy_2_arg;
+     mpol_arg modify_policy_2_arg;
+     gpol_arg get_policy_2_arg;
+     setkey_arg setkey_principal_2_arg;
+     cprinc3_arg create_principal3_2_arg;
+     chpass3_arg chpass_principal3_2_arg;
+     chrand3_arg chrand_principal3_2_arg;
+     setkey3_arg setkey_principal3_2_arg;
+     setkey4_arg setkey_principal4_2_arg;
+     getpkeys_arg get_principal_keys_2_arg;
+     cprincs_arg create_principals_2_arg;
+     mprincs_arg modify_principals_2_arg;
+     gprincs_page_arg get_princs_page_2_arg;
+};
+
+union kadm_1_result {
+     generic_ret gen_ret;
+     gprinc_ret get_principal_2_ret;
+     chrand_ret chrand_principal_2_ret;
+     gpol_ret get_policy_2_ret;
+     getprivs_ret get_privs_2_ret;
+     gprincs_ret get_princs_2_ret;
+     gpols_ret get_pols_2_ret;
+     chrand_ret chrand_principal3_2_ret;
+     gstrings_ret get_string_2_ret;
+     getpkeys_ret get_principal_keys_ret;
+     princs_ret princs_2_ret;
+     gprincs_page_ret get_princs_page_2_ret;
+};
+
+/*
+ * Group commit.  If kadmind_commit_delay is set, the first update request
+ * opens a batch which is committed commit_delay milliseconds later.  While a
+ * batch is open, the KDB is held locked (so that a DB2 database is written
+ * back and synced once when the batch ends rather than after every change)
+ * and ulog syncs are deferred, so that iprop does not see the updates until
+ * the database changes are committed.  Replies to update requests are held
+ * until the batch is committed.  Only RPCSEC_GSS keeps the client's
+ * credentials with the transport after the request is dispatched, so
+ * updates from clients using other flavors commit the open batch before
+ * replying.  While a reply is held, its transport's receive operation is
+ * wrapped to send the reply before the next request is read (so that the
+ * reply carries its own request's xid), and its destroy operation is wrapped
+ * so that the reply is dropped if the connection goes away.
+ */
+
+struct held_reply {
+     struct held_reply *next;
+     SVCXPRT *xprt;
+     struct xp_ops *orig_ops;
+     struct xp_ops ops;
+     bool_t (*xdr_result)();
+     union kadm_1_result result;
+};
+
+static verto_ctx *commit_ctx;
+static int commit_delay;
+static verto_ev *commit_ev;
+static struct held_reply *held_replies;
+
+/* Return the link pointing to the held reply for xprt, or to the terminating
+ * null pointer if there is none. */
+static struct held_reply **
+find_held_reply(SVCXPRT *xprt)
+{
+     struct held_reply **hp;
+
+     for (hp = &held_replies; *hp != NULL; hp = &(*hp)->next) {
+	  if ((*hp)->xprt == xprt)
+	       break;
+     }
+     return hp;
+}
+
+/* Transport receive wrapper for connections with a held reply.  Commit the
+ * batch to send the reply before reading the next request. */
+static bool_t
+held_reply_recv(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+     (void) kadm_commit_flush();
+     return SVC_RECV(xprt, msg);
+}
+
+/* Transport destroy wrapper for connections with a held reply. */
+static void
+held_reply_destroy(SVCXPRT *xprt)
+{
+     struct held_reply **hp = find_held_reply(xprt), *h = *hp;
+
+     if (h != NULL) {
+	  *hp = h->next;
+	  xprt->xp_ops = h->orig_ops;
+	  xdr_free((xdrproc_t)h->xdr_result, (char *)&h->result);
+	  free(h);
+     }
+     SVC_DESTROY(xprt);
+}
+
+/* Hold the reply result to the request on xprt until the open batch is
+ * committed.  On success, take ownership of the contents of result. */
+static krb5_boolean
+hold_reply(SVCXPRT *xprt, bool_t (*xdr_result)(),
+	   const union kadm_1_result *result)
+{
+     struct held_reply *h;
+
+     h = calloc(1, sizeof(*h));
+     if (h == NULL)
+	  return FALSE;
+     h->xprt = xprt;
+     h->orig_ops = xprt->xp_ops;
+     h->ops = *xprt->xp_ops;
+     h->ops.xp_recv = held_reply_recv;
+     h->ops.xp_destroy = held_reply_destroy;
+     h->xdr_result = xdr_result;
+     h->result = *result;
+     xprt->xp_ops = &h->ops;
+     h->next = held_replies;
+     held_replies = h;
+     return TRUE;
+}
+
+/*
+ * Send the reply result to a request.  If commit_ret is set, the request's
+ * update was lost when its batch failed to commit, so send that error in
+ * place of a successful result.  Every update procedure's result begins with
+ * the API version and code, and encodes nothing further when the code is an
+ * error, so a generic_ret can stand in for any of them.
+ */
+static void
+send_reply(SVCXPRT *xprt, bool_t (*xdr_result)(),
+	   union kadm_1_result *result, kadm5_ret_t commit_ret)
+{
+     generic_ret failed;
+
+     if (commit_ret && result->gen_ret.code == KADM5_OK) {
+	  failed.api_version = result->gen_ret.api_version;
+	  failed.code = commit_ret;
+	  if (!svc_sendreply(xprt, xdr_generic_ret, (void *)&failed)) {
+	       krb5_klog_syslog(LOG_ERR, "WARNING! Unable to send function "
+				"results, continuing.");
+	       svcerr_systemerr(xprt);
+	  }
+     } else if (!svc_sendreply(xprt, xdr_result, (void *)result)) {
+	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to send function "
+			   "results, continuing.");
+	  svcerr_systemerr(xprt);
+     }
+}
+
+/* Commit the open batch and send the replies held for it.  Return the
+ * commit result. */
+static kadm5_ret_t
+commit_batch(void)
+{
+     kadm5_server_handle_t handle = global_server_handle;
+     struct held_reply *h;
+     krb5_error_code ret;
+     const char *emsg;
+
+     /* Commit the database changes before the ulog entries describing them,
+      * as is done for a single update.  If the commit fails, the ulog entries
+      * must not reach replicas. */
+     ret = krb5_db_unlock(handle->context);
+     if (ret) {
+	  emsg = krb5_get_error_message(handle->context, ret);
+	  krb5_klog_syslog(LOG_ERR, _("Failed to commit database updates: %s"),
+			   emsg);
+	  krb5_free_error_message(handle->context, emsg);
+	  ulog_abort_deferred(handle->context);
+     } else {
+	  ulog_defer_sync(handle->context, FALSE);
+     }
+
+     while ((h = held_replies) != NULL) {
+	  held_replies = h->next;
+	  h->xprt->xp_ops = h->orig_ops;
+	  send_reply(h->xprt, h->xdr_result, &h->result, ret);
+	  if (!svc_freeargs(h->xprt, h->xdr_result, &h->result)) {
+	       krb5_klog_syslog(LOG_ERR, "WARNING! Unable to free results, "
+				"continuing.");
+	  }
+	  free(h);
+     }
+     return ret;
+}
+
+static void
+commit_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+     /* The event is not persistent, so verto frees it after this call. */
+     commit_ev = NULL;
+     (void) commit_batch();
+}
+
+/* Open a batch if one is not already open.  Return true if a batch is
+ * open. */
+static krb5_boolean
+open_batch(void)
+{
+     kadm5_server_handle_t handle = global_server_handle;
+
+     if (commit_ev != NULL)
+	  return TRUE;
+
+     /* Backends which do not support locking simply commit each change. */
+     if (krb5_db_lock(handle->context, KRB5_DB_LOCKMODE_EXCLUSIVE) != 0)
+	  return FALSE;
+     commit_ev = verto_add_timeout(commit_ctx, VERTO_EV_FLAG_NONE,
+				   commit_timeout, commit_delay);
+     if (commit_ev == NULL) {
+	  /* Nothing has been changed under the lock yet. */
+	  (void) krb5_db_unlock(handle->context);
+	  return FALSE;
+     }
+     ulog_defer_sync(handle->context, TRUE);
+     return TRUE;
+}
+
+/* Return true if proc may modify the database. */
+static krb5_boolean
+is_update_proc(rpcproc_t proc)
+{
+     switch (proc) {
+     case NULLPROC:
+     case GET_PRINCIPAL:
+     case GET_PRINCS:
+     case GET_PRINCS_PAGE:
+     case GET_POLICY:
+     case GET_POLS:
+     case GET_PRIVS:
+     case INIT:
+     case GET_STRINGS:
+     case EXTRACT_KEYS:
+	  return FALSE;
+     default:
+	  return TRUE;
+     }
+}
+
+void
+kadm_commit_init(verto_ctx *ctx, int delay_ms)
+{
+     commit_ctx = ctx;
+     commit_delay = delay_ms;
+}
+
+/* Commit the open batch now, if there is one.  Return an error if the batch
+ * failed to commit. */
+kadm5_ret_t
+kadm_commit_flush(void)
+{
+     if (commit_ev == NULL)
+	  return 0;
+     verto_del(commit_ev);
+     commit_ev = NULL;
+     return commit_batch();
+}
+
+void
+kadm_commit_fini(void)
+{
+     (void) kadm_commit_flush();
+     commit_ctx = NULL;
+     commit_delay = 0;
+}
+
+/*
+ * Worker threads.  If kadmind_threads is set, requests which only read the
+ * database (get_principal, get_policy, get_privs and get_strings) are handed
+ * to a pool of worker threads so that slow lookups do not hold up the event
+ * loop.  Each worker has its own server handle, with its own krb5 context and
+ * database open.  Updates are still made on the main thread, and the back
+ * end's locking keeps them consistent with the workers' reads.
+ *
+ * Arguments are decoded and replies are sent on the main thread, which is the
+ * only thread to use the RPC transport and GSS-API context state.  While a
+ * request is with a worker, its transport's receive and destroy operations
+ * are wrapped to wait for the request to finish first, so that the client's
+ * GSS-API context remains valid and is not used for another request.
+ * Workers report finished requests to the main thread through a pipe.
+ */
+
+static struct kadm_thread main_thread;
+
+#ifdef HAVE_PTHREAD
+
+struct job {
+     struct job *next;		/* list of requests with workers */
+     struct job *qnext;		/* queue of requests awaiting a worker */
+     SVCXPRT *xprt;
+     struct xp_ops *orig_ops;
+     struct xp_ops ops;
+     struct svc_req rqst;
+     bool_t (*xdr_argument)(), (*xdr_result)();
+     bool_t (*local)();
+     union kadm_1_argument argument;
+     union kadm_1_result result;
+     bool_t retval;
+     krb5_boolean done;
+};
+
+static int nworkers;
+static pthread_t *worker_threads;
+static struct kadm_thread *worker_states;
+static krb5_boolean have_worker_key;
+static pthread_key_t worker_key;
+static struct job *jobs;
+static int done_pipe[2] = { -1, -1 };
+static verto_ev *done_ev;
+
+/* The following are protected by job_lock. */
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static struct job *queue, **queue_tail = &queue;
+static krb5_boolean workers_stopping;
+
+static void *
+worker_main(void *arg)
+{
+     struct job *j;
+     char c = 0;
+
+     (void)pthread_setspecific(worker_key, arg);
+     pthread_mutex_lock(&job_lock);
+     for (;;) {
+	  while (queue == NULL && !workers_stopping)
+	       pthread_cond_wait(&queue_cond, &job_lock);
+	  j = queue;
+	  if (j == NULL)
+	       break;
+	  queue = j->qnext;
+	  if (queue == NULL)
+	       queue_tail = &queue;
+	  pthread_mutex_unlock(&job_lock);
+
+	  j->retval = (*j->local)(&j->argument, &j->result, &j->rqst);
+
+	  pthread_mutex_lock(&job_lock);
+	  j->done = TRUE;
+	  pthread_cond_broadcast(&done_cond);
+	  /* If the pipe is full, the main thread already has a wakeup
+	   * pending. */
+	  (void)write(done_pipe[1], &c, 1);
+     }
+     pthread_mutex_unlock(&job_lock);
+     return NULL;
+}
+
+/* Return the link pointing to the request in progress for xprt, or to the
+ * terminating null pointer if there is none. */
+static struct job **
+find_job(SVCXPRT *xprt)
+{
+     struct job **jp;
+
+     for (jp = &jobs; *jp != NULL; jp = &(*jp)->next) {
+	  if ((*jp)->xprt == xprt)
+	       break;
+     }
+     return jp;
+}
+
+/* Wait for a worker to finish with j. */
+static void
+wait_job(struct job *j)
+{
+     /* The worker may be waiting for the database lock held by an open
+      * batch. */
+     kadm_commit_flush();
+     pthread_mutex_lock(&job_lock);
+     while (!j->done)
+	  pthread_cond_wait(&done_cond, &job_lock);
+     pthread_mutex_unlock(&job_lock);
+}
+
+/* Remove the finished request at *jp from the list, send its reply if
+ * send_reply is true, and free it. */
+static void
+finish_job(struct job **jp, krb5_boolean send_reply)
+{
+     struct job *j = *jp;
+     SVCXPRT *xprt = j->xprt;
+
+     *jp = j->next;
+     xprt->xp_ops = j->orig_ops;
+     if (send_reply && j->retval &&
+	 !svc_sendreply(xprt, j->xdr_result, (void *)&j->result)) {
+	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to send function results, "
+			   "continuing.");
+	  svcerr_systemerr(xprt);
+     }
+     if (!svc_freeargs(xprt, j->xdr_argument, &j->argument)) {
+	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to free arguments, "
+			   "continuing.");
+     }
+     if (!svc_freeargs(xprt, j->xdr_result, &j->result)) {
+	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to free results, "
+			   "continuing.");
+     }
+     free(j);
+}
+
+/* Transport receive wrapper for connections with a request in progress.
+ * Reply to the request before reading the next one. */
+static bool_t
+job_recv(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+     struct job **jp = find_job(xprt);
+
+     wait_job(*jp);
+     finish_job(jp, TRUE);
+     return SVC_RECV(xprt, msg);
+}
+
+/* Transport destroy wrapper for connections with a request in progress. */
+static void
+job_destroy(SVCXPRT *xprt)
+{
+     struct job **jp = find_job(xprt);
+
+     wait_job(*jp);
+     finish_job(jp, FALSE);
+     SVC_DESTROY(xprt);
+}
+
+/* Send the replies to requests which workers have finished. */
+static void
+jobs_done(verto_ctx *ctx, verto_ev *ev)
+{
+     char buf[64];
+     struct job **jp;
+     krb5_boolean done;
+
+     while (read(done_pipe[0], buf, sizeof(buf)) > 0);
+     jp = &jobs;
+     while (*jp != NULL) {
+	  pthread_mutex_lock(&job_lock);
+	  done = (*jp)->done;
+	  pthread_mutex_unlock(&job_lock);
+	  if (done)
+	       finish_job(jp, TRUE);
+	  else
+	       jp = &(*jp)->next;
+     }
+}
+
+/* Return true if proc only reads the database and may be run by a worker. */
+static krb5_boolean
+is_worker_proc(rpcproc_t proc)
+{
+     switch (proc) {
+     case GET_PRINCIPAL:
+     case GET_POLICY:
+     case GET_PRIVS:
+     case GET_STRINGS:
+	  return TRUE;
+     default:
+	  return FALSE;
+     }
+}
+
+/* Hand the request on xprt to a worker if possible.  On success, take
+ * ownership of the contents of argument; the reply is sent when the worker
+ * has finished. */
+static krb5_boolean
+queue_job(struct svc_req *rqstp, SVCXPRT *xprt, bool_t (*xdr_argument)(),
+	  bool_t (*xdr_result)(), bool_t (*local)(),
+	  const union kadm_1_argument *argument)
+{
+     struct job *j;
+
+     /* Only RPCSEC_GSS keeps the client's credentials with the transport.
+      * While a batch is open, the database is locked by the main thread's
+      * handle, so a worker would have to wait for the batch to end. */
+     if (nworkers == 0 || !is_worker_proc(rqstp->rq_proc) ||
+	 rqstp->rq_cred.oa_flavor != RPCSEC_GSS || commit_ev != NULL)
+	  return FALSE;
+
+     j = calloc(1, sizeof(*j));
+     if (j == NULL)
+	  return FALSE;
+     j->xprt = xprt;
+     j->orig_ops = xprt->xp_ops;
+     j->ops = *xprt->xp_ops;
+     j->ops.xp_recv = job_recv;
+     j->ops.xp_destroy = job_destroy;
+     j->rqst = *rqstp;
+     j->xdr_argument = xdr_argument;
+     j->xdr_result = xdr_result;
+     j->local = local;
+     j->argument = *argument;
+     xprt->xp_ops = &j->ops;
+     j->next = jobs;
+     jobs = j;
+
+     pthread_mutex_lock(&job_lock);
+     *queue_tail = j;
+     queue_tail = &j->qnext;
+     pthread_cond_signal(&queue_cond);
+     pthread_mutex_unlock(&job_lock);
+     return TRUE;
+}
+
+/* Destroy a worker's server handle and its krb5 context. */
+static void
+free_worker_handle(void *server_handle)
+{
+     krb5_context kctx = ((kadm5_server_handle_t)server_handle)->context;
+
+     kadm5_destroy(server_handle);
+     krb5_free_context(kctx);
+}
+
+krb5_error_code
+kadm_workers_init(verto_ctx *ctx, kadm5_config_params *params,
+		  char **db_args, int nthreads)
+{
+     krb5_error_code ret;
+     krb5_context kctx;
+     void *server_handle;
+     int i;
+
+     if (nthreads <= 0)
+	  return 0;
+
+     ret = pthread_key_create(&worker_key, NULL);
+     if (ret)
+	  return ret;
+     have_worker_key = TRUE;
+
+     if (pipe(done_pipe) != 0) {
+	  ret = errno;
+	  goto error;
+     }
+     for (i = 0; i < 2; i++) {
+	  set_cloexec_fd(done_pipe[i]);
+	  if (fcntl(done_pipe[i], F_SETFL, O_NONBLOCK) != 0) {
+	       ret = errno;
+	       goto error;
+	  }
+     }
+     done_ev = verto_add_io(ctx, VERTO_EV_FLAG_IO_READ | VERTO_EV_FLAG_PERSIST,
+			    jobs_done, done_pipe[0]);
+     if (done_ev == NULL) {
+	  ret = ENOMEM;
+	  goto error;
+     }
+
+     worker_threads = k5calloc(nthreads, sizeof(*worker_threads), &ret);
+     if (worker_threads == NULL)
+	  goto error;
+     worker_states = k5calloc(nthreads, sizeof(*worker_states), &ret);
+     if (worker_states == NULL)
+	  goto error;
+
+     for (i = 0; i < nthreads; i++) {
+	  ret = kadm5_init_krb5_context(&kctx);
+	  if (ret)
+	       goto error;
+	  ret = kadm5_init(kctx, "kadmind", NULL, NULL, params,
+			   KADM5_STRUCT_VERSION, KADM5_API_VERSION_4, db_args,
+			   &server_handle);
+	  if (ret) {
+	       krb5_free_context(kctx);
+	       goto error;
+	  }
+	  worker_states[i].server_handle = server_handle;
+	  ret = pthread_create(&worker_threads[i], NULL, worker_main,
+			       &worker_states[i]);
+	  if (ret) {
+	       free_worker_handle(server_handle);
+	       goto error;
+	  }
+	  nworkers++;
+     }
+     return 0;
+
+error:
+     kadm_workers_fini();
+     return ret;
+}
+
+void
+kadm_workers_fini(void)
+{
+     int i;
+
+     pthread_mutex_lock(&job_lock);
+     workers_stopping = TRUE;
+     pthread_cond_broadcast(&queue_cond);
+     pthread_mutex_unlock(&job_lock);
+     for (i = 0; i < nworkers; i++)
+	  pthread_join(worker_threads[i], NULL);
+
+     /* The workers have finished every queued request. */
+     while (jobs != NULL)
+	  finish_job(&jobs, FALSE);
+
+     for (i = 0; i < nworkers; i++)
+	  free_worker_handle(worker_states[i].server_handle);
+     free(worker_threads);
+     free(worker_states);
+     worker_threads = NULL;
+     worker_states = NULL;
+     nworkers = 0;
+     workers_stopping = FALSE;
+
+     if (done_ev != NULL)
+	  verto_del(done_ev);
+     done_ev = NULL;
+     for (i = 0; i < 2; i++) {
+	  if (done_pipe[i] != -1)
+	       close(done_pipe[i]);
+	  done_pipe[i] = -1;
+     }
+     if (have_worker_key)
+	  (void)pthread_key_delete(worker_key);
+     have_worker_key = FALSE;
+}
+
+#else /* HAVE_PTHREAD */
+
+krb5_error_code
+kadm_workers_init(verto_ctx *ctx, kadm5_config_params *params,
+		  char **db_args, int nthreads)
+{
+     if (nthreads > 0) {
+	  krb5_klog_syslog(LOG_WARNING, _("kadmind_threads is not supported "
+					  "without thread support"));
+     }
+     return 0;
+}
+
+void
+kadm_workers_fini(void)
+{
+}
+
+#endif /* HAVE_PTHREAD */
+
+/* Return the state of the calling thread. */
+struct kadm_thread *
+kadm_current_thread(void)
+{
+#ifdef HAVE_PTHREAD
+     struct kadm_thread *t;
+
+     if (have_worker_key) {
+	  t = pthread_getspecific(worker_key);
+	  if (t != NULL)
+	       return t;
+     }
+#endif
+     main_thread.server_handle = global_server_handle;
+     return &main_thread;
+}
+
 /*
  * Function: kadm_1
  *
@@ -40,41 +709,13 @@ void kadm_1(rqstp, transp)
    struct svc_req *rqstp;
    SVCXPRT *transp;
 {
-     union {
-	  cprinc_arg create_principal_2_arg;
-	  dprinc_arg delete_principal_2_arg;
-	  mprinc_arg modify_principal_2_arg;
-	  rprinc_arg rename_principal_2_arg;
-	  gprinc_arg get_principal_2_arg;
-	  chpass_arg chpass_principal_2_arg;
-	  chrand_arg chrand_principal_2_arg;
-	  cpol_arg create_policy_2_arg;
-	  dpol_arg delete_policy_2_arg;
-	  mpol_arg modify_policy_2_arg;
-	  gpol_arg get_policy_2_arg;
-	  setkey_arg setkey_principal_2_arg;
-	  cprinc3_arg create_principal3_2_arg;
-	  chpass3_arg chpass_principal3_2_arg;
-	  chrand3_arg chrand_principal3_2_arg;
-	  setkey3_arg setkey_principal3_2_arg;
-	  setkey4_arg setkey_principal4_2_arg;
-	  getpkeys_arg get_principal_keys_2_arg;
-     } argument;
-     union {
-	  generic_ret gen_ret;
-	  gprinc_ret get_principal_2_ret;
-	  chrand_ret chrand_principal_2_ret;
-	  gpol_ret get_policy_2_ret;
-	  getprivs_ret get_privs_2_ret;
-	  gprincs_ret get_princs_2_ret;
-	  gpols_ret get_pols_2_ret;
-	  chrand_ret chrand_principal3_2_ret;
-	  gstrings_ret get_string_2_ret;
-	  getpkeys_ret get_principal_keys_ret;
-     } result;
+     union kadm_1_argument argument;
+     union kadm_1_result result;
      bool_t retval;
      bool_t (*xdr_argument)(), (*xdr_result)();
      bool_t (*local)();
+     krb5_boolean batched, held;
+     kadm5_ret_t commit_ret;
 
      if (rqstp->rq_cred.oa_flavor != AUTH_GSSAPI &&
 	 !check_rpcsec_auth(rqstp)) {
@@ -241,6 +882,24 @@ void kadm_1(rqstp, transp)
 	  local = (bool_t (*)()) get_principal_keys_2_svc;
 	  break;
 
+     case CREATE_PRINCIPALS:
+	  xdr_argument = xdr_cprincs_arg;
+	  xdr_result = xdr_princs_ret;
+	  local = (bool_t (*)()) create_principals_2_svc;
+	  break;
+
+     case MODIFY_PRINCIPALS:
+	  xdr_argument = xdr_mprincs_arg;
+	  xdr_result = xdr_princs_ret;
+	  local = (bool_t (*)()) modify_principals_2_svc;
+	  break;
+
+     case GET_PRINCS_PAGE:
+	  xdr_argument = xdr_gprincs_page_arg;
+	  xdr_result = xdr_gprincs_page_ret;
+	  local = (bool_t (*)()) get_princs_page_2_svc;
+	  break;
+
      default:
 	  krb5_klog_syslog(LOG_ERR, "Invalid KADM5 procedure number: %s, %d",
 			   client_addr(rqstp->rq_xprt), rqstp->rq_proc);
@@ -252,18 +911,27 @@ void kadm_1(rqstp, transp)
 	  svcerr_decode(transp);
 	  return;
      }
+#ifdef HAVE_PTHREAD
+     if (queue_job(rqstp, transp, xdr_argument, xdr_result, local, &argument))
+	  return;
+#endif
+     batched = (commit_delay > 0 && is_update_proc(rqstp->rq_proc) &&
+		rqstp->rq_cred.oa_flavor == RPCSEC_GSS && open_batch());
      memset(&result, 0, sizeof(result));
      retval = (*local)(&argument, &result, rqstp);
-     if (retval && !svc_sendreply(transp, xdr_result, (void *)&result)) {
-	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to send function results, "
-		 "continuing.");
-	  svcerr_systemerr(transp);
-     }
+     held = (retval && batched && hold_reply(transp, xdr_result, &result));
+     /* Don't acknowledge an update which joined an open batch until the
+      * batch is committed. */
+     commit_ret = 0;
+     if (!held && is_update_proc(rqstp->rq_proc))
+	  commit_ret = kadm_commit_flush();
+     if (retval && !held)
+	  send_reply(transp, xdr_result, &result, commit_ret);
      if (!svc_freeargs(transp, xdr_argument, &argument)) {
 	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to free arguments, "
 		 "continuing.");
      }
-     if (!svc_freeargs(transp, xdr_result, &result)) {
+     if (!held && !svc_freeargs(transp, xdr_result, &result)) {
 	  krb5_klog_syslog(LOG_ERR, "WARNING! Unable to free results, "
 		 "continuing.");
      }
@@ -23,6 +23,23 @@ kadm5_ret_t check_min_life(void *server_handle, krb5_principal principal,
                            char *msg_ret, unsigned int msg_len);
 
 void kadm_1(struct svc_req *, SVCXPRT *);
+void kadm_commit_init(verto_ctx *ctx, int delay_ms);
+kadm5_ret_t kadm_commit_flush(void);
+void kadm_commit_fini(void);
+
+#define KADM_ADDRBUF_LEN 128
+
+/* State for the thread processing a request. */
+struct kadm_thread {
+    void *server_handle;        /* base for request server handles */
+    char addrbuf[KADM_ADDRBUF_LEN]; /* buffer for client_addr() */
+};
+
+struct kadm_thread *kadm_current_thread(void);
+krb5_error_code kadm_workers_init(verto_ctx *ctx,
+                                  kadm5_config_params *params,
+                                  char **db_args, int nthreads);
+void kadm_workers_fini(void);
 void krb5_iprop_prog_1(struct svc_req *, SVCXPRT *);
 
 void trunc_name(size_t *len, char **dots);
@@ -45,6 +62,9 @@ const char *client_addr(SVCXPRT *xprt);
 void
 krb5_iprop_prog_1(struct svc_req *rqstp, SVCXPRT *transp);
 
+krb5_error_code iprop_wait_init(verto_ctx *ctx, const char *logfile);
+void iprop_wait_fini(void);
+
 kadm5_ret_t
 kiprop_get_adm_host_srv_name(krb5_context,
                              const char *,
@@ -133,6 +133,29 @@ write_pid_file(const char *pid_file)
     return st1 ? st1 : st2;
 }
 
+/* Return true if the realm's database module can be opened by each of
+ * kadmind's worker threads.  LMDB does not allow a database to be opened more
+ * than once in a process. */
+static krb5_boolean
+db_allows_threads(const char *realm)
+{
+    char *module = NULL, *lib = NULL;
+    krb5_boolean result = FALSE;
+
+    if (profile_get_string(context->profile, KDB_REALM_SECTION, realm,
+                           KDB_MODULE_POINTER, realm, &module) != 0)
+        goto cleanup;
+    if (profile_get_string(context->profile, KDB_MODULE_SECTION, module,
+                           KDB_LIB_POINTER, "db2", &lib) != 0)
+        goto cleanup;
+    result = (strcmp(lib, "klmdb") != 0);
+
+cleanup:
+    profile_release_string(module);
+    profile_release_string(lib);
+    return result;
+}
+
 /* Set up the main loop.  If proponly is set, don't set up ports for kpasswd or
  * kadmin.  May set *ctx_out even on error. */
 static krb5_error_code
@@ -169,6 +192,9 @@ setup_loop(kadm5_config_params *params, int proponly, verto_ctx **ctx_out)
                                    krb5_iprop_prog_1);
         if (ret)
             return ret;
+        ret = iprop_wait_init(ctx, params->iprop_logfile);
+        if (ret)
+            return ret;
     }
 #endif
     return loop_setup_network(ctx, global_server_handle, progname,
@@ -354,6 +380,7 @@ main(int argc, char *argv[])
     char **db_args = NULL, **tmpargs;
     const char *acl_file;
     int ret, i, db_args_size = 0, strong_random = 1, proponly = 0;
+    int commit_delay, nthreads;
 
     setlocale(LC_ALL, "");
     setvbuf(stderr, NULL, _IONBF, 0);
@@ -477,6 +504,12 @@ main(int argc, char *argv[])
     if (ret)
         fail_to_start(ret, _("initializing network"));
 
+    if (profile_get_integer(context->profile, KRB5_CONF_REALMS, params.realm,
+                            KRB5_CONF_KADMIND_COMMIT_DELAY, 0,
+                            &commit_delay) != 0 || commit_delay < 0)
+        commit_delay = 0;
+    kadm_commit_init(vctx, commit_delay);
+
     names[0].name = build_princ_name(KADM5_ADMIN_SERVICE, params.realm);
     names[1].name = build_princ_name(KADM5_CHANGEPW_SERVICE, params.realm);
     if (names[0].name == NULL || names[1].name == NULL)
@@ -541,6 +574,27 @@ main(int argc, char *argv[])
     if (kprop_port == NULL)
         kprop_port = getenv("KPROP_PORT");
 
+    /* Start worker threads now that we have daemonized. */
+    if (profile_get_integer(context->profile, KRB5_CONF_REALMS, params.realm,
+                            KRB5_CONF_KADMIND_THREADS, 0, &nthreads) != 0 ||
+        nthreads < 0)
+        nthreads = 0;
+    if (nthreads > 0 && params.mkey_from_kbd) {
+        krb5_klog_syslog(LOG_WARNING, _("Ignoring kadmind_threads as the "
+                                        "master key was read from the "
+                                        "keyboard"));
+        nthreads = 0;
+    }
+    if (nthreads > 0 && !db_allows_threads(params.realm)) {
+        krb5_klog_syslog(LOG_WARNING, _("Ignoring kadmind_threads as the "
+                                        "database module does not support "
+                                        "it"));
+        nthreads = 0;
+    }
+    ret = kadm_workers_init(vctx, &params, db_args, nthreads);
+    if (ret)
+        fail_to_start(ret, _("starting worker threads"));
+
     krb5_klog_syslog(LOG_INFO, _("starting"));
     if (nofork)
         fprintf(stderr, _("%s: starting...\n"), progname);
@@ -549,8 +603,11 @@ main(int argc, char *argv[])
     krb5_klog_syslog(LOG_INFO, _("finished, exiting"));
 
     /* Clean up memory, etc */
+    kadm_commit_fini();
+    kadm_workers_fini();
     svcauth_gssapi_unset_names();
     kadm5_destroy(global_server_handle);
+    iprop_wait_fini();
     loop_free(vctx);
     auth_fini(context);
     (void)gss_release_name(&minor_status, &gss_changepw_name);
@@ -439,6 +439,7 @@ dispatch(void *handle, const krb5_fulladdr *local_addr,
     kadm5_server_handle_t server_handle = (kadm5_server_handle_t)handle;
     krb5_data *response = NULL;
     const char *emsg;
+    kadm5_ret_t commit_ret;
 
     ret = krb5_kt_resolve(server_handle->context, "KDB:", &kt);
     if (ret != 0) {
@@ -465,5 +466,12 @@ egress:
     if (ret)
         krb5_free_data(server_handle->context, response);
     krb5_kt_close(server_handle->context, kt);
+    /* Don't report a password change before it is committed, or if the
+     * commit failed. */
+    commit_ret = kadm_commit_flush();
+    if (commit_ret && ret == 0) {
+        krb5_free_data(server_handle->context, response);
+        ret = commit_ret;
+    }
     (*respond)(arg, ret, ret == 0 ? response : NULL);
 }
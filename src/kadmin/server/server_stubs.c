@@ -19,7 +19,6 @@
 
 extern gss_name_t                       gss_changepw_name;
 extern gss_name_t                       gss_oldchangepw_name;
-extern void *                           global_server_handle;
 
 #define CHANGEPW_SERVICE(rqstp)                                         \
     (cmp_gss_names_rel_1(acceptor_name(rqstp->rq_svccred), gss_changepw_name) | \
@@ -114,7 +113,8 @@ static kadm5_ret_t new_server_handle(krb5_ui_4 api_version,
            malloc(sizeof(*handle))))
         return ENOMEM;
 
-    *handle = *(kadm5_server_handle_t)global_server_handle;
+    /* Use the calling worker thread's handle, if there is one. */
+    *handle = *(kadm5_server_handle_t)kadm_current_thread()->server_handle;
     handle->api_version = api_version;
 
     if (! gss_to_krb5_name(handle, rqst2name(rqstp),
@@ -143,11 +143,12 @@ static void free_server_handle(kadm5_server_handle_t handle)
     free(handle);
 }
 
-/* Result is stored in a static buffer and is invalidated by the next call. */
+/* Result is stored in a per-thread buffer and is invalidated by the next call
+ * in the same thread. */
 const char *
 client_addr(SVCXPRT *xprt)
 {
-    static char abuf[128];
+    char *abuf = kadm_current_thread()->addrbuf;
     struct sockaddr_storage ss;
     socklen_t len = sizeof(ss);
     const char *p = NULL;
@@ -155,9 +156,10 @@ client_addr(SVCXPRT *xprt)
     if (getpeername(xprt->xp_sock, ss2sa(&ss), &len) != 0)
         return "(unknown)";
     if (ss2sa(&ss)->sa_family == AF_INET)
-        p = inet_ntop(AF_INET, &ss2sin(&ss)->sin_addr, abuf, sizeof(abuf));
+        p = inet_ntop(AF_INET, &ss2sin(&ss)->sin_addr, abuf, KADM_ADDRBUF_LEN);
     else if (ss2sa(&ss)->sa_family == AF_INET6)
-        p = inet_ntop(AF_INET6, &ss2sin6(&ss)->sin6_addr, abuf, sizeof(abuf));
+        p = inet_ntop(AF_INET6, &ss2sin6(&ss)->sin6_addr, abuf,
+                      KADM_ADDRBUF_LEN);
     return (p == NULL) ? "(unknown)" : p;
 }
 
@@ -790,6 +792,52 @@ exit_func:
     return TRUE;
 }
 
+bool_t
+get_princs_page_2_svc(gprincs_page_arg *arg, gprincs_page_ret *ret,
+                      struct svc_req *rqstp)
+{
+    char                            *prime_arg = NULL;
+    gss_buffer_desc                 client_name = GSS_C_EMPTY_BUFFER;
+    gss_buffer_desc                 service_name = GSS_C_EMPTY_BUFFER;
+    kadm5_server_handle_t           handle;
+    const char                      *errmsg = NULL;
+    krb5_boolean                    more;
+
+    ret->code = stub_setup(arg->api_version, rqstp, NULL, &handle,
+                           &ret->api_version, &client_name, &service_name,
+                           NULL);
+    if (ret->code)
+        goto exit_func;
+
+    prime_arg = arg->exp;
+    if (prime_arg == NULL)
+        prime_arg = "*";
+
+    if (CHANGEPW_SERVICE(rqstp) ||
+        !stub_auth(handle, OP_LISTPRINCS, NULL, NULL, NULL, NULL)) {
+        ret->code = KADM5_AUTH_LIST;
+        log_unauth("kadm5_get_principals_page", prime_arg,
+                   &client_name, &service_name, rqstp);
+    } else {
+        ret->code = kadm5_get_principals_page(handle, arg->exp, arg->start,
+                                              arg->max, &ret->princs,
+                                              &ret->count, &more);
+        ret->more = more;
+        if (ret->code != 0)
+            errmsg = krb5_get_error_message(handle->context, ret->code);
+
+        log_done("kadm5_get_principals_page", prime_arg, errmsg,
+                 &client_name, &service_name, rqstp);
+
+        if (errmsg != NULL)
+            krb5_free_error_message(handle->context, errmsg);
+    }
+
+exit_func:
+    stub_cleanup(handle, NULL, &client_name, &service_name);
+    return TRUE;
+}
+
 bool_t
 chpass_principal_2_svc(chpass_arg *arg, generic_ret *ret,
                        struct svc_req *rqstp)
@@ -1645,3 +1693,216 @@ exit_func:
     stub_cleanup(handle, prime_arg, &client_name, &service_name);
     return TRUE;
 }
+
+/* The entries of a batch principal request which passed authorization,
+ * gathered for one call to the kadm5 batch API. */
+struct princ_batch {
+    int n;
+    int *idx;                   /* Request index of each gathered entry */
+    char **names;               /* Unparsed principal names, by request index */
+    kadm5_principal_ent_rec *recs;
+    long *masks;
+    char **passwds;
+    kadm5_ret_t *results;
+};
+
+/* Allocate b and the result codes of ret for a request of count entries. */
+static kadm5_ret_t
+batch_init(struct princ_batch *b, int count, princs_ret *ret)
+{
+    size_t n = (count > 0) ? count : 1;
+
+    b->idx = calloc(n, sizeof(*b->idx));
+    b->names = calloc(n, sizeof(*b->names));
+    b->recs = calloc(n, sizeof(*b->recs));
+    b->masks = calloc(n, sizeof(*b->masks));
+    b->passwds = calloc(n, sizeof(*b->passwds));
+    b->results = calloc(n, sizeof(*b->results));
+    ret->codes = calloc(n, sizeof(*ret->codes));
+    if (b->idx == NULL || b->names == NULL || b->recs == NULL ||
+        b->masks == NULL || b->passwds == NULL || b->results == NULL ||
+        ret->codes == NULL)
+        return ENOMEM;
+    ret->n_codes = count;
+    return 0;
+}
+
+/* Unparse the name of request entry i into b, or set its result code. */
+static krb5_boolean
+batch_unparse(kadm5_server_handle_t handle, struct princ_batch *b, int i,
+              krb5_principal princ, princs_ret *ret)
+{
+    if (princ == NULL ||
+        krb5_unparse_name(handle->context, princ, &b->names[i])) {
+        ret->codes[i] = KADM5_BAD_PRINCIPAL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Copy the results of the gathered entries of b into ret and log them. */
+static void
+batch_done(kadm5_server_handle_t handle, struct princ_batch *b, char *op,
+           princs_ret *ret, gss_buffer_t client_name,
+           gss_buffer_t service_name, struct svc_req *rqstp)
+{
+    const char *errmsg;
+    int i, j;
+
+    for (j = 0; j < b->n; j++) {
+        i = b->idx[j];
+        ret->codes[i] = b->results[j];
+        errmsg = NULL;
+        if (b->results[j] != 0)
+            errmsg = krb5_get_error_message(handle->context, b->results[j]);
+
+        log_done(op, b->names[i], errmsg, client_name, service_name, rqstp);
+
+        if (errmsg != NULL)
+            krb5_free_error_message(handle->context, errmsg);
+    }
+}
+
+static void
+batch_free(struct princ_batch *b, int count, princs_ret *ret)
+{
+    int i;
+
+    if (b->names != NULL) {
+        for (i = 0; i < count; i++)
+            free(b->names[i]);
+    }
+    free(b->idx);
+    free(b->names);
+    free(b->recs);
+    free(b->masks);
+    free(b->passwds);
+    free(b->results);
+
+    /* Result codes are only marshalled (and freed by XDR) on success. */
+    if (ret->code != KADM5_OK) {
+        free(ret->codes);
+        ret->codes = NULL;
+        ret->n_codes = 0;
+    }
+}
+
+bool_t
+create_principals_2_svc(cprincs_arg *arg, princs_ret *ret,
+                        struct svc_req *rqstp)
+{
+    gss_buffer_desc             client_name = GSS_C_EMPTY_BUFFER;
+    gss_buffer_desc             service_name = GSS_C_EMPTY_BUFFER;
+    kadm5_server_handle_t       handle;
+    struct princ_batch          b;
+    cprincs_ent                 *ent;
+    int                         i;
+
+    memset(&b, 0, sizeof(b));
+    ret->code = stub_setup(arg->api_version, rqstp, NULL, &handle,
+                           &ret->api_version, &client_name, &service_name,
+                           NULL);
+    if (ret->code)
+        goto exit_func;
+
+    ret->code = batch_init(&b, arg->n_ents, ret);
+    if (ret->code)
+        goto exit_func;
+
+    for (i = 0; i < arg->n_ents; i++) {
+        ent = &arg->ents[i];
+        if (!batch_unparse(handle, &b, i, ent->rec.principal, ret))
+            continue;
+        if (CHANGEPW_SERVICE(rqstp) ||
+            !stub_auth_restrict(handle, OP_ADDPRINC, &ent->rec, &ent->mask)) {
+            ret->codes[i] = KADM5_AUTH_ADD;
+            log_unauth("kadm5_create_principal", b.names[i],
+                       &client_name, &service_name, rqstp);
+            continue;
+        }
+        b.idx[b.n] = i;
+        b.recs[b.n] = ent->rec;
+        b.masks[b.n] = ent->mask;
+        b.passwds[b.n] = ent->passwd;
+        b.n++;
+    }
+
+    ret->code = kadm5_create_principals(handle, b.n, b.recs, b.masks,
+                                        arg->n_ks_tuple, arg->ks_tuple,
+                                        b.passwds, b.results);
+    if (ret->code == KADM5_OK) {
+        batch_done(handle, &b, "kadm5_create_principal", ret,
+                   &client_name, &service_name, rqstp);
+    }
+
+exit_func:
+    batch_free(&b, arg->n_ents, ret);
+    stub_cleanup(handle, NULL, &client_name, &service_name);
+    return TRUE;
+}
+
+bool_t
+modify_principals_2_svc(mprincs_arg *arg, princs_ret *ret,
+                        struct svc_req *rqstp)
+{
+    gss_buffer_desc             client_name = GSS_C_EMPTY_BUFFER;
+    gss_buffer_desc             service_name = GSS_C_EMPTY_BUFFER;
+    kadm5_server_handle_t       handle;
+    struct princ_batch          b;
+    mprincs_ent                 *ent;
+    kadm5_ret_t                 code;
+    int                         i;
+
+    memset(&b, 0, sizeof(b));
+    ret->code = stub_setup(arg->api_version, rqstp, NULL, &handle,
+                           &ret->api_version, &client_name, &service_name,
+                           NULL);
+    if (ret->code)
+        goto exit_func;
+
+    ret->code = batch_init(&b, arg->n_ents, ret);
+    if (ret->code)
+        goto exit_func;
+
+    for (i = 0; i < arg->n_ents; i++) {
+        ent = &arg->ents[i];
+        if (!batch_unparse(handle, &b, i, ent->rec.principal, ret))
+            continue;
+        if (CHANGEPW_SERVICE(rqstp) ||
+            !stub_auth_restrict(handle, OP_MODPRINC, &ent->rec, &ent->mask)) {
+            ret->codes[i] = KADM5_AUTH_MODIFY;
+            log_unauth("kadm5_modify_principal", b.names[i],
+                       &client_name, &service_name, rqstp);
+            continue;
+        }
+        if ((ent->mask & KADM5_ATTRIBUTES) &&
+            !(ent->rec.attributes & KRB5_KDB_LOCKDOWN_KEYS)) {
+            code = check_lockdown_keys(handle, ent->rec.principal);
+            if (code == KADM5_PROTECT_KEYS) {
+                log_unauth("kadm5_modify_principal", b.names[i],
+                           &client_name, &service_name, rqstp);
+                code = KADM5_AUTH_MODIFY;
+            }
+            if (code) {
+                ret->codes[i] = code;
+                continue;
+            }
+        }
+        b.idx[b.n] = i;
+        b.recs[b.n] = ent->rec;
+        b.masks[b.n] = ent->mask;
+        b.n++;
+    }
+
+    ret->code = kadm5_modify_principals(handle, b.n, b.recs, b.masks,
+                                        b.results);
+    if (ret->code == KADM5_OK) {
+        batch_done(handle, &b, "kadm5_modify_principal", ret,
+                   &client_name, &service_name, rqstp);
+    }
+
+exit_func:
+    batch_free(&b, arg->n_ents, ret);
+    stub_cleanup(handle, NULL, &client_name, &service_name);
+    return TRUE;
+}
@@ -204,7 +204,49 @@ has_s4u2self_padata(krb5_pa_data **padata)
     return FALSE;
 }
 
-/* If a header ticket is decrypted, *ticket_out is filled in even on error. */
+/*
+ * Make a heap copy of ticket, which was decoded into an arena, and move its
+ * decrypted part (always heap-allocated) into the copy.
+ */
+static krb5_error_code
+copy_header_ticket(krb5_context context, krb5_ticket *ticket,
+                   krb5_ticket **ticket_out)
+{
+    krb5_error_code ret;
+    krb5_ticket *t;
+
+    *ticket_out = NULL;
+    t = k5alloc(sizeof(*t), &ret);
+    if (t == NULL)
+        return ret;
+    t->magic = ticket->magic;
+    t->enc_part = ticket->enc_part;
+    t->enc_part.ciphertext = empty_data();
+    ret = krb5_copy_principal(context, ticket->server, &t->server);
+    if (ret) {
+        free(t);
+        return ret;
+    }
+    ret = krb5int_copy_data_contents(context, &ticket->enc_part.ciphertext,
+                                     &t->enc_part.ciphertext);
+    if (ret) {
+        krb5_free_ticket(context, t);
+        return ret;
+    }
+    t->enc_part2 = ticket->enc_part2;
+    ticket->enc_part2 = NULL;
+    *ticket_out = t;
+    return 0;
+}
+
+/*
+ * If a header ticket is decrypted, *ticket_out is filled in even on error.
+ *
+ * The AP-REQ is decoded into an arena, as it does not outlive this function.
+ * krb5_rd_req_decoded_anyflag() only adds heap-allocated parts to it (the
+ * decrypted ticket part), and does not replace the ticket server because
+ * kdc_rd_ap_req() always supplies the TGS key.
+ */
 krb5_error_code
 kdc_process_tgs_req(kdc_realm_t *kdc_active_realm,
                     krb5_kdc_req *request, const krb5_fulladdr *from,
@@ -215,8 +257,9 @@ kdc_process_tgs_req(kdc_realm_t *kdc_active_realm,
                     krb5_pa_data **pa_tgs_req)
 {
     krb5_pa_data        * tmppa;
+    k5_asn1_arena       * arena = NULL;
     krb5_ap_req         * apreq;
-    krb5_error_code       retval;
+    krb5_error_code       retval, ret;
     krb5_authdata **authdata = NULL;
     krb5_data             scratch1;
     krb5_data           * scratch = NULL;
@@ -238,8 +281,12 @@ kdc_process_tgs_req(kdc_realm_t *kdc_active_realm,
 
     scratch1.length = tmppa->length;
     scratch1.data = (char *)tmppa->contents;
-    if ((retval = decode_krb5_ap_req(&scratch1, &apreq)))
+    if ((retval = k5_asn1_arena_create(&arena)))
+        return retval;
+    if ((retval = decode_krb5_ap_req_arena(arena, &scratch1, &apreq))) {
+        k5_asn1_arena_free(arena);
         return retval;
+    }
     ticket = apreq->ticket;
 
     if (isflagset(apreq->ap_options, AP_OPTS_USE_SESSION_KEY) ||
@@ -359,11 +406,15 @@ cleanup:
         *tgskey = NULL;
     }
     if (apreq->ticket->enc_part2 != NULL) {
-        /* Steal the decrypted ticket pointer, even on error. */
-        *ticket_out = apreq->ticket;
-        apreq->ticket = NULL;
+        /* Return the decrypted ticket, even on error. */
+        ret = copy_header_ticket(kdc_context, apreq->ticket, ticket_out);
+        if (ret) {
+            krb5_free_enc_tkt_part(kdc_context, apreq->ticket->enc_part2);
+            if (retval == 0)
+                retval = ret;
+        }
     }
-    krb5_free_ap_req(kdc_context, apreq);
+    k5_asn1_arena_free(arena);
     krb5_db_free_principal(kdc_context, krbtgt);
     return retval;
 }
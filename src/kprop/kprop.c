@@ -46,6 +46,7 @@
 #endif
 
 static char *kprop_version = KPROP_PROT_VERSION;
+static char *kprop_stream_version = KPROP_STREAM_PROT_VERSION;
 
 static char *progname = NULL;
 static int debug = 0;
@@ -68,14 +69,18 @@ static void parse_args(krb5_context context, int argc, char **argv);
 static void get_tickets(krb5_context context);
 static void usage(void);
 static void open_connection(krb5_context context, char *host, int *fd_out);
-static void kerberos_authenticate(krb5_context context,
-                                  krb5_auth_context *auth_context, int fd,
-                                  krb5_principal me, krb5_creds **new_creds);
+static krb5_error_code kerberos_authenticate(krb5_context context,
+                                             krb5_auth_context *auth_context,
+                                             int fd, char *version,
+                                             krb5_principal me,
+                                             krb5_creds **new_creds);
 static int open_database(krb5_context context, char *data_fn, int *size);
 static void close_database(krb5_context context, int fd);
 static void xmit_database(krb5_context context,
                           krb5_auth_context auth_context, krb5_creds *my_creds,
                           int fd, int database_fd, int in_database_size);
+static void xmit_stream(krb5_context context, krb5_auth_context auth_context,
+                        krb5_creds *my_creds, int fd, int database_fd);
 static void send_error(krb5_context context, krb5_creds *my_creds, int fd,
                        char *err_text, krb5_error_code err_code);
 static void update_last_prop_file(char *hostname, char *file_name);
@@ -95,6 +100,7 @@ main(int argc, char **argv)
     krb5_context context;
     krb5_creds *my_creds;
     krb5_auth_context auth_context;
+    krb5_boolean from_stdin;
 
     setlocale(LC_ALL, "");
     retval = krb5_init_context(&context);
@@ -105,15 +111,52 @@ main(int argc, char **argv)
     parse_args(context, argc, argv);
     get_tickets(context);
 
-    database_fd = open_database(context, file, &database_size);
+    /* A file name of "-" means to stream a dump from standard input, such as
+     * the output of "kdb5_util dump -". */
+    from_stdin = (strcmp(file, "-") == 0);
+    if (from_stdin) {
+        database_fd = STDIN_FILENO;
+        database_size = 0;
+    } else {
+        database_fd = open_database(context, file, &database_size);
+    }
+
     open_connection(context, replica_host, &fd);
-    kerberos_authenticate(context, &auth_context, fd, my_principal, &my_creds);
-    xmit_database(context, auth_context, my_creds, fd, database_fd,
-                  database_size);
-    update_last_prop_file(replica_host, file);
+    retval = kerberos_authenticate(context, &auth_context, fd,
+                                   kprop_stream_version, my_principal,
+                                   &my_creds);
+    if (retval == 0) {
+        xmit_stream(context, auth_context, my_creds, fd, database_fd);
+    } else if (from_stdin) {
+        com_err(progname, retval,
+                _("while negotiating streamed propagation to %s"),
+                replica_host);
+        exit(1);
+    } else {
+        /* The replica does not support streaming; reconnect and send the
+         * dump file using the original protocol. */
+        if (debug)
+            printf(_("Falling back to non-streamed propagation.\n"));
+        close(fd);
+        krb5_auth_con_free(context, auth_context);
+        krb5_free_address(context, sender_addr);
+        krb5_free_address(context, receiver_addr);
+        open_connection(context, replica_host, &fd);
+        retval = kerberos_authenticate(context, &auth_context, fd,
+                                       kprop_version, my_principal, &my_creds);
+        if (retval) {
+            com_err(progname, retval, _("while authenticating to server"));
+            exit(1);
+        }
+        xmit_database(context, auth_context, my_creds, fd, database_fd,
+                      database_size);
+    }
     printf(_("Database propagation to %s: SUCCEEDED\n"), replica_host);
     krb5_free_cred_contents(context, my_creds);
-    close_database(context, database_fd);
+    if (!from_stdin) {
+        update_last_prop_file(replica_host, file);
+        close_database(context, database_fd);
+    }
     krb5_free_default_realm(context, def_realm);
     exit(0);
 }
@@ -281,9 +324,13 @@ open_connection(krb5_context context, char *host, int *fd_out)
     }
 }
 
-static void
+/* Authenticate to the replica using the application protocol version
+ * version.  Return KRB5_SENDAUTH_BADAPPLVERS if the replica does not support
+ * version; exit on any other error. */
+static krb5_error_code
 kerberos_authenticate(krb5_context context, krb5_auth_context *auth_context,
-                      int fd, krb5_principal me, krb5_creds **new_creds)
+                      int fd, char *version, krb5_principal me,
+                      krb5_creds **new_creds)
 {
     krb5_error_code retval;
     krb5_error *error = NULL;
@@ -303,9 +350,11 @@ kerberos_authenticate(krb5_context context, krb5_auth_context *auth_context,
         exit(1);
     }
 
-    retval = krb5_sendauth(context, auth_context, &fd, kprop_version,
+    retval = krb5_sendauth(context, auth_context, &fd, version,
                            me, creds.server, AP_OPTS_MUTUAL_REQUIRED, NULL,
                            &creds, NULL, &error, &rep_result, new_creds);
+    if (retval == KRB5_SENDAUTH_BADAPPLVERS)
+        return retval;
     if (retval) {
         com_err(progname, retval, _("while authenticating to server"));
         if (error != NULL) {
@@ -328,6 +377,7 @@ kerberos_authenticate(krb5_context context, krb5_auth_context *auth_context,
         exit(1);
     }
     krb5_free_ap_rep_enc_part(context, rep_result);
+    return 0;
 }
 
 /*
@@ -401,6 +451,62 @@ close_database(krb5_context context, int fd)
     close(fd);
 }
 
+/*
+ * Wait for the replica to indicate that it has received and loaded the
+ * database, and place the contents of its KRB_SAFE reply in *out.  Exit if the
+ * replica reports an error.
+ */
+static void
+read_confirmation(krb5_context context, krb5_auth_context auth_context,
+                  int fd, krb5_data *out)
+{
+    krb5_data inbuf;
+    krb5_error_code retval;
+    krb5_error *error;
+
+    retval = krb5_read_message(context, &fd, &inbuf);
+    if (retval) {
+        com_err(progname, retval, _("while reading response from server"));
+        exit(1);
+    }
+    /*
+     * If we got an error response back from the server, display
+     * the error message
+     */
+    if (krb5_is_krb_error(&inbuf)) {
+        retval = krb5_rd_error(context, &inbuf, &error);
+        if (retval) {
+            com_err(progname, retval,
+                    _("while decoding error response from server"));
+            exit(1);
+        }
+        if (error->error == KRB_ERR_GENERIC) {
+            if (error->text.data) {
+                fprintf(stderr, _("Generic remote error: %s\n"),
+                        error->text.data);
+            }
+        } else if (error->error) {
+            com_err(progname,
+                    (krb5_error_code)error->error + ERROR_TABLE_BASE_krb5,
+                    _("signalled from server"));
+            if (error->text.data) {
+                fprintf(stderr, _("Error text from server: %s\n"),
+                        error->text.data);
+            }
+        }
+        krb5_free_error(context, error);
+        exit(1);
+    }
+
+    retval = krb5_rd_safe(context, auth_context, &inbuf, out, NULL);
+    if (retval) {
+        com_err(progname, retval,
+                "while decoding final size packet from server");
+        exit(1);
+    }
+    free(inbuf.data);
+}
+
 /*
  * Now we send over the database.  We use the following protocol:
  * Send over a KRB_SAFE message with the size.  Then we send over the
@@ -419,7 +525,6 @@ xmit_database(krb5_context context, krb5_auth_context auth_context,
     krb5_data inbuf, outbuf;
     char buf[KPROP_BUFSIZ];
     krb5_error_code retval;
-    krb5_error *error;
     krb5_ui_4 database_size = in_database_size, send_size, sent_size;
 
     /* Send over the size. */
@@ -492,55 +597,118 @@ xmit_database(krb5_context context, krb5_auth_context auth_context,
      * OK, we've sent the database; now let's wait for a success
      * indication from the remote end.
      */
-    retval = krb5_read_message(context, &fd, &inbuf);
-    if (retval) {
-        com_err(progname, retval, _("while reading response from server"));
+    read_confirmation(context, auth_context, fd, &outbuf);
+    if (outbuf.length != sizeof(send_size)) {
+        com_err(progname, 0, _("Kpropd sent a malformed size packet"));
         exit(1);
     }
-    /*
-     * If we got an error response back from the server, display
-     * the error message
-     */
-    if (krb5_is_krb_error(&inbuf)) {
-        retval = krb5_rd_error(context, &inbuf, &error);
-        if (retval) {
-            com_err(progname, retval,
-                    _("while decoding error response from server"));
-            exit(1);
-        }
-        if (error->error == KRB_ERR_GENERIC) {
-            if (error->text.data) {
-                fprintf(stderr, _("Generic remote error: %s\n"),
-                        error->text.data);
-            }
-        } else if (error->error) {
-            com_err(progname,
-                    (krb5_error_code)error->error + ERROR_TABLE_BASE_krb5,
-                    _("signalled from server"));
-            if (error->text.data) {
-                fprintf(stderr, _("Error text from server: %s\n"),
-                        error->text.data);
-            }
-        }
-        krb5_free_error(context, error);
+    memcpy(&send_size, outbuf.data, sizeof(send_size));
+    send_size = ntohl(send_size);
+    if (send_size != database_size) {
+        com_err(progname, 0, _("Kpropd sent database size %d, expecting %d"),
+                send_size, database_size);
         exit(1);
     }
+    free(outbuf.data);
+}
+
+/* Read up to len bytes from fd, stopping early only at end of file.  Return
+ * the number of bytes read, or -1 on error. */
+static ssize_t
+read_block(int fd, char *buf, size_t len)
+{
+    size_t total = 0;
+    ssize_t n;
+
+    while (total < len) {
+        n = read(fd, buf + total, len - total);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        total += n;
+    }
+    return total;
+}
 
-    retval = krb5_rd_safe(context,auth_context,&inbuf,&outbuf,NULL);
+/*
+ * Send the database using the streaming protocol: a series of KRB_PRIV
+ * blocks of up to KPROP_STREAM_BUFSIZ bytes, ending with an empty block.  The
+ * size of the database is not needed in advance, so database_fd may be a
+ * pipe.  The replica loads the blocks as they arrive, and then replies with
+ * the number of bytes it received.
+ */
+static void
+xmit_stream(krb5_context context, krb5_auth_context auth_context,
+            krb5_creds *my_creds, int fd, int database_fd)
+{
+    krb5_data inbuf, outbuf;
+    char *buf, errbuf[128];
+    ssize_t n;
+    uint64_t sent_size = 0;
+    krb5_error_code retval;
+
+    buf = malloc(KPROP_STREAM_BUFSIZ);
+    if (buf == NULL) {
+        com_err(progname, ENOMEM, _("while allocating database buffer"));
+        exit(1);
+    }
+
+    retval = krb5_auth_con_initivector(context, auth_context);
     if (retval) {
-        com_err(progname, retval,
-                "while decoding final size packet from server");
+        send_error(context, my_creds, fd,
+                   "failed while initializing i_vector", retval);
+        com_err(progname, retval, _("while allocating i_vector"));
         exit(1);
     }
 
-    memcpy(&send_size, outbuf.data, sizeof(send_size));
-    send_size = ntohl(send_size);
-    if (send_size != database_size) {
-        com_err(progname, 0, _("Kpropd sent database size %d, expecting %d"),
-                send_size, database_size);
+    do {
+        n = read_block(database_fd, buf, KPROP_STREAM_BUFSIZ);
+        if (n < 0) {
+            com_err(progname, errno, _("while reading database"));
+            send_error(context, my_creds, fd, "while reading database",
+                       KRB5KRB_ERR_GENERIC);
+            exit(1);
+        }
+
+        inbuf = make_data(buf, n);
+        retval = krb5_mk_priv(context, auth_context, &inbuf, &outbuf, NULL);
+        if (retval) {
+            snprintf(errbuf, sizeof(errbuf),
+                     "while encoding database block starting at %llu",
+                     (unsigned long long)sent_size);
+            com_err(progname, retval, "%s", errbuf);
+            send_error(context, my_creds, fd, errbuf, retval);
+            exit(1);
+        }
+
+        retval = krb5_write_message(context, &fd, &outbuf);
+        krb5_free_data_contents(context, &outbuf);
+        if (retval) {
+            com_err(progname, retval,
+                    _("while sending database block starting at %llu"),
+                    (unsigned long long)sent_size);
+            exit(1);
+        }
+        sent_size += n;
+        if (debug && n > 0)
+            printf("%llu bytes sent.\n", (unsigned long long)sent_size);
+    } while (n > 0);
+    free(buf);
+
+    read_confirmation(context, auth_context, fd, &outbuf);
+    if (outbuf.length != 8) {
+        com_err(progname, 0, _("Kpropd sent a malformed size packet"));
+        exit(1);
+    }
+    if (load_64_be(outbuf.data) != sent_size) {
+        com_err(progname, 0, _("Kpropd received %llu bytes, expecting %llu"),
+                (unsigned long long)load_64_be(outbuf.data),
+                (unsigned long long)sent_size);
         exit(1);
     }
-    free(inbuf.data);
     free(outbuf.data);
 }
 
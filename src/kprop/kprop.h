@@ -31,7 +31,18 @@
 
 #define KPROP_PROT_VERSION "kprop5_01"
 
+/*
+ * In the streaming protocol, the database is sent as a series of KRB_PRIV
+ * blocks terminated by an empty block, without sending its size first.  The
+ * replica loads the blocks as they arrive, but only makes the loaded database
+ * live once the empty block has been received; a connection which ends
+ * without it aborts the load.  The replica acknowledges the number of bytes
+ * received as a 64-bit big-endian integer in a KRB_SAFE message.
+ */
+#define KPROP_STREAM_PROT_VERSION "kprop5_02"
+
 #define KPROP_BUFSIZ 32768
+#define KPROP_STREAM_BUFSIZ (256 * 1024)
 
 /* pathnames are in osconf.h, included via k5-int.h */
 
@@ -105,12 +105,16 @@ typedef struct _kadm5_iprop_handle_t {
     char *cache_name;
     int destroy_cache;
     CLIENT *clnt;
+    int client_socket;
     krb5_context context;
     kadm5_config_params params;
     struct _kadm5_iprop_handle_t *lhandle;
 } *kadm5_iprop_handle_t;
 
 static char *kprop_version = KPROP_PROT_VERSION;
+static char *kprop_stream_version = KPROP_STREAM_PROT_VERSION;
+static krb5_boolean stream_protocol;    /* client negotiated streaming */
+static pid_t load_pid = -1;             /* streamed load in progress */
 
 static kadm5_config_params params;
 
@@ -152,8 +156,16 @@ static void kerberos_authenticate(krb5_context context, int fd,
 static krb5_boolean authorized_principal(krb5_context context,
                                          krb5_principal p,
                                          krb5_enctype auth_etype);
+static int write_all(int fd, const char *buf, size_t len);
+static void abort_load(int load_fd);
+static void recv_stream(krb5_context context, int fd, int database_fd,
+                        int load_fd, krb5_data *confmsg);
 static void recv_database(krb5_context context, int fd, int database_fd,
                           krb5_data *confmsg);
+static pid_t start_load(krb5_context context, char *kdb_util,
+                        char *database_file_name, int *load_fd_out,
+                        int *end_fd_out);
+static void finish_load(char *kdb_util, pid_t child_pid);
 static void load_database(krb5_context context, char *kdb_util,
                           char *database_file_name);
 static void send_error(krb5_context context, int fd, krb5_error_code err_code,
@@ -213,6 +225,10 @@ alarm_handler(int sig)
 {
     static char *timeout_msg = "Full propagation timed out\n";
 
+    /* Don't let a streamed load mistake the end of its input for the end of
+     * the dump. */
+    if (load_pid > 0)
+        kill(load_pid, SIGKILL);
     write(STDERR_FILENO, timeout_msg, strlen(timeout_msg));
     exit(1);
 }
@@ -486,7 +502,7 @@ doit(int fd)
     int lock_fd;
     mode_t omask;
     krb5_enctype etype;
-    int database_fd;
+    int database_fd, load_fd, end_fd;
     char host[INET6_ADDRSTRLEN + 1];
 
     signal_wrapper(SIGALRM, alarm_handler);
@@ -559,19 +575,46 @@ doit(int fd)
                 temp_file_name);
         exit(1);
     }
-    recv_database(kpropd_context, fd, database_fd, &confmsg);
-    if (rename(temp_file_name, file)) {
-        com_err(progname, errno, _("while renaming %s to %s"),
-                temp_file_name, file);
-        exit(1);
-    }
-    retval = krb5_lock_file(kpropd_context, lock_fd, KRB5_LOCKMODE_SHARED);
-    if (retval) {
-        com_err(progname, retval, _("while downgrading lock on '%s'"),
-                temp_file_name);
-        exit(1);
+    if (stream_protocol) {
+        /* Load the database as it arrives, while also saving it to the dump
+         * file. */
+        if (debug)
+            fprintf(stderr, _("Using streamed full propagation.\n"));
+        load_pid = start_load(kpropd_context, kdb5_util, "-", &load_fd,
+                              &end_fd);
+        recv_stream(kpropd_context, fd, database_fd, load_fd, &confmsg);
+        /* The whole dump has arrived; let the loader make it live. */
+        if (write_all(end_fd, "", 1)) {
+            com_err(progname, errno, _("while confirming end of dump to %s"),
+                    kdb5_util);
+            abort_load(load_fd);
+            exit(1);
+        }
+        close(end_fd);
+        close(load_fd);
+        finish_load(kdb5_util, load_pid);
+        load_pid = -1;
+        if (rename(temp_file_name, file)) {
+            com_err(progname, errno, _("while renaming %s to %s"),
+                    temp_file_name, file);
+            exit(1);
+        }
+    } else {
+        recv_database(kpropd_context, fd, database_fd, &confmsg);
+        if (rename(temp_file_name, file)) {
+            com_err(progname, errno, _("while renaming %s to %s"),
+                    temp_file_name, file);
+            exit(1);
+        }
+        retval = krb5_lock_file(kpropd_context, lock_fd,
+                                KRB5_LOCKMODE_SHARED);
+        if (retval) {
+            com_err(progname, retval, _("while downgrading lock on '%s'"),
+                    temp_file_name);
+            exit(1);
+        }
+        load_database(kpropd_context, kdb5_util, file);
     }
-    load_database(kpropd_context, kdb5_util, file);
     retval = krb5_lock_file(kpropd_context, lock_fd, KRB5_LOCKMODE_UNLOCK);
     if (retval) {
         com_err(progname, retval, _("while unlocking '%s'"), temp_file_name);
@@ -606,7 +649,7 @@ static kdb_fullresync_result_t *
 full_resync(CLIENT *clnt)
 {
     static kdb_fullresync_result_t clnt_res;
-    uint32_t vers = IPROPX_VERSION_1; /* max version we support */
+    uint32_t vers = IPROPX_VERSION; /* max version we support */
     enum clnt_stat status;
 
     memset(&clnt_res, 0, sizeof(clnt_res));
@@ -623,6 +666,60 @@ full_resync(CLIENT *clnt)
     return (status == RPC_SUCCESS) ? &clnt_res : NULL;
 }
 
+/* Return true if the master implements IPROP_WAIT_UPDATES. */
+static krb5_boolean
+master_can_wait(CLIENT *clnt, kdb_last_t *last)
+{
+    kdb_incr_result_t res;
+    kdb_wait_t arg;
+    enum clnt_stat status;
+
+    /* With a zero timeout, the master answers immediately. */
+    memset(&res, 0, sizeof(res));
+    arg.last = *last;
+    arg.timeout = 0;
+    status = clnt_call(clnt, IPROP_WAIT_UPDATES, (xdrproc_t)xdr_kdb_wait_t,
+                       &arg, (xdrproc_t)xdr_kdb_incr_result_t, &res,
+                       full_resync_timeout);
+    if (status == RPC_SUCCESS)
+        xdr_free((xdrproc_t)xdr_kdb_incr_result_t, (char *)&res);
+    return status != RPC_PROCUNAVAIL;
+}
+
+/*
+ * Ask the master to answer as soon as it records updates past *last, and wait
+ * up to timeout seconds for the answer to arrive on fd.  The answer is never
+ * read: our next iprop_get_updates_1() call supersedes the parked request on
+ * the master, and the RPC client skips the stale reply because its xid does
+ * not match.  Unlike a blocking clnt_call(), the wait can be cut short with
+ * SIGUSR1.  Return false if the request could not be sent.
+ */
+static krb5_boolean
+wait_for_updates(CLIENT *clnt, int fd, kdb_last_t *last, unsigned int timeout)
+{
+    struct timeval no_reply = { 0, 0 }, tv;
+    kdb_incr_result_t res;
+    kdb_wait_t arg;
+    fd_set rfds;
+
+    arg.last = *last;
+    arg.timeout = timeout;
+
+    /* A zero timeout makes clnt_call() send the request without waiting for
+     * the reply. */
+    if (clnt_call(clnt, IPROP_WAIT_UPDATES, (xdrproc_t)xdr_kdb_wait_t, &arg,
+                  (xdrproc_t)xdr_kdb_incr_result_t, &res,
+                  no_reply) != RPC_TIMEDOUT)
+        return FALSE;
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    tv.tv_sec = timeout;
+    tv.tv_usec = 0;
+    (void)select(fd + 1, &rfds, NULL, NULL, &tv);
+    return TRUE;
+}
+
 /*
  * Beg for incrementals from the KDC.
  *
@@ -641,6 +738,7 @@ do_iprop()
     struct timeval iprop_start, iprop_end;
     unsigned long usec;
     time_t frrequested = 0, now;
+    int can_wait;
     kdb_incr_result_t *incr_ret;
     kdb_last_t mylast;
     kdb_fullresync_result_t *full_ret;
@@ -751,6 +849,7 @@ reinit:
      * Reset re-initialization count to zero now.
      */
     reinit_cnt = backoff_time = 0;
+    can_wait = -1;
 
     /*
      * Reset the handle to the correct type for the RPC call
@@ -974,6 +1073,42 @@ reinit:
                         backoff_time);
             }
             sleep(backoff_time);
+        } else if (can_wait != 0 && (incr_ret->ret == UPDATE_NIL ||
+                                     incr_ret->ret == UPDATE_OK)) {
+            /*
+             * We are in sync (or have just applied all the updates the
+             * master gave us), so instead of sleeping for the poll interval,
+             * ask the master to tell us as soon as it has anything newer.
+             */
+            retval = ulog_get_last(kpropd_context, &mylast);
+            if (retval) {
+                com_err(progname, retval, _("reading update log header"));
+                goto done;
+            }
+            if (can_wait == -1)
+                can_wait = master_can_wait(handle->clnt, &mylast);
+            if (can_wait) {
+                if (debug) {
+                    fprintf(stderr, _("Waiting for up to %d seconds for "
+                                      "updates from master\n"), pollin);
+                }
+                if (!wait_for_updates(handle->clnt, handle->client_socket,
+                                      &mylast, pollin)) {
+                    clnt_perror(handle->clnt,
+                                _("iprop_wait_updates call failed"));
+                    kadm5_destroy(server_handle);
+                    server_handle = NULL;
+                    handle = NULL;
+                    goto reinit;
+                }
+            } else {
+                if (debug) {
+                    fprintf(stderr, _("Waiting for %d seconds before "
+                                      "checking for updates again\n"),
+                            pollin);
+                }
+                sleep(pollin);
+            }
         } else {
             if (debug) {
                 fprintf(stderr, _("Waiting for %d seconds before checking "
@@ -1188,6 +1323,7 @@ kerberos_authenticate(krb5_context context, int fd, krb5_principal *clientp,
     struct sockaddr_storage r_sin;
     GETSOCKNAME_ARG3_TYPE sin_length;
     krb5_keytab keytab = NULL;
+    krb5_data version;
     char *name, etypebuf[100];
 
     /* Set recv_addr and send_addr. */
@@ -1209,8 +1345,8 @@ kerberos_authenticate(krb5_context context, int fd, krb5_principal *clientp,
             com_err(progname, retval, _("while unparsing client name"));
             exit(1);
         }
-        fprintf(stderr, "krb5_recvauth(%d, %s, %s, ...)\n", fd, kprop_version,
-                name);
+        fprintf(stderr, "krb5_recvauth(%d, %s|%s, %s, ...)\n", fd,
+                kprop_version, kprop_stream_version, name);
         free(name);
     }
 
@@ -1246,14 +1382,25 @@ kerberos_authenticate(krb5_context context, int fd, krb5_principal *clientp,
         }
     }
 
-    retval = krb5_recvauth(context, &auth_context, &fd, kprop_version, server,
-                           0, keytab, &ticket);
+    retval = krb5_recvauth_version(context, &auth_context, &fd, server, 0,
+                                   keytab, &ticket, &version);
     if (retval) {
         syslog(LOG_ERR, _("Error in krb5_recvauth: %s"),
                error_message(retval));
         exit(1);
     }
 
+    /* Accept either the original or the streaming protocol. */
+    if (version.length == strlen(kprop_stream_version) + 1 &&
+        memcmp(version.data, kprop_stream_version, version.length) == 0) {
+        stream_protocol = TRUE;
+    } else if (version.length != strlen(kprop_version) + 1 ||
+               memcmp(version.data, kprop_version, version.length) != 0) {
+        syslog(LOG_ERR, _("Unsupported kprop protocol version"));
+        exit(1);
+    }
+    krb5_free_data_contents(context, &version);
+
     retval = krb5_copy_principal(context, ticket->enc_part2->client, clientp);
     if (retval) {
         syslog(LOG_ERR, _("Error in krb5_copy_prinicpal: %s"),
@@ -1452,6 +1599,134 @@ recv_database(krb5_context context, int fd, int database_fd,
     }
 }
 
+/* Write len bytes from buf to fd.  Return 0 on success, -1 on failure. */
+static int
+write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Stop the streamed load process after a failed transfer. */
+static void
+abort_load(int load_fd)
+{
+    kill(load_pid, SIGKILL);
+    close(load_fd);
+    (void)waitpid(load_pid, NULL, 0);
+    load_pid = -1;
+    if (debug) {
+        fprintf(stderr,
+                _("Database load process for full propagation aborted.\n"));
+    }
+}
+
+/*
+ * Receive the database using the streaming protocol.  Write each block to
+ * database_fd and to load_fd (the standard input of the loading process) as
+ * it arrives, until an empty block marks the end of the stream.  Create the
+ * acknowledgement message in *confmsg, to be sent after the load completes.
+ */
+static void
+recv_stream(krb5_context context, int fd, int database_fd, int load_fd,
+            krb5_data *confmsg)
+{
+    uint64_t received_size = 0;
+    unsigned char sizebuf[8];
+    char buf[1024];
+    krb5_data inbuf, outbuf;
+    krb5_error_code retval;
+    krb5_boolean done = FALSE;
+
+    /* Report a failure of the loading process as an error rather than being
+     * killed by SIGPIPE. */
+    signal_wrapper(SIGPIPE, SIG_IGN);
+
+    retval = krb5_auth_con_initivector(context, auth_context);
+    if (retval) {
+        send_error(context, fd, retval,
+                   "failed while initializing i_vector");
+        com_err(progname, retval, _("while initializing i_vector"));
+        abort_load(load_fd);
+        exit(1);
+    }
+
+    if (debug)
+        fprintf(stderr, _("Full propagation transfer started.\n"));
+
+    while (!done) {
+        retval = krb5_read_message(context, &fd, &inbuf);
+        if (retval) {
+            snprintf(buf, sizeof(buf),
+                     "while reading database block starting at offset %llu",
+                     (unsigned long long)received_size);
+            com_err(progname, retval, "%s", buf);
+            abort_load(load_fd);
+            send_error(context, fd, retval, buf);
+            exit(1);
+        }
+        if (krb5_is_krb_error(&inbuf)) {
+            abort_load(load_fd);
+            recv_error(context, &inbuf);
+        }
+        retval = krb5_rd_priv(context, auth_context, &inbuf, &outbuf, NULL);
+        krb5_free_data_contents(context, &inbuf);
+        if (retval) {
+            snprintf(buf, sizeof(buf),
+                     "while decoding database block starting at offset %llu",
+                     (unsigned long long)received_size);
+            com_err(progname, retval, "%s", buf);
+            abort_load(load_fd);
+            send_error(context, fd, retval, buf);
+            exit(1);
+        }
+
+        if (outbuf.length == 0) {
+            done = TRUE;
+        } else if (write_all(database_fd, outbuf.data, outbuf.length) ||
+                   write_all(load_fd, outbuf.data, outbuf.length)) {
+            retval = errno;
+            snprintf(buf, sizeof(buf),
+                     "while writing database block starting at offset %llu",
+                     (unsigned long long)received_size);
+            com_err(progname, retval, "%s", buf);
+            abort_load(load_fd);
+            send_error(context, fd, retval, buf);
+            exit(1);
+        }
+        received_size += outbuf.length;
+        krb5_free_data_contents(context, &outbuf);
+        if (debug && !done) {
+            fprintf(stderr, "%llu bytes received.\n",
+                    (unsigned long long)received_size);
+        }
+    }
+
+    if (debug)
+        fprintf(stderr, _("Full propagation transfer finished.\n"));
+
+    /* Create message acknowledging number of bytes received, but
+     * don't send it until kdb5_util returns successfully. */
+    store_64_be(received_size, sizebuf);
+    inbuf = make_data(sizebuf, sizeof(sizebuf));
+    retval = krb5_mk_safe(context, auth_context, &inbuf, confmsg, NULL);
+    if (retval) {
+        com_err(progname, retval, "while encoding # of receieved bytes");
+        abort_load(load_fd);
+        send_error(context, fd, retval, "while encoding # of received bytes");
+        exit(1);
+    }
+}
 
 static void
 send_error(krb5_context context, int fd, krb5_error_code err_code,
@@ -1517,22 +1792,22 @@ recv_error(krb5_context context, krb5_data *inbuf)
     exit(1);
 }
 
-static void
-load_database(krb5_context context, char *kdb_util, char *database_file_name)
+/*
+ * Start kdb_util to load database_file_name, returning the process ID.  If
+ * load_fd_out is not NULL, database_file_name should be "-", and *load_fd_out
+ * is set to a pipe to the standard input of the loading process.  *end_fd_out
+ * is then set to a pipe on which a byte must be written once the whole dump
+ * has been written; the loading process fails without making the database
+ * live if this pipe is closed without it.
+ */
+static pid_t
+start_load(krb5_context context, char *kdb_util, char *database_file_name,
+           int *load_fd_out, int *end_fd_out)
 {
-    static char *edit_av[10];
-    int error_ret, child_pid, count;
-
-    /* <sys/param.h> has been included, so BSD will be defined on
-     * BSD systems. */
-#if BSD > 0 && BSD <= 43
-#ifndef WEXITSTATUS
-#define WEXITSTATUS(w) (w).w_retcode
-#endif
-    union wait waitb;
-#else
-    int waitb;
-#endif
+    static char *edit_av[12];
+    static char end_fd_str[16];
+    int count, pipefds[2], endfds[2];
+    pid_t child_pid;
     kdb_log_context *log_ctx;
 
     if (debug)
@@ -1553,6 +1828,16 @@ load_database(krb5_context context, char *kdb_util, char *database_file_name)
     }
     if (log_ctx && log_ctx->iproprole == IPROP_REPLICA)
         edit_av[count++] = "-i";
+    if (load_fd_out != NULL) {
+        if (pipe(pipefds) != 0 || pipe(endfds) != 0) {
+            com_err(progname, errno, _("while creating pipe for %s"),
+                    kdb_util);
+            exit(1);
+        }
+        snprintf(end_fd_str, sizeof(end_fd_str), "%d", endfds[0]);
+        edit_av[count++] = "-endfd";
+        edit_av[count++] = end_fd_str;
+    }
     edit_av[count++] = database_file_name;
     edit_av[count++] = NULL;
 
@@ -1561,17 +1846,56 @@ load_database(krb5_context context, char *kdb_util, char *database_file_name)
         com_err(progname, errno, _("while trying to fork %s"), kdb_util);
         exit(1);
     case 0:
+        if (load_fd_out != NULL) {
+            if (dup2(pipefds[0], STDIN_FILENO) < 0)
+                _exit(1);
+            close(pipefds[0]);
+            close(pipefds[1]);
+            close(endfds[1]);
+        }
         execv(kdb_util, edit_av);
         com_err(progname, errno, _("while trying to exec %s"), kdb_util);
         _exit(1);
         /*NOTREACHED*/
     default:
         if (debug)
-            fprintf(stderr, "Load PID is %d\n", child_pid);
-        if (wait(&waitb) < 0) {
-            com_err(progname, errno, _("while waiting for %s"), kdb_util);
-            exit(1);
-        }
+            fprintf(stderr, "Load PID is %d\n", (int)child_pid);
+    }
+
+    if (load_fd_out != NULL) {
+        close(pipefds[0]);
+        close(endfds[0]);
+        *load_fd_out = pipefds[1];
+        *end_fd_out = endfds[1];
+    }
+    return child_pid;
+}
+
+/* Wait for the loading process started by start_load() and exit if it
+ * failed. */
+static void
+finish_load(char *kdb_util, pid_t child_pid)
+{
+    int error_ret;
+    pid_t pid;
+
+    /* <sys/param.h> has been included, so BSD will be defined on
+     * BSD systems. */
+#if BSD > 0 && BSD <= 43
+#ifndef WEXITSTATUS
+#define WEXITSTATUS(w) (w).w_retcode
+#endif
+    union wait waitb;
+#else
+    int waitb;
+#endif
+
+    do {
+        pid = wait(&waitb);
+    } while (pid >= 0 && pid != child_pid);
+    if (pid < 0) {
+        com_err(progname, errno, _("while waiting for %s"), kdb_util);
+        exit(1);
     }
 
     if (!WIFEXITED(waitb)) {
@@ -1585,7 +1909,13 @@ load_database(krb5_context context, char *kdb_util, char *database_file_name)
                 kdb_util, error_ret);
         exit(1);
     }
-    return;
+}
+
+static void
+load_database(krb5_context context, char *kdb_util, char *database_file_name)
+{
+    finish_load(kdb_util, start_load(context, kdb_util, database_file_name,
+                                     NULL, NULL));
 }
 
 /*
@@ -363,11 +363,22 @@ kadm5_ret_t    kadm5_create_principal_3(void *server_handle,
                                         int n_ks_tuple,
                                         krb5_key_salt_tuple *ks_tuple,
                                         char *pass);
+kadm5_ret_t    kadm5_create_principals(void *server_handle, int count,
+                                       kadm5_principal_ent_t ents,
+                                       long *masks,
+                                       int n_ks_tuple,
+                                       krb5_key_salt_tuple *ks_tuple,
+                                       char **passes,
+                                       kadm5_ret_t *results);
 kadm5_ret_t    kadm5_delete_principal(void *server_handle,
                                       krb5_principal principal);
 kadm5_ret_t    kadm5_modify_principal(void *server_handle,
                                       kadm5_principal_ent_t ent,
                                       long mask);
+kadm5_ret_t    kadm5_modify_principals(void *server_handle, int count,
+                                       kadm5_principal_ent_t ents,
+                                       long *masks,
+                                       kadm5_ret_t *results);
 kadm5_ret_t    kadm5_rename_principal(void *server_handle,
                                       krb5_principal,krb5_principal);
 kadm5_ret_t    kadm5_get_principal(void *server_handle,
@@ -451,6 +462,16 @@ kadm5_ret_t    kadm5_get_principals(void *server_handle,
                                     char *exp, char ***princs,
                                     int *count);
 
+/*
+ * Get up to max principal names matching exp which sort after start (or from
+ * the beginning if start is NULL), in sorted order.  Set *more if there are
+ * further matching names; pass the last name returned as start to get them.
+ */
+kadm5_ret_t    kadm5_get_principals_page(void *server_handle,
+                                         char *exp, char *start, int max,
+                                         char ***princs, int *count,
+                                         krb5_boolean *more);
+
 kadm5_ret_t    kadm5_get_policies(void *server_handle,
                                   char *exp, char ***pols,
                                   int *count);
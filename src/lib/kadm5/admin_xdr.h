@@ -71,3 +71,8 @@ bool_t      xdr_osa_pw_hist_ent(XDR *xdrs, osa_pw_hist_ent *objp);
 bool_t      xdr_kadm5_key_data(XDR *xdrs, kadm5_key_data *objp);
 bool_t      xdr_getpkeys_arg(XDR *xdrs, getpkeys_arg *objp);
 bool_t      xdr_getpkeys_ret(XDR *xdrs, getpkeys_ret *objp);
+bool_t      xdr_cprincs_arg(XDR *xdrs, cprincs_arg *objp);
+bool_t      xdr_mprincs_arg(XDR *xdrs, mprincs_arg *objp);
+bool_t      xdr_princs_ret(XDR *xdrs, princs_ret *objp);
+bool_t      xdr_gprincs_page_arg(XDR *xdrs, gprincs_page_arg *objp);
+bool_t      xdr_gprincs_page_ret(XDR *xdrs, gprincs_page_ret *objp);
@@ -101,6 +101,91 @@ kadm5_create_principal_3(void *server_handle,
     return r.code;
 }
 
+/* Copy princ to *out, leaving out the fields which mask does not select. */
+static void
+copy_masked_rec(kadm5_principal_ent_t princ, long mask,
+                kadm5_principal_ent_t out)
+{
+    memcpy(out, princ, sizeof(*out));
+    out->mod_name = NULL;
+    if (!(mask & KADM5_POLICY))
+        out->policy = NULL;
+    if (!(mask & KADM5_KEY_DATA)) {
+        out->n_key_data = 0;
+        out->key_data = NULL;
+    }
+    if (!(mask & KADM5_TL_DATA)) {
+        out->n_tl_data = 0;
+        out->tl_data = NULL;
+    }
+}
+
+/* Copy the per-principal results of a batch operation from r to results. */
+static kadm5_ret_t
+copy_results(princs_ret *r, int count, kadm5_ret_t *results)
+{
+    kadm5_ret_t ret = r->code;
+
+    if (ret == 0 && r->n_codes != count)
+        ret = KADM5_RPC_ERROR;
+    if (ret == 0)
+        memcpy(results, r->codes, count * sizeof(*results));
+    free(r->codes);
+    return ret;
+}
+
+kadm5_ret_t
+kadm5_create_principals(void *server_handle, int count,
+                        kadm5_principal_ent_t princs, long *masks,
+                        int n_ks_tuple, krb5_key_salt_tuple *ks_tuple,
+                        char **pws, kadm5_ret_t *results)
+{
+    cprincs_arg         arg;
+    princs_ret          r;
+    enum clnt_stat      stat;
+    kadm5_server_handle_t handle = server_handle;
+    int                 i;
+
+    CHECK_HANDLE(server_handle);
+
+    if (count < 0 || (count > 0 && (princs == NULL || masks == NULL ||
+                                    results == NULL)))
+        return EINVAL;
+    if (count == 0)
+        return 0;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.api_version = handle->api_version;
+    arg.n_ks_tuple = n_ks_tuple;
+    arg.ks_tuple = ks_tuple;
+    arg.ents = calloc(count, sizeof(*arg.ents));
+    if (arg.ents == NULL)
+        return ENOMEM;
+    arg.n_ents = count;
+    for (i = 0; i < count; i++) {
+        copy_masked_rec(&princs[i], masks[i], &arg.ents[i].rec);
+        arg.ents[i].mask = masks[i];
+        arg.ents[i].passwd = (pws == NULL) ? NULL : pws[i];
+    }
+
+    memset(&r, 0, sizeof(r));
+    stat = create_principals_2(&arg, &r, handle->clnt);
+    free(arg.ents);
+    if (stat == RPC_PROCUNAVAIL) {
+        /* The server predates batch operations; go one at a time. */
+        for (i = 0; i < count; i++) {
+            results[i] = kadm5_create_principal_3(server_handle, &princs[i],
+                                                  masks[i], n_ks_tuple,
+                                                  ks_tuple, (pws == NULL) ?
+                                                  NULL : pws[i]);
+        }
+        return 0;
+    }
+    if (stat)
+        eret();
+    return copy_results(&r, count, results);
+}
+
 kadm5_ret_t
 kadm5_delete_principal(void *server_handle, krb5_principal principal)
 {
@@ -206,6 +291,129 @@ kadm5_get_principals(void *server_handle,
     return r.code;
 }
 
+static int
+compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Emulate kadm5_get_principals_page() for servers which predate it by
+ * retrieving all matching names and selecting a page from them. */
+static kadm5_ret_t
+get_principals_page_fallback(void *server_handle, char *exp, char *start,
+                             int max, char ***princs, int *count,
+                             krb5_boolean *more)
+{
+    kadm5_ret_t ret;
+    char **names;
+    int i, n, nkeep = 0;
+
+    ret = kadm5_get_principals(server_handle, exp, &names, &n);
+    if (ret)
+        return ret;
+    qsort(names, n, sizeof(*names), compare_names);
+    for (i = 0; i < n; i++) {
+        if (nkeep <= max && (start == NULL || strcmp(names[i], start) > 0))
+            names[nkeep++] = names[i];
+        else
+            free(names[i]);
+    }
+    if (nkeep > max) {
+        free(names[max]);
+        nkeep = max;
+        *more = TRUE;
+    }
+    *princs = names;
+    *count = nkeep;
+    return KADM5_OK;
+}
+
+kadm5_ret_t
+kadm5_get_principals_page(void *server_handle, char *exp, char *start,
+                          int max, char ***princs, int *count,
+                          krb5_boolean *more)
+{
+    gprincs_page_arg arg;
+    gprincs_page_ret r;
+    enum clnt_stat stat;
+    kadm5_server_handle_t handle = server_handle;
+
+    CHECK_HANDLE(server_handle);
+
+    if (princs == NULL || count == NULL || more == NULL)
+        return EINVAL;
+    *princs = NULL;
+    *count = 0;
+    *more = FALSE;
+    if (max <= 0)
+        return EINVAL;
+
+    arg.api_version = handle->api_version;
+    arg.exp = exp;
+    arg.start = start;
+    arg.max = max;
+    memset(&r, 0, sizeof(r));
+    stat = get_princs_page_2(&arg, &r, handle->clnt);
+    if (stat == RPC_PROCUNAVAIL) {
+        return get_principals_page_fallback(server_handle, exp, start, max,
+                                            princs, count, more);
+    }
+    if (stat)
+        eret();
+    if (r.code == 0) {
+        *princs = r.princs;
+        *count = r.count;
+        *more = r.more;
+    }
+    return r.code;
+}
+
+kadm5_ret_t
+kadm5_modify_principals(void *server_handle, int count,
+                        kadm5_principal_ent_t princs, long *masks,
+                        kadm5_ret_t *results)
+{
+    mprincs_arg         arg;
+    princs_ret          r;
+    enum clnt_stat      stat;
+    kadm5_server_handle_t handle = server_handle;
+    int                 i;
+
+    CHECK_HANDLE(server_handle);
+
+    if (count < 0 || (count > 0 && (princs == NULL || masks == NULL ||
+                                    results == NULL)))
+        return EINVAL;
+    if (count == 0)
+        return 0;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.api_version = handle->api_version;
+    arg.ents = calloc(count, sizeof(*arg.ents));
+    if (arg.ents == NULL)
+        return ENOMEM;
+    arg.n_ents = count;
+    for (i = 0; i < count; i++) {
+        copy_masked_rec(&princs[i], masks[i], &arg.ents[i].rec);
+        arg.ents[i].mask = masks[i];
+    }
+
+    memset(&r, 0, sizeof(r));
+    stat = modify_principals_2(&arg, &r, handle->clnt);
+    free(arg.ents);
+    if (stat == RPC_PROCUNAVAIL) {
+        /* The server predates batch operations; go one at a time. */
+        for (i = 0; i < count; i++) {
+            results[i] = kadm5_modify_principal(server_handle, &princs[i],
+                                                masks[i]);
+        }
+        return 0;
+    }
+    if (stat)
+        eret();
+    return copy_results(&r, count, results);
+}
+
 kadm5_ret_t
 kadm5_rename_principal(void *server_handle,
                        krb5_principal source, krb5_principal dest)
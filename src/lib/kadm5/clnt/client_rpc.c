@@ -211,3 +211,28 @@ get_principal_keys_2(getpkeys_arg *argp, getpkeys_ret *res, CLIENT *clnt)
 			 (xdrproc_t)xdr_getpkeys_arg, (caddr_t)argp,
 			 (xdrproc_t)xdr_getpkeys_ret, (caddr_t)res, TIMEOUT);
 }
+
+enum clnt_stat
+create_principals_2(cprincs_arg *argp, princs_ret *res, CLIENT *clnt)
+{
+	return clnt_call(clnt, CREATE_PRINCIPALS,
+			 (xdrproc_t)xdr_cprincs_arg, (caddr_t)argp,
+			 (xdrproc_t)xdr_princs_ret, (caddr_t)res, TIMEOUT);
+}
+
+enum clnt_stat
+modify_principals_2(mprincs_arg *argp, princs_ret *res, CLIENT *clnt)
+{
+	return clnt_call(clnt, MODIFY_PRINCIPALS,
+			 (xdrproc_t)xdr_mprincs_arg, (caddr_t)argp,
+			 (xdrproc_t)xdr_princs_ret, (caddr_t)res, TIMEOUT);
+}
+
+enum clnt_stat
+get_princs_page_2(gprincs_page_arg *argp, gprincs_page_ret *res,
+		  CLIENT *clnt)
+{
+	return clnt_call(clnt, GET_PRINCS_PAGE,
+			 (xdrproc_t)xdr_gprincs_page_arg, (caddr_t)argp,
+			 (xdrproc_t)xdr_gprincs_page_ret, (caddr_t)res, TIMEOUT);
+}
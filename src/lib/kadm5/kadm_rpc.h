@@ -246,6 +246,60 @@ struct getpkeys_ret {
 };
 typedef struct getpkeys_ret getpkeys_ret;
 
+struct cprincs_ent {
+	kadm5_principal_ent_rec rec;
+	long mask;
+	char *passwd;
+};
+typedef struct cprincs_ent cprincs_ent;
+
+struct cprincs_arg {
+	krb5_ui_4 api_version;
+	cprincs_ent *ents;
+	int n_ents;
+	int n_ks_tuple;
+	krb5_key_salt_tuple *ks_tuple;
+};
+typedef struct cprincs_arg cprincs_arg;
+
+struct mprincs_ent {
+	kadm5_principal_ent_rec rec;
+	long mask;
+};
+typedef struct mprincs_ent mprincs_ent;
+
+struct mprincs_arg {
+	krb5_ui_4 api_version;
+	mprincs_ent *ents;
+	int n_ents;
+};
+typedef struct mprincs_arg mprincs_arg;
+
+struct princs_ret {
+	krb5_ui_4 api_version;
+	kadm5_ret_t code;
+	kadm5_ret_t *codes;
+	int n_codes;
+};
+typedef struct princs_ret princs_ret;
+
+struct gprincs_page_arg {
+	krb5_ui_4 api_version;
+	char *exp;
+	char *start;
+	int max;
+};
+typedef struct gprincs_page_arg gprincs_page_arg;
+
+struct gprincs_page_ret {
+	krb5_ui_4 api_version;
+	kadm5_ret_t code;
+	char **princs;
+	int count;
+	bool_t more;
+};
+typedef struct gprincs_page_ret gprincs_page_ret;
+
 #define KADM 2112
 #define KADMVERS 2
 #define CREATE_PRINCIPAL 1
@@ -360,6 +414,21 @@ extern enum clnt_stat get_principal_keys_2(getpkeys_arg *, getpkeys_ret *,
 					   CLIENT *);
 extern  bool_t get_principal_keys_2_svc(getpkeys_arg *, getpkeys_ret *,
 					struct svc_req *);
+#define CREATE_PRINCIPALS 27
+extern  enum clnt_stat create_principals_2(cprincs_arg *, princs_ret *,
+					   CLIENT *);
+extern  bool_t create_principals_2_svc(cprincs_arg *, princs_ret *,
+				       struct svc_req *);
+#define MODIFY_PRINCIPALS 28
+extern  enum clnt_stat modify_principals_2(mprincs_arg *, princs_ret *,
+					   CLIENT *);
+extern  bool_t modify_principals_2_svc(mprincs_arg *, princs_ret *,
+				       struct svc_req *);
+#define GET_PRINCS_PAGE 29
+extern  enum clnt_stat get_princs_page_2(gprincs_page_arg *,
+					 gprincs_page_ret *, CLIENT *);
+extern  bool_t get_princs_page_2_svc(gprincs_page_arg *, gprincs_page_ret *,
+				     struct svc_req *);
 
 extern bool_t xdr_cprinc_arg ();
 extern bool_t xdr_cprinc3_arg ();
@@ -404,5 +473,10 @@ extern bool_t xdr_krb5_string_attr ();
 extern bool_t xdr_kadm5_key_data ();
 extern bool_t xdr_getpkeys_arg ();
 extern bool_t xdr_getpkeys_ret ();
+extern bool_t xdr_cprincs_arg ();
+extern bool_t xdr_mprincs_arg ();
+extern bool_t xdr_princs_ret ();
+extern bool_t xdr_gprincs_page_arg ();
+extern bool_t xdr_gprincs_page_ret ();
 
 #endif /* __KADM_RPC_H__ */
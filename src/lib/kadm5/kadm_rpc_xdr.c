@@ -1197,3 +1197,124 @@ xdr_getpkeys_ret(XDR *xdrs, getpkeys_ret *objp)
 	}
 	return TRUE;
 }
+
+static bool_t
+xdr_cprincs_ent(XDR *xdrs, cprincs_ent *objp)
+{
+	if (!_xdr_kadm5_principal_ent_rec(xdrs, &objp->rec,
+					  KADM5_API_VERSION_4)) {
+		return FALSE;
+	}
+	if (!xdr_long(xdrs, &objp->mask)) {
+		return FALSE;
+	}
+	if (!xdr_nullstring(xdrs, &objp->passwd)) {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_cprincs_arg(XDR *xdrs, cprincs_arg *objp)
+{
+	if (!xdr_ui_4(xdrs, &objp->api_version)) {
+		return FALSE;
+	}
+	if (!xdr_array(xdrs, (caddr_t *) &objp->ents,
+		       (unsigned int *) &objp->n_ents, ~0,
+		       sizeof(cprincs_ent), xdr_cprincs_ent)) {
+		return FALSE;
+	}
+	if (!xdr_array(xdrs, (caddr_t *) &objp->ks_tuple,
+		       (unsigned int *) &objp->n_ks_tuple, ~0,
+		       sizeof(krb5_key_salt_tuple), xdr_krb5_key_salt_tuple)) {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static bool_t
+xdr_mprincs_ent(XDR *xdrs, mprincs_ent *objp)
+{
+	if (!_xdr_kadm5_principal_ent_rec(xdrs, &objp->rec,
+					  KADM5_API_VERSION_4)) {
+		return FALSE;
+	}
+	if (!xdr_long(xdrs, &objp->mask)) {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_mprincs_arg(XDR *xdrs, mprincs_arg *objp)
+{
+	if (!xdr_ui_4(xdrs, &objp->api_version)) {
+		return FALSE;
+	}
+	if (!xdr_array(xdrs, (caddr_t *) &objp->ents,
+		       (unsigned int *) &objp->n_ents, ~0,
+		       sizeof(mprincs_ent), xdr_mprincs_ent)) {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_princs_ret(XDR *xdrs, princs_ret *objp)
+{
+	if (!xdr_ui_4(xdrs, &objp->api_version)) {
+		return FALSE;
+	}
+	if (!xdr_kadm5_ret_t(xdrs, &objp->code)) {
+		return FALSE;
+	}
+	if (objp->code == KADM5_OK) {
+		if (!xdr_array(xdrs, (caddr_t *) &objp->codes,
+			       (unsigned int *) &objp->n_codes, ~0,
+			       sizeof(kadm5_ret_t), xdr_kadm5_ret_t)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_gprincs_page_arg(XDR *xdrs, gprincs_page_arg *objp)
+{
+	if (!xdr_ui_4(xdrs, &objp->api_version)) {
+		return FALSE;
+	}
+	if (!xdr_nullstring(xdrs, &objp->exp)) {
+		return FALSE;
+	}
+	if (!xdr_nullstring(xdrs, &objp->start)) {
+		return FALSE;
+	}
+	if (!xdr_int(xdrs, &objp->max)) {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+bool_t
+xdr_gprincs_page_ret(XDR *xdrs, gprincs_page_ret *objp)
+{
+	if (!xdr_ui_4(xdrs, &objp->api_version)) {
+		return FALSE;
+	}
+	if (!xdr_kadm5_ret_t(xdrs, &objp->code)) {
+		return FALSE;
+	}
+	if (objp->code == KADM5_OK) {
+		if (!xdr_array(xdrs, (caddr_t *) &objp->princs,
+			       (unsigned int *) &objp->count, ~0,
+			       sizeof(char *), xdr_nullstring)) {
+			return FALSE;
+		}
+		if (!xdr_bool(xdrs, &objp->more)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
@@ -37,6 +37,9 @@
 #include <ctype.h>
 #include <syslog.h>
 #include <stdarg.h>
+#ifdef HAVE_PTHREAD
+#include <sys/uio.h>
+#endif
 
 #define KRB5_KLOG_MAX_ERRMSG_SIZE       2048
 #ifndef MAXHOSTNAMELEN
@@ -64,6 +67,8 @@
 #define log_notice_string       _("Notice")
 #define log_info_string         _("info")
 #define log_debug_string        _("debug")
+#define log_dropped_string      _("%lu log messages dropped")
+#define log_total_dropped_string _("%lu log messages dropped since startup")
 
 /*
  * Output logging.
@@ -147,6 +152,62 @@ static struct log_control log_control = {
 };
 static struct log_entry def_log_entry;
 
+/* Serializes log output and reopening, for multithreaded callers. */
+static k5_mutex_t log_lock = K5_MUTEX_PARTIAL_INITIALIZER;
+
+#ifdef HAVE_PTHREAD
+/*
+ * Asynchronous logging.  If [logging]->async is set, klog_vsyslog() copies
+ * each formatted message into a bounded ring buffer, and a flusher thread
+ * writes the buffered messages to the logging specifications in batches, so
+ * that a slow log file or syslog socket does not stall the caller.  When the
+ * ring is full, messages are dropped and counted, and the flusher logs the
+ * count with its next batch.
+ */
+#define LOG_RING_SIZE   (256 * 1024)
+#define LOG_BATCH       64
+#define LOG_ALIGN(n)    (((n) + 7) & ~(size_t)7)
+
+/* A ring record header, followed by the NUL-terminated formatted message.  A
+ * zero len marks unused space at the end of the ring. */
+struct log_rec {
+    size_t      len;
+    size_t      msglen;
+    size_t      syslog_off;
+    int         priority;
+};
+
+/* A message in a batch being written by the flusher thread. */
+struct log_line {
+    int         priority;
+    const char  *msg;
+    size_t      msglen;
+    const char  *syslogp;
+};
+
+static struct {
+    krb5_boolean        enabled;
+    krb5_boolean        running;
+    krb5_boolean        stopping;
+    krb5_boolean        hooks_set;
+    pthread_t           thread;
+    char                *ring;
+    size_t              head;
+    size_t              tail;
+    size_t              used;
+    unsigned long       dropped;
+    unsigned long       total_dropped;
+} log_async;
+
+/* ring_lock protects log_async.  It may be acquired before log_lock, but not
+ * after it. */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t drain_cond = PTHREAD_COND_INITIALIZER;
+
+static void stop_flusher(void);
+#endif /* HAVE_PTHREAD */
+
 /*
  * These macros define any special processing that needs to happen for
  * devices.  For unix, of course, this is hardly anything.
@@ -236,7 +297,7 @@ krb5_klog_init(krb5_context kcontext, char *ename, char *whoami, krb5_boolean do
     int         i, ngood, fd, append;
     char        *cp, *cp2;
     char        savec = '\0';
-    int         error, debug;
+    int         error, debug, async;
     int         do_openlog, log_facility;
     FILE        *f = NULL;
 
@@ -245,6 +306,9 @@ krb5_klog_init(krb5_context kcontext, char *ename, char *whoami, krb5_boolean do
     log_facility = 0;
 
     err_context = kcontext;
+    error = k5_mutex_finish_init(&log_lock);
+    if (error)
+        return error;
 
     /* Look up [logging]->debug in the profile to see if we should include
      * debug messages for types other than syslog.  Default to false. */
@@ -252,6 +316,17 @@ krb5_klog_init(krb5_context kcontext, char *ename, char *whoami, krb5_boolean do
                              KRB5_CONF_DEBUG, NULL, 0, &debug))
         log_control.log_debug = debug;
 
+#ifdef HAVE_PTHREAD
+    /* Look up [logging]->async to see if messages should be written by a
+     * background thread.  Default to false. */
+    if (!profile_get_boolean(kcontext->profile, KRB5_CONF_LOGGING,
+                             KRB5_CONF_ASYNC, NULL, 0, &async)) {
+        pthread_mutex_lock(&ring_lock);
+        log_async.enabled = async;
+        pthread_mutex_unlock(&ring_lock);
+    }
+#endif
+
     /*
      * Look up [logging]-><ename> in the profile.  If that doesn't
      * succeed, then look for [logging]->default.
@@ -535,6 +610,15 @@ krb5_klog_close(krb5_context kcontext)
 {
     int lindex;
     (void) reset_com_err_hook();
+#ifdef HAVE_PTHREAD
+    /* Write out any buffered messages, then log synchronously from here on. */
+    stop_flusher();
+    pthread_mutex_lock(&ring_lock);
+    log_async.enabled = FALSE;
+    free(log_async.ring);
+    log_async.ring = NULL;
+    pthread_mutex_unlock(&ring_lock);
+#endif
     for (lindex = 0; lindex < log_control.log_nentries; lindex++) {
         switch (log_control.log_entries[lindex].log_type) {
         case K_LOG_FILE:
@@ -617,65 +701,79 @@ severity2string(int severity)
 }
 
 /*
- * krb5_klog_syslog()   - Simulate the calling sequence of syslog(3), while
- *                        also performing the logging redirection as specified
- *                        by krb5_klog_init().
+ * Format a syslog-esque message of the format:
+ *
+ * (verbose form)
+ *          <date> <hostname> <id>[<pid>](<priority>): <message>
+ *
+ * (short form)
+ *          <date> <message>
+ *
+ * into outbuf, and set *syslogp to the start of <message>.
  */
 static int
-klog_vsyslog(int priority, const char *format, va_list arglist)
+klog_format(char *outbuf, size_t bufsize, char **syslogp, int priority,
+            const char *format, va_list arglist)
 #if !defined(__cplusplus) && (__GNUC__ > 2)
-    __attribute__((__format__(__printf__, 2, 0)))
+    __attribute__((__format__(__printf__, 5, 0)))
 #endif
     ;
 
 static int
-klog_vsyslog(int priority, const char *format, va_list arglist)
+klog_format(char *outbuf, size_t bufsize, char **syslogp, int priority,
+            const char *format, va_list arglist)
 {
-    char        outbuf[KRB5_KLOG_MAX_ERRMSG_SIZE];
-    int         lindex;
-    char        *syslogp;
     char        *cp;
     time_t      now;
     size_t      soff;
-    struct tm  *tm;
+    struct tm   *tm;
+#ifdef HAVE_LOCALTIME_R
+    struct tm   tmbuf;
+#endif
 
-    /*
-     * Format a syslog-esque message of the format:
-     *
-     * (verbose form)
-     *          <date> <hostname> <id>[<pid>](<priority>): <message>
-     *
-     * (short form)
-     *          <date> <message>
-     */
     cp = outbuf;
     (void) time(&now);
 
     /*
      * Format the date: mon dd hh:mm:ss
      */
+#ifdef HAVE_LOCALTIME_R
+    tm = localtime_r(&now, &tmbuf);
+#else
     tm = localtime(&now);
+#endif
     if (tm == NULL)
         return(-1);
-    soff = strftime(outbuf, sizeof(outbuf), "%b %d %H:%M:%S", tm);
+    soff = strftime(outbuf, bufsize, "%b %d %H:%M:%S", tm);
     if (soff > 0)
         cp += soff;
     else
         return(-1);
 
 #ifdef VERBOSE_LOGS
-    snprintf(cp, sizeof(outbuf) - (cp-outbuf), " %s %s[%ld](%s): ",
+    snprintf(cp, bufsize - (cp-outbuf), " %s %s[%ld](%s): ",
              log_control.log_hostname ? log_control.log_hostname : "",
              log_control.log_whoami ? log_control.log_whoami : "",
              (long) getpid(),
              severity2string(priority));
 #else
-    snprintf(cp, sizeof(outbuf) - (cp-outbuf), " ");
+    snprintf(cp, bufsize - (cp-outbuf), " ");
 #endif
-    syslogp = &outbuf[strlen(outbuf)];
+    *syslogp = &outbuf[strlen(outbuf)];
 
     /* Now format the actual message */
-    vsnprintf(syslogp, sizeof(outbuf) - (syslogp - outbuf), format, arglist);
+    vsnprintf(*syslogp, bufsize - (*syslogp - outbuf), format, arglist);
+    return(0);
+}
+
+/*
+ * Write a formatted message to each logging specification.  log_lock must be
+ * held.
+ */
+static void
+klog_write(int priority, const char *outbuf, const char *syslogp)
+{
+    int         lindex;
 
     /*
      * If the user did not use krb5_klog_init() instead of dropping
@@ -737,6 +835,333 @@ klog_vsyslog(int priority, const char *format, va_list arglist)
             break;
         }
     }
+}
+
+#ifdef HAVE_PTHREAD
+
+/* Format and write a message immediately.  log_lock must be held. */
+static void
+klog_write_now(int priority, const char *format, ...)
+#if !defined(__cplusplus) && (__GNUC__ > 2)
+    __attribute__((__format__(__printf__, 2, 3)))
+#endif
+    ;
+
+static void
+klog_write_now(int priority, const char *format, ...)
+{
+    char        outbuf[KRB5_KLOG_MAX_ERRMSG_SIZE];
+    char        *syslogp;
+    va_list     pvar;
+    int         ret;
+
+    va_start(pvar, format);
+    ret = klog_format(outbuf, sizeof(outbuf), &syslogp, priority, format,
+                      pvar);
+    va_end(pvar);
+    if (ret == 0)
+        klog_write(priority, outbuf, syslogp);
+}
+
+/*
+ * Write a batch of ring records to each logging specification, using one
+ * writev() per file or device.  log_lock must be held.
+ */
+static void
+write_lines(struct log_line *lines, int nlines)
+{
+    struct iovec        iov[LOG_BATCH * 2];
+    struct log_entry    *ent;
+    const char          *term;
+    FILE                *f;
+    int                 lindex, i, niov;
+
+    for (lindex = 0; lindex < log_control.log_nentries; lindex++) {
+        ent = &log_control.log_entries[lindex];
+        if (ent->log_type == K_LOG_SYSLOG) {
+            for (i = 0; i < nlines; i++)
+                syslog(lines[i].priority, "%s", lines[i].syslogp);
+            continue;
+        } else if (ent->log_type == K_LOG_FILE ||
+                   ent->log_type == K_LOG_STDERR) {
+            f = ent->lfu_filep;
+            term = "\n";
+        } else if (ent->log_type == K_LOG_CONSOLE ||
+                   ent->log_type == K_LOG_DEVICE) {
+            f = ent->ldu_filep;
+            term = "\r\n";
+        } else {
+            continue;
+        }
+
+        niov = 0;
+        for (i = 0; i < nlines; i++) {
+            if (lines[i].priority == LOG_DEBUG && !log_control.log_debug)
+                continue;
+            iov[niov].iov_base = (char *)lines[i].msg;
+            iov[niov++].iov_len = lines[i].msglen;
+            iov[niov].iov_base = (char *)term;
+            iov[niov++].iov_len = strlen(term);
+        }
+        if (niov == 0 || writev(fileno(f), iov, niov) >= 0)
+            continue;
+
+        /* Attempt to report error */
+        if (ent->log_type == K_LOG_FILE || ent->log_type == K_LOG_STDERR) {
+            fprintf(stderr, log_file_err, log_control.log_whoami,
+                    ent->lfu_fname);
+        } else {
+            fprintf(stderr, log_device_err, log_control.log_whoami,
+                    ent->ldu_devname);
+        }
+    }
+}
+
+/*
+ * Write records from the ring until asked to stop and the ring is empty.
+ * Records stay in the ring while they are being written, so producers cannot
+ * overwrite them; the head only advances after each batch.
+ */
+static void *
+flush_thread(void *arg)
+{
+    struct log_line     lines[LOG_BATCH];
+    struct log_rec      *rec;
+    size_t              pos, consumed;
+    unsigned long       dropped;
+    int                 n;
+
+    pthread_mutex_lock(&ring_lock);
+    for (;;) {
+        while (log_async.used == 0 && log_async.dropped == 0 &&
+               !log_async.stopping)
+            pthread_cond_wait(&ring_cond, &ring_lock);
+        if (log_async.used == 0 && log_async.dropped == 0)
+            break;
+
+        n = 0;
+        pos = log_async.head;
+        consumed = 0;
+        while (consumed < log_async.used && n < LOG_BATCH) {
+            rec = (struct log_rec *)(log_async.ring + pos);
+            if (LOG_RING_SIZE - pos < sizeof(*rec) || rec->len == 0) {
+                /* Skip the unused space at the end of the ring. */
+                consumed += LOG_RING_SIZE - pos;
+                pos = 0;
+                continue;
+            }
+            lines[n].priority = rec->priority;
+            lines[n].msg = (char *)(rec + 1);
+            lines[n].msglen = rec->msglen;
+            lines[n].syslogp = lines[n].msg + rec->syslog_off;
+            n++;
+            consumed += rec->len;
+            pos = (pos + rec->len) % LOG_RING_SIZE;
+        }
+        dropped = log_async.dropped;
+        log_async.dropped = 0;
+        pthread_mutex_unlock(&ring_lock);
+
+        k5_mutex_lock(&log_lock);
+        write_lines(lines, n);
+        if (dropped > 0)
+            klog_write_now(LOG_WARNING, log_dropped_string, dropped);
+        k5_mutex_unlock(&log_lock);
+
+        pthread_mutex_lock(&ring_lock);
+        log_async.head = pos;
+        log_async.used -= consumed;
+        if (log_async.used == 0)
+            pthread_cond_broadcast(&drain_cond);
+    }
+    pthread_mutex_unlock(&ring_lock);
+    return NULL;
+}
+
+/*
+ * Around fork(), let the flusher empty the ring so that buffered messages are
+ * written exactly once, and keep the locks held so that the child gets them
+ * in a consistent state.  The child has no flusher thread; it starts its own
+ * when it next logs.
+ */
+static void
+atfork_prepare(void)
+{
+    pthread_mutex_lock(&ring_lock);
+    while (log_async.running && log_async.used > 0)
+        pthread_cond_wait(&drain_cond, &ring_lock);
+    k5_mutex_lock(&log_lock);
+}
+
+static void
+atfork_parent(void)
+{
+    k5_mutex_unlock(&log_lock);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+static void
+atfork_child(void)
+{
+    log_async.running = FALSE;
+    log_async.stopping = FALSE;
+    k5_mutex_unlock(&log_lock);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+/* Write out buffered messages if the process exits without calling
+ * krb5_klog_close(). */
+static void
+flush_at_exit(void)
+{
+    stop_flusher();
+}
+
+/* Start the flusher thread for this process.  ring_lock must be held. */
+static int
+start_flusher(void)
+{
+    if (log_async.ring == NULL) {
+        log_async.ring = malloc(LOG_RING_SIZE);
+        if (log_async.ring == NULL)
+            return ENOMEM;
+        log_async.head = log_async.tail = log_async.used = 0;
+    }
+    if (!log_async.hooks_set) {
+        if (pthread_atfork(atfork_prepare, atfork_parent, atfork_child) != 0)
+            return EAGAIN;
+        atexit(flush_at_exit);
+        log_async.hooks_set = TRUE;
+    }
+    if (pthread_create(&log_async.thread, NULL, flush_thread, NULL) != 0)
+        return EAGAIN;
+    log_async.running = TRUE;
+    return 0;
+}
+
+/*
+ * Ask the flusher thread to write out the ring and wait for it to exit, then
+ * log the number of messages dropped over its lifetime.
+ */
+static void
+stop_flusher(void)
+{
+    unsigned long total;
+
+    pthread_mutex_lock(&ring_lock);
+    if (!log_async.running) {
+        pthread_mutex_unlock(&ring_lock);
+        return;
+    }
+    log_async.stopping = TRUE;
+    pthread_cond_signal(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+
+    pthread_join(log_async.thread, NULL);
+
+    pthread_mutex_lock(&ring_lock);
+    log_async.running = FALSE;
+    log_async.stopping = FALSE;
+    total = log_async.total_dropped;
+    log_async.total_dropped = 0;
+    pthread_mutex_unlock(&ring_lock);
+
+    if (total > 0) {
+        k5_mutex_lock(&log_lock);
+        klog_write_now(LOG_WARNING, log_total_dropped_string, total);
+        k5_mutex_unlock(&log_lock);
+    }
+}
+
+/*
+ * Copy a formatted message into the ring for the flusher thread, starting the
+ * thread if necessary.  If the ring is full, drop the message and count it.
+ * Return 0 if the message was queued or dropped, or -1 if the caller should
+ * write it synchronously.
+ */
+static int
+klog_enqueue(int priority, const char *outbuf, const char *syslogp)
+{
+    struct log_rec      *rec;
+    size_t              msglen, len, pad = 0;
+
+    msglen = strlen(outbuf);
+    len = LOG_ALIGN(sizeof(*rec) + msglen + 1);
+
+    pthread_mutex_lock(&ring_lock);
+    if (!log_async.enabled || log_async.stopping) {
+        pthread_mutex_unlock(&ring_lock);
+        return -1;
+    }
+    if (!log_async.running && start_flusher() != 0) {
+        /* Fall back to synchronous logging for good. */
+        log_async.enabled = FALSE;
+        pthread_mutex_unlock(&ring_lock);
+        return -1;
+    }
+
+    /* Records are contiguous; wrap early if this one won't fit at the end. */
+    if (log_async.tail + len > LOG_RING_SIZE)
+        pad = LOG_RING_SIZE - log_async.tail;
+    if (log_async.used + pad + len > LOG_RING_SIZE) {
+        log_async.dropped++;
+        log_async.total_dropped++;
+        pthread_mutex_unlock(&ring_lock);
+        return 0;
+    }
+    if (pad > 0) {
+        if (pad >= sizeof(*rec))
+            ((struct log_rec *)(log_async.ring + log_async.tail))->len = 0;
+        log_async.used += pad;
+        log_async.tail = 0;
+    }
+
+    rec = (struct log_rec *)(log_async.ring + log_async.tail);
+    rec->len = len;
+    rec->msglen = msglen;
+    rec->syslog_off = syslogp - outbuf;
+    rec->priority = priority;
+    memcpy(rec + 1, outbuf, msglen + 1);
+    log_async.tail = (log_async.tail + len) % LOG_RING_SIZE;
+    log_async.used += len;
+
+    pthread_cond_signal(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+    return 0;
+}
+
+#endif /* HAVE_PTHREAD */
+
+/*
+ * krb5_klog_syslog()   - Simulate the calling sequence of syslog(3), while
+ *                        also performing the logging redirection as specified
+ *                        by krb5_klog_init().
+ */
+static int
+klog_vsyslog(int priority, const char *format, va_list arglist)
+#if !defined(__cplusplus) && (__GNUC__ > 2)
+    __attribute__((__format__(__printf__, 2, 0)))
+#endif
+    ;
+
+static int
+klog_vsyslog(int priority, const char *format, va_list arglist)
+{
+    char        outbuf[KRB5_KLOG_MAX_ERRMSG_SIZE];
+    char        *syslogp;
+
+    if (klog_format(outbuf, sizeof(outbuf), &syslogp, priority, format,
+                    arglist) != 0)
+        return(-1);
+
+#ifdef HAVE_PTHREAD
+    if (klog_enqueue(priority, outbuf, syslogp) == 0)
+        return(0);
+#endif
+
+    k5_mutex_lock(&log_lock);
+    klog_write(priority, outbuf, syslogp);
+    k5_mutex_unlock(&log_lock);
     return(0);
 }
 
@@ -769,6 +1194,7 @@ krb5_klog_reopen(krb5_context kcontext)
      * Only logs which are actually files need to be closed
      * and reopened in response to a SIGHUP
      */
+    k5_mutex_lock(&log_lock);
     for (lindex = 0; lindex < log_control.log_nentries; lindex++) {
         if (log_control.log_entries[lindex].log_type == K_LOG_FILE) {
             fclose(log_control.log_entries[lindex].lfu_filep);
@@ -787,4 +1213,5 @@ krb5_klog_reopen(krb5_context kcontext)
             }
         }
     }
+    k5_mutex_unlock(&log_lock);
 }
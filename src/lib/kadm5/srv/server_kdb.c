@@ -440,7 +440,8 @@ kdb_iter_entry(kadm5_server_handle_t handle, char *match_entry,
     id.func = iter_fct;
     id.data = data;
 
-    ret = krb5_db_iterate(handle->context, match_entry, kdb_iter_func, &id, 0);
+    ret = krb5_db_iterate(handle->context, match_entry, kdb_iter_func, &id,
+                          KRB5_DB_ITER_NAMES_ONLY);
     if (ret)
         return(ret);
 
@@ -35,6 +35,9 @@ struct iter_data {
     int n_names, sz_names;
     unsigned int malloc_failed;
     char *exp;
+    const char *start;          /* only collect names after this one */
+    int max;                    /* if positive, keep the max + 1 lowest */
+    krb5_boolean full;          /* an ordered page iteration has max + 1 */
 #ifdef SOLARIS_REGEXPS
     char *expbuf;
 #endif
@@ -127,6 +130,55 @@ static kadm5_ret_t glob_to_regexp(char *glob, char *realm, char **regexp)
     return KADM5_OK;
 }
 
+/* Make room for one more name in data->names.  Return 0 on success, -1 on
+ * allocation failure. */
+static int grow_names(struct iter_data *data)
+{
+    int new_sz;
+    char **new_names;
+
+    if (data->n_names < data->sz_names)
+        return 0;
+    new_sz = data->sz_names * 2;
+    new_names = realloc(data->names, new_sz * sizeof(char *));
+    if (new_names == NULL)
+        return -1;
+    data->names = new_names;
+    data->sz_names = new_sz;
+    return 0;
+}
+
+/* Insert name into data->names in sorted order, discarding the highest name if
+ * there would be more than data->max + 1. */
+static void add_sorted(struct iter_data *data, char *name)
+{
+    int lo = 0, hi = data->n_names, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strcmp(data->names[mid], name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (data->n_names > data->max) {
+        if (lo == data->n_names) {
+            free(name);
+            return;
+        }
+        free(data->names[--data->n_names]);
+    }
+    if (grow_names(data) != 0) {
+        data->malloc_failed = 1;
+        free(name);
+        return;
+    }
+    memmove(&data->names[lo + 1], &data->names[lo],
+            (data->n_names - lo) * sizeof(char *));
+    data->names[lo] = name;
+    data->n_names++;
+}
+
 static void get_either_iter(struct iter_data *data, char *name)
 {
     int match;
@@ -139,19 +191,15 @@ static void get_either_iter(struct iter_data *data, char *name)
 #ifdef BSD_REGEXPS
     match = (re_exec(name) != 0);
 #endif
-    if (match) {
-        if (data->n_names == data->sz_names) {
-            int new_sz = data->sz_names * 2;
-            char **new_names = realloc(data->names,
-                                       new_sz * sizeof(char *));
-            if (new_names) {
-                data->names = new_names;
-                data->sz_names = new_sz;
-            } else {
-                data->malloc_failed = 1;
-                free(name);
-                return;
-            }
+    if (match && data->start != NULL && strcmp(name, data->start) <= 0)
+        match = 0;
+    if (match && data->max > 0) {
+        add_sorted(data, name);
+    } else if (match) {
+        if (grow_names(data) != 0) {
+            data->malloc_failed = 1;
+            free(name);
+            return;
         }
         data->names[data->n_names++] = name;
     } else
@@ -177,9 +225,25 @@ static void get_princs_iter(void *data, krb5_principal princ)
     get_either_iter(data, name);
 }
 
+/* Collect a name from an iteration in name order.  Once there is one more name
+ * than the page can hold, stop the iteration with an arbitrary error. */
+static krb5_error_code get_princs_page_iter(krb5_pointer data,
+                                            krb5_db_entry *entry)
+{
+    struct iter_data *id = data;
+
+    get_princs_iter(id, entry->princ);
+    if (id->n_names <= id->max)
+        return 0;
+    id->full = TRUE;
+    return ECANCELED;
+}
+
 static kadm5_ret_t kadm5_get_either(int princ,
                                     void *server_handle,
                                     char *exp,
+                                    const char *start,
+                                    int max,
                                     char ***princs,
                                     int *count)
 {
@@ -222,13 +286,27 @@ static kadm5_ret_t kadm5_get_either(int princ,
     data.n_names = 0;
     data.sz_names = 10;
     data.malloc_failed = 0;
+    data.start = start;
+    data.max = max;
+    data.full = FALSE;
     data.names = malloc(sizeof(char *) * data.sz_names);
     if (data.names == NULL) {
         free(regexp);
         return ENOMEM;
     }
 
-    if (princ) {
+    if (princ && max > 0) {
+        /* If the module can iterate in name order from start, each page
+         * visits only its own names. */
+        data.context = handle->context;
+        ret = krb5_db_iterate_from(handle->context, exp, start,
+                                   get_princs_page_iter, &data,
+                                   KRB5_DB_ITER_NAMES_ONLY);
+        if (data.full)
+            ret = 0;
+        else if (ret == KRB5_PLUGIN_OP_NOTSUPP)
+            ret = kdb_iter_entry(handle, exp, get_princs_iter, &data);
+    } else if (princ) {
         data.context = handle->context;
         ret = kdb_iter_entry(handle, exp, get_princs_iter, (void *) &data);
     } else {
@@ -258,7 +336,40 @@ kadm5_ret_t kadm5_get_principals(void *server_handle,
                                  char ***princs,
                                  int *count)
 {
-    return kadm5_get_either(1, server_handle, exp, princs, count);
+    return kadm5_get_either(1, server_handle, exp, NULL, 0, princs, count);
+}
+
+/*
+ * Each page keeps the lowest max + 1 matching names after start; the extra
+ * name tells us whether there is another page.  If the KDB module iterates in
+ * name order, the iteration begins at start and ends after max + 1 names;
+ * otherwise every name which could match exp is visited.
+ */
+kadm5_ret_t kadm5_get_principals_page(void *server_handle,
+                                      char *exp,
+                                      char *start,
+                                      int max,
+                                      char ***princs,
+                                      int *count,
+                                      krb5_boolean *more)
+{
+    kadm5_ret_t ret;
+
+    *princs = NULL;
+    *count = 0;
+    *more = FALSE;
+    if (max <= 0)
+        return EINVAL;
+
+    ret = kadm5_get_either(1, server_handle, exp, start, max, princs, count);
+    if (ret)
+        return ret;
+    if (*count > max) {
+        free((*princs)[max]);
+        *count = max;
+        *more = TRUE;
+    }
+    return KADM5_OK;
 }
 
 kadm5_ret_t kadm5_get_policies(void *server_handle,
@@ -266,5 +377,5 @@ kadm5_ret_t kadm5_get_policies(void *server_handle,
                                char ***pols,
                                int *count)
 {
-    return kadm5_get_either(0, server_handle, exp, pols, count);
+    return kadm5_get_either(0, server_handle, exp, NULL, 0, pols, count);
 }
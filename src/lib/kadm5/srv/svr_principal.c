@@ -9,6 +9,7 @@
 #include        <kadm5/admin.h>
 #include        <kdb.h>
 #include        "server_internal.h"
+#include        <kdb_log.h>
 #ifdef USE_PASSWORD_SERVER
 #include        <sys/wait.h>
 #include        <signal.h>
@@ -123,6 +124,70 @@ get_policy(kadm5_server_handle_t handle, const char *name,
     return (ret == KADM5_UNK_POLICY) ? 0 : ret;
 }
 
+/* A list of policies fetched during an operation, so that a batch of
+ * principals sharing a policy looks it up only once. */
+struct policy_cache {
+    struct policy_cache *next;
+    char *name;
+    krb5_boolean have_pol;
+    kadm5_policy_ent_rec pol;
+};
+
+/* Set *pol_out to the policy name from *cache, fetching it if necessary, or
+ * to NULL if name is NULL or the policy does not exist. */
+static kadm5_ret_t
+get_cached_policy(kadm5_server_handle_t handle, struct policy_cache **cache,
+                  const char *name, kadm5_policy_ent_t *pol_out)
+{
+    krb5_error_code ret;
+    struct policy_cache *ent;
+
+    *pol_out = NULL;
+    if (name == NULL)
+        return 0;
+
+    for (ent = *cache; ent != NULL; ent = ent->next) {
+        if (strcmp(ent->name, name) == 0)
+            break;
+    }
+    if (ent == NULL) {
+        ent = k5alloc(sizeof(*ent), &ret);
+        if (ent == NULL)
+            return ret;
+        ent->name = strdup(name);
+        if (ent->name == NULL) {
+            free(ent);
+            return ENOMEM;
+        }
+        ret = get_policy(handle, name, &ent->pol, &ent->have_pol);
+        if (ret) {
+            free(ent->name);
+            free(ent);
+            return ret;
+        }
+        ent->next = *cache;
+        *cache = ent;
+    }
+
+    if (ent->have_pol)
+        *pol_out = &ent->pol;
+    return 0;
+}
+
+static void
+free_policy_cache(kadm5_server_handle_t handle, struct policy_cache *cache)
+{
+    struct policy_cache *next;
+
+    for (; cache != NULL; cache = next) {
+        next = cache->next;
+        if (cache->have_pol)
+            kadm5_free_policy_ent(handle->lhandle, &cache->pol);
+        free(cache->name);
+        free(cache);
+    }
+}
+
 /*
  * Apply the -allowedkeysalts policy (see kadmin(1)'s addpol/modpol
  * commands).  We use the allowed key/salt tuple list as a default if
@@ -131,13 +196,12 @@ get_policy(kadm5_server_handle_t handle, const char *name,
  * (which may be a subset of the policy) to reflect the policy order.
  */
 static kadm5_ret_t
-apply_keysalt_policy(kadm5_server_handle_t handle, const char *policy,
-                     int n_ks_tuple, krb5_key_salt_tuple *ks_tuple,
-                     int *new_n_kstp, krb5_key_salt_tuple **new_kstp)
+apply_allowed_keysalts(kadm5_server_handle_t handle,
+                       const char *allowed_keysalts,
+                       int n_ks_tuple, krb5_key_salt_tuple *ks_tuple,
+                       int *new_n_kstp, krb5_key_salt_tuple **new_kstp)
 {
     kadm5_ret_t ret;
-    kadm5_policy_ent_rec polent;
-    krb5_boolean have_polent;
     int ak_n_ks_tuple = 0;
     int new_n_ks_tuple = 0;
     krb5_key_salt_tuple *ak_ks_tuple = NULL;
@@ -150,12 +214,7 @@ apply_keysalt_policy(kadm5_server_handle_t handle, const char *policy,
         *new_kstp = NULL;
     }
 
-    memset(&polent, 0, sizeof(polent));
-    ret = get_policy(handle, policy, &polent, &have_polent);
-    if (ret)
-        goto cleanup;
-
-    if (polent.allowed_keysalts == NULL) {
+    if (allowed_keysalts == NULL) {
         /* Requested keysalts allowed or default to supported_enctypes. */
         if (n_ks_tuple == 0) {
             /* Default to supported_enctypes. */
@@ -174,7 +233,7 @@ apply_keysalt_policy(kadm5_server_handle_t handle, const char *policy,
         goto cleanup;
     }
 
-    ret = krb5_string_to_keysalts(polent.allowed_keysalts,
+    ret = krb5_string_to_keysalts(allowed_keysalts,
                                   ",",   /* Tuple separators */
                                   NULL,  /* Key/salt separators */
                                   0,     /* No duplicates */
@@ -223,8 +282,6 @@ apply_keysalt_policy(kadm5_server_handle_t handle, const char *policy,
     ret = 0;
 
 cleanup:
-    if (have_polent)
-        kadm5_free_policy_ent(handle->lhandle, &polent);
     free(ak_ks_tuple);
 
     if (new_n_kstp != NULL) {
@@ -236,6 +293,31 @@ cleanup:
     return ret;
 }
 
+/* Apply the allowed key/salt types of the named policy, if it exists. */
+static kadm5_ret_t
+apply_keysalt_policy(kadm5_server_handle_t handle, const char *policy,
+                     int n_ks_tuple, krb5_key_salt_tuple *ks_tuple,
+                     int *new_n_kstp, krb5_key_salt_tuple **new_kstp)
+{
+    kadm5_ret_t ret;
+    kadm5_policy_ent_rec polent;
+    krb5_boolean have_polent;
+
+    if (new_n_kstp != NULL) {
+        *new_n_kstp = 0;
+        *new_kstp = NULL;
+    }
+
+    memset(&polent, 0, sizeof(polent));
+    ret = get_policy(handle, policy, &polent, &have_polent);
+    if (ret)
+        return ret;
+    ret = apply_allowed_keysalts(handle, polent.allowed_keysalts, n_ks_tuple,
+                                 ks_tuple, new_n_kstp, new_kstp);
+    if (have_polent)
+        kadm5_free_policy_ent(handle->lhandle, &polent);
+    return ret;
+}
 
 /*
  * Set *passptr to NULL if the request looks like the first part of a krb5 1.6
@@ -277,36 +359,24 @@ count_new_keys(int n_key_data, krb5_key_data *key_data)
     return n_key_data;
 }
 
-kadm5_ret_t
-kadm5_create_principal(void *server_handle,
-                       kadm5_principal_ent_t entry, long mask,
-                       char *password)
-{
-    return
-        kadm5_create_principal_3(server_handle, entry, mask,
-                                 0, NULL, password);
-}
-kadm5_ret_t
-kadm5_create_principal_3(void *server_handle,
-                         kadm5_principal_ent_t entry, long mask,
-                         int n_ks_tuple, krb5_key_salt_tuple *ks_tuple,
-                         char *password)
+/* Create one principal, looking up its policy through *policies. */
+static kadm5_ret_t
+create_principal(kadm5_server_handle_t handle, struct policy_cache **policies,
+                 kadm5_principal_ent_t entry, long mask,
+                 int n_ks_tuple, krb5_key_salt_tuple *ks_tuple,
+                 char *password)
 {
     krb5_db_entry               *kdb;
     osa_princ_ent_rec           adb;
-    kadm5_policy_ent_rec        polent;
-    krb5_boolean                have_polent = FALSE;
+    kadm5_policy_ent_t          entry_pol, polent = NULL;
     krb5_timestamp              now;
     krb5_tl_data                *tl_data_tail;
     unsigned int                ret;
-    kadm5_server_handle_t handle = server_handle;
     krb5_keyblock               *act_mkey;
     krb5_kvno                   act_kvno;
     int                         new_n_ks_tuple = 0;
     krb5_key_salt_tuple         *new_ks_tuple = NULL;
 
-    CHECK_HANDLE(server_handle);
-
     krb5_clear_error_message(handle->context);
 
     check_1_6_dummy(entry, mask, n_ks_tuple, ks_tuple, &password);
@@ -359,17 +429,16 @@ kadm5_create_principal_3(void *server_handle,
     memset(&adb, 0, sizeof(osa_princ_ent_rec));
 
     /*
-     * If a policy was specified, load it.
-     * If we can not find the one specified return an error
+     * Load the entry's policy.  It only applies to the principal if the mask
+     * says so, but its allowed key/salt types are used regardless.
      */
-    if ((mask & KADM5_POLICY)) {
-        ret = get_policy(handle, entry->policy, &polent, &have_polent);
-        if (ret)
-            goto cleanup;
-    }
+    ret = get_cached_policy(handle, policies, entry->policy, &entry_pol);
+    if (ret)
+        goto cleanup;
+    if ((mask & KADM5_POLICY))
+        polent = entry_pol;
     if (password) {
-        ret = passwd_check(handle, password, have_polent ? &polent : NULL,
-                           entry->principal);
+        ret = passwd_check(handle, password, polent, entry->principal);
         if (ret)
             goto cleanup;
     }
@@ -405,9 +474,9 @@ kadm5_create_principal_3(void *server_handle,
         kdb->expiration = handle->params.expiration;
 
     kdb->pw_expiration = 0;
-    if (have_polent) {
-        if(polent.pw_max_life)
-            kdb->pw_expiration = ts_incr(now, polent.pw_max_life);
+    if (polent != NULL) {
+        if(polent->pw_max_life)
+            kdb->pw_expiration = ts_incr(now, polent->pw_max_life);
         else
             kdb->pw_expiration = 0;
     }
@@ -445,8 +514,10 @@ kadm5_create_principal_3(void *server_handle,
      * check enctype policy, which is why we check/initialize ks_tuple
      * this late.
      */
-    ret = apply_keysalt_policy(handle, entry->policy, n_ks_tuple, ks_tuple,
-                               &new_n_ks_tuple, &new_ks_tuple);
+    ret = apply_allowed_keysalts(handle, (entry_pol == NULL) ? NULL :
+                                 entry_pol->allowed_keysalts,
+                                 n_ks_tuple, ks_tuple,
+                                 &new_n_ks_tuple, &new_ks_tuple);
     if (ret)
         goto cleanup;
 
@@ -512,8 +583,114 @@ kadm5_create_principal_3(void *server_handle,
 cleanup:
     free(new_ks_tuple);
     krb5_db_free_principal(handle->context, kdb);
-    if (have_polent)
-        (void) kadm5_free_policy_ent(handle->lhandle, &polent);
+    return ret;
+}
+
+kadm5_ret_t
+kadm5_create_principal(void *server_handle,
+                       kadm5_principal_ent_t entry, long mask,
+                       char *password)
+{
+    return
+        kadm5_create_principal_3(server_handle, entry, mask,
+                                 0, NULL, password);
+}
+
+kadm5_ret_t
+kadm5_create_principal_3(void *server_handle,
+                         kadm5_principal_ent_t entry, long mask,
+                         int n_ks_tuple, krb5_key_salt_tuple *ks_tuple,
+                         char *password)
+{
+    kadm5_server_handle_t handle = server_handle;
+    struct policy_cache *policies = NULL;
+    kadm5_ret_t ret;
+
+    CHECK_HANDLE(server_handle);
+
+    ret = create_principal(handle, &policies, entry, mask, n_ks_tuple,
+                           ks_tuple, password);
+    free_policy_cache(handle, policies);
+    return ret;
+}
+
+/*
+ * Hold the database lock and defer ulog syncs across a batch of updates, so
+ * that the batch is committed to disk once when end_batch() is called.
+ * Modules without lock support commit each update as usual.
+ */
+static kadm5_ret_t
+begin_batch(kadm5_server_handle_t handle, krb5_boolean *locked_out)
+{
+    krb5_error_code ret;
+
+    *locked_out = FALSE;
+    ret = krb5_db_lock(handle->context, KRB5_DB_LOCKMODE_EXCLUSIVE);
+    if (ret && ret != KRB5_PLUGIN_OP_NOTSUPP)
+        return ret;
+    *locked_out = (ret == 0);
+    if (*locked_out)
+        ulog_defer_sync(handle->context, TRUE);
+    return 0;
+}
+
+/*
+ * Release the lock taken by begin_batch(), committing the batch.  If the
+ * commit fails, none of the batch's changes were made, so replace each
+ * successful result in results with the error, discard the ulog entries
+ * describing the changes, and return the error.
+ */
+static kadm5_ret_t
+end_batch(kadm5_server_handle_t handle, krb5_boolean locked, int count,
+          kadm5_ret_t *results)
+{
+    krb5_error_code ret;
+    int i;
+
+    if (!locked)
+        return 0;
+    ret = krb5_db_unlock(handle->context);
+    if (ret) {
+        ulog_abort_deferred(handle->context);
+        for (i = 0; i < count; i++) {
+            if (results[i] == KADM5_OK)
+                results[i] = ret;
+        }
+        return ret;
+    }
+    ulog_defer_sync(handle->context, FALSE);
+    return 0;
+}
+
+kadm5_ret_t
+kadm5_create_principals(void *server_handle, int count,
+                        kadm5_principal_ent_t entries, long *masks,
+                        int n_ks_tuple, krb5_key_salt_tuple *ks_tuple,
+                        char **passwords, kadm5_ret_t *results)
+{
+    kadm5_server_handle_t handle = server_handle;
+    struct policy_cache *policies = NULL;
+    krb5_boolean locked;
+    kadm5_ret_t ret;
+    int i;
+
+    CHECK_HANDLE(server_handle);
+
+    if (count < 0 || (count > 0 && (entries == NULL || masks == NULL ||
+                                    results == NULL)))
+        return EINVAL;
+
+    ret = begin_batch(handle, &locked);
+    if (ret)
+        return ret;
+    for (i = 0; i < count; i++) {
+        results[i] = create_principal(handle, &policies, &entries[i],
+                                      masks[i], n_ks_tuple, ks_tuple,
+                                      (passwords == NULL) ? NULL :
+                                      passwords[i]);
+    }
+    ret = end_batch(handle, locked, count, results);
+    free_policy_cache(handle, policies);
     return ret;
 }
 
@@ -554,19 +731,16 @@ kadm5_delete_principal(void *server_handle, krb5_principal principal)
     return ret;
 }
 
-kadm5_ret_t
-kadm5_modify_principal(void *server_handle,
-                       kadm5_principal_ent_t entry, long mask)
+/* Modify one principal, looking up its new policy through *policies. */
+static kadm5_ret_t
+modify_principal(kadm5_server_handle_t handle, struct policy_cache **policies,
+                 kadm5_principal_ent_t entry, long mask)
 {
-    int                     ret, ret2, i;
-    kadm5_policy_ent_rec    pol;
-    krb5_boolean            have_pol = FALSE;
+    int                     ret, i;
+    kadm5_policy_ent_t      pol = NULL;
     krb5_db_entry           *kdb;
     krb5_tl_data            *tl_data_orig;
     osa_princ_ent_rec       adb;
-    kadm5_server_handle_t handle = server_handle;
-
-    CHECK_HANDLE(server_handle);
 
     krb5_clear_error_message(handle->context);
 
@@ -602,7 +776,7 @@ kadm5_modify_principal(void *server_handle,
      */
 
     if ((mask & KADM5_POLICY)) {
-        ret = get_policy(handle, entry->policy, &pol, &have_pol);
+        ret = get_cached_policy(handle, policies, entry->policy, &pol);
         if (ret)
             goto done;
 
@@ -612,14 +786,15 @@ kadm5_modify_principal(void *server_handle,
             free(adb.policy);
         adb.policy = strdup(entry->policy);
     }
-    if (have_pol) {
+    if (pol != NULL) {
         /* set pw_max_life based on new policy */
-        if (pol.pw_max_life) {
+        if (pol->pw_max_life) {
             ret = krb5_dbe_lookup_last_pwd_change(handle->context, kdb,
                                                   &(kdb->pw_expiration));
             if (ret)
                 goto done;
-            kdb->pw_expiration = ts_incr(kdb->pw_expiration, pol.pw_max_life);
+            kdb->pw_expiration = ts_incr(kdb->pw_expiration,
+                                         pol->pw_max_life);
         } else {
             kdb->pw_expiration = 0;
         }
@@ -693,14 +868,52 @@ kadm5_modify_principal(void *server_handle,
 
     ret = KADM5_OK;
 done:
-    if (have_pol) {
-        ret2 = kadm5_free_policy_ent(handle->lhandle, &pol);
-        ret = ret ? ret : ret2;
-    }
     kdb_free_entry(handle, kdb, &adb);
     return ret;
 }
 
+kadm5_ret_t
+kadm5_modify_principal(void *server_handle,
+                       kadm5_principal_ent_t entry, long mask)
+{
+    kadm5_server_handle_t handle = server_handle;
+    struct policy_cache *policies = NULL;
+    kadm5_ret_t ret;
+
+    CHECK_HANDLE(server_handle);
+
+    ret = modify_principal(handle, &policies, entry, mask);
+    free_policy_cache(handle, policies);
+    return ret;
+}
+
+kadm5_ret_t
+kadm5_modify_principals(void *server_handle, int count,
+                        kadm5_principal_ent_t entries, long *masks,
+                        kadm5_ret_t *results)
+{
+    kadm5_server_handle_t handle = server_handle;
+    struct policy_cache *policies = NULL;
+    krb5_boolean locked;
+    kadm5_ret_t ret;
+    int i;
+
+    CHECK_HANDLE(server_handle);
+
+    if (count < 0 || (count > 0 && (entries == NULL || masks == NULL ||
+                                    results == NULL)))
+        return EINVAL;
+
+    ret = begin_batch(handle, &locked);
+    if (ret)
+        return ret;
+    for (i = 0; i < count; i++)
+        results[i] = modify_principal(handle, &policies, &entries[i], masks[i]);
+    ret = end_batch(handle, locked, count, results);
+    free_policy_cache(handle, policies);
+    return ret;
+}
+
 kadm5_ret_t
 kadm5_rename_principal(void *server_handle,
                        krb5_principal source, krb5_principal target)
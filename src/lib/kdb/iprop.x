@@ -210,6 +210,16 @@ struct kdb_fullresync_result_t {
 	update_status_t 	ret;
 };
 
+/*
+ * Argument to IPROP_WAIT_UPDATES: the replica's last entry, and the
+ * number of seconds it is willing to wait for the master to record a
+ * newer one.
+ */
+struct kdb_wait_t {
+	kdb_last_t		last;
+	uint32_t		timeout;
+};
+
 program KRB5_IPROP_PROG {
 	version KRB5_IPROP_VERS {
 		/*
@@ -239,5 +249,16 @@ program KRB5_IPROP_PROG {
 		 */
 		kdb_fullresync_result_t
 		IPROP_FULL_RESYNC_EXT(uint32_t) = 3;
+
+		/*
+		 * Long-poll for updates.  The master holds the request
+		 * until its ulog has updates past the replica's last
+		 * entry or the timeout expires, then replies with the
+		 * status IPROP_GET_UPDATES would give.
+		 * No updates are returned; the replica fetches them
+		 * with IPROP_GET_UPDATES.
+		 */
+		kdb_incr_result_t
+		IPROP_WAIT_UPDATES(kdb_wait_t) = 4;
 	} = 1;
 } = 100423;
@@ -330,6 +330,11 @@ copy_vtable(const kdb_vftabl *in, kdb_vftabl *out)
     if (in->min_ver >= 1)
         out->get_s4u_x509_principal = in->get_s4u_x509_principal;
 
+    /* Copy fields for minor version 2 (major version 7). */
+    out->iterate_from = NULL;
+    if (in->min_ver >= 2)
+        out->iterate_from = in->iterate_from;
+
     /* Set defaults for optional fields. */
     if (out->fetch_master_key == NULL)
         out->fetch_master_key = krb5_db_def_fetch_mkey;
@@ -1093,6 +1098,36 @@ krb5_db_iterate(krb5_context kcontext, char *match_entry,
                       &proxy_args, iterflags);
 }
 
+krb5_error_code
+krb5_db_iterate_from(krb5_context kcontext, char *match_entry,
+                     const char *start,
+                     int (*func)(krb5_pointer, krb5_db_entry *),
+                     krb5_pointer func_arg, krb5_flags iterflags)
+{
+    krb5_error_code status = 0;
+    kdb_vftabl *v;
+    struct callback_proxy_args proxy_args;
+
+    status = get_vftabl(kcontext, &v);
+    if (status)
+        return status;
+    if (v->iterate_from == NULL)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+    if (start == NULL)
+        start = "";
+
+    proxy_args.func = func;
+    proxy_args.func_arg = func_arg;
+    return v->iterate_from(kcontext, match_entry, start,
+                           sort_entry_callback_proxy, &proxy_args, iterflags);
+}
+
+size_t
+krb5_db_match_prefix_len(const char *match_entry)
+{
+    return strcspn(match_entry, "*?[\\+(){}|");
+}
+
 /* Return a read only pointer alias to mkey list.  Do not free this! */
 krb5_keylist_node *
 krb5_db_mkey_list_alias(krb5_context kcontext)
@@ -103,6 +103,42 @@ sync_header(kdb_hlog_t *ulog)
     }
 }
 
+/*
+ * Update the ulog file's timestamps after new entries are published, so that
+ * a process watching the file (kadmind, for parked IPROP_WAIT_UPDATES
+ * requests) is notified.  Writes through the mapping do not generate file
+ * change notifications.
+ */
+static void
+notify_watchers(kdb_log_context *log_ctx)
+{
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_FUTIMENS)
+    (void)futimens(log_ctx->ulogfd, NULL);
+#endif
+}
+
+/*
+ * Return true if each of the ulog's entries carries the serial number
+ * expected for its slot.  Deferred syncs can leave the header on disk ahead
+ * of its entries if the system crashes.
+ */
+static krb5_boolean
+check_entries(kdb_log_context *log_ctx)
+{
+    kdb_hlog_t *ulog = log_ctx->ulog;
+    kdb_ent_header_t *ent;
+    kdb_sno_t sno;
+    uint32_t i;
+
+    for (i = 0; i < ulog->kdb_num; i++) {
+        sno = ulog->kdb_first_sno + i;
+        ent = INDEX(ulog, (sno - 1) % log_ctx->ulogentries);
+        if (ent->kdb_umagic != KDB_ULOG_MAGIC || ent->kdb_entry_sno != sno)
+            return FALSE;
+    }
+    return TRUE;
+}
+
 /* Return true if the ulog entry for sno matches sno and timestamp. */
 static krb5_boolean
 check_sno(kdb_log_context *log_ctx, kdb_sno_t sno,
@@ -269,6 +305,38 @@ unlock_ulog(krb5_context context)
     (void)lock_ulog(context, KRB5_LOCKMODE_UNLOCK);
 }
 
+/*
+ * Return the header to which updates are added.  While syncs are deferred,
+ * this is a private copy of the shared header, so that the updates are not
+ * visible to readers until ulog_sync() publishes them.
+ */
+static kdb_hlog_t *
+update_header(kdb_log_context *log_ctx)
+{
+    if (!log_ctx->defer_sync)
+        return log_ctx->ulog;
+    if (!log_ctx->unsynced) {
+        log_ctx->pending = *log_ctx->ulog;
+        log_ctx->unsynced = TRUE;
+    }
+    return &log_ctx->pending;
+}
+
+/* Remove the first entry from the shared header's view of the log, because an
+ * unpublished update is about to overwrite it. */
+static void
+drop_first_entry(kdb_log_context *log_ctx)
+{
+    kdb_hlog_t *ulog = log_ctx->ulog;
+    kdb_ent_header_t *ent;
+
+    if (--ulog->kdb_num == 0)
+        return;
+    ulog->kdb_first_sno++;
+    ent = INDEX(ulog, (ulog->kdb_first_sno - 1) % log_ctx->ulogentries);
+    ulog->kdb_first_time = ent->kdb_time;
+}
+
 /*
  * Add an update to the log.  The update's kdb_entry_sno and kdb_time fields
  * must already be set.  The layout of the update log looks like:
@@ -280,13 +348,18 @@ store_update(kdb_log_context *log_ctx, kdb_incr_update_t *upd)
 {
     XDR xdrs;
     kdb_ent_header_t *indx_log;
+    kdb_incr_update_t stored;
     unsigned int i, recsize;
     unsigned long upd_size;
     krb5_error_code retval;
-    kdb_hlog_t *ulog = log_ctx->ulog;
+    kdb_hlog_t *ulog = log_ctx->ulog, *hdr = update_header(log_ctx);
     uint32_t ulogentries = log_ctx->ulogentries;
 
-    upd_size = xdr_sizeof((xdrproc_t)xdr_kdb_incr_update_t, upd);
+    /* The header's commit flag is what protects readers from a partial
+     * entry; set the encoded flag so the encoding can be served as is. */
+    stored = *upd;
+    stored.kdb_commit = TRUE;
+    upd_size = xdr_sizeof((xdrproc_t)xdr_kdb_incr_update_t, &stored);
 
     recsize = sizeof(kdb_ent_header_t) + upd_size;
 
@@ -294,10 +367,18 @@ store_update(kdb_log_context *log_ctx, kdb_incr_update_t *upd)
         retval = resize(ulog, ulogentries, log_ctx->ulogfd, recsize);
         if (retval)
             return retval;
+        /* Unpublished updates are discarded along with the rest. */
+        if (hdr != ulog)
+            *hdr = *ulog;
     }
 
     ulog->kdb_state = KDB_UNSTABLE;
 
+    if (hdr != ulog && ulog->kdb_num > 0 &&
+        upd->kdb_entry_sno > ulogentries &&
+        upd->kdb_entry_sno - ulogentries == ulog->kdb_first_sno)
+        drop_first_entry(log_ctx);
+
     i = (upd->kdb_entry_sno - 1) % ulogentries;
     indx_log = INDEX(ulog, i);
 
@@ -310,32 +391,36 @@ store_update(kdb_log_context *log_ctx, kdb_incr_update_t *upd)
 
     xdrmem_create(&xdrs, (char *)indx_log->entry_data,
                   indx_log->kdb_entry_size, XDR_ENCODE);
-    if (!xdr_kdb_incr_update_t(&xdrs, upd))
+    if (!xdr_kdb_incr_update_t(&xdrs, &stored))
         return KRB5_LOG_CONV;
 
     indx_log->kdb_commit = TRUE;
-    sync_update(ulog, indx_log);
+    if (hdr == ulog)
+        sync_update(ulog, indx_log);
 
     /* Modify the ulog header to reflect the new update. */
-    ulog->kdb_last_sno = upd->kdb_entry_sno;
-    ulog->kdb_last_time = upd->kdb_time;
-    if (ulog->kdb_num == 0) {
+    hdr->kdb_last_sno = upd->kdb_entry_sno;
+    hdr->kdb_last_time = upd->kdb_time;
+    if (hdr->kdb_num == 0) {
         /* We should only see this in old ulogs. */
-        ulog->kdb_num = 1;
-        ulog->kdb_first_sno = upd->kdb_entry_sno;
-        ulog->kdb_first_time = upd->kdb_time;
-    } else if (ulog->kdb_num < ulogentries) {
-        ulog->kdb_num++;
+        hdr->kdb_num = 1;
+        hdr->kdb_first_sno = upd->kdb_entry_sno;
+        hdr->kdb_first_time = upd->kdb_time;
+    } else if (hdr->kdb_num < ulogentries) {
+        hdr->kdb_num++;
     } else {
         /* We are circling; set kdb_first_sno and time to the next update. */
         i = upd->kdb_entry_sno % ulogentries;
         indx_log = INDEX(ulog, i);
-        ulog->kdb_first_sno = indx_log->kdb_entry_sno;
-        ulog->kdb_first_time = indx_log->kdb_time;
+        hdr->kdb_first_sno = indx_log->kdb_entry_sno;
+        hdr->kdb_first_time = indx_log->kdb_time;
     }
 
     ulog->kdb_state = KDB_STABLE;
-    sync_header(ulog);
+    if (hdr == ulog) {
+        sync_header(ulog);
+        notify_watchers(log_ctx);
+    }
     return 0;
 }
 
@@ -345,7 +430,7 @@ ulog_add_update(krb5_context context, kdb_incr_update_t *upd)
 {
     krb5_error_code ret;
     kdb_log_context *log_ctx;
-    kdb_hlog_t *ulog;
+    kdb_hlog_t *ulog, *hdr;
 
     INIT_ULOG(context);
     ret = lock_ulog(context, KRB5_LOCKMODE_EXCLUSIVE);
@@ -354,10 +439,14 @@ ulog_add_update(krb5_context context, kdb_incr_update_t *upd)
 
     /* If we have reached the last possible serial number, reinitialize the
      * ulog and start over.  Replicas will do a full resync. */
-    if (ulog->kdb_last_sno == (kdb_sno_t)-1)
+    hdr = update_header(log_ctx);
+    if (hdr->kdb_last_sno == (kdb_sno_t)-1) {
         reset_ulog(log_ctx);
+        if (hdr != ulog)
+            *hdr = *ulog;
+    }
 
-    upd->kdb_entry_sno = ulog->kdb_last_sno + 1;
+    upd->kdb_entry_sno = hdr->kdb_last_sno + 1;
     time_current(&upd->kdb_time);
     ret = store_update(log_ctx, upd);
     unlock_ulog(context);
@@ -464,6 +553,49 @@ ulog_init_header(krb5_context context)
     return 0;
 }
 
+/*
+ * Version 1 ulogs store entries with kdb_commit false in their encodings,
+ * relying on the entry header.  Rewrite the encodings with the flag set,
+ * resetting the ulog if an entry cannot be decoded.  The ulog must be locked
+ * exclusively.
+ */
+static void
+upgrade_entries(kdb_log_context *log_ctx)
+{
+    kdb_hlog_t *ulog = log_ctx->ulog;
+    kdb_ent_header_t *indx_log;
+    kdb_incr_update_t upd;
+    kdb_sno_t sno;
+    XDR xdrs;
+    bool_t ok;
+
+    for (sno = ulog->kdb_first_sno; ulog->kdb_num > 0 &&
+             sno <= ulog->kdb_last_sno; sno++) {
+        indx_log = INDEX(ulog, (sno - 1) % log_ctx->ulogentries);
+        if (!indx_log->kdb_commit || indx_log->kdb_entry_size == 0)
+            continue;
+
+        memset(&upd, 0, sizeof(upd));
+        xdrmem_create(&xdrs, (char *)indx_log->entry_data,
+                      indx_log->kdb_entry_size, XDR_DECODE);
+        ok = xdr_kdb_incr_update_t(&xdrs, &upd);
+        if (ok) {
+            upd.kdb_commit = TRUE;
+            xdrmem_create(&xdrs, (char *)indx_log->entry_data,
+                          indx_log->kdb_entry_size, XDR_ENCODE);
+            ok = xdr_kdb_incr_update_t(&xdrs, &upd);
+        }
+        xdr_free((xdrproc_t)xdr_kdb_incr_update_t, (char *)&upd);
+        if (!ok) {
+            reset_ulog(log_ctx);
+            return;
+        }
+        sync_update(ulog, indx_log);
+    }
+    ulog->db_version_num = KDB_VERSION;
+    sync_header(ulog);
+}
+
 /* Map the log file to memory for performance and simplicity. */
 krb5_error_code
 ulog_map(krb5_context context, const char *logname, uint32_t ulogentries)
@@ -520,14 +652,19 @@ ulog_map(krb5_context context, const char *logname, uint32_t ulogentries)
         reset_ulog(log_ctx);
     }
 
-    /* Reinit ulog if ulogentries changed such that we have too many entries or
-     * our first or last entry was written to the wrong location. */
+    /* Reinit ulog if ulogentries changed such that we have too many entries,
+     * our first or last entry was written to the wrong location, or an entry
+     * did not make it to disk. */
     if (ulog->kdb_num != 0 &&
         (ulog->kdb_num > ulogentries ||
          !check_sno(log_ctx, ulog->kdb_first_sno, &ulog->kdb_first_time) ||
-         !check_sno(log_ctx, ulog->kdb_last_sno, &ulog->kdb_last_time)))
+         !check_sno(log_ctx, ulog->kdb_last_sno, &ulog->kdb_last_time) ||
+         !check_entries(log_ctx)))
         reset_ulog(log_ctx);
 
+    if (ulog->db_version_num < KDB_VERSION)
+        upgrade_entries(log_ctx);
+
     if (ulog->kdb_num != ulogentries) {
         /* Expand the ulog file if it isn't big enough. */
         filesize = sizeof(kdb_hlog_t) + ulogentries * ulog->kdb_block;
@@ -616,6 +753,261 @@ cleanup:
     return retval;
 }
 
+/*
+ * Helpers for stepping over the XDR encoding of a kdb_incr_update_t without
+ * decoding it.  Each advances *pp past one item, returning false if the item
+ * runs past end.
+ */
+static krb5_boolean
+skip_units(const uint8_t **pp, const uint8_t *end, size_t n)
+{
+    if ((size_t)(end - *pp) / BYTES_PER_XDR_UNIT < n)
+        return FALSE;
+    *pp += n * BYTES_PER_XDR_UNIT;
+    return TRUE;
+}
+
+static krb5_boolean
+get_unit(const uint8_t **pp, const uint8_t *end, uint32_t *val_out)
+{
+    if (end - *pp < BYTES_PER_XDR_UNIT)
+        return FALSE;
+    *val_out = load_32_be(*pp);
+    *pp += BYTES_PER_XDR_UNIT;
+    return TRUE;
+}
+
+static krb5_boolean
+skip_opaque(const uint8_t **pp, const uint8_t *end)
+{
+    uint32_t len;
+
+    return get_unit(pp, end, &len) &&
+        skip_units(pp, end, ((size_t)len + BYTES_PER_XDR_UNIT - 1) /
+                   BYTES_PER_XDR_UNIT);
+}
+
+static krb5_boolean
+skip_princ(const uint8_t **pp, const uint8_t *end)
+{
+    uint32_t i, n;
+
+    if (!skip_opaque(pp, end) || !get_unit(pp, end, &n))
+        return FALSE;
+    for (i = 0; i < n; i++) {
+        if (!skip_units(pp, end, 1) || !skip_opaque(pp, end))
+            return FALSE;
+    }
+    return skip_units(pp, end, 1);
+}
+
+/* Skip a counted array of kdbe_key_t. */
+static krb5_boolean
+skip_keys(const uint8_t **pp, const uint8_t *end)
+{
+    uint32_t i, j, n, m;
+
+    if (!get_unit(pp, end, &n))
+        return FALSE;
+    for (i = 0; i < n; i++) {
+        /* Skip k_ver and k_kvno, then the k_enctype array. */
+        if (!skip_units(pp, end, 2) || !get_unit(pp, end, &m) ||
+            !skip_units(pp, end, m) || !get_unit(pp, end, &m))
+            return FALSE;
+        for (j = 0; j < m; j++) {
+            if (!skip_opaque(pp, end))
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static krb5_boolean
+skip_val(const uint8_t **pp, const uint8_t *end)
+{
+    uint32_t type, i, n;
+
+    if (!get_unit(pp, end, &type))
+        return FALSE;
+    switch (type) {
+    case AT_ATTRFLAGS:
+    case AT_MAX_LIFE:
+    case AT_MAX_RENEW_LIFE:
+    case AT_EXP:
+    case AT_PW_EXP:
+    case AT_LAST_SUCCESS:
+    case AT_LAST_FAILED:
+    case AT_FAIL_AUTH_COUNT:
+    case AT_LEN:
+    case AT_PW_LAST_CHANGE:
+    case AT_MOD_TIME:
+    case AT_PW_POLICY_SWITCH:
+    case AT_PW_HIST_KVNO:
+        return skip_units(pp, end, 1);
+    case AT_PRINC:
+    case AT_MOD_PRINC:
+        return skip_princ(pp, end);
+    case AT_KEYDATA:
+        return skip_keys(pp, end);
+    case AT_TL_DATA:
+        if (!get_unit(pp, end, &n))
+            return FALSE;
+        for (i = 0; i < n; i++) {
+            if (!skip_units(pp, end, 1) || !skip_opaque(pp, end))
+                return FALSE;
+        }
+        return TRUE;
+    case AT_PW_HIST:
+        if (!get_unit(pp, end, &n))
+            return FALSE;
+        for (i = 0; i < n; i++) {
+            if (!skip_keys(pp, end))
+                return FALSE;
+        }
+        return TRUE;
+    default:
+        /* AT_MOD_WHERE, AT_PW_POLICY, and extensions are all opaque. */
+        return skip_opaque(pp, end);
+    }
+}
+
+/* Set *offset_out to the offset of the kdb_commit flag within the XDR
+ * encoding of a kdb_incr_update_t.  Return false if the encoding is
+ * malformed. */
+static krb5_boolean
+find_commit_flag(const uint8_t *data, size_t len, size_t *offset_out)
+{
+    const uint8_t *p = data, *end = data + len;
+    uint32_t i, n;
+
+    /* Skip kdb_princ_name, kdb_entry_sno, and kdb_time. */
+    if (!skip_opaque(&p, end) || !skip_units(&p, end, 3))
+        return FALSE;
+    if (!get_unit(&p, end, &n))
+        return FALSE;
+    for (i = 0; i < n; i++) {
+        if (!skip_val(&p, end))
+            return FALSE;
+    }
+    /* Skip kdb_deleted. */
+    if (!skip_units(&p, end, 1) || end - p < BYTES_PER_XDR_UNIT)
+        return FALSE;
+    *offset_out = p - data;
+    return TRUE;
+}
+
+/*
+ * Like ulog_get_entries(), but return the updates after last in their stored
+ * XDR encodings, copied out of the ulog under the lock without decoding them.
+ * Entries are checked against their headers.  An entry appended by an earlier
+ * release may have the commit flag clear in its encoding; set it in the copy,
+ * since the entry header says the entry is committed.
+ */
+krb5_error_code
+ulog_get_raw_entries(krb5_context context, const kdb_last_t *last,
+                     kdb_incr_raw_result_t *res)
+{
+    kdb_ent_header_t *indx_log;
+    kdb_sno_t sno;
+    size_t len = 0, maxsize, offset;
+    uint8_t *p;
+    krb5_error_code retval;
+    kdb_log_context *log_ctx;
+    kdb_hlog_t *ulog = NULL;
+    uint32_t ulogentries;
+
+    memset(res, 0, sizeof(*res));
+    INIT_ULOG(context);
+    ulogentries = log_ctx->ulogentries;
+
+    retval = lock_ulog(context, KRB5_LOCKMODE_SHARED);
+    if (retval)
+        return retval;
+
+    /* If another process terminated mid-update, reset the ulog and force full
+     * resyncs. */
+    if (ulog->kdb_state != KDB_STABLE)
+        reset_ulog(log_ctx);
+
+    res->result.ret = get_sno_status(log_ctx, last);
+    if (res->result.ret != UPDATE_OK)
+        goto cleanup;
+
+    /* Check the entry headers and total up the encoding sizes. */
+    maxsize = ulog->kdb_block - offsetof(kdb_ent_header_t, entry_data);
+    for (sno = last->last_sno + 1; sno <= ulog->kdb_last_sno; sno++) {
+        indx_log = INDEX(ulog, (sno - 1) % ulogentries);
+        if (indx_log->kdb_umagic != KDB_ULOG_MAGIC ||
+            indx_log->kdb_entry_sno != sno || !indx_log->kdb_commit ||
+            indx_log->kdb_entry_size == 0 ||
+            indx_log->kdb_entry_size > maxsize ||
+            indx_log->kdb_entry_size % BYTES_PER_XDR_UNIT != 0) {
+            res->result.ret = UPDATE_ERROR;
+            retval = KRB5_LOG_CORRUPT;
+            goto cleanup;
+        }
+        len += indx_log->kdb_entry_size;
+    }
+
+    res->updates.data = k5alloc(len, &retval);
+    if (res->updates.data == NULL) {
+        res->result.ret = UPDATE_ERROR;
+        goto cleanup;
+    }
+    res->updates.length = len;
+    p = (uint8_t *)res->updates.data;
+    for (sno = last->last_sno + 1; sno <= ulog->kdb_last_sno; sno++) {
+        indx_log = INDEX(ulog, (sno - 1) % ulogentries);
+        memcpy(p, indx_log->entry_data, indx_log->kdb_entry_size);
+        if (!find_commit_flag(p, indx_log->kdb_entry_size, &offset)) {
+            ulog_free_raw_entries(res);
+            res->result.ret = UPDATE_ERROR;
+            retval = KRB5_LOG_CORRUPT;
+            goto cleanup;
+        }
+        store_32_be(TRUE, p + offset);
+        p += indx_log->kdb_entry_size;
+    }
+
+    res->result.updates.kdb_ulog_t_len = ulog->kdb_last_sno - last->last_sno;
+    res->result.lastentry.last_sno = ulog->kdb_last_sno;
+    res->result.lastentry.last_time = ulog->kdb_last_time;
+
+cleanup:
+    unlock_ulog(context);
+    return retval;
+}
+
+void
+ulog_free_raw_entries(kdb_incr_raw_result_t *res)
+{
+    free(res->updates.data);
+    res->updates.data = NULL;
+    res->updates.length = 0;
+    res->result.updates.kdb_ulog_t_len = 0;
+}
+
+/* Encode res the same way as xdr_kdb_incr_result_t() would encode the
+ * decoded updates.  Only encoding is supported. */
+bool_t
+xdr_kdb_incr_raw_result_t(XDR *xdrs, kdb_incr_raw_result_t *res)
+{
+    u_int count = res->result.updates.kdb_ulog_t_len;
+
+    if (xdrs->x_op == XDR_FREE)
+        return TRUE;
+    if (xdrs->x_op != XDR_ENCODE)
+        return FALSE;
+    if (!xdr_kdb_last_t(xdrs, &res->result.lastentry))
+        return FALSE;
+    if (!xdr_u_int(xdrs, &count))
+        return FALSE;
+    if (res->updates.length > 0 &&
+        !xdr_opaque(xdrs, res->updates.data, res->updates.length))
+        return FALSE;
+    return xdr_update_status_t(xdrs, &res->result.ret);
+}
+
 krb5_error_code
 ulog_set_role(krb5_context ctx, iprop_role role)
 {
@@ -672,6 +1064,110 @@ ulog_set_last(krb5_context context, const kdb_last_t *last)
     return 0;
 }
 
+/*
+ * Write updates stored while syncs were deferred to disk, and publish them in
+ * the shared header.  The entries are synced before the header page, so that
+ * the header on disk does not refer to entries which are not yet there unless
+ * the kernel wrote it back early.
+ */
+void
+ulog_sync(krb5_context context)
+{
+    kdb_log_context *log_ctx = context->kdblog_context;
+    kdb_hlog_t *ulog;
+    size_t len;
+    krb5_boolean locked;
+
+    if (log_ctx == NULL || log_ctx->ulog == NULL || !log_ctx->unsynced)
+        return;
+    ulog = log_ctx->ulog;
+
+    if (!pagesize)
+        pagesize = getpagesize();
+    len = sizeof(kdb_hlog_t) + log_ctx->ulogentries * ulog->kdb_block;
+    if (len > (size_t)pagesize &&
+        msync((caddr_t)ulog + pagesize, len - pagesize, MS_SYNC)) {
+        /* Couldn't sync to disk, let's panic. */
+        syslog(LOG_ERR, _("could not sync ulog update to disk"));
+        abort();
+    }
+
+    locked = (lock_ulog(context, KRB5_LOCKMODE_EXCLUSIVE) == 0);
+    ulog->kdb_num = log_ctx->pending.kdb_num;
+    ulog->kdb_first_sno = log_ctx->pending.kdb_first_sno;
+    ulog->kdb_first_time = log_ctx->pending.kdb_first_time;
+    ulog->kdb_last_sno = log_ctx->pending.kdb_last_sno;
+    ulog->kdb_last_time = log_ctx->pending.kdb_last_time;
+    sync_header(ulog);
+    if (locked)
+        unlock_ulog(context);
+    notify_watchers(log_ctx);
+    log_ctx->unsynced = FALSE;
+}
+
+/* Drop the updates stored while syncs were deferred and reinitialize the
+ * ulog. */
+static void
+discard_deferred(krb5_context context)
+{
+    kdb_log_context *log_ctx = context->kdblog_context;
+    krb5_boolean locked;
+
+    log_ctx->defer_failed = FALSE;
+    if (log_ctx->ulog == NULL)
+        return;
+    locked = (lock_ulog(context, KRB5_LOCKMODE_EXCLUSIVE) == 0);
+    reset_ulog(log_ctx);
+    if (locked)
+        unlock_ulog(context);
+    notify_watchers(log_ctx);
+    log_ctx->unsynced = FALSE;
+}
+
+/*
+ * Start or stop deferring ulog syncs.  While syncs are deferred, updates are
+ * stored in the ulog but are not visible to other processes or to iprop
+ * until ulog_sync() writes them to disk and publishes them, allowing a caller
+ * to commit a group of updates with one sync after the database changes they
+ * describe.  The caller must hold the database lock exclusively while syncs
+ * are deferred, so that no other process adds to the ulog.  Calls nest;
+ * stopping the outermost deferral syncs any pending updates.
+ */
+void
+ulog_defer_sync(krb5_context context, krb5_boolean defer)
+{
+    kdb_log_context *log_ctx = context->kdblog_context;
+
+    if (log_ctx == NULL)
+        return;
+    if (defer) {
+        log_ctx->defer_sync++;
+    } else if (log_ctx->defer_sync > 0 && --log_ctx->defer_sync == 0) {
+        if (log_ctx->defer_failed)
+            discard_deferred(context);
+        else
+            ulog_sync(context);
+    }
+}
+
+/*
+ * Stop deferring ulog syncs after the database changes made while they were
+ * deferred have failed to commit.  When the outermost deferral ends, the
+ * updates stored meanwhile are discarded instead of published, and the ulog
+ * is reinitialized so that replicas do a full resync, since the caller
+ * cannot tell which of the changes reached the database.
+ */
+void
+ulog_abort_deferred(krb5_context context)
+{
+    kdb_log_context *log_ctx = context->kdblog_context;
+
+    if (log_ctx == NULL || log_ctx->defer_sync == 0)
+        return;
+    log_ctx->defer_failed = TRUE;
+    ulog_defer_sync(context, FALSE);
+}
+
 void
 ulog_fini(krb5_context context)
 {
@@ -679,6 +1175,7 @@ ulog_fini(krb5_context context)
 
     if (log_ctx == NULL)
         return;
+    ulog_sync(context);
     if (log_ctx->ulog != NULL)
         munmap(log_ctx->ulog, MAXLOGLEN);
     if (log_ctx->ulogfd != -1)
@@ -32,9 +32,12 @@
 
 /*
  * This program performs unit tests for the update log functions in kdb_log.c.
- * Right now it contains only a test for issue #7839, checking that
- * ulog_add_update behaves appropriately when the last serial number is
- * reached.
+ * It checks that ulog_add_update behaves appropriately when the last serial
+ * number is reached (issue #7839), that ulog_get_raw_entries() results encode
+ * the same as ulog_get_entries() results (even for entries stored by earlier
+ * releases), that updates stored while syncs are deferred are not visible
+ * until they are synced, and that ulog_map() upgrades the entries of a
+ * version 1 ulog.
  *
  * The test program accepts one argument, which it unlinks and then maps with
  * ulog_map().  This lets us test all of the update log functions except for
@@ -50,25 +53,86 @@
 static struct _krb5_context context_st;
 static krb5_context context = &context_st;
 
-int
-main(int argc, char **argv)
+static kdb_hlog_t *
+map_new_ulog(const char *filename)
+{
+    unlink(filename);
+    if (ulog_map(context, filename, 10) != 0)
+        abort();
+    return context->kdblog_context->ulog;
+}
+
+/* Add count updates with distinct contents, checking that the caller's
+ * structure is not modified. */
+static void
+add_updates(int count)
 {
-    kdb_log_context *lctx;
-    kdb_hlog_t *ulog;
     kdb_incr_update_t upd;
-    const char *filename;
+    int i;
 
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s filename\n", argv[0]);
-        exit(1);
+    for (i = 0; i < count; i++) {
+        memset(&upd, 0, sizeof(upd));
+        upd.kdb_deleted = (i % 2);
+        if (ulog_add_update(context, &upd) != 0)
+            abort();
+        assert(!upd.kdb_commit);
     }
-    filename = argv[1];
-    unlink(filename);
+}
 
-    if (ulog_map(context, filename, 10) != 0)
+/* Decode the entry for sno and return its encoded commit flag. */
+static bool_t
+entry_commit_flag(kdb_hlog_t *ulog, kdb_sno_t sno)
+{
+    kdb_ent_header_t *indx_log;
+    kdb_incr_update_t upd;
+    XDR xdrs;
+    bool_t commit;
+
+    indx_log = INDEX(ulog, (sno - 1) % context->kdblog_context->ulogentries);
+    memset(&upd, 0, sizeof(upd));
+    xdrmem_create(&xdrs, (char *)indx_log->entry_data,
+                  indx_log->kdb_entry_size, XDR_DECODE);
+    if (!xdr_kdb_incr_update_t(&xdrs, &upd))
         abort();
+    commit = upd.kdb_commit;
+    xdr_free((xdrproc_t)xdr_kdb_incr_update_t, (char *)&upd);
+    return commit;
+}
+
+/* Rewrite the entry for sno with its encoded commit flag clear, the way
+ * earlier releases stored entries. */
+static void
+clear_commit_flag(kdb_hlog_t *ulog, kdb_sno_t sno)
+{
+    kdb_ent_header_t *indx_log;
+    kdb_incr_update_t upd;
+    XDR xdrs;
+
+    indx_log = INDEX(ulog, (sno - 1) % context->kdblog_context->ulogentries);
+    memset(&upd, 0, sizeof(upd));
+    xdrmem_create(&xdrs, (char *)indx_log->entry_data,
+                  indx_log->kdb_entry_size, XDR_DECODE);
+    if (!xdr_kdb_incr_update_t(&xdrs, &upd))
+        abort();
+    upd.kdb_commit = FALSE;
+    xdrmem_create(&xdrs, (char *)indx_log->entry_data,
+                  indx_log->kdb_entry_size, XDR_ENCODE);
+    if (!xdr_kdb_incr_update_t(&xdrs, &upd))
+        abort();
+    xdr_free((xdrproc_t)xdr_kdb_incr_update_t, (char *)&upd);
+}
+
+/* Test that ulog_add_update reinitializes the ulog when the last serial
+ * number is reached. */
+static void
+test_last_sno(const char *filename)
+{
+    kdb_log_context *lctx;
+    kdb_hlog_t *ulog;
+    kdb_incr_update_t upd;
+
+    ulog = map_new_ulog(filename);
     lctx = context->kdblog_context;
-    ulog = lctx->ulog;
 
     /* Modify the ulog to look like it has reached the last serial number.
      * Leave the timestamps at 0 and don't bother setting up the entries. */
@@ -84,5 +148,175 @@ main(int argc, char **argv)
     assert(ulog->kdb_num == 2);
     assert(ulog->kdb_first_sno == 1);
     assert(ulog->kdb_last_sno == 2);
+    ulog_fini(context);
+}
+
+/* Test that the stored encodings returned by ulog_get_raw_entries() go out
+ * on the wire exactly as the decoded updates would. */
+static void
+test_raw_entries(const char *filename)
+{
+    kdb_hlog_t *ulog;
+    kdb_ent_header_t *indx_log;
+    kdb_last_t last;
+    kdb_incr_result_t res;
+    kdb_incr_raw_result_t raw;
+    char buf1[4096], buf2[4096];
+    u_int len1, len2;
+    XDR xdrs;
+
+    ulog = map_new_ulog(filename);
+    add_updates(4);
+    assert(entry_commit_flag(ulog, ulog->kdb_last_sno));
+
+    /* An earlier release may have appended an entry to the ulog after it was
+     * upgraded.  It should still go out with the commit flag set. */
+    clear_commit_flag(ulog, ulog->kdb_last_sno);
+
+    /* Ask for the updates after the second entry in the ulog. */
+    indx_log = INDEX(ulog, ulog->kdb_first_sno %
+                     context->kdblog_context->ulogentries);
+    last.last_sno = indx_log->kdb_entry_sno;
+    last.last_time = indx_log->kdb_time;
+    if (ulog_get_entries(context, &last, &res) != 0)
+        abort();
+    if (ulog_get_raw_entries(context, &last, &raw) != 0)
+        abort();
+    assert(res.ret == UPDATE_OK && raw.result.ret == UPDATE_OK);
+    assert(raw.result.updates.kdb_ulog_t_len ==
+           ulog->kdb_last_sno - last.last_sno);
+    assert(raw.result.lastentry.last_sno == ulog->kdb_last_sno);
+
+    xdrmem_create(&xdrs, buf1, sizeof(buf1), XDR_ENCODE);
+    if (!xdr_kdb_incr_result_t(&xdrs, &res))
+        abort();
+    len1 = xdr_getpos(&xdrs);
+    xdrmem_create(&xdrs, buf2, sizeof(buf2), XDR_ENCODE);
+    if (!xdr_kdb_incr_raw_result_t(&xdrs, &raw))
+        abort();
+    len2 = xdr_getpos(&xdrs);
+    assert(len1 == len2 && memcmp(buf1, buf2, len1) == 0);
+
+    ulog_free_entries(res.updates.kdb_ulog_t_val, res.updates.kdb_ulog_t_len);
+    ulog_free_raw_entries(&raw);
+
+    /* A replica which is up to date gets no updates. */
+    last.last_sno = ulog->kdb_last_sno;
+    last.last_time = ulog->kdb_last_time;
+    if (ulog_get_raw_entries(context, &last, &raw) != 0)
+        abort();
+    assert(raw.result.ret == UPDATE_NIL);
+    assert(raw.result.updates.kdb_ulog_t_len == 0);
+    ulog_free_raw_entries(&raw);
+    ulog_fini(context);
+}
+
+/* Test that updates stored while syncs are deferred are published by
+ * ulog_sync(), and that the published log gives up the entries they
+ * overwrite. */
+static void
+test_deferred(const char *filename)
+{
+    kdb_hlog_t *ulog;
+    kdb_last_t last, cur;
+
+    ulog = map_new_ulog(filename);
+    add_updates(8);
+    assert(ulog->kdb_first_sno == 1 && ulog->kdb_last_sno == 9);
+    if (ulog_get_last(context, &last) != 0)
+        abort();
+
+    /* The second and third deferred updates wrap around the ulog. */
+    ulog_defer_sync(context, TRUE);
+    add_updates(3);
+    if (ulog_get_last(context, &cur) != 0)
+        abort();
+    assert(cur.last_sno == last.last_sno);
+    assert(ulog_get_sno_status(context, &last) == UPDATE_NIL);
+    assert(ulog->kdb_first_sno == 3 && ulog->kdb_num == 7);
+
+    ulog_defer_sync(context, FALSE);
+    assert(ulog->kdb_first_sno == 3 && ulog->kdb_last_sno == 12);
+    assert(ulog->kdb_num == 10);
+    assert(ulog_get_sno_status(context, &last) == UPDATE_OK);
+    ulog_fini(context);
+}
+
+/* Test that updates deferred across a failed commit are not published, and
+ * that replicas are made to resync fully. */
+static void
+test_abort_deferred(const char *filename)
+{
+    kdb_hlog_t *ulog;
+    kdb_last_t last;
+
+    ulog = map_new_ulog(filename);
+    add_updates(4);
+    if (ulog_get_last(context, &last) != 0)
+        abort();
+
+    ulog_defer_sync(context, TRUE);
+    ulog_defer_sync(context, TRUE);
+    add_updates(2);
+    ulog_abort_deferred(context);
+    assert(ulog->kdb_last_sno == last.last_sno);
+    ulog_defer_sync(context, FALSE);
+    assert(ulog->kdb_first_sno == 1 && ulog->kdb_last_sno == 1);
+    assert(ulog->kdb_num == 1);
+    assert(ulog_get_sno_status(context, &last) == UPDATE_FULL_RESYNC_NEEDED);
+
+    /* Later updates are published as usual. */
+    add_updates(1);
+    assert(ulog->kdb_last_sno == 2);
+    ulog_fini(context);
+}
+
+/* Test that mapping a version 1 ulog rewrites its entries with the commit
+ * flag set in their encodings, without discarding them. */
+static void
+test_upgrade(const char *filename)
+{
+    kdb_hlog_t *ulog;
+    kdb_sno_t sno, first, last;
+
+    ulog = map_new_ulog(filename);
+    add_updates(3);
+    first = ulog->kdb_first_sno;
+    last = ulog->kdb_last_sno;
+
+    /* Rewrite the ulog the way earlier releases stored it.  The first entry
+     * is the dummy entry created by ulog_map(), which has no encoding. */
+    for (sno = first + 1; sno <= last; sno++)
+        clear_commit_flag(ulog, sno);
+    ulog->db_version_num = 1;
+    assert(!entry_commit_flag(ulog, last));
+    ulog_fini(context);
+
+    if (ulog_map(context, filename, 10) != 0)
+        abort();
+    ulog = context->kdblog_context->ulog;
+    assert(ulog->db_version_num == KDB_VERSION);
+    assert(ulog->kdb_first_sno == first && ulog->kdb_last_sno == last);
+    for (sno = first + 1; sno <= last; sno++)
+        assert(entry_commit_flag(ulog, sno));
+    ulog_fini(context);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *filename;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s filename\n", argv[0]);
+        exit(1);
+    }
+    filename = argv[1];
+
+    test_last_sno(filename);
+    test_raw_entries(filename);
+    test_deferred(filename);
+    test_abort_deferred(filename);
+    test_upgrade(filename);
     return 0;
 }
@@ -28,18 +28,24 @@
 
 struct asn1buf_st {
     uint8_t *ptr;               /* Position, moving backwards; may be NULL */
+    uint8_t *base;              /* Start of the output buffer */
     size_t count;               /* Count of bytes written so far */
 };
 
 /**** Functions for encoding primitive types ****/
 
-/* Insert one byte into buf going backwards. */
+/* Insert one byte into buf going backwards.  If the output buffer is full,
+ * stop writing (leaving buf->ptr NULL) but continue counting. */
 static inline void
 insert_byte(asn1buf *buf, uint8_t o)
 {
     if (buf->ptr != NULL) {
-        buf->ptr--;
-        *buf->ptr = o;
+        if (buf->ptr == buf->base) {
+            buf->ptr = NULL;
+        } else {
+            buf->ptr--;
+            *buf->ptr = o;
+        }
     }
     buf->count++;
 }
@@ -50,8 +56,12 @@ static inline void
 insert_bytes(asn1buf *buf, const void *bytes, size_t len)
 {
     if (buf->ptr != NULL) {
-        memcpy(buf->ptr - len, bytes, len);
-        buf->ptr -= len;
+        if ((size_t)(buf->ptr - buf->base) < len) {
+            buf->ptr = NULL;
+        } else {
+            memcpy(buf->ptr - len, bytes, len);
+            buf->ptr -= len;
+        }
     }
     buf->count += len;
 }
@@ -169,6 +179,116 @@ k5_asn1_encode_bitstring(asn1buf *buf, uint8_t *const *val, size_t len)
     return 0;
 }
 
+/**** Arena allocation for decoded objects ****/
+
+/*
+ * An arena is a chain of blocks from which decoded objects are carved without
+ * individual headers.  Nothing allocated from an arena is freed on its own;
+ * the whole arena is released or reset at once.  Blocks grow geometrically, so
+ * a reused arena settles into a single block large enough for its typical
+ * message.
+ */
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK 4096
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;                /* Usable bytes following the header */
+    size_t used;
+};
+
+/* The size of a block header, rounded up to preserve alignment. */
+#define ARENA_HDR_SIZE ((sizeof(struct arena_block) + ARENA_ALIGN - 1) & \
+                        ~(size_t)(ARENA_ALIGN - 1))
+
+struct k5_asn1_arena_st {
+    struct arena_block *blocks; /* Newest (and largest) block first */
+};
+
+krb5_error_code
+k5_asn1_arena_create(k5_asn1_arena **arena_out)
+{
+    *arena_out = calloc(1, sizeof(**arena_out));
+    return (*arena_out == NULL) ? ENOMEM : 0;
+}
+
+void
+k5_asn1_arena_reset(k5_asn1_arena *arena)
+{
+    struct arena_block *b, *next;
+
+    if (arena == NULL || arena->blocks == NULL)
+        return;
+    /* Keep the newest block, which is the largest, for reuse. */
+    for (b = arena->blocks->next; b != NULL; b = next) {
+        next = b->next;
+        free(b);
+    }
+    arena->blocks->next = NULL;
+    arena->blocks->used = 0;
+}
+
+void
+k5_asn1_arena_free(k5_asn1_arena *arena)
+{
+    struct arena_block *b, *next;
+
+    if (arena == NULL)
+        return;
+    for (b = arena->blocks; b != NULL; b = next) {
+        next = b->next;
+        free(b);
+    }
+    free(arena);
+}
+
+void *
+k5_asn1_alloc(k5_asn1_arena *arena, size_t size)
+{
+    struct arena_block *b;
+    size_t bsize;
+    void *ptr;
+
+    if (arena == NULL)
+        return malloc(size);
+
+    if (size > SIZE_MAX / 2 - ARENA_HDR_SIZE)
+        return NULL;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    b = arena->blocks;
+    if (b == NULL || b->size - b->used < size) {
+        bsize = (b == NULL) ? ARENA_MIN_BLOCK : b->size * 2;
+        while (bsize < size)
+            bsize *= 2;
+        b = malloc(ARENA_HDR_SIZE + bsize);
+        if (b == NULL)
+            return NULL;
+        b->size = bsize;
+        b->used = 0;
+        b->next = arena->blocks;
+        arena->blocks = b;
+    }
+    ptr = (uint8_t *)b + ARENA_HDR_SIZE + b->used;
+    b->used += size;
+    return ptr;
+}
+
+/* Allocate zero-filled memory from arena, or from the heap if arena is
+ * NULL. */
+static void *
+alloc_zero(k5_asn1_arena *arena, size_t size)
+{
+    void *ptr;
+
+    if (arena == NULL)
+        return calloc(1, size);
+    ptr = k5_asn1_alloc(arena, size);
+    if (ptr != NULL)
+        memset(ptr, 0, size);
+    return ptr;
+}
+
 /**** Functions for decoding primitive types ****/
 
 krb5_error_code
@@ -220,8 +340,8 @@ k5_asn1_decode_uint(const uint8_t *asn1, size_t len, uintmax_t *val)
 }
 
 krb5_error_code
-k5_asn1_decode_bytestring(const uint8_t *asn1, size_t len,
-                          uint8_t **str_out, size_t *len_out)
+k5_asn1_decode_bytestring(k5_asn1_arena *arena, const uint8_t *asn1,
+                          size_t len, uint8_t **str_out, size_t *len_out)
 {
     uint8_t *str;
 
@@ -229,7 +349,7 @@ k5_asn1_decode_bytestring(const uint8_t *asn1, size_t len,
     *len_out = 0;
     if (len == 0)
         return 0;
-    str = malloc(len);
+    str = k5_asn1_alloc(arena, len);
     if (str == NULL)
         return ENOMEM;
     memcpy(str, asn1, len);
@@ -277,8 +397,8 @@ k5_asn1_decode_generaltime(const uint8_t *asn1, size_t len, time_t *time_out)
  * multiple of 8.
  */
 krb5_error_code
-k5_asn1_decode_bitstring(const uint8_t *asn1, size_t len,
-                         uint8_t **bits_out, size_t *len_out)
+k5_asn1_decode_bitstring(k5_asn1_arena *arena, const uint8_t *asn1,
+                         size_t len, uint8_t **bits_out, size_t *len_out)
 {
     uint8_t unused, *bits;
 
@@ -291,7 +411,7 @@ k5_asn1_decode_bitstring(const uint8_t *asn1, size_t len,
     if (unused > 7)
         return ASN1_BAD_FORMAT;
 
-    bits = malloc(len);
+    bits = k5_asn1_alloc(arena, len);
     if (bits == NULL)
         return ENOMEM;
     memcpy(bits, asn1, len);
@@ -628,15 +748,15 @@ split_der(asn1buf *buf, uint8_t *const *der, size_t len, taginfo *tag_out)
  * DER encoding.
  */
 static krb5_error_code
-store_der(const taginfo *t, const uint8_t *asn1, size_t len, void *val,
-          size_t *count_out)
+store_der(k5_asn1_arena *arena, const taginfo *t, const uint8_t *asn1,
+          size_t len, void *val, size_t *count_out)
 {
     uint8_t *der;
     size_t der_len;
 
     *count_out = 0;
     der_len = t->tag_len + len + t->tag_end_len;
-    der = malloc(der_len);
+    der = k5_asn1_alloc(arena, der_len);
     if (der == NULL)
         return ENOMEM;
     memcpy(der, asn1 - t->tag_len, der_len);
@@ -1128,24 +1248,30 @@ check_atype_tag(const struct atype_info *a, const taginfo *t)
 }
 
 static krb5_error_code
-decode_cntype(const taginfo *t, const uint8_t *asn1, size_t len,
-              const struct cntype_info *c, void *val, size_t *count_out);
+decode_cntype(k5_asn1_arena *arena, const taginfo *t, const uint8_t *asn1,
+              size_t len, const struct cntype_info *c, void *val,
+              size_t *count_out);
 static krb5_error_code
-decode_atype_to_ptr(const taginfo *t, const uint8_t *asn1, size_t len,
+decode_atype_to_ptr(k5_asn1_arena *arena, const taginfo *t,
+                    const uint8_t *asn1, size_t len,
                     const struct atype_info *basetype, void **ptr_out);
 static krb5_error_code
-decode_sequence(const uint8_t *asn1, size_t len, const struct seq_info *seq,
-                void *val);
+decode_sequence(k5_asn1_arena *arena, const uint8_t *asn1, size_t len,
+                const struct seq_info *seq, void *val);
 static krb5_error_code
-decode_sequence_of(const uint8_t *asn1, size_t len,
-                   const struct atype_info *elemtype, void **seq_out,
-                   size_t *count_out);
+decode_sequence_of(k5_asn1_arena *arena, const uint8_t *asn1, size_t len,
+                   const struct atype_info *elemtype, size_t extra,
+                   void **seq_out, size_t *count_out);
 
-/* Given the enclosing tag t, decode from asn1/len the contents of the ASN.1
- * type specified by a, placing the result into val (caller-allocated). */
+/*
+ * Given the enclosing tag t, decode from asn1/len the contents of the ASN.1
+ * type specified by a, placing the result into val (caller-allocated).  If
+ * arena is not NULL, allocate all memory for the result from it, and do not
+ * free partial results on error.
+ */
 static krb5_error_code
-decode_atype(const taginfo *t, const uint8_t *asn1, size_t len,
-             const struct atype_info *a, void *val)
+decode_atype(k5_asn1_arena *arena, const taginfo *t, const uint8_t *asn1,
+             size_t len, const struct atype_info *a, void *val)
 {
     krb5_error_code ret;
 
@@ -1153,19 +1279,20 @@ decode_atype(const taginfo *t, const uint8_t *asn1, size_t len,
     case atype_fn: {
         const struct fn_info *fn = a->tinfo;
         assert(fn->dec != NULL);
-        return fn->dec(t, asn1, len, val);
+        return fn->dec(arena, t, asn1, len, val);
     }
     case atype_sequence:
-        return decode_sequence(asn1, len, a->tinfo, val);
+        return decode_sequence(arena, asn1, len, a->tinfo, val);
     case atype_ptr: {
         const struct ptr_info *ptrinfo = a->tinfo;
         void *ptr = LOADPTR(val, ptrinfo);
         assert(ptrinfo->basetype != NULL);
         if (ptr != NULL) {
             /* Container was already allocated by a previous sequence field. */
-            return decode_atype(t, asn1, len, ptrinfo->basetype, ptr);
+            return decode_atype(arena, t, asn1, len, ptrinfo->basetype, ptr);
         } else {
-            ret = decode_atype_to_ptr(t, asn1, len, ptrinfo->basetype, &ptr);
+            ret = decode_atype_to_ptr(arena, t, asn1, len, ptrinfo->basetype,
+                                      &ptr);
             if (ret)
                 return ret;
             STOREPTR(ptr, ptrinfo, val);
@@ -1175,19 +1302,20 @@ decode_atype(const taginfo *t, const uint8_t *asn1, size_t len,
     case atype_offset: {
         const struct offset_info *off = a->tinfo;
         assert(off->basetype != NULL);
-        return decode_atype(t, asn1, len, off->basetype,
+        return decode_atype(arena, t, asn1, len, off->basetype,
                             (char *)val + off->dataoff);
     }
     case atype_optional: {
         const struct optional_info *opt = a->tinfo;
-        return decode_atype(t, asn1, len, opt->basetype, val);
+        return decode_atype(arena, t, asn1, len, opt->basetype, val);
     }
     case atype_counted: {
         const struct counted_info *counted = a->tinfo;
         void *dataptr = (char *)val + counted->dataoff;
         size_t count;
         assert(counted->basetype != NULL);
-        ret = decode_cntype(t, asn1, len, counted->basetype, dataptr, &count);
+        ret = decode_cntype(arena, t, asn1, len, counted->basetype, dataptr,
+                            &count);
         if (ret)
             return ret;
         return store_count(count, counted, val);
@@ -1207,7 +1335,7 @@ decode_atype(const taginfo *t, const uint8_t *asn1, size_t len,
             if (!check_atype_tag(tag->basetype, tp))
                 return ASN1_BAD_ID;
         }
-        return decode_atype(tp, asn1, len, tag->basetype, val);
+        return decode_atype(arena, tp, asn1, len, tag->basetype, val);
     }
     case atype_bool: {
         intmax_t intval;
@@ -1259,8 +1387,9 @@ decode_atype(const taginfo *t, const uint8_t *asn1, size_t len,
  * set *count_out to SIZE_MAX.
  */
 static krb5_error_code
-decode_cntype(const taginfo *t, const uint8_t *asn1, size_t len,
-              const struct cntype_info *c, void *val, size_t *count_out)
+decode_cntype(k5_asn1_arena *arena, const taginfo *t, const uint8_t *asn1,
+              size_t len, const struct cntype_info *c, void *val,
+              size_t *count_out)
 {
     krb5_error_code ret;
 
@@ -1268,16 +1397,16 @@ decode_cntype(const taginfo *t, const uint8_t *asn1, size_t len,
     case cntype_string: {
         const struct string_info *string = c->tinfo;
         assert(string->dec != NULL);
-        return string->dec(asn1, len, val, count_out);
+        return string->dec(arena, asn1, len, val, count_out);
     }
     case cntype_der:
-        return store_der(t, asn1, len, val, count_out);
+        return store_der(arena, t, asn1, len, val, count_out);
     case cntype_seqof: {
         const struct atype_info *a = c->tinfo;
         const struct ptr_info *ptrinfo = a->tinfo;
         void *seq;
         assert(a->type == atype_ptr);
-        ret = decode_sequence_of(asn1, len, ptrinfo->basetype, &seq,
+        ret = decode_sequence_of(arena, asn1, len, ptrinfo->basetype, 0, &seq,
                                  count_out);
         if (ret)
             return ret;
@@ -1289,7 +1418,8 @@ decode_cntype(const taginfo *t, const uint8_t *asn1, size_t len,
         size_t i;
         for (i = 0; i < choice->n_options; i++) {
             if (check_atype_tag(choice->options[i], t)) {
-                ret = decode_atype(t, asn1, len, choice->options[i], val);
+                ret = decode_atype(arena, t, asn1, len, choice->options[i],
+                                   val);
                 if (ret)
                     return ret;
                 *count_out = i;
@@ -1309,27 +1439,22 @@ decode_cntype(const taginfo *t, const uint8_t *asn1, size_t len,
     return 0;
 }
 
-/* Add a null pointer to the end of a sequence.  ptr is consumed on success
- * (to be replaced by *ptr_out), left alone on failure. */
-static krb5_error_code
-null_terminate(const struct atype_info *eltinfo, void *ptr, size_t count,
-               void **ptr_out)
+/* Add a null pointer to the end of a sequence of count elements.  The
+ * sequence must have been allocated with room for it. */
+static void
+null_terminate(const struct atype_info *eltinfo, void *ptr, size_t count)
 {
     const struct ptr_info *ptrinfo = eltinfo->tinfo;
     void *endptr;
 
     assert(eltinfo->type == atype_ptr);
-    ptr = realloc(ptr, (count + 1) * eltinfo->size);
-    if (ptr == NULL)
-        return ENOMEM;
     endptr = (char *)ptr + count * eltinfo->size;
     STOREPTR(NULL, ptrinfo, endptr);
-    *ptr_out = ptr;
-    return 0;
 }
 
 static krb5_error_code
-decode_atype_to_ptr(const taginfo *t, const uint8_t *asn1, size_t len,
+decode_atype_to_ptr(k5_asn1_arena *arena, const taginfo *t,
+                    const uint8_t *asn1, size_t len,
                     const struct atype_info *a, void **ptr_out)
 {
     krb5_error_code ret;
@@ -1340,24 +1465,22 @@ decode_atype_to_ptr(const taginfo *t, const uint8_t *asn1, size_t len,
     switch (a->type) {
     case atype_nullterm_sequence_of:
     case atype_nonempty_nullterm_sequence_of:
-        ret = decode_sequence_of(asn1, len, a->tinfo, &ptr, &count);
+        ret = decode_sequence_of(arena, asn1, len, a->tinfo, 1, &ptr,
+                                 &count);
         if (ret)
             return ret;
-        ret = null_terminate(a->tinfo, ptr, count, &ptr);
-        if (ret) {
-            free_sequence_of(a->tinfo, ptr, count);
-            return ret;
-        }
+        null_terminate(a->tinfo, ptr, count);
         /* Historically we do not enforce non-emptiness of sequences when
          * decoding, even when it is required by the ASN.1 type. */
         break;
     default:
-        ptr = calloc(a->size, 1);
+        ptr = alloc_zero(arena, a->size);
         if (ptr == NULL)
             return ENOMEM;
-        ret = decode_atype(t, asn1, len, a, ptr);
+        ret = decode_atype(arena, t, asn1, len, a, ptr);
         if (ret) {
-            free(ptr);
+            if (arena == NULL)
+                free(ptr);
             return ret;
         }
         break;
@@ -1408,8 +1531,8 @@ omit_atype(const struct atype_info *a, void *val)
 
 /* Decode an ASN.1 sequence into a C object. */
 static krb5_error_code
-decode_sequence(const uint8_t *asn1, size_t len, const struct seq_info *seq,
-                void *val)
+decode_sequence(k5_asn1_arena *arena, const uint8_t *asn1, size_t len,
+                const struct seq_info *seq, void *val)
 {
     krb5_error_code ret;
     const uint8_t *contents;
@@ -1441,7 +1564,7 @@ decode_sequence(const uint8_t *asn1, size_t len, const struct seq_info *seq,
          * changing this before making the encoder visible to plugins. */
         if (i == seq->n_fields)
             break;
-        ret = decode_atype(&t, contents, clen, seq->fields[i], val);
+        ret = decode_atype(arena, &t, contents, clen, seq->fields[i], val);
         if (ret)
             goto error;
     }
@@ -1455,6 +1578,9 @@ decode_sequence(const uint8_t *asn1, size_t len, const struct seq_info *seq,
     return 0;
 
 error:
+    /* Partial results in an arena are released with the arena. */
+    if (arena != NULL)
+        return ret;
     /* Free what we've decoded so far.  Free pointers in a second pass in
      * case multiple fields refer to the same pointer. */
     for (j = 0; j < i; j++)
@@ -1464,19 +1590,42 @@ error:
     return ret;
 }
 
+/*
+ * Decode the elements of a sequence-of into a newly allocated array, with
+ * extra zero-filled elements at the end.  If the sequence is empty and extra
+ * is 0, set *seq_out to NULL.
+ */
 static krb5_error_code
-decode_sequence_of(const uint8_t *asn1, size_t len,
-                   const struct atype_info *elemtype, void **seq_out,
-                   size_t *count_out)
+decode_sequence_of(k5_asn1_arena *arena, const uint8_t *asn1, size_t len,
+                   const struct atype_info *elemtype, size_t extra,
+                   void **seq_out, size_t *count_out)
 {
     krb5_error_code ret;
-    void *seq = NULL, *elem, *newseq;
-    const uint8_t *contents;
-    size_t clen, count = 0;
+    void *seq = NULL, *elem;
+    const uint8_t *contents, *p;
+    size_t clen, plen, nelems = 0, count = 0;
     taginfo t;
 
     *seq_out = NULL;
     *count_out = 0;
+
+    /* Count the elements first so that the array is allocated only once. */
+    p = asn1;
+    plen = len;
+    while (plen > 0) {
+        ret = get_tag(p, plen, &t, &contents, &clen, &p, &plen);
+        if (ret)
+            return ret;
+        nelems++;
+    }
+    if (nelems + extra == 0)
+        return 0;
+    if (nelems + extra > SIZE_MAX / elemtype->size)
+        return ENOMEM;
+    seq = alloc_zero(arena, (nelems + extra) * elemtype->size);
+    if (seq == NULL)
+        return ENOMEM;
+
     while (len > 0) {
         ret = get_tag(asn1, len, &t, &contents, &clen, &asn1, &len);
         if (ret)
@@ -1485,15 +1634,8 @@ decode_sequence_of(const uint8_t *asn1, size_t len,
             ret = ASN1_BAD_ID;
             goto error;
         }
-        newseq = realloc(seq, (count + 1) * elemtype->size);
-        if (newseq == NULL) {
-            ret = ENOMEM;
-            goto error;
-        }
-        seq = newseq;
         elem = (char *)seq + count * elemtype->size;
-        memset(elem, 0, elemtype->size);
-        ret = decode_atype(&t, contents, clen, elemtype, elem);
+        ret = decode_atype(arena, &t, contents, clen, elemtype, elem);
         if (ret)
             goto error;
         count++;
@@ -1503,8 +1645,10 @@ decode_sequence_of(const uint8_t *asn1, size_t len,
     return 0;
 
 error:
-    free_sequence_of(elemtype, seq, count);
-    free(seq);
+    if (arena == NULL) {
+        free_sequence_of(elemtype, seq, count);
+        free(seq);
+    }
     return ret;
 }
 
@@ -1519,49 +1663,85 @@ k5_asn1_encode_atype(asn1buf *buf, const void *val, const struct atype_info *a,
 }
 
 krb5_error_code
-k5_asn1_decode_atype(const taginfo *t, const uint8_t *asn1, size_t len,
+k5_asn1_decode_atype(k5_asn1_arena *arena, const taginfo *t,
+                     const uint8_t *asn1, size_t len,
                      const struct atype_info *a, void *val)
 {
-    return decode_atype(t, asn1, len, a, val);
+    return decode_atype(arena, t, asn1, len, a, val);
 }
 
 krb5_error_code
-k5_asn1_full_encode(const void *rep, const struct atype_info *a,
-                    krb5_data **code_out)
+k5_asn1_encode_length(const void *rep, const struct atype_info *a,
+                      size_t *len_out)
 {
     krb5_error_code ret;
     asn1buf buf;
-    krb5_data *d;
-    uint8_t *bytes;
 
-    *code_out = NULL;
+    *len_out = 0;
+    if (rep == NULL)
+        return ASN1_MISSING_FIELD;
+
+    /* Make a pass over rep without an output buffer to count the encoding
+     * size. */
+    buf.ptr = buf.base = NULL;
+    buf.count = 0;
+    ret = encode_atype_and_tag(&buf, rep, a);
+    if (ret)
+        return ret;
+    *len_out = buf.count;
+    return 0;
+}
+
+krb5_error_code
+k5_asn1_encode_into(const void *rep, const struct atype_info *a,
+                    uint8_t *out, size_t len)
+{
+    krb5_error_code ret;
+    asn1buf buf;
 
     if (rep == NULL)
         return ASN1_MISSING_FIELD;
 
-    /* Make a first pass over rep to count the encoding size. */
-    buf.ptr = NULL;
+    /* buf.ptr moves backwards as we encode, and must exactly return to the
+     * base.  If the encoding is longer than len, writing stops at the base
+     * and buf.ptr becomes NULL. */
+    buf.ptr = out + len;
+    buf.base = out;
     buf.count = 0;
     ret = encode_atype_and_tag(&buf, rep, a);
+    if (ret)
+        return ret;
+    if (buf.ptr != out || buf.count != len)
+        return ASN1_BAD_LENGTH;
+    return 0;
+}
+
+krb5_error_code
+k5_asn1_full_encode(const void *rep, const struct atype_info *a,
+                    krb5_data **code_out)
+{
+    krb5_error_code ret;
+    krb5_data *d;
+    uint8_t *bytes;
+    size_t len;
+
+    *code_out = NULL;
+
+    ret = k5_asn1_encode_length(rep, a, &len);
     if (ret)
         return ret;
 
     /* Allocate space for the encoding. */
-    bytes = malloc(buf.count + 1);
+    bytes = malloc(len + 1);
     if (bytes == NULL)
         return ENOMEM;
-    bytes[buf.count] = 0;
+    bytes[len] = 0;
 
-    /* Make a second pass over rep to encode it.  buf.ptr moves backwards as we
-     * encode, and will always exactly return to the base. */
-    buf.ptr = bytes + buf.count;
-    buf.count = 0;
-    ret = encode_atype_and_tag(&buf, rep, a);
+    ret = k5_asn1_encode_into(rep, a, bytes, len);
     if (ret) {
         free(bytes);
         return ret;
     }
-    assert(buf.ptr == bytes);
 
     /* Create the output data object. */
     *code_out = malloc(sizeof(*d));
@@ -1569,13 +1749,20 @@ k5_asn1_full_encode(const void *rep, const struct atype_info *a,
         free(bytes);
         return ENOMEM;
     }
-    **code_out = make_data(bytes, buf.count);
+    **code_out = make_data(bytes, len);
     return 0;
 }
 
 krb5_error_code
 k5_asn1_full_decode(const krb5_data *code, const struct atype_info *a,
                     void **retrep)
+{
+    return k5_asn1_full_decode_arena(NULL, code, a, retrep);
+}
+
+krb5_error_code
+k5_asn1_full_decode_arena(k5_asn1_arena *arena, const krb5_data *code,
+                          const struct atype_info *a, void **retrep)
 {
     krb5_error_code ret;
     const uint8_t *contents, *remainder;
@@ -1591,5 +1778,5 @@ k5_asn1_full_decode(const krb5_data *code, const struct atype_info *a,
      * non-length-preserving enctypes, it will sometimes be nonzero). */
     if (!check_atype_tag(a, &t))
         return ASN1_BAD_ID;
-    return decode_atype_to_ptr(&t, contents, clen, a, retrep);
+    return decode_atype_to_ptr(arena, &t, contents, clen, a, retrep);
 }
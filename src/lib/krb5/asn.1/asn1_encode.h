@@ -65,11 +65,17 @@ krb5_error_code k5_asn1_decode_uint(const uint8_t *asn1, size_t len,
                                     uintmax_t *val);
 krb5_error_code k5_asn1_decode_generaltime(const uint8_t *asn1, size_t len,
                                            time_t *time_out);
-krb5_error_code k5_asn1_decode_bytestring(const uint8_t *asn1, size_t len,
+krb5_error_code k5_asn1_decode_bytestring(k5_asn1_arena *arena,
+                                          const uint8_t *asn1, size_t len,
                                           uint8_t **str_out, size_t *len_out);
-krb5_error_code k5_asn1_decode_bitstring(const uint8_t *asn1, size_t len,
+krb5_error_code k5_asn1_decode_bitstring(k5_asn1_arena *arena,
+                                         const uint8_t *asn1, size_t len,
                                          uint8_t **bits_out, size_t *len_out);
 
+/* Allocate size bytes (not zero-filled) from arena, or from the heap if arena
+ * is NULL.  Decoder functions use this for all memory in decoded objects. */
+void *k5_asn1_alloc(k5_asn1_arena *arena, size_t size);
+
 /*
  * An atype_info structure specifies how to map a C object to an ASN.1 value.
  *
@@ -146,7 +152,8 @@ struct atype_info {
 
 struct fn_info {
     krb5_error_code (*enc)(asn1buf *, const void *, taginfo *);
-    krb5_error_code (*dec)(const taginfo *, const uint8_t *, size_t, void *);
+    krb5_error_code (*dec)(k5_asn1_arena *, const taginfo *, const uint8_t *,
+                           size_t, void *);
     int (*check_tag)(const taginfo *);
     void (*free_func)(void *);
 };
@@ -224,7 +231,8 @@ struct cntype_info {
 
 struct string_info {
     krb5_error_code (*enc)(asn1buf *, uint8_t *const *, size_t);
-    krb5_error_code (*dec)(const uint8_t *, size_t, uint8_t **, size_t *);
+    krb5_error_code (*dec)(k5_asn1_arena *, const uint8_t *, size_t,
+                           uint8_t **, size_t *);
     unsigned int tagval : 5;
 };
 
@@ -529,7 +537,8 @@ k5_asn1_encode_atype(asn1buf *buf, const void *val, const struct atype_info *a,
 /* Decode the tag and contents of a type, storing the result in the
  * caller-allocated C object val.  Used only by kdc_req_body. */
 krb5_error_code
-k5_asn1_decode_atype(const taginfo *t, const uint8_t *asn1, size_t len,
+k5_asn1_decode_atype(k5_asn1_arena *arena, const taginfo *t,
+                     const uint8_t *asn1, size_t len,
                      const struct atype_info *a, void *val);
 
 /* Returns a completed encoding, with tag and in the correct byte order, in an
@@ -541,6 +550,23 @@ krb5_error_code
 k5_asn1_full_decode(const krb5_data *code, const struct atype_info *a,
                     void **rep_out);
 
+/* Compute the exact length of the encoding of rep. */
+krb5_error_code
+k5_asn1_encode_length(const void *rep, const struct atype_info *a,
+                      size_t *len_out);
+
+/* Encode rep into out, which must be exactly the length computed by
+ * k5_asn1_encode_length().  Return ASN1_BAD_LENGTH if it is not. */
+krb5_error_code
+k5_asn1_encode_into(const void *rep, const struct atype_info *a,
+                    uint8_t *out, size_t len);
+
+/* Like k5_asn1_full_decode, but allocate the result from arena.  The result
+ * must not be freed except by resetting or freeing the arena. */
+krb5_error_code
+k5_asn1_full_decode_arena(k5_asn1_arena *arena, const krb5_data *code,
+                          const struct atype_info *a, void **rep_out);
+
 #define MAKE_ENCODER(FNAME, DESC)                                       \
     krb5_error_code                                                     \
     FNAME(const aux_type_##DESC *rep, krb5_data **code_out)             \
@@ -549,6 +575,21 @@ k5_asn1_full_decode(const krb5_data *code, const struct atype_info *a,
     }                                                                   \
     extern int dummy /* gobble semicolon */
 
+/* Define FNAME_length and FNAME_into functions, for callers which place the
+ * encoding in a buffer of their own. */
+#define MAKE_SIZED_ENCODER(FNAME, DESC)                                 \
+    krb5_error_code                                                     \
+    FNAME##_length(const aux_type_##DESC *rep, size_t *len_out)         \
+    {                                                                   \
+        return k5_asn1_encode_length(rep, &k5_atype_##DESC, len_out);   \
+    }                                                                   \
+    krb5_error_code                                                     \
+    FNAME##_into(const aux_type_##DESC *rep, uint8_t *out, size_t len)  \
+    {                                                                   \
+        return k5_asn1_encode_into(rep, &k5_atype_##DESC, out, len);    \
+    }                                                                   \
+    extern int dummy /* gobble semicolon */
+
 #define MAKE_DECODER(FNAME, DESC)                                       \
     krb5_error_code                                                     \
     FNAME(const krb5_data *code, aux_type_##DESC **rep_out)             \
@@ -564,6 +605,23 @@ k5_asn1_full_decode(const krb5_data *code, const struct atype_info *a,
     }                                                                   \
     extern int dummy /* gobble semicolon */
 
+#define MAKE_ARENA_DECODER(FNAME, DESC)                                 \
+    krb5_error_code                                                     \
+    FNAME(k5_asn1_arena *arena, const krb5_data *code,                  \
+          aux_type_##DESC **rep_out)                                    \
+    {                                                                   \
+        krb5_error_code ret;                                            \
+        void *rep;                                                      \
+        *rep_out = NULL;                                                \
+        ret = k5_asn1_full_decode_arena(arena, code, &k5_atype_##DESC,  \
+                                        &rep);                          \
+        if (ret)                                                        \
+            return ret;                                                 \
+        *rep_out = rep;                                                 \
+        return 0;                                                       \
+    }                                                                   \
+    extern int dummy /* gobble semicolon */
+
 #include <stddef.h>
 /*
  * Ugly hack!
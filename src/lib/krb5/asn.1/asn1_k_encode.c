@@ -131,7 +131,8 @@ encode_seqno(asn1buf *buf, const void *p, taginfo *rettag)
     return 0;
 }
 static krb5_error_code
-decode_seqno(const taginfo *t, const uint8_t *asn1, size_t len, void *p)
+decode_seqno(k5_asn1_arena *arena, const taginfo *t, const uint8_t *asn1,
+             size_t len, void *p)
 {
     krb5_error_code ret;
     intmax_t val;
@@ -165,8 +166,8 @@ encode_kerberos_time(asn1buf *buf, const void *p, taginfo *rettag)
     return k5_asn1_encode_generaltime(buf, val);
 }
 static krb5_error_code
-decode_kerberos_time(const taginfo *t, const uint8_t *asn1, size_t len,
-                     void *p)
+decode_kerberos_time(k5_asn1_arena *arena, const taginfo *t,
+                     const uint8_t *asn1, size_t len, void *p)
 {
     krb5_error_code ret;
     time_t val;
@@ -239,13 +240,14 @@ encode_krb5_flags(asn1buf *buf, const void *p, taginfo *rettag)
     return k5_asn1_encode_bitstring(buf, &cptr, 4);
 }
 static krb5_error_code
-decode_krb5_flags(const taginfo *t, const uint8_t *asn1, size_t len, void *val)
+decode_krb5_flags(k5_asn1_arena *arena, const taginfo *t, const uint8_t *asn1,
+                  size_t len, void *val)
 {
     krb5_error_code ret;
     size_t i, blen;
     krb5_flags f = 0;
     uint8_t *bits;
-    ret = k5_asn1_decode_bitstring(asn1, len, &bits, &blen);
+    ret = k5_asn1_decode_bitstring(NULL, asn1, len, &bits, &blen);
     if (ret)
         return ret;
     /* Copy up to 32 bits into f, starting at the most significant byte. */
@@ -325,7 +327,8 @@ encode_lr_type(asn1buf *buf, const void *p, taginfo *rettag)
     return 0;
 }
 static krb5_error_code
-decode_lr_type(const taginfo *t, const uint8_t *asn1, size_t len, void *p)
+decode_lr_type(k5_asn1_arena *arena, const taginfo *t, const uint8_t *asn1,
+               size_t len, void *p)
 {
     krb5_error_code ret;
     intmax_t val;
@@ -499,15 +502,33 @@ free_kdc_req_body(void *val)
     free(req->authorization_data.ciphertext.data);
     krb5_free_tickets(NULL, req->second_ticket);
 }
+/* Copy a realm for decode_kdc_req_body, allocating from arena if it is not
+ * NULL. */
 static krb5_error_code
-decode_kdc_req_body(const taginfo *t, const uint8_t *asn1, size_t len,
-                    void *val)
+copy_realm(k5_asn1_arena *arena, const krb5_data *in, krb5_data *out)
+{
+    if (arena == NULL)
+        return krb5int_copy_data_contents(NULL, in, out);
+    *out = make_data(NULL, 0);
+    if (in->length == 0)
+        return 0;
+    out->data = k5_asn1_alloc(arena, in->length);
+    if (out->data == NULL)
+        return ENOMEM;
+    memcpy(out->data, in->data, in->length);
+    out->length = in->length;
+    return 0;
+}
+static krb5_error_code
+decode_kdc_req_body(k5_asn1_arena *arena, const taginfo *t,
+                    const uint8_t *asn1, size_t len, void *val)
 {
     krb5_error_code ret;
     kdc_req_hack h;
     krb5_kdc_req *b = val;
     memset(&h, 0, sizeof(h));
-    ret = k5_asn1_decode_atype(t, asn1, len, &k5_atype_kdc_req_body_hack, &h);
+    ret = k5_asn1_decode_atype(arena, t, asn1, len,
+                               &k5_atype_kdc_req_body_hack, &h);
     if (ret)
         return ret;
     b->kdc_options = h.v.kdc_options;
@@ -523,11 +544,12 @@ decode_kdc_req_body(const taginfo *t, const uint8_t *asn1, size_t len,
     b->authorization_data = h.v.authorization_data;
     b->second_ticket = h.v.second_ticket;
     if (b->client != NULL && b->server != NULL) {
-        ret = krb5int_copy_data_contents(NULL, &h.server_realm,
-                                         &b->client->realm);
+        ret = copy_realm(arena, &h.server_realm, &b->client->realm);
         if (ret) {
-            free_kdc_req_body(b);
-            free(h.server_realm.data);
+            if (arena == NULL) {
+                free_kdc_req_body(b);
+                free(h.server_realm.data);
+            }
             return ret;
         }
         b->server->realm = h.server_realm;
@@ -535,7 +557,7 @@ decode_kdc_req_body(const taginfo *t, const uint8_t *asn1, size_t len,
         b->client->realm = h.server_realm;
     else if (b->server != NULL)
         b->server->realm = h.server_realm;
-    else
+    else if (arena == NULL)
         free(h.server_realm.data);
     return 0;
 }
@@ -1143,12 +1165,16 @@ DEFSEQTYPE(iakerb_finished, krb5_iakerb_finished, iakerb_finished_fields);
 
 MAKE_ENCODER(encode_krb5_authenticator, authenticator);
 MAKE_DECODER(decode_krb5_authenticator, authenticator);
+MAKE_ARENA_DECODER(decode_krb5_authenticator_arena, authenticator);
 MAKE_ENCODER(encode_krb5_ticket, ticket);
 MAKE_DECODER(decode_krb5_ticket, ticket);
+MAKE_ARENA_DECODER(decode_krb5_ticket_arena, ticket);
 MAKE_ENCODER(encode_krb5_encryption_key, encryption_key);
 MAKE_DECODER(decode_krb5_encryption_key, encryption_key);
 MAKE_ENCODER(encode_krb5_enc_tkt_part, enc_tkt_part);
+MAKE_SIZED_ENCODER(encode_krb5_enc_tkt_part, enc_tkt_part);
 MAKE_DECODER(decode_krb5_enc_tkt_part, enc_tkt_part);
+MAKE_ARENA_DECODER(decode_krb5_enc_tkt_part_arena, enc_tkt_part);
 
 krb5_error_code KRB5_CALLCONV
 krb5_decode_ticket(const krb5_data *code, krb5_ticket **repptr)
@@ -1163,6 +1189,7 @@ krb5_decode_ticket(const krb5_data *code, krb5_ticket **repptr)
  * pushed up into libkrb5.
  */
 MAKE_ENCODER(encode_krb5_enc_kdc_rep_part, enc_tgs_rep_part);
+MAKE_SIZED_ENCODER(encode_krb5_enc_kdc_rep_part, enc_tgs_rep_part);
 krb5_error_code
 decode_krb5_enc_kdc_rep_part(const krb5_data *code,
                              krb5_enc_kdc_rep_part **rep_out)
@@ -1188,18 +1215,23 @@ decode_krb5_enc_kdc_rep_part(const krb5_data *code,
 
 MAKE_ENCODER(encode_krb5_as_rep, as_rep);
 MAKE_DECODER(decode_krb5_as_rep, as_rep);
+MAKE_ARENA_DECODER(decode_krb5_as_rep_arena, as_rep);
 MAKE_ENCODER(encode_krb5_tgs_rep, tgs_rep);
 MAKE_DECODER(decode_krb5_tgs_rep, tgs_rep);
+MAKE_ARENA_DECODER(decode_krb5_tgs_rep_arena, tgs_rep);
 MAKE_ENCODER(encode_krb5_ap_req, ap_req);
 MAKE_DECODER(decode_krb5_ap_req, ap_req);
+MAKE_ARENA_DECODER(decode_krb5_ap_req_arena, ap_req);
 MAKE_ENCODER(encode_krb5_ap_rep, ap_rep);
 MAKE_DECODER(decode_krb5_ap_rep, ap_rep);
 MAKE_ENCODER(encode_krb5_ap_rep_enc_part, ap_rep_enc_part);
 MAKE_DECODER(decode_krb5_ap_rep_enc_part, ap_rep_enc_part);
 MAKE_ENCODER(encode_krb5_as_req, as_req_encode);
 MAKE_DECODER(decode_krb5_as_req, as_req);
+MAKE_ARENA_DECODER(decode_krb5_as_req_arena, as_req);
 MAKE_ENCODER(encode_krb5_tgs_req, tgs_req_encode);
 MAKE_DECODER(decode_krb5_tgs_req, tgs_req);
+MAKE_ARENA_DECODER(decode_krb5_tgs_req_arena, tgs_req);
 MAKE_ENCODER(encode_krb5_kdc_req_body, kdc_req_body);
 MAKE_DECODER(decode_krb5_kdc_req_body, kdc_req_body);
 MAKE_ENCODER(encode_krb5_safe, safe);
@@ -1268,6 +1300,7 @@ MAKE_ENCODER(encode_krb5_pa_enc_ts, pa_enc_ts);
 MAKE_DECODER(decode_krb5_pa_enc_ts, pa_enc_ts);
 MAKE_ENCODER(encode_krb5_padata_sequence, seqof_pa_data);
 MAKE_DECODER(decode_krb5_padata_sequence, seqof_pa_data);
+MAKE_ARENA_DECODER(decode_krb5_padata_sequence_arena, seqof_pa_data);
 /* sam preauth additions */
 MAKE_ENCODER(encode_krb5_sam_challenge_2, sam_challenge_2);
 MAKE_DECODER(decode_krb5_sam_challenge_2, sam_challenge_2);
@@ -45,6 +45,31 @@ k5_cc_retrieve_cred_default(krb5_context, krb5_ccache, krb5_flags,
 krb5_boolean
 krb5int_cc_creds_match_request(krb5_context, krb5_flags whichfields, krb5_creds *mcreds, krb5_creds *creds);
 
+/* An immutable, parsed copy of a ccache's contents (ccsnap.c). */
+struct k5_cc_snapshot {
+    krb5_creds *creds;
+    size_t ncreds;
+};
+
+/* Get a snapshot of cache's contents, reusing a cached one if it is still
+ * current.  Release the result with k5_cc_snapshot_release(). */
+krb5_error_code
+k5_cc_snapshot_get(krb5_context context, krb5_ccache cache,
+                   struct k5_cc_snapshot **snap_out);
+
+void
+k5_cc_snapshot_release(struct k5_cc_snapshot *snap);
+
+/* Discard all snapshots; called when any ccache is modified. */
+void
+k5_cc_snapshot_invalidate(void);
+
+int
+k5_cc_snapshot_initialize(void);
+
+void
+k5_cc_snapshot_finalize(void);
+
 int
 krb5int_cc_initialize(void);
 
@@ -61,11 +61,19 @@ struct uuid_list {
     size_t pos;
 };
 
+/* A list of zero-terminated cache names, as returned by GET_CACHE_LIST. */
+struct name_list {
+    char *namebytes;            /* all of the names concatenated together */
+    size_t len;
+    size_t pos;
+};
+
 struct kcmio {
     SOCKET fd;
 #ifdef __APPLE__
     mach_port_t mport;
 #endif
+    krb5_boolean no_cred_list;  /* daemon doesn't support GET_CRED_LIST */
 };
 
 /* This structure bundles together a KCM request and reply, to minimize how
@@ -85,11 +93,33 @@ struct kcm_cache_data {
 
 struct kcm_ptcursor {
     char *residual;             /* primary or singleton subsidiary */
-    struct uuid_list *uuids;    /* NULL for singleton subsidiary */
+    struct name_list *names;    /* initialized caches, if server supports it */
+    struct uuid_list *uuids;    /* NULL for singleton subsidiary or names */
     struct kcmio *io;
     krb5_boolean first;
 };
 
+/* Credential cursor.  If the server supports GET_CRED_LIST, creds holds all
+ * of the credentials fetched with one call, and ownership of each is
+ * transferred to the caller as it is yielded.  Otherwise uuids is used to
+ * fetch each credential with GET_CRED_BY_UUID. */
+struct kcm_cursor {
+    struct uuid_list *uuids;
+    krb5_creds *creds;
+    size_t count;
+    size_t pos;
+};
+
+/* Return true if code could indicate an unsupported operation.  Heimdal and
+ * macOS KCM daemons return KRB5_FCC_INTERNAL for unknown opcodes; older
+ * versions of sssd return KRB5_CC_IO. */
+static krb5_boolean
+unsupported_op_error(krb5_error_code code)
+{
+    return code == KRB5_FCC_INTERNAL || code == KRB5_CC_IO ||
+        code == KRB5_CC_NOSUPP;
+}
+
 /* Map EINVAL or KRB5_CC_FORMAT to KRB5_KCM_MALFORMED_REPLY; pass through all
  * other codes. */
 static inline krb5_error_code
@@ -499,6 +529,123 @@ free_uuid_list(struct uuid_list *uuids)
     free(uuids);
 }
 
+/* Fetch a name list from req->reply.  Like UUID lists, name lists are not
+ * delimited, so we consume the rest of the input. */
+static krb5_error_code
+kcmreq_get_name_list(struct kcmreq *req, struct name_list **names_out)
+{
+    struct name_list *names;
+    size_t len = req->reply.len;
+
+    *names_out = NULL;
+
+    /* Every name, including the last, must be zero-terminated. */
+    if (len > 0 && req->reply.ptr[len - 1] != '\0')
+        return KRB5_KCM_MALFORMED_REPLY;
+
+    names = malloc(sizeof(*names));
+    if (names == NULL)
+        return ENOMEM;
+    names->len = len;
+    names->pos = 0;
+
+    if (len > 0) {
+        names->namebytes = malloc(len);
+        if (names->namebytes == NULL) {
+            free(names);
+            return ENOMEM;
+        }
+        memcpy(names->namebytes, req->reply.ptr, len);
+        (void)k5_input_get_bytes(&req->reply, len);
+    } else {
+        names->namebytes = NULL;
+    }
+
+    *names_out = names;
+    return 0;
+}
+
+/* Return true if name is present in names. */
+static krb5_boolean
+name_list_contains(struct name_list *names, const char *name)
+{
+    const char *p;
+    size_t i;
+
+    for (i = 0; i < names->len; i += strlen(p) + 1) {
+        p = names->namebytes + i;
+        if (strcmp(p, name) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+free_name_list(struct name_list *names)
+{
+    if (names != NULL)
+        free(names->namebytes);
+    free(names);
+}
+
+static void
+free_cred_array(krb5_creds *creds, size_t count)
+{
+    size_t i;
+
+    if (creds == NULL)
+        return;
+    for (i = 0; i < count; i++)
+        krb5_free_cred_contents(NULL, &creds[i]);
+    free(creds);
+}
+
+/* Fetch a credential list from req->reply, as returned by GET_CRED_LIST. */
+static krb5_error_code
+kcmreq_get_cred_list(struct kcmreq *req, krb5_creds **creds_out,
+                     size_t *count_out)
+{
+    krb5_error_code ret = 0;
+    struct k5input *in = &req->reply;
+    krb5_creds *creds;
+    size_t count, len, i;
+
+    *creds_out = NULL;
+    *count_out = 0;
+
+    /* Each credential needs at least a four-byte length, so a count larger
+     * than that would allow must be bogus. */
+    count = k5_input_get_uint32_be(in);
+    if (in->status || count > in->len / 4)
+        return KRB5_KCM_MALFORMED_REPLY;
+
+    creds = k5calloc(count + 1, sizeof(*creds), &ret);
+    if (creds == NULL)
+        return ret;
+
+    for (i = 0; i < count; i++) {
+        len = k5_input_get_uint32_be(in);
+        if (in->status || len > in->len) {
+            ret = KRB5_KCM_MALFORMED_REPLY;
+            break;
+        }
+        ret = k5_unmarshal_cred(in->ptr, len, 4, &creds[i]);
+        if (ret) {
+            ret = map_invalid(ret);
+            break;
+        }
+        (void)k5_input_get_bytes(in, len);
+    }
+    if (ret) {
+        free_cred_array(creds, i);
+        return ret;
+    }
+
+    *creds_out = creds;
+    *count_out = count;
+    return 0;
+}
+
 static void
 kcmreq_free(struct kcmreq *req)
 {
@@ -763,23 +910,43 @@ kcm_start_seq_get(krb5_context context, krb5_ccache cache,
 {
     krb5_error_code ret;
     struct kcmreq req = EMPTY_KCMREQ;
-    struct uuid_list *uuids;
+    struct kcm_cache_data *data = cache->data;
+    struct kcm_cursor *cursor;
 
     *cursor_out = NULL;
 
     get_kdc_offset(context, cache);
 
+    cursor = k5alloc(sizeof(*cursor), &ret);
+    if (cursor == NULL)
+        return ret;
+
+    /* Fetch all of the credentials in one round trip if we can. */
+    if (!data->io->no_cred_list) {
+        kcmreq_init(&req, KCM_OP_GET_CRED_LIST, cache);
+        ret = cache_call(context, cache, &req);
+        if (!ret) {
+            ret = kcmreq_get_cred_list(&req, &cursor->creds, &cursor->count);
+            goto cleanup;
+        }
+        if (!unsupported_op_error(ret))
+            goto cleanup;
+        data->io->no_cred_list = TRUE;
+        kcmreq_free(&req);
+    }
+
     kcmreq_init(&req, KCM_OP_GET_CRED_UUID_LIST, cache);
     ret = cache_call(context, cache, &req);
     if (ret)
         goto cleanup;
-    ret = kcmreq_get_uuid_list(&req, &uuids);
-    if (ret)
-        goto cleanup;
-    *cursor_out = (krb5_cc_cursor)uuids;
+    ret = kcmreq_get_uuid_list(&req, &cursor->uuids);
 
 cleanup:
     kcmreq_free(&req);
+    if (ret)
+        free(cursor);
+    else
+        *cursor_out = (krb5_cc_cursor)cursor;
     return ret;
 }
 
@@ -789,10 +956,20 @@ kcm_next_cred(krb5_context context, krb5_ccache cache, krb5_cc_cursor *cursor,
 {
     krb5_error_code ret;
     struct kcmreq req;
-    struct uuid_list *uuids = (struct uuid_list *)*cursor;
+    struct kcm_cursor *c = (struct kcm_cursor *)*cursor;
+    struct uuid_list *uuids = c->uuids;
 
     memset(cred_out, 0, sizeof(*cred_out));
 
+    if (uuids == NULL) {
+        if (c->pos >= c->count)
+            return KRB5_CC_END;
+        *cred_out = c->creds[c->pos];
+        memset(&c->creds[c->pos], 0, sizeof(*c->creds));
+        c->pos++;
+        return 0;
+    }
+
     if (uuids->pos >= uuids->count)
         return KRB5_CC_END;
 
@@ -811,7 +988,13 @@ static krb5_error_code KRB5_CALLCONV
 kcm_end_seq_get(krb5_context context, krb5_ccache cache,
                 krb5_cc_cursor *cursor)
 {
-    free_uuid_list((struct uuid_list *)*cursor);
+    struct kcm_cursor *c = (struct kcm_cursor *)*cursor;
+
+    if (c == NULL)
+        return 0;
+    free_uuid_list(c->uuids);
+    free_cred_array(c->creds, c->count);
+    free(c);
     *cursor = NULL;
     return 0;
 }
@@ -846,9 +1029,11 @@ kcm_get_flags(krb5_context context, krb5_ccache cache, krb5_flags *flags_out)
     return 0;
 }
 
-/* Construct a per-type cursor, always taking ownership of io and uuids. */
+/* Construct a per-type cursor, always taking ownership of io, names, and
+ * uuids. */
 static krb5_error_code
-make_ptcursor(const char *residual, struct uuid_list *uuids, struct kcmio *io,
+make_ptcursor(const char *residual, struct name_list *names,
+              struct uuid_list *uuids, struct kcmio *io,
               krb5_cc_ptcursor *cursor_out)
 {
     krb5_cc_ptcursor cursor = NULL;
@@ -870,6 +1055,7 @@ make_ptcursor(const char *residual, struct uuid_list *uuids, struct kcmio *io,
         goto oom;
 
     data->residual = residual_copy;
+    data->names = names;
     data->uuids = uuids;
     data->io = io;
     data->first = TRUE;
@@ -880,6 +1066,7 @@ make_ptcursor(const char *residual, struct uuid_list *uuids, struct kcmio *io,
 
 oom:
     kcmio_close(io);
+    free_name_list(names);
     free_uuid_list(uuids);
     free(residual_copy);
     free(data);
@@ -893,6 +1080,7 @@ kcm_ptcursor_new(krb5_context context, krb5_cc_ptcursor *cursor_out)
     krb5_error_code ret;
     struct kcmreq req = EMPTY_KCMREQ;
     struct kcmio *io = NULL;
+    struct name_list *names = NULL;
     struct uuid_list *uuids = NULL;
     const char *defname, *primary;
 
@@ -902,7 +1090,7 @@ kcm_ptcursor_new(krb5_context context, krb5_cc_ptcursor *cursor_out)
      * name has the KCM type. */
     defname = krb5_cc_default_name(context);
     if (defname == NULL || strncmp(defname, "KCM:", 4) != 0)
-        return make_ptcursor(NULL, NULL, NULL, cursor_out);
+        return make_ptcursor(NULL, NULL, NULL, NULL, cursor_out);
 
     ret = kcmio_connect(context, &io);
     if (ret)
@@ -910,20 +1098,33 @@ kcm_ptcursor_new(krb5_context context, krb5_cc_ptcursor *cursor_out)
 
     /* If defname is a subsidiary cache, return a singleton cursor. */
     if (strlen(defname) > 4)
-        return make_ptcursor(defname + 4, NULL, io, cursor_out);
+        return make_ptcursor(defname + 4, NULL, NULL, io, cursor_out);
 
-    kcmreq_init(&req, KCM_OP_GET_CACHE_UUID_LIST, NULL);
+    /* Get the names of all initialized caches in one round trip if we can,
+     * so that kcm_ptcursor_next() doesn't need to query each cache. */
+    kcmreq_init(&req, KCM_OP_GET_CACHE_LIST, NULL);
     ret = kcmio_call(context, io, &req);
+    if (ret == 0) {
+        ret = kcmreq_get_name_list(&req, &names);
+        if (ret)
+            goto cleanup;
+    } else if (unsupported_op_error(ret)) {
+        kcmreq_free(&req);
+        kcmreq_init(&req, KCM_OP_GET_CACHE_UUID_LIST, NULL);
+        ret = kcmio_call(context, io, &req);
+    }
     if (ret == KRB5_FCC_NOFILE) {
         /* There are no accessible caches; return an empty cursor. */
-        ret = make_ptcursor(NULL, NULL, NULL, cursor_out);
+        ret = make_ptcursor(NULL, NULL, NULL, NULL, cursor_out);
         goto cleanup;
     }
     if (ret)
         goto cleanup;
-    ret = kcmreq_get_uuid_list(&req, &uuids);
-    if (ret)
-        goto cleanup;
+    if (names == NULL) {
+        ret = kcmreq_get_uuid_list(&req, &uuids);
+        if (ret)
+            goto cleanup;
+    }
 
     kcmreq_free(&req);
     kcmreq_init(&req, KCM_OP_GET_DEFAULT_CACHE, NULL);
@@ -934,11 +1135,13 @@ kcm_ptcursor_new(krb5_context context, krb5_cc_ptcursor *cursor_out)
     if (ret)
         goto cleanup;
 
-    ret = make_ptcursor(primary, uuids, io, cursor_out);
+    ret = make_ptcursor(primary, names, uuids, io, cursor_out);
+    names = NULL;
     uuids = NULL;
     io = NULL;
 
 cleanup:
+    free_name_list(names);
     free_uuid_list(uuids);
     kcmio_close(io);
     kcmreq_free(&req);
@@ -966,19 +1169,36 @@ kcm_ptcursor_next(krb5_context context, krb5_cc_ptcursor cursor,
     krb5_error_code ret = 0;
     struct kcmreq req = EMPTY_KCMREQ;
     struct kcm_ptcursor *data = cursor->data;
+    struct name_list *names = data->names;
     struct uuid_list *uuids;
     const unsigned char *id;
     const char *name;
+    krb5_boolean exists;
 
     *cache_out = NULL;
 
     /* Return the primary or specified subsidiary cache if we haven't yet. */
     if (data->first && data->residual != NULL) {
         data->first = FALSE;
-        if (name_exists(context, data->io, data->residual))
+        if (names != NULL)
+            exists = name_list_contains(names, data->residual);
+        else
+            exists = name_exists(context, data->io, data->residual);
+        if (exists)
             return make_cache(context, data->residual, NULL, cache_out);
     }
 
+    if (names != NULL) {
+        while (names->pos < names->len) {
+            name = names->namebytes + names->pos;
+            names->pos += strlen(name) + 1;
+            /* Don't yield the primary cache twice. */
+            if (strcmp(name, data->residual) != 0)
+                return make_cache(context, name, NULL, cache_out);
+        }
+        return 0;
+    }
+
     uuids = data->uuids;
     if (uuids == NULL)
         return 0;
@@ -1018,6 +1238,7 @@ kcm_ptcursor_free(krb5_context context, krb5_cc_ptcursor *cursor)
     struct kcm_ptcursor *data = (*cursor)->data;
 
     free(data->residual);
+    free_name_list(data->names);
     free_uuid_list(data->uuids);
     kcmio_close(data->io);
     free(data);
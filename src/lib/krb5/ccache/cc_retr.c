@@ -251,6 +251,60 @@ krb5_cc_retrieve_cred_seq (krb5_context context, krb5_ccache id,
         return nomatch_err;
 }
 
+/* Search a snapshot of a ccache with the same semantics as
+ * krb5_cc_retrieve_cred_seq(). */
+static krb5_error_code
+retrieve_cred_snapshot(krb5_context context, struct k5_cc_snapshot *snap,
+                       krb5_flags whichfields, krb5_creds *mcreds,
+                       krb5_creds *creds, int nktypes, krb5_enctype *ktypes)
+{
+    krb5_error_code nomatch_err = KRB5_CC_NOTFOUND;
+    krb5_creds *c, *best = NULL;
+    size_t i;
+    int p, best_pref = 0;
+
+    for (i = 0; i < snap->ncreds; i++) {
+        c = &snap->creds[i];
+        if (!krb5int_cc_creds_match_request(context, whichfields, mcreds, c))
+            continue;
+        if (ktypes == NULL) {
+            best = c;
+            break;
+        }
+        p = pref(c->keyblock.enctype, nktypes, ktypes);
+        if (p < 0) {
+            nomatch_err = KRB5_CC_NOT_KTYPE;
+        } else if (best == NULL || p < best_pref) {
+            best = c;
+            best_pref = p;
+        }
+    }
+    if (best == NULL)
+        return nomatch_err;
+    return k5_copy_creds_contents(context, best, creds);
+}
+
+/* Search id for a match, using an in-process snapshot of its contents if the
+ * context is configured to cache ccache reads. */
+static krb5_error_code
+retrieve_cred(krb5_context context, krb5_ccache id, krb5_flags whichfields,
+              krb5_creds *mcreds, krb5_creds *creds, int nktypes,
+              krb5_enctype *ktypes)
+{
+    krb5_error_code ret;
+    struct k5_cc_snapshot *snap;
+
+    if (context->ccache_read_cache &&
+        k5_cc_snapshot_get(context, id, &snap) == 0) {
+        ret = retrieve_cred_snapshot(context, snap, whichfields, mcreds,
+                                     creds, nktypes, ktypes);
+        k5_cc_snapshot_release(snap);
+        return ret;
+    }
+    return krb5_cc_retrieve_cred_seq(context, id, whichfields, mcreds, creds,
+                                     nktypes, ktypes);
+}
+
 krb5_error_code
 k5_cc_retrieve_cred_default(krb5_context context, krb5_ccache id,
                             krb5_flags flags, krb5_creds *mcreds,
@@ -266,12 +320,11 @@ k5_cc_retrieve_cred_default(krb5_context context, krb5_ccache id,
             return ret;
         nktypes = k5_count_etypes (ktypes);
 
-        ret = krb5_cc_retrieve_cred_seq (context, id, flags, mcreds, creds,
-                                         nktypes, ktypes);
+        ret = retrieve_cred(context, id, flags, mcreds, creds, nktypes,
+                            ktypes);
         free (ktypes);
         return ret;
     } else {
-        return krb5_cc_retrieve_cred_seq (context, id, flags, mcreds, creds,
-                                          0, 0);
+        return retrieve_cred(context, id, flags, mcreds, creds, 0, NULL);
     }
 }
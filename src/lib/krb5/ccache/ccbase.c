@@ -122,6 +122,9 @@ krb5int_cc_initialize(void)
     if (err)
         return err;
 #endif
+    err = k5_cc_snapshot_initialize();
+    if (err)
+        return err;
     return 0;
 }
 
@@ -139,6 +142,7 @@ krb5int_cc_finalize(void)
 #ifdef USE_KEYRING_CCACHE
     k5_cc_mutex_destroy(&krb5int_krcc_mutex);
 #endif
+    k5_cc_snapshot_finalize();
     for (t = cc_typehead; t != INITIAL_TYPEHEAD; t = t_next) {
         t_next = t->next;
         free(t);
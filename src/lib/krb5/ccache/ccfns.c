@@ -28,6 +28,15 @@
 #include "cc-int.h"
 #include "../krb/int-proto.h"
 
+/* Discard any in-process snapshots of ccache contents after a cache of type
+ * ops is modified.  Memory caches are never snapshotted. */
+static void
+note_change(const krb5_cc_ops *ops)
+{
+    if (strcmp(ops->prefix, "MEMORY") != 0)
+        k5_cc_snapshot_invalidate();
+}
+
 const char * KRB5_CALLCONV
 krb5_cc_get_name(krb5_context context, krb5_ccache cache)
 {
@@ -59,15 +68,24 @@ krb5_error_code KRB5_CALLCONV
 krb5_cc_initialize(krb5_context context, krb5_ccache cache,
                    krb5_principal principal)
 {
+    krb5_error_code ret;
+
     TRACE_CC_INIT(context, cache, principal);
-    return cache->ops->init(context, cache, principal);
+    ret = cache->ops->init(context, cache, principal);
+    note_change(cache->ops);
+    return ret;
 }
 
 krb5_error_code KRB5_CALLCONV
 krb5_cc_destroy(krb5_context context, krb5_ccache cache)
 {
+    const krb5_cc_ops *ops = cache->ops;
+    krb5_error_code ret;
+
     TRACE_CC_DESTROY(context, cache);
-    return cache->ops->destroy(context, cache);
+    ret = ops->destroy(context, cache);
+    note_change(ops);
+    return ret;
 }
 
 krb5_error_code KRB5_CALLCONV
@@ -80,8 +98,12 @@ krb5_error_code KRB5_CALLCONV
 krb5_cc_store_cred(krb5_context context, krb5_ccache cache,
                    krb5_creds *creds)
 {
+    krb5_error_code ret;
+
     TRACE_CC_STORE(context, cache, creds);
-    return cache->ops->store(context, cache, creds);
+    ret = cache->ops->store(context, cache, creds);
+    note_change(cache->ops);
+    return ret;
 }
 
 krb5_error_code KRB5_CALLCONV
@@ -142,8 +164,12 @@ krb5_error_code KRB5_CALLCONV
 krb5_cc_remove_cred(krb5_context context, krb5_ccache cache, krb5_flags flags,
                     krb5_creds *creds)
 {
+    krb5_error_code ret;
+
     TRACE_CC_REMOVE(context, cache, creds);
-    return cache->ops->remove_cred(context, cache, flags, creds);
+    ret = cache->ops->remove_cred(context, cache, flags, creds);
+    note_change(cache->ops);
+    return ret;
 }
 
 krb5_error_code KRB5_CALLCONV
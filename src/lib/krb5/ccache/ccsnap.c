@@ -0,0 +1,321 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* lib/krb5/ccache/ccsnap.c - In-process read cache for ccache contents */
+/*
+ * Copyright (C) 2020 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * When the ccache_read_cache libdefaults variable is set, credential
+ * retrievals are answered from a parsed snapshot of the ccache contents kept
+ * in process memory, instead of re-reading a file or making a KCM or keyring
+ * round trip for every lookup.
+ *
+ * Snapshots are immutable once published and are reference-counted, so the
+ * table lock is held only long enough to find and reference one; matching
+ * and copying credentials happen without any lock held.  A snapshot is
+ * discarded when:
+ *
+ * - any ccache is modified through this process's krb5_cc_* functions (a
+ *   process-wide generation counter changes);
+ * - for FILE caches, the file's device, inode, size, or modification time
+ *   no longer match what they were before the snapshot was read;
+ * - for other types, which offer no change detection, the snapshot is older
+ *   than SNAPSHOT_LIFETIME_USEC.
+ */
+
+#include "cc-int.h"
+
+#include <sys/stat.h>
+
+/* The maximum number of ccache snapshots retained. */
+#define MAX_SNAPSHOTS 16
+
+/* How long to trust a snapshot of a cache type with no change detection. */
+#define SNAPSHOT_LIFETIME_USEC 1000000
+
+struct k5_cc_snapshot_st {
+    struct k5_cc_snapshot snap;
+    int refcount;
+    char *name;
+    unsigned int generation;
+    krb5_timestamp taken_sec;
+    krb5_int32 taken_usec;
+    krb5_boolean have_stat;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    struct k5_cc_snapshot_st *next;
+};
+
+static k5_mutex_t snapshot_lock = K5_MUTEX_PARTIAL_INITIALIZER;
+static struct k5_cc_snapshot_st *snapshots;
+static unsigned int snapshot_generation;
+
+int
+k5_cc_snapshot_initialize(void)
+{
+    return k5_mutex_finish_init(&snapshot_lock);
+}
+
+static void
+free_snapshot(struct k5_cc_snapshot_st *st)
+{
+    size_t i;
+
+    for (i = 0; i < st->snap.ncreds; i++)
+        krb5_free_cred_contents(NULL, &st->snap.creds[i]);
+    free(st->snap.creds);
+    free(st->name);
+    free(st);
+}
+
+/* Release a reference to st.  Call with snapshot_lock held. */
+static void
+unref_locked(struct k5_cc_snapshot_st *st)
+{
+    if (--st->refcount == 0)
+        free_snapshot(st);
+}
+
+void
+k5_cc_snapshot_finalize(void)
+{
+    struct k5_cc_snapshot_st *st, *next;
+
+    for (st = snapshots; st != NULL; st = next) {
+        next = st->next;
+        free_snapshot(st);
+    }
+    snapshots = NULL;
+    k5_mutex_destroy(&snapshot_lock);
+}
+
+void
+k5_cc_snapshot_invalidate(void)
+{
+    struct k5_cc_snapshot_st *st, *next;
+
+    k5_mutex_lock(&snapshot_lock);
+    snapshot_generation++;
+    for (st = snapshots; st != NULL; st = next) {
+        next = st->next;
+        unref_locked(st);
+    }
+    snapshots = NULL;
+    k5_mutex_unlock(&snapshot_lock);
+}
+
+void
+k5_cc_snapshot_release(struct k5_cc_snapshot *snap)
+{
+    struct k5_cc_snapshot_st *st = (struct k5_cc_snapshot_st *)snap;
+
+    if (st == NULL)
+        return;
+    k5_mutex_lock(&snapshot_lock);
+    unref_locked(st);
+    k5_mutex_unlock(&snapshot_lock);
+}
+
+/* Stat the file behind a FILE ccache.  Return false if it can't be done. */
+static krb5_boolean
+stat_file_cache(krb5_context context, krb5_ccache cache, struct stat *sb)
+{
+    if (strcmp(krb5_cc_get_type(context, cache), "FILE") != 0)
+        return FALSE;
+    return stat(krb5_cc_get_name(context, cache), sb) == 0;
+}
+
+/* Return true if st still reflects the current cache contents. */
+static krb5_boolean
+snapshot_valid(struct k5_cc_snapshot_st *st, krb5_boolean have_stat,
+               const struct stat *sb, krb5_timestamp now_sec,
+               krb5_int32 now_usec)
+{
+    long long age;
+
+    if (st->generation != snapshot_generation)
+        return FALSE;
+    if (st->have_stat) {
+        return have_stat && sb->st_dev == st->dev && sb->st_ino == st->ino &&
+            sb->st_size == st->size && sb->st_mtime == st->mtime;
+    }
+    age = (long long)ts_delta(now_sec, st->taken_sec) * 1000000 +
+        (now_usec - st->taken_usec);
+    return age >= 0 && age < SNAPSHOT_LIFETIME_USEC;
+}
+
+/* Read the contents of cache into a new snapshot object. */
+static krb5_error_code
+read_snapshot(krb5_context context, krb5_ccache cache,
+              struct k5_cc_snapshot_st **st_out)
+{
+    krb5_error_code ret;
+    krb5_cc_cursor cursor;
+    krb5_creds creds, *newptr;
+    struct k5_cc_snapshot_st *st;
+    size_t alloc = 0;
+
+    *st_out = NULL;
+
+    st = k5alloc(sizeof(*st), &ret);
+    if (st == NULL)
+        return ret;
+    st->refcount = 1;
+
+    ret = krb5_cc_start_seq_get(context, cache, &cursor);
+    if (ret) {
+        free(st);
+        return ret;
+    }
+    while ((ret = krb5_cc_next_cred(context, cache, &cursor, &creds)) == 0) {
+        if (st->snap.ncreds == alloc) {
+            alloc = (alloc == 0) ? 8 : alloc * 2;
+            newptr = realloc(st->snap.creds, alloc * sizeof(*newptr));
+            if (newptr == NULL) {
+                krb5_free_cred_contents(context, &creds);
+                ret = ENOMEM;
+                break;
+            }
+            st->snap.creds = newptr;
+        }
+        st->snap.creds[st->snap.ncreds++] = creds;
+    }
+    krb5_cc_end_seq_get(context, cache, &cursor);
+    if (ret != KRB5_CC_END) {
+        free_snapshot(st);
+        return ret;
+    }
+
+    *st_out = st;
+    return 0;
+}
+
+krb5_error_code
+k5_cc_snapshot_get(krb5_context context, krb5_ccache cache,
+                   struct k5_cc_snapshot **snap_out)
+{
+    krb5_error_code ret;
+    struct k5_cc_snapshot_st *st, **stp, *newst = NULL;
+    struct stat sb;
+    krb5_boolean have_stat;
+    krb5_timestamp now_sec;
+    krb5_int32 now_usec;
+    unsigned int generation;
+    char *name = NULL;
+    int count;
+
+    *snap_out = NULL;
+
+    /* Memory caches are already in process memory. */
+    if (strcmp(krb5_cc_get_type(context, cache), "MEMORY") == 0)
+        return KRB5_CC_NOSUPP;
+
+    ret = krb5_cc_get_full_name(context, cache, &name);
+    if (ret)
+        return ret;
+    ret = krb5_crypto_us_timeofday(&now_sec, &now_usec);
+    if (ret)
+        goto cleanup;
+    have_stat = stat_file_cache(context, cache, &sb);
+
+    k5_mutex_lock(&snapshot_lock);
+    for (st = snapshots; st != NULL; st = st->next) {
+        if (strcmp(st->name, name) == 0)
+            break;
+    }
+    if (st != NULL && snapshot_valid(st, have_stat, &sb, now_sec, now_usec)) {
+        st->refcount++;
+        k5_mutex_unlock(&snapshot_lock);
+        TRACE_CC_SNAPSHOT_REUSE(context, cache);
+        *snap_out = &st->snap;
+        goto cleanup;
+    }
+    generation = snapshot_generation;
+    k5_mutex_unlock(&snapshot_lock);
+
+    /* Read the cache without holding the lock.  The stat information and
+     * generation were recorded beforehand, so a concurrent change will make
+     * the new snapshot look stale rather than current. */
+    TRACE_CC_SNAPSHOT_READ(context, cache);
+    ret = read_snapshot(context, cache, &newst);
+    if (ret)
+        goto cleanup;
+    newst->generation = generation;
+    newst->taken_sec = now_sec;
+    newst->taken_usec = now_usec;
+    if (have_stat) {
+        newst->have_stat = TRUE;
+        newst->dev = sb.st_dev;
+        newst->ino = sb.st_ino;
+        newst->size = sb.st_size;
+        newst->mtime = sb.st_mtime;
+    }
+
+    /* A file modified during the current second could be modified again
+     * without changing its modification time, so don't retain a snapshot of
+     * it; just use it to answer this request. */
+    if (have_stat && sb.st_mtime >= now_sec) {
+        *snap_out = &newst->snap;
+        goto cleanup;
+    }
+
+    newst->name = name;
+    name = NULL;
+    newst->refcount = 2;
+    k5_mutex_lock(&snapshot_lock);
+    /* Replace any existing snapshot of this cache and drop the oldest
+     * snapshot if there are too many. */
+    for (stp = &snapshots; *stp != NULL; stp = &(*stp)->next) {
+        if (strcmp((*stp)->name, newst->name) == 0) {
+            st = *stp;
+            *stp = st->next;
+            unref_locked(st);
+            break;
+        }
+    }
+    newst->next = snapshots;
+    snapshots = newst;
+    for (count = 1, stp = &snapshots->next; *stp != NULL;
+         stp = &(*stp)->next) {
+        if (++count > MAX_SNAPSHOTS) {
+            st = *stp;
+            *stp = NULL;
+            unref_locked(st);
+            break;
+        }
+    }
+    k5_mutex_unlock(&snapshot_lock);
+    *snap_out = &newst->snap;
+
+cleanup:
+    free(name);
+    return ret;
+}
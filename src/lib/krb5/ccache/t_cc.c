@@ -33,6 +33,8 @@
 #include <unistd.h>
 #endif
 #include "com_err.h"
+#include <sys/wait.h>
+#include <utime.h>
 
 #define KRB5_OK 0
 
@@ -560,6 +562,103 @@ test_memory_concurrent(krb5_context context)
     free_test_cred(context);
 }
 
+static void
+count_snapshot_trace(krb5_context context, const krb5_trace_info *info,
+                     void *cb_data)
+{
+    int *counts = cb_data;
+
+    if (info == NULL)
+        return;
+    if (strstr(info->message, "Reading snapshot") != NULL)
+        counts[0]++;
+    else if (strstr(info->message, "Using cached snapshot") != NULL)
+        counts[1]++;
+}
+
+/* Set the modification time of file back a minute, so that the in-process
+ * read cache is willing to retain a snapshot of it. */
+static void
+age_file(const char *file)
+{
+    struct utimbuf ut;
+
+    ut.actime = ut.modtime = time(NULL) - 60;
+    CHECK_BOOL(utime(file, &ut) != 0, "utime failed", "age_file");
+}
+
+/*
+ * Test the in-process ccache read cache: repeated lookups should be answered
+ * from a snapshot, and a change made to the cache by another process should
+ * be noticed.
+ */
+static void
+test_snapshot(krb5_context context)
+{
+    krb5_error_code kret;
+    krb5_ccache id;
+    krb5_creds creds;
+    krb5_flags flags = KRB5_TC_MATCH_IS_SKEY;
+    int counts[2] = { 0, 0 }, status;
+    pid_t pid;
+    const char *file = "t_cc_snapshot";
+
+    fprintf(stderr, "Testing ccache read cache\n");
+
+    kret = init_test_cred(context);
+    CHECK(kret, "init_creds");
+    kret = krb5_cc_resolve(context, "FILE:t_cc_snapshot", &id);
+    CHECK(kret, "resolve");
+    kret = krb5_cc_initialize(context, id, test_creds.client);
+    CHECK(kret, "initialize");
+    kret = krb5_cc_store_cred(context, id, &test_creds);
+    CHECK(kret, "store");
+    age_file(file);
+
+    context->ccache_read_cache = TRUE;
+    kret = krb5_set_trace_callback(context, count_snapshot_trace, counts);
+    CHECK(kret, "set_trace_callback");
+
+    /* The first lookup reads the cache; the second should not. */
+    kret = krb5_cc_retrieve_cred(context, id, flags, &test_creds, &creds);
+    CHECK(kret, "retrieve 1");
+    krb5_free_cred_contents(context, &creds);
+    kret = krb5_cc_retrieve_cred(context, id, flags, &test_creds, &creds);
+    CHECK(kret, "retrieve 2");
+    krb5_free_cred_contents(context, &creds);
+    CHECK_BOOL(counts[0] != 1 || counts[1] != 1, "cached snapshot not used",
+               "snapshot reuse");
+
+    /* Store a second credential from another process. */
+    pid = fork();
+    CHECK_BOOL(pid == -1, "fork failed", "snapshot fork");
+    if (pid == 0) {
+        krb5_context ctx2;
+        krb5_ccache id2;
+
+        if (krb5_init_context(&ctx2) != 0)
+            _exit(1);
+        if (krb5_cc_resolve(ctx2, "FILE:t_cc_snapshot", &id2) != 0 ||
+            krb5_cc_store_cred(ctx2, id2, &test_creds2) != 0)
+            _exit(1);
+        _exit(0);
+    }
+    CHECK_BOOL(waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+               WEXITSTATUS(status) != 0, "child failed", "snapshot child");
+
+    /* The stale snapshot must not be used to answer the next lookup. */
+    kret = krb5_cc_retrieve_cred(context, id, flags, &test_creds2, &creds);
+    CHECK(kret, "retrieve after external store");
+    krb5_free_cred_contents(context, &creds);
+    CHECK_BOOL(counts[0] != 2, "stale snapshot used", "snapshot invalidate");
+
+    krb5_set_trace_callback(context, NULL, NULL);
+    context->ccache_read_cache = FALSE;
+    kret = krb5_cc_destroy(context, id);
+    CHECK(kret, "destroy");
+    free_test_cred(context);
+}
+
 extern const krb5_cc_ops krb5_mcc_ops;
 extern const krb5_cc_ops krb5_fcc_ops;
 
@@ -609,6 +708,7 @@ main(void)
     do_test(context, "FILE:");
 
     test_memory_concurrent(context);
+    test_snapshot(context);
 
     krb5_free_context(context);
     return 0;
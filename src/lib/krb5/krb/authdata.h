@@ -74,6 +74,10 @@ struct krb5_pac_data {
 #define PAC_CLIENT_INFO_LENGTH      10U
 #define PAC_INFO_BUFFER_LENGTH  16
 
+/* Round len up to a multiple of PAC_ALIGNMENT. */
+#define PAC_ALIGN(len)                                                  \
+    (((size_t)(len) + PAC_ALIGNMENT - 1) & ~(size_t)(PAC_ALIGNMENT - 1))
+
 #define NT_TIME_EPOCH               11644473600LL
 
 extern krb5plugin_authdata_client_ftable_v0 k5_mspac_ad_client_ftable;
@@ -93,6 +97,14 @@ k5_pac_validate_client(krb5_context context,
                        krb5_const_principal principal,
                        krb5_boolean with_realm);
 
+krb5_error_code
+k5_pac_add_buffers(krb5_context context,
+                   krb5_pac pac,
+                   size_t count,
+                   const krb5_ui_4 *types,
+                   const unsigned int *lengths,
+                   krb5_data *out_data);
+
 krb5_error_code
 k5_pac_add_buffer(krb5_context context,
                   krb5_pac pac,
@@ -101,6 +113,16 @@ k5_pac_add_buffer(krb5_context context,
                   krb5_boolean zerofill,
                   krb5_data *out_data);
 
+krb5_boolean
+k5_pac_cache_check(krb5_context context,
+                   const krb5_ticket *ticket,
+                   const krb5_pac pac);
+
+void
+k5_pac_cache_add(krb5_context context,
+                 const krb5_ticket *ticket,
+                 const krb5_pac pac);
+
 krb5_error_code
 k5_seconds_since_1970_to_time(krb5_timestamp elapsedSeconds, uint64_t *ntTime);
 
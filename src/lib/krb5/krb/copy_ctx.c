@@ -85,6 +85,8 @@ krb5_copy_context(krb5_context ctx, krb5_context *nctx_out)
     nctx->kdblog_context = NULL;
     nctx->trace_callback = NULL;
     nctx->trace_callback_data = NULL;
+    nctx->pac_server_key = NULL;
+    nctx->pac_privsvr_key = NULL;
     nctx->err_fmt = NULL;
     if (ctx->err_fmt != NULL)
         nctx->err_fmt = strdup(ctx->err_fmt);   /* It's OK if this fails */
@@ -51,3 +51,49 @@ krb5_encrypt_helper(krb5_context context,
 
     return(ret);
 }
+
+krb5_error_code
+k5_alloc_enc_data_iov(krb5_context context, krb5_enctype enctype, size_t len,
+                      krb5_enc_data *cipher, krb5_crypto_iov iov[4])
+{
+    krb5_error_code ret;
+    unsigned int header_len, padding_len, trailer_len;
+    size_t total;
+    char *p;
+
+    cipher->ciphertext = empty_data();
+    ret = krb5_c_crypto_length(context, enctype, KRB5_CRYPTO_TYPE_HEADER,
+                               &header_len);
+    if (ret)
+        return ret;
+    ret = krb5_c_padding_length(context, enctype, len, &padding_len);
+    if (ret)
+        return ret;
+    ret = krb5_c_crypto_length(context, enctype, KRB5_CRYPTO_TYPE_TRAILER,
+                               &trailer_len);
+    if (ret)
+        return ret;
+    total = (size_t)header_len + padding_len + trailer_len;
+    if (len > UINT_MAX - total)
+        return KRB5_BAD_MSIZE;
+    total += len;
+
+    p = k5alloc(total, &ret);
+    if (p == NULL)
+        return ret;
+
+    cipher->magic = KV5M_ENC_DATA;
+    cipher->kvno = 0;
+    cipher->enctype = enctype;
+    cipher->ciphertext = make_data(p, total);
+
+    iov[0].flags = KRB5_CRYPTO_TYPE_HEADER;
+    iov[0].data = make_data(p, header_len);
+    iov[1].flags = KRB5_CRYPTO_TYPE_DATA;
+    iov[1].data = make_data(p + header_len, len);
+    iov[2].flags = KRB5_CRYPTO_TYPE_PADDING;
+    iov[2].data = make_data(p + header_len + len, padding_len);
+    iov[3].flags = KRB5_CRYPTO_TYPE_TRAILER;
+    iov[3].data = make_data(p + header_len + len + padding_len, trailer_len);
+    return 0;
+}
@@ -46,10 +46,11 @@ krb5_encode_kdc_rep(krb5_context context, krb5_msgtype type,
                     int using_subkey, const krb5_keyblock *client_key,
                     krb5_kdc_rep *dec_rep, krb5_data **enc_rep)
 {
-    krb5_data *scratch;
     krb5_error_code retval;
     krb5_enc_kdc_rep_part tmp_encpart;
     krb5_keyusage usage;
+    krb5_crypto_iov iov[4];
+    size_t len;
 
     if (!krb5_c_valid_enctype(dec_rep->enc_part.enctype))
         return KRB5_PROG_ETYPE_NOSUPP;
@@ -83,17 +84,24 @@ krb5_encode_kdc_rep(krb5_context context, krb5_msgtype type,
      */
     tmp_encpart = *encpart;
     tmp_encpart.msg_type = type;
-    retval = encode_krb5_enc_kdc_rep_part(&tmp_encpart, &scratch);
-    if (retval) {
+
+    /* Encode the encrypted part directly into the ciphertext buffer, then
+     * encrypt it in place. */
+    retval = encode_krb5_enc_kdc_rep_part_length(&tmp_encpart, &len);
+    if (retval)
         return retval;
-    }
+    retval = k5_alloc_enc_data_iov(context, client_key->enctype, len,
+                                   &dec_rep->enc_part, iov);
+    if (retval)
+        return retval;
+    retval = encode_krb5_enc_kdc_rep_part_into(&tmp_encpart,
+                                               (uint8_t *)iov[1].data.data,
+                                               len);
     memset(&tmp_encpart, 0, sizeof(tmp_encpart));
-
-#define cleanup_scratch() { (void) memset(scratch->data, 0, scratch->length); \
-        krb5_free_data(context, scratch); }
-
-    retval = krb5_encrypt_helper(context, client_key, usage, scratch,
-                                 &dec_rep->enc_part);
+    if (!retval) {
+        retval = krb5_c_encrypt_iov(context, client_key, usage, NULL, iov,
+                                    4);
+    }
 
 #define cleanup_encpart() {                                     \
         (void) memset(dec_rep->enc_part.ciphertext.data, 0,     \
@@ -102,10 +110,10 @@ krb5_encode_kdc_rep(krb5_context context, krb5_msgtype type,
         dec_rep->enc_part.ciphertext.length = 0;                \
         dec_rep->enc_part.ciphertext.data = 0;}
 
-    cleanup_scratch();
-
-    if (retval)
+    if (retval) {
+        cleanup_encpart();
         return(retval);
+    }
 
     /* now it's ready to be encoded for the wire! */
 
@@ -42,24 +42,31 @@ krb5_error_code
 krb5_encrypt_tkt_part(krb5_context context, const krb5_keyblock *srv_key,
                       krb5_ticket *dec_ticket)
 {
-    krb5_data *scratch;
     krb5_error_code retval;
     krb5_enc_tkt_part *dec_tkt_part = dec_ticket->enc_part2;
+    krb5_enc_data *cipher = &dec_ticket->enc_part;
+    krb5_crypto_iov iov[4];
+    size_t len;
 
-    /*  start by encoding the to-be-encrypted part. */
-    if ((retval = encode_krb5_enc_tkt_part(dec_tkt_part, &scratch))) {
+    /* Encode the to-be-encrypted part directly into the ciphertext buffer,
+     * then encrypt it in place. */
+    retval = encode_krb5_enc_tkt_part_length(dec_tkt_part, &len);
+    if (retval)
         return retval;
+    retval = k5_alloc_enc_data_iov(context, srv_key->enctype, len, cipher,
+                                   iov);
+    if (retval)
+        return retval;
+    retval = encode_krb5_enc_tkt_part_into(dec_tkt_part,
+                                           (uint8_t *)iov[1].data.data, len);
+    if (!retval) {
+        retval = krb5_c_encrypt_iov(context, srv_key,
+                                    KRB5_KEYUSAGE_KDC_REP_TICKET, NULL, iov,
+                                    4);
     }
-
-#define cleanup_scratch() { (void) memset(scratch->data, 0, scratch->length); \
-        krb5_free_data(context, scratch); }
-
-    /* call the encryption routine */
-    retval = krb5_encrypt_helper(context, srv_key,
-                                 KRB5_KEYUSAGE_KDC_REP_TICKET, scratch,
-                                 &dec_ticket->enc_part);
-
-    cleanup_scratch();
-
-    return(retval);
+    if (retval) {
+        zapfree(cipher->ciphertext.data, cipher->ciphertext.length);
+        cipher->ciphertext = empty_data();
+    }
+    return retval;
 }
@@ -238,6 +238,16 @@ krb5_init_context_profile(profile_t profile, krb5_flags flags,
         goto cleanup;
     ctx->dns_canonicalize_hostname = tmp;
 
+    retval = get_boolean(ctx, KRB5_CONF_CCACHE_READ_CACHE, 0, &tmp);
+    if (retval)
+        goto cleanup;
+    ctx->ccache_read_cache = tmp;
+
+    retval = get_boolean(ctx, KRB5_CONF_ACCEPTOR_PAC_CACHE, 0, &tmp);
+    if (retval)
+        goto cleanup;
+    ctx->acceptor_pac_cache = tmp;
+
     /* initialize the prng (not well, but passable) */
     if ((retval = krb5_c_random_os_entropy( ctx, 0, NULL)) !=0)
         goto cleanup;
@@ -319,6 +329,9 @@ krb5_free_context(krb5_context ctx)
     krb5_clear_error_message(ctx);
     free(ctx->err_fmt);
 
+    krb5_k_free_key(ctx, ctx->pac_server_key);
+    krb5_k_free_key(ctx, ctx->pac_privsvr_key);
+
 #ifndef DISABLE_TRACING
     if (ctx->trace_callback)
         ctx->trace_callback(ctx, NULL, ctx->trace_callback_data);
@@ -30,80 +30,119 @@
 /* draft-brezak-win2k-krb-authz-00 */
 
 /*
- * Add a buffer to the provided PAC and update header.
+ * Add count zero-filled buffers with the given types and lengths to the
+ * provided PAC and update the header, growing the PAC storage only once.  If
+ * out_data is not NULL, set out_data[i] to the location of the ith new buffer.
  */
 krb5_error_code
-k5_pac_add_buffer(krb5_context context,
-                  krb5_pac pac,
-                  krb5_ui_4 type,
-                  const krb5_data *data,
-                  krb5_boolean zerofill,
-                  krb5_data *out_data)
+k5_pac_add_buffers(krb5_context context,
+                   krb5_pac pac,
+                   size_t count,
+                   const krb5_ui_4 *types,
+                   const unsigned int *lengths,
+                   krb5_data *out_data)
 {
     PACTYPE *header;
-    size_t header_len, i, pad = 0;
+    PAC_INFO_BUFFER *buffer;
+    size_t header_len, shift, len, offset, i, j, nold;
     char *pac_data;
 
-    assert((data->data == NULL) == zerofill);
+    if (count == 0)
+        return 0;
 
-    /* Check there isn't already a buffer of this type */
-    if (k5_pac_locate_buffer(context, pac, type, NULL) == 0) {
-        return EEXIST;
+    /* Check there isn't already a buffer of any of these types */
+    for (i = 0; i < count; i++) {
+        if (k5_pac_locate_buffer(context, pac, types[i], NULL) == 0)
+            return EEXIST;
+        for (j = 0; j < i; j++) {
+            if (types[j] == types[i])
+                return EEXIST;
+        }
     }
 
+    nold = pac->pac->cBuffers;
     header = (PACTYPE *)realloc(pac->pac,
                                 sizeof(PACTYPE) +
-                                (pac->pac->cBuffers * sizeof(PAC_INFO_BUFFER)));
+                                ((nold + count - 1) * sizeof(PAC_INFO_BUFFER)));
     if (header == NULL) {
         return ENOMEM;
     }
     pac->pac = header;
 
-    header_len = PACTYPE_LENGTH + (pac->pac->cBuffers * PAC_INFO_BUFFER_LENGTH);
+    header_len = PACTYPE_LENGTH + (nold * PAC_INFO_BUFFER_LENGTH);
+    shift = count * PAC_INFO_BUFFER_LENGTH;
 
-    if (data->length % PAC_ALIGNMENT)
-        pad = PAC_ALIGNMENT - (data->length % PAC_ALIGNMENT);
+    len = pac->data.length + shift;
+    for (i = 0; i < count; i++)
+        len += PAC_ALIGN(lengths[i]);
+    if (len > UINT_MAX)
+        return ERANGE;
 
-    pac_data = realloc(pac->data.data,
-                       pac->data.length + PAC_INFO_BUFFER_LENGTH + data->length + pad);
+    pac_data = realloc(pac->data.data, len);
     if (pac_data == NULL) {
         return ENOMEM;
     }
     pac->data.data = pac_data;
 
     /* Update offsets of existing buffers */
-    for (i = 0; i < pac->pac->cBuffers; i++)
-        pac->pac->Buffers[i].Offset += PAC_INFO_BUFFER_LENGTH;
+    for (i = 0; i < nold; i++)
+        pac->pac->Buffers[i].Offset += shift;
 
-    /* Make room for new PAC_INFO_BUFFER */
-    memmove(pac->data.data + header_len + PAC_INFO_BUFFER_LENGTH,
+    /* Make room for the new PAC_INFO_BUFFERs */
+    memmove(pac->data.data + header_len + shift,
             pac->data.data + header_len,
             pac->data.length - header_len);
-    memset(pac->data.data + header_len, 0, PAC_INFO_BUFFER_LENGTH);
+    memset(pac->data.data + header_len, 0, shift);
+
+    /* Initialise the new PAC_INFO_BUFFERs and zero their data and padding */
+    offset = pac->data.length + shift;
+    for (i = 0; i < count; i++) {
+        buffer = &pac->pac->Buffers[nold + i];
+        buffer->ulType = types[i];
+        buffer->cbBufferSize = lengths[i];
+        buffer->Offset = offset;
+        assert((buffer->Offset % PAC_ALIGNMENT) == 0);
+
+        memset(pac->data.data + offset, 0, PAC_ALIGN(lengths[i]));
+        if (out_data != NULL)
+            out_data[i] = make_data(pac->data.data + offset, lengths[i]);
+        offset += PAC_ALIGN(lengths[i]);
+    }
 
-    /* Initialise new PAC_INFO_BUFFER */
-    pac->pac->Buffers[i].ulType = type;
-    pac->pac->Buffers[i].cbBufferSize = data->length;
-    pac->pac->Buffers[i].Offset = pac->data.length + PAC_INFO_BUFFER_LENGTH;
-    assert((pac->pac->Buffers[i].Offset % PAC_ALIGNMENT) == 0);
+    pac->pac->cBuffers += count;
+    pac->data.length = len;
 
-    /* Copy in new PAC data and zero padding bytes */
-    if (zerofill)
-        memset(pac->data.data + pac->pac->Buffers[i].Offset, 0, data->length);
-    else
-        memcpy(pac->data.data + pac->pac->Buffers[i].Offset, data->data, data->length);
+    pac->verified = FALSE;
+
+    return 0;
+}
+
+/*
+ * Add a buffer to the provided PAC and update header.
+ */
+krb5_error_code
+k5_pac_add_buffer(krb5_context context,
+                  krb5_pac pac,
+                  krb5_ui_4 type,
+                  const krb5_data *data,
+                  krb5_boolean zerofill,
+                  krb5_data *out_data)
+{
+    krb5_error_code ret;
+    krb5_data buf;
 
-    memset(pac->data.data + pac->pac->Buffers[i].Offset + data->length, 0, pad);
+    assert((data->data == NULL) == zerofill);
 
-    pac->pac->cBuffers++;
-    pac->data.length += PAC_INFO_BUFFER_LENGTH + data->length + pad;
+    ret = k5_pac_add_buffers(context, pac, 1, &type, &data->length, &buf);
+    if (ret != 0)
+        return ret;
 
-    if (out_data != NULL) {
-        out_data->data = pac->data.data + pac->pac->Buffers[i].Offset;
-        out_data->length = data->length;
-    }
+    /* Copy in new PAC data */
+    if (!zerofill)
+        memcpy(buf.data, data->data, data->length);
 
-    pac->verified = FALSE;
+    if (out_data != NULL)
+        *out_data = buf;
 
     return 0;
 }
@@ -794,11 +833,20 @@ mspac_verify(krb5_context kcontext,
     if (pacctx->pac == NULL)
         return EINVAL;
 
+    /* Skip the checks if we have already verified this ticket's PAC. */
+    if (k5_pac_cache_check(kcontext, req->ticket, pacctx->pac)) {
+        TRACE_MSPAC_VERIFY_CACHED(kcontext);
+        pacctx->pac->verified = TRUE;
+        return 0;
+    }
+
     code = krb5_pac_verify(kcontext, pacctx->pac,
                            req->ticket->enc_part2->times.authtime,
                            req->ticket->enc_part2->client, key, NULL);
     if (code != 0)
         TRACE_MSPAC_VERIFY_FAIL(kcontext, code);
+    else
+        k5_pac_cache_add(kcontext, req->ticket, pacctx->pac);
 
     /*
      * If the above verification failed, don't fail the whole authentication,
@@ -0,0 +1,207 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* lib/krb5/krb/pac_cache.c - Process-wide cache of verified PACs */
+/*
+ * Copyright (C) 2020 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * When the acceptor_pac_cache libdefaults variable is set, the mspac authdata
+ * module remembers the PACs it has verified, keyed by the encrypted part of
+ * the ticket which carried them.  Clients usually present the same service
+ * ticket many times.  A ticket ciphertext which decrypts successfully always
+ * yields the same PAC, client principal, and authtime, so the server checksum
+ * and client info checks need not be repeated for it.
+ *
+ * Entries are kept until the ticket expires.  At most MAX_ENTRIES are kept;
+ * the oldest is discarded to make room for a new one.
+ */
+
+#include "k5-int.h"
+#include "k5-queue.h"
+#include "k5-hashtab.h"
+#include "authdata.h"
+
+/* The maximum number of verified PACs retained. */
+#define MAX_ENTRIES 1024
+
+struct entry {
+    K5_TAILQ_ENTRY(entry) links;
+    krb5_data ciphertext;       /* hash table key */
+    krb5_enctype enctype;
+    krb5_kvno kvno;
+    krb5_timestamp endtime;
+    krb5_data pac_data;
+};
+
+K5_TAILQ_HEAD(entry_queue, entry);
+
+static k5_mutex_t pac_cache_lock = K5_MUTEX_PARTIAL_INITIALIZER;
+static struct k5_hashtab *pac_table;
+static struct entry_queue pac_queue = K5_TAILQ_HEAD_INITIALIZER(pac_queue);
+static size_t pac_count;
+
+int
+k5_pac_cache_initialize(void)
+{
+    return k5_mutex_finish_init(&pac_cache_lock);
+}
+
+static void
+free_entry(struct entry *entry)
+{
+    free(entry->ciphertext.data);
+    zapfree(entry->pac_data.data, entry->pac_data.length);
+    free(entry);
+}
+
+/* Remove entry from the cache and free it.  Call with pac_cache_lock
+ * held. */
+static void
+discard_entry(struct entry *entry)
+{
+    k5_hashtab_remove(pac_table, entry->ciphertext.data,
+                      entry->ciphertext.length);
+    K5_TAILQ_REMOVE(&pac_queue, entry, links);
+    pac_count--;
+    free_entry(entry);
+}
+
+void
+k5_pac_cache_finalize(void)
+{
+    struct entry *entry, *next;
+
+    K5_TAILQ_FOREACH_SAFE(entry, &pac_queue, links, next)
+        free_entry(entry);
+    K5_TAILQ_INIT(&pac_queue);
+    pac_count = 0;
+    if (pac_table != NULL)
+        k5_hashtab_free(pac_table);
+    pac_table = NULL;
+    k5_mutex_destroy(&pac_cache_lock);
+}
+
+/* Ensure that pac_table is initialized.  Call with pac_cache_lock held. */
+static krb5_error_code
+init_table(krb5_context context)
+{
+    krb5_error_code ret;
+    uint8_t seed[K5_HASH_SEED_LEN];
+    krb5_data d = make_data(seed, sizeof(seed));
+
+    if (pac_table != NULL)
+        return 0;
+    ret = krb5_c_random_make_octets(context, &d);
+    if (ret)
+        return ret;
+    return k5_hashtab_create(seed, 64, &pac_table);
+}
+
+/*
+ * Return true if pac was previously verified as part of ticket and the ticket
+ * has not expired.  ticket must have been decrypted successfully.
+ */
+krb5_boolean
+k5_pac_cache_check(krb5_context context, const krb5_ticket *ticket,
+                   const krb5_pac pac)
+{
+    const krb5_enc_data *enc = &ticket->enc_part;
+    struct entry *entry;
+    krb5_timestamp now;
+    krb5_boolean found = FALSE;
+
+    if (!context->acceptor_pac_cache)
+        return FALSE;
+    if (krb5_timeofday(context, &now) != 0)
+        return FALSE;
+
+    k5_mutex_lock(&pac_cache_lock);
+    if (pac_table == NULL)
+        goto done;
+    entry = k5_hashtab_get(pac_table, enc->ciphertext.data,
+                           enc->ciphertext.length);
+    if (entry == NULL)
+        goto done;
+    if (ts_after(now, entry->endtime)) {
+        discard_entry(entry);
+        goto done;
+    }
+    found = entry->enctype == enc->enctype && entry->kvno == enc->kvno &&
+        data_eq(entry->pac_data, pac->data);
+
+done:
+    k5_mutex_unlock(&pac_cache_lock);
+    return found;
+}
+
+/* Record that pac has been verified as part of ticket.  Failures are not
+ * reported, as the cache is only an optimization. */
+void
+k5_pac_cache_add(krb5_context context, const krb5_ticket *ticket,
+                 const krb5_pac pac)
+{
+    const krb5_enc_data *enc = &ticket->enc_part;
+    struct entry *entry;
+
+    if (!context->acceptor_pac_cache || ticket->enc_part2 == NULL)
+        return;
+
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+        return;
+    entry->enctype = enc->enctype;
+    entry->kvno = enc->kvno;
+    entry->endtime = ticket->enc_part2->times.endtime;
+    if (krb5int_copy_data_contents(context, &enc->ciphertext,
+                                   &entry->ciphertext) != 0 ||
+        krb5int_copy_data_contents(context, &pac->data,
+                                   &entry->pac_data) != 0) {
+        free_entry(entry);
+        return;
+    }
+
+    k5_mutex_lock(&pac_cache_lock);
+    if (init_table(context) != 0 ||
+        k5_hashtab_get(pac_table, entry->ciphertext.data,
+                       entry->ciphertext.length) != NULL)
+        goto fail;
+    while (pac_count >= MAX_ENTRIES)
+        discard_entry(K5_TAILQ_FIRST(&pac_queue));
+    if (k5_hashtab_add(pac_table, entry->ciphertext.data,
+                       entry->ciphertext.length, entry) != 0)
+        goto fail;
+    K5_TAILQ_INSERT_TAIL(&pac_queue, entry, links);
+    pac_count++;
+    k5_mutex_unlock(&pac_cache_lock);
+    return;
+
+fail:
+    k5_mutex_unlock(&pac_cache_lock);
+    free_entry(entry);
+}
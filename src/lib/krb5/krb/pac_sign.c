@@ -29,28 +29,18 @@
 
 /* draft-brezak-win2k-krb-authz-00 */
 
+/* Produce the UTF-16LE name of principal for a CLIENT_INFO buffer. */
 static krb5_error_code
-k5_insert_client_info(krb5_context context,
-                      krb5_pac pac,
-                      krb5_timestamp authtime,
-                      krb5_const_principal principal,
-                      krb5_boolean with_realm)
+k5_client_info_name(krb5_context context,
+                    krb5_const_principal principal,
+                    krb5_boolean with_realm,
+                    unsigned char **name_out,
+                    size_t *len_out)
 {
     krb5_error_code ret;
-    krb5_data client_info;
     char *princ_name_utf8 = NULL;
-    unsigned char *princ_name_utf16 = NULL, *p;
-    size_t princ_name_utf16_len = 0;
-    uint64_t nt_authtime;
     int flags = 0;
 
-    /* If we already have a CLIENT_INFO buffer, then just validate it */
-    if (k5_pac_locate_buffer(context, pac, KRB5_PAC_CLIENT_INFO,
-                             &client_info) == 0) {
-        return k5_pac_validate_client(context, pac, authtime, principal,
-                                      with_realm);
-    }
-
     if (!with_realm) {
         flags |= KRB5_PRINCIPAL_UNPARSE_NO_REALM;
     } else if (principal->type == KRB5_NT_ENTERPRISE_PRINCIPAL) {
@@ -60,22 +50,25 @@ k5_insert_client_info(krb5_context context,
 
     ret = krb5_unparse_name_flags(context, principal, flags, &princ_name_utf8);
     if (ret != 0)
-        goto cleanup;
-
-    ret = k5_utf8_to_utf16le(princ_name_utf8, &princ_name_utf16,
-                             &princ_name_utf16_len);
-    if (ret != 0)
-        goto cleanup;
+        return ret;
 
-    client_info.length = PAC_CLIENT_INFO_LENGTH + princ_name_utf16_len;
-    client_info.data = NULL;
+    ret = k5_utf8_to_utf16le(princ_name_utf8, name_out, len_out);
+    krb5_free_unparsed_name(context, princ_name_utf8);
+    return ret;
+}
 
-    ret = k5_pac_add_buffer(context, pac, KRB5_PAC_CLIENT_INFO,
-                            &client_info, TRUE, &client_info);
-    if (ret != 0)
-        goto cleanup;
+/* Fill in a zeroed CLIENT_INFO buffer of the right size. */
+static void
+k5_write_client_info(krb5_data *client_info,
+                     krb5_timestamp authtime,
+                     const unsigned char *princ_name_utf16,
+                     size_t princ_name_utf16_len)
+{
+    unsigned char *p = (unsigned char *)client_info->data;
+    uint64_t nt_authtime;
 
-    p = (unsigned char *)client_info.data;
+    assert(client_info->length ==
+           PAC_CLIENT_INFO_LENGTH + princ_name_utf16_len);
 
     /* copy in authtime converted to a 64-bit NT time */
     k5_seconds_since_1970_to_time(authtime, &nt_authtime);
@@ -88,21 +81,22 @@ k5_insert_client_info(krb5_context context,
 
     /* copy in principal name */
     memcpy(p, princ_name_utf16, princ_name_utf16_len);
-
-cleanup:
-    if (princ_name_utf16 != NULL)
-        free(princ_name_utf16);
-    krb5_free_unparsed_name(context, princ_name_utf8);
-
-    return ret;
 }
 
+/*
+ * Determine the checksum type for key.  If pac already has a checksum buffer
+ * of the given type, zero it; otherwise append the type and length of the
+ * buffer to be added to types and lengths.
+ */
 static krb5_error_code
-k5_insert_checksum(krb5_context context,
-                   krb5_pac pac,
-                   krb5_ui_4 type,
-                   const krb5_keyblock *key,
-                   krb5_cksumtype *cksumtype)
+k5_prepare_checksum(krb5_context context,
+                    krb5_pac pac,
+                    krb5_ui_4 type,
+                    const krb5_keyblock *key,
+                    krb5_cksumtype *cksumtype,
+                    krb5_ui_4 *types,
+                    unsigned int *lengths,
+                    size_t *count)
 {
     krb5_error_code ret;
     size_t len;
@@ -127,20 +121,49 @@ k5_insert_checksum(krb5_context context,
 
         memset(cksumdata.data, 0, cksumdata.length);
     } else {
-        /* Add a zero filled buffer */
-        cksumdata.length = PAC_SIGNATURE_DATA_LENGTH + len;
-        cksumdata.data = NULL;
+        types[*count] = type;
+        lengths[*count] = PAC_SIGNATURE_DATA_LENGTH + len;
+        (*count)++;
+    }
+
+    return 0;
+}
+
+/* Return true if key holds the same key as keyblock. */
+static krb5_boolean
+k5_key_matches(krb5_key key, const krb5_keyblock *keyblock)
+{
+    return key != NULL && key->keyblock.enctype == keyblock->enctype &&
+        key->keyblock.length == keyblock->length &&
+        k5_bcmp(key->keyblock.contents, keyblock->contents,
+                keyblock->length) == 0;
+}
+
+/*
+ * Get a krb5_key for keyblock, reusing *cache if it holds the same key and
+ * replacing it otherwise.  A KDC signs most PACs with the same few keys (the
+ * krbtgt key in particular), so this lets the checksum key derivations and
+ * cipher state be computed once instead of once per PAC.
+ */
+static krb5_error_code
+k5_get_cached_key(krb5_context context,
+                  krb5_key *cache,
+                  const krb5_keyblock *keyblock,
+                  krb5_key *key_out)
+{
+    krb5_error_code ret;
+    krb5_key key = *cache;
 
-        ret = k5_pac_add_buffer(context, pac,
-                                type, &cksumdata,
-                                TRUE, &cksumdata);
+    if (!k5_key_matches(key, keyblock)) {
+        ret = krb5_k_create_key(context, keyblock, &key);
         if (ret != 0)
             return ret;
+        krb5_k_free_key(context, *cache);
+        *cache = key;
     }
 
-    /* Encode checksum type into buffer */
-    store_32_le((krb5_ui_4)*cksumtype, cksumdata.data);
-
+    krb5_k_reference_key(context, key);
+    *key_out = key;
     return 0;
 }
 
@@ -203,44 +226,107 @@ krb5_pac_sign_ext(krb5_context context, krb5_pac pac, krb5_timestamp authtime,
                   krb5_data *data)
 {
     krb5_error_code ret;
-    krb5_data server_cksum, privsvr_cksum;
+    krb5_data client_info, server_cksum, privsvr_cksum;
     krb5_cksumtype server_cksumtype, privsvr_cksumtype;
     krb5_crypto_iov iov[2];
+    krb5_ui_4 types[3];
+    unsigned int lengths[3];
+    size_t count = 0;
+    unsigned char *princ_name_utf16 = NULL;
+    size_t princ_name_utf16_len = 0;
+    krb5_boolean add_client_info = FALSE;
+    krb5_key skey = NULL, pkey = NULL;
 
     data->length = 0;
     data->data = NULL;
 
+    /*
+     * Work out which buffers need to be added and how large they are, so that
+     * they can all be added at once.  If we already have a CLIENT_INFO
+     * buffer, then just validate it.
+     */
     if (principal != NULL) {
-        ret = k5_insert_client_info(context, pac, authtime, principal,
-                                    with_realm);
-        if (ret != 0)
-            return ret;
+        if (k5_pac_locate_buffer(context, pac, KRB5_PAC_CLIENT_INFO,
+                                 NULL) == 0) {
+            ret = k5_pac_validate_client(context, pac, authtime, principal,
+                                         with_realm);
+            if (ret != 0)
+                goto cleanup;
+        } else {
+            ret = k5_client_info_name(context, principal, with_realm,
+                                      &princ_name_utf16,
+                                      &princ_name_utf16_len);
+            if (ret != 0)
+                goto cleanup;
+            types[count] = KRB5_PAC_CLIENT_INFO;
+            lengths[count] = PAC_CLIENT_INFO_LENGTH + princ_name_utf16_len;
+            count++;
+            add_client_info = TRUE;
+        }
     }
 
     /* Create zeroed buffers for both checksums */
-    ret = k5_insert_checksum(context, pac, KRB5_PAC_SERVER_CHECKSUM,
-                             server_key, &server_cksumtype);
+    ret = k5_prepare_checksum(context, pac, KRB5_PAC_SERVER_CHECKSUM,
+                              server_key, &server_cksumtype, types, lengths,
+                              &count);
     if (ret != 0)
-        return ret;
+        goto cleanup;
 
-    ret = k5_insert_checksum(context, pac, KRB5_PAC_PRIVSVR_CHECKSUM,
-                             privsvr_key, &privsvr_cksumtype);
+    ret = k5_prepare_checksum(context, pac, KRB5_PAC_PRIVSVR_CHECKSUM,
+                              privsvr_key, &privsvr_cksumtype, types, lengths,
+                              &count);
     if (ret != 0)
-        return ret;
+        goto cleanup;
 
-    /* Now, encode the PAC header so that the checksums will include it */
-    ret = k5_pac_encode_header(context, pac);
+    ret = k5_pac_add_buffers(context, pac, count, types, lengths, NULL);
     if (ret != 0)
-        return ret;
+        goto cleanup;
 
-    /* Generate the server checksum over the entire PAC */
+    if (add_client_info) {
+        ret = k5_pac_locate_buffer(context, pac, KRB5_PAC_CLIENT_INFO,
+                                   &client_info);
+        if (ret != 0)
+            goto cleanup;
+        k5_write_client_info(&client_info, authtime, princ_name_utf16,
+                             princ_name_utf16_len);
+    }
+
+    /* Encode checksum types into the checksum buffers */
     ret = k5_pac_locate_buffer(context, pac, KRB5_PAC_SERVER_CHECKSUM,
                                &server_cksum);
     if (ret != 0)
-        return ret;
-
+        goto cleanup;
     assert(server_cksum.length > PAC_SIGNATURE_DATA_LENGTH);
+    store_32_le((krb5_ui_4)server_cksumtype, server_cksum.data);
+
+    ret = k5_pac_locate_buffer(context, pac, KRB5_PAC_PRIVSVR_CHECKSUM,
+                               &privsvr_cksum);
+    if (ret != 0)
+        goto cleanup;
+    assert(privsvr_cksum.length > PAC_SIGNATURE_DATA_LENGTH);
+    store_32_le((krb5_ui_4)privsvr_cksumtype, privsvr_cksum.data);
+
+    /* Now, encode the PAC header so that the checksums will include it */
+    ret = k5_pac_encode_header(context, pac);
+    if (ret != 0)
+        goto cleanup;
+
+    ret = k5_get_cached_key(context, &context->pac_privsvr_key, privsvr_key,
+                            &pkey);
+    if (ret != 0)
+        goto cleanup;
+    if (k5_key_matches(pkey, server_key)) {
+        /* The PAC is for a TGT, so both checksums use the krbtgt key. */
+        krb5_k_reference_key(context, pkey);
+        skey = pkey;
+    } else {
+        ret = k5_get_cached_key(context, &context->pac_server_key, server_key,
+                                &skey);
+        if (ret != 0)
+            goto cleanup;
+    }
 
+    /* Generate the server checksum over the entire PAC */
     iov[0].flags = KRB5_CRYPTO_TYPE_DATA;
     iov[0].data = pac->data;
 
@@ -248,20 +334,13 @@ krb5_pac_sign_ext(krb5_context context, krb5_pac pac, krb5_timestamp authtime,
     iov[1].data.data = server_cksum.data + PAC_SIGNATURE_DATA_LENGTH;
     iov[1].data.length = server_cksum.length - PAC_SIGNATURE_DATA_LENGTH;
 
-    ret = krb5_c_make_checksum_iov(context, server_cksumtype,
-                                   server_key, KRB5_KEYUSAGE_APP_DATA_CKSUM,
+    ret = krb5_k_make_checksum_iov(context, server_cksumtype,
+                                   skey, KRB5_KEYUSAGE_APP_DATA_CKSUM,
                                    iov, sizeof(iov)/sizeof(iov[0]));
     if (ret != 0)
-        return ret;
+        goto cleanup;
 
     /* Generate the privsvr checksum over the server checksum buffer */
-    ret = k5_pac_locate_buffer(context, pac, KRB5_PAC_PRIVSVR_CHECKSUM,
-                               &privsvr_cksum);
-    if (ret != 0)
-        return ret;
-
-    assert(privsvr_cksum.length > PAC_SIGNATURE_DATA_LENGTH);
-
     iov[0].flags = KRB5_CRYPTO_TYPE_DATA;
     iov[0].data.data = server_cksum.data + PAC_SIGNATURE_DATA_LENGTH;
     iov[0].data.length = server_cksum.length - PAC_SIGNATURE_DATA_LENGTH;
@@ -270,19 +349,23 @@ krb5_pac_sign_ext(krb5_context context, krb5_pac pac, krb5_timestamp authtime,
     iov[1].data.data = privsvr_cksum.data + PAC_SIGNATURE_DATA_LENGTH;
     iov[1].data.length = privsvr_cksum.length - PAC_SIGNATURE_DATA_LENGTH;
 
-    ret = krb5_c_make_checksum_iov(context, privsvr_cksumtype,
-                                   privsvr_key, KRB5_KEYUSAGE_APP_DATA_CKSUM,
+    ret = krb5_k_make_checksum_iov(context, privsvr_cksumtype,
+                                   pkey, KRB5_KEYUSAGE_APP_DATA_CKSUM,
                                    iov, sizeof(iov)/sizeof(iov[0]));
     if (ret != 0)
-        return ret;
+        goto cleanup;
 
     data->data = k5memdup(pac->data.data, pac->data.length, &ret);
     if (data->data == NULL)
-        return ret;
+        goto cleanup;
     data->length = pac->data.length;
 
     memset(pac->data.data, 0,
            PACTYPE_LENGTH + (pac->pac->cBuffers * PAC_INFO_BUFFER_LENGTH));
 
-    return 0;
+cleanup:
+    free(princ_name_utf16);
+    krb5_k_free_key(context, skey);
+    krb5_k_free_key(context, pkey);
+    return ret;
 }
@@ -28,25 +28,42 @@
 
 /*
  * A plugin_mapping structure maps a module name to a built-in or dynamic
- * module.  modname is always present; the other three fields can be in four
+ * module.  modname is always present; the other two fields can be in four
  * different states:
  *
- * - If dyn_path and dyn_handle are null but module is set, the mapping is to a
- *   built-in module.
- * - If dyn_path is set but dyn_handle and module are null, the mapping is to a
- *   dynamic module which hasn't been loaded yet.
- * - If all three fields are set, the mapping is to a dynamic module which has
- *   been loaded and is ready to use.
- * - If all three fields are null, the mapping is to a dynamic module which
- *   failed to load and should be ignored.
+ * - If dyn_path is null but module is set, the mapping is to a built-in
+ *   module.
+ * - If dyn_path is set but module is null, the mapping is to a dynamic module
+ *   which hasn't been loaded yet.
+ * - If both fields are set, the mapping is to a dynamic module which has been
+ *   loaded and is ready to use.
+ * - If both fields are null, the mapping is to a dynamic module which failed
+ *   to load and should be ignored.
  */
 struct plugin_mapping {
     char *modname;
     char *dyn_path;
-    struct plugin_file_handle *dyn_handle;
     krb5_plugin_initvt_fn module;
 };
 
+/*
+ * Dynamic modules are loaded once per process and shared by all contexts.  A
+ * cache entry maps a module path and initvt symbol name to the loaded module
+ * handle and its initvt function.  Entries are kept until the library is
+ * finalized; modules are opened with RTLD_NODELETE where available, so
+ * closing them earlier would not unload them anyway.
+ */
+struct plugin_cache_entry {
+    char *path;
+    char *symname;
+    struct plugin_file_handle *handle;
+    krb5_plugin_initvt_fn module;
+    struct plugin_cache_entry *next;
+};
+
+static k5_mutex_t plugin_cache_lock = K5_MUTEX_PARTIAL_INITIALIZER;
+static struct plugin_cache_entry *plugin_cache;
+
 const char *interface_names[] = {
     "pwqual",
     "kadm5_hook",
@@ -80,8 +97,6 @@ free_plugin_mapping(struct plugin_mapping *map)
         return;
     free(map->modname);
     free(map->dyn_path);
-    if (map->dyn_handle != NULL)
-        krb5int_close_plugin(map->dyn_handle);
     free(map);
 }
 
@@ -346,36 +361,81 @@ cleanup:
     return ret;
 }
 
-/* If map is for a dynamic module which hasn't been loaded yet, attempt to load
- * it.  Only try to load a module once. */
+/* Look up the cached module for path and symname, loading it and adding it to
+ * the cache if necessary.  Call with plugin_cache_lock held. */
+static krb5_error_code
+get_cached_module(krb5_context context, const char *path, const char *symname,
+                  krb5_plugin_initvt_fn *module_out)
+{
+    krb5_error_code ret;
+    struct plugin_cache_entry *ent;
+    struct plugin_file_handle *handle = NULL;
+    void (*initvt_fn)();
+
+    for (ent = plugin_cache; ent != NULL; ent = ent->next) {
+        if (strcmp(ent->path, path) == 0 &&
+            strcmp(ent->symname, symname) == 0) {
+            *module_out = ent->module;
+            return 0;
+        }
+    }
+
+    ret = krb5int_open_plugin(path, &handle, &context->err);
+    if (ret)
+        return ret;
+    ret = krb5int_get_plugin_func(handle, symname, &initvt_fn, &context->err);
+    if (ret)
+        goto cleanup;
+
+    ent = k5alloc(sizeof(*ent), &ret);
+    if (ent == NULL)
+        goto cleanup;
+    ent->path = strdup(path);
+    ent->symname = strdup(symname);
+    if (ent->path == NULL || ent->symname == NULL) {
+        free(ent->path);
+        free(ent->symname);
+        free(ent);
+        ret = ENOMEM;
+        goto cleanup;
+    }
+    ent->handle = handle;
+    ent->module = (krb5_plugin_initvt_fn)initvt_fn;
+    ent->next = plugin_cache;
+    plugin_cache = ent;
+    handle = NULL;
+    *module_out = ent->module;
+
+cleanup:
+    if (handle != NULL)
+        krb5int_close_plugin(handle);
+    return ret;
+}
+
+/* If map is for a dynamic module which hasn't been loaded yet, get it from the
+ * process-wide module cache, loading it if no other context has.  Only try to
+ * load a module once per context. */
 static void
 load_if_needed(krb5_context context, struct plugin_mapping *map,
                const char *iname)
 {
+    krb5_error_code ret;
     char *symname = NULL;
-    struct plugin_file_handle *handle = NULL;
-    void (*initvt_fn)();
 
     if (map->module != NULL || map->dyn_path == NULL)
         return;
     if (asprintf(&symname, "%s_%s_initvt", iname, map->modname) < 0)
         return;
-    if (krb5int_open_plugin(map->dyn_path, &handle, &context->err))
-        goto err;
-    if (krb5int_get_plugin_func(handle, symname, &initvt_fn, &context->err))
-        goto err;
-    free(symname);
-    map->dyn_handle = handle;
-    map->module = (krb5_plugin_initvt_fn)initvt_fn;
-    return;
 
-err:
-    /* Clean up, and also null out map->dyn_path so we don't try again. */
-    if (handle != NULL)
-        krb5int_close_plugin(handle);
+    k5_mutex_lock(&plugin_cache_lock);
+    ret = get_cached_module(context, map->dyn_path, symname, &map->module);
+    k5_mutex_unlock(&plugin_cache_lock);
     free(symname);
-    free(map->dyn_path);
-    map->dyn_path = NULL;
+    if (ret) {
+        /* Null out map->dyn_path so we don't try again. */
+        free(map->dyn_path);
+        map->dyn_path = NULL;
+    }
 }
 
 krb5_error_code
@@ -499,3 +559,25 @@ k5_plugin_free_context(krb5_context context)
         free_mapping_list(context->plugins[i].modules);
     memset(context->plugins, 0, sizeof(context->plugins));
 }
+
+int
+k5_plugin_cache_initialize(void)
+{
+    return k5_mutex_finish_init(&plugin_cache_lock);
+}
+
+void
+k5_plugin_cache_finalize(void)
+{
+    struct plugin_cache_entry *ent, *next;
+
+    for (ent = plugin_cache; ent != NULL; ent = next) {
+        next = ent->next;
+        krb5int_close_plugin(ent->handle);
+        free(ent->path);
+        free(ent->symname);
+        free(ent);
+    }
+    plugin_cache = NULL;
+    k5_mutex_destroy(&plugin_cache_lock);
+}
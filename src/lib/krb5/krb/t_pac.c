@@ -33,6 +33,7 @@
  */
 
 #include "k5-int.h"
+#include "authdata.h"
 
 #define U(x) (uint8_t *)x
 
@@ -595,6 +596,69 @@ check_pac(krb5_context context, int index, const unsigned char *pdata,
     krb5_pac_free(context, pac);
 }
 
+/* Check the acceptor-side cache of verified PACs. */
+static void
+check_pac_cache(krb5_context context)
+{
+    krb5_error_code ret;
+    krb5_pac pac, other;
+    krb5_ticket ticket;
+    krb5_enc_tkt_part enc;
+    krb5_timestamp now;
+    char cipher[] = "ticket ciphertext", cipher2[] = "other ciphertext";
+
+    ret = krb5_pac_parse(context, saved_pac, sizeof(saved_pac), &pac);
+    if (ret)
+        err(context, ret, "krb5_pac_parse");
+    ret = krb5_pac_parse(context, s4u_pac_regular, sizeof(s4u_pac_regular),
+                         &other);
+    if (ret)
+        err(context, ret, "krb5_pac_parse");
+    ret = krb5_timeofday(context, &now);
+    if (ret)
+        err(context, ret, "krb5_timeofday");
+
+    memset(&ticket, 0, sizeof(ticket));
+    memset(&enc, 0, sizeof(enc));
+    ticket.enc_part.enctype = ENCTYPE_AES256_CTS_HMAC_SHA1_96;
+    ticket.enc_part.kvno = 1;
+    ticket.enc_part.ciphertext = string2data(cipher);
+    ticket.enc_part2 = &enc;
+    enc.times.endtime = ts_incr(now, 3600);
+
+    /* Nothing is cached unless acceptor_pac_cache is set. */
+    context->acceptor_pac_cache = FALSE;
+    k5_pac_cache_add(context, &ticket, pac);
+    context->acceptor_pac_cache = TRUE;
+    if (k5_pac_cache_check(context, &ticket, pac))
+        err(context, 0, "PAC cached while cache disabled");
+
+    k5_pac_cache_add(context, &ticket, pac);
+    if (!k5_pac_cache_check(context, &ticket, pac))
+        err(context, 0, "PAC not found in cache");
+
+    /* A different PAC, kvno, or ciphertext must not match. */
+    if (k5_pac_cache_check(context, &ticket, other))
+        err(context, 0, "different PAC found in cache");
+    ticket.enc_part.kvno = 2;
+    if (k5_pac_cache_check(context, &ticket, pac))
+        err(context, 0, "PAC found in cache with different kvno");
+    ticket.enc_part.kvno = 1;
+    ticket.enc_part.ciphertext = string2data(cipher2);
+    if (k5_pac_cache_check(context, &ticket, pac))
+        err(context, 0, "PAC found in cache with different ciphertext");
+
+    /* Entries for expired tickets are not used. */
+    enc.times.endtime = ts_incr(now, -1);
+    k5_pac_cache_add(context, &ticket, other);
+    if (k5_pac_cache_check(context, &ticket, other))
+        err(context, 0, "PAC for expired ticket found in cache");
+
+    context->acceptor_pac_cache = FALSE;
+    krb5_pac_free(context, pac);
+    krb5_pac_free(context, other);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -732,6 +796,36 @@ main(int argc, char **argv)
         free(list);
     }
 
+    /* Sign and verify a PAC using the KDC key for both checksums, as for a
+     * TGT, then continue signing with the member key below. */
+    {
+        krb5_pac tgtpac;
+        krb5_data tgtdata;
+
+        ret = krb5_pac_init(context, &tgtpac);
+        if (ret)
+            err(context, ret, "krb5_pac_init");
+        ret = krb5_pac_sign(context, tgtpac, authtime, p, &kdc_keyblock,
+                            &kdc_keyblock, &tgtdata);
+        if (ret)
+            err(context, ret, "krb5_pac_sign TGT");
+        krb5_pac_free(context, tgtpac);
+
+        ret = krb5_pac_parse(context, tgtdata.data, tgtdata.length, &tgtpac);
+        krb5_free_data_contents(context, &tgtdata);
+        if (ret)
+            err(context, ret, "krb5_pac_parse TGT");
+        ret = krb5_pac_verify(context, tgtpac, authtime, p, &kdc_keyblock,
+                              &kdc_keyblock);
+        if (ret)
+            err(context, ret, "krb5_pac_verify TGT");
+        ret = krb5_pac_verify(context, tgtpac, authtime, p, &member_keyblock,
+                              &kdc_keyblock);
+        if (ret == 0)
+            err(context, 0, "krb5_pac_verify TGT with member key succeeded");
+        krb5_pac_free(context, tgtpac);
+    }
+
     {
         krb5_principal ep, np;
 
@@ -913,6 +1007,8 @@ main(int argc, char **argv)
 
     krb5_pac_free(context, pac);
 
+    check_pac_cache(context);
+
     krb5_free_principal(context, p);
     krb5_free_context(context);
 
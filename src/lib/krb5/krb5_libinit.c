@@ -48,6 +48,12 @@ int krb5int_lib_init(void)
     if (err)
         return err;
     err = k5_mutex_finish_init(&krb5int_us_time_mutex);
+    if (err)
+        return err;
+    err = k5_plugin_cache_initialize();
+    if (err)
+        return err;
+    err = k5_pac_cache_initialize();
     if (err)
         return err;
 
@@ -78,6 +84,8 @@ void krb5int_lib_fini(void)
 #endif
 
     k5_mutex_destroy(&krb5int_us_time_mutex);
+    k5_plugin_cache_finalize();
+    k5_pac_cache_finalize();
 
     krb5int_cc_finalize();
 #ifndef LEAN_CLIENT
@@ -63,4 +63,65 @@ krb5_error_code
 kau_j_tgs_u2u(const krb5_boolean ev_success, krb5_audit_state *state,
               char **jout);
 
+/*
+ * These variants append the JSON record for an event to buf instead of
+ * allocating a new string, so that a caller can reuse one buffer for every
+ * event.  They return ENOMEM if buf ran out of memory.  As with the variants
+ * above, a NULL state produces the record "state is NULL".
+ */
+struct k5buf;
+
+krb5_error_code
+kau_j_kdc_stop_buf(const krb5_boolean ev_success, struct k5buf *buf);
+
+krb5_error_code
+kau_j_kdc_start_buf(const krb5_boolean ev_success, struct k5buf *buf);
+
+krb5_error_code
+kau_j_as_req_buf(const krb5_boolean ev_success, krb5_audit_state *state,
+                 struct k5buf *buf);
+
+krb5_error_code
+kau_j_tgs_req_buf(const krb5_boolean ev_success, krb5_audit_state *state,
+                  struct k5buf *buf);
+
+krb5_error_code
+kau_j_tgs_s4u2self_buf(const krb5_boolean ev_success, krb5_audit_state *state,
+                       struct k5buf *buf);
+
+krb5_error_code
+kau_j_tgs_s4u2proxy_buf(const krb5_boolean ev_success,
+                        krb5_audit_state *state, struct k5buf *buf);
+
+krb5_error_code
+kau_j_tgs_u2u_buf(const krb5_boolean ev_success, krb5_audit_state *state,
+                  struct k5buf *buf);
+
+/*
+ * An audit sink copies records into a ring buffer, and a background thread
+ * passes them to write_fn in batches, calling flush_fn (if not null) after
+ * each batch.  kau_sink_put() only blocks if the ring is full, so that no
+ * records are lost.  kau_sink_free() writes out any buffered records.
+ * Without thread support, records are written synchronously.
+ */
+typedef struct kau_sink_st *kau_sink;
+
+typedef void
+(*kau_sink_write_fn)(void *data, int type, krb5_boolean ev_success,
+                     const char *record);
+
+typedef void
+(*kau_sink_flush_fn)(void *data);
+
+krb5_error_code
+kau_sink_create(kau_sink_write_fn write_fn, kau_sink_flush_fn flush_fn,
+                void *data, kau_sink *sink_out);
+
+void
+kau_sink_put(kau_sink sink, int type, krb5_boolean ev_success,
+             const char *record);
+
+void
+kau_sink_free(kau_sink sink);
+
 #endif /* KRB5_KDC_J_ENCODE_H_INCLUDED */
@@ -0,0 +1,257 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* plugins/audit/kdc_j_sink.c - Buffered output for KDC audit records */
+/*
+ * Copyright (C) 2020 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <k5-int.h>
+#include "kdc_j_encode.h"
+
+struct kau_sink_st {
+    kau_sink_write_fn write_fn;
+    kau_sink_flush_fn flush_fn;
+    void *data;
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready_cond;  /* records were added, or stopping is set */
+    pthread_cond_t space_cond;  /* records were written */
+    krb5_boolean stopping;
+    char *ring;
+    size_t head;
+    size_t tail;
+    size_t used;
+#endif
+};
+
+#ifdef HAVE_PTHREAD
+
+#define SINK_RING_SIZE  (256 * 1024)
+#define SINK_ALIGN(n)   (((n) + 7) & ~(size_t)7)
+
+/* A ring record header, followed by the NUL-terminated record.  A zero len
+ * marks unused space at the end of the ring. */
+struct sink_rec {
+    size_t len;
+    int type;
+    krb5_boolean ev_success;
+};
+
+/*
+ * Write out records until asked to stop and the ring is empty.  Records stay
+ * in the ring while they are being written, so producers cannot overwrite
+ * them; the head only advances after each batch.
+ */
+static void *
+sink_thread(void *arg)
+{
+    kau_sink sink = arg;
+    struct sink_rec *rec;
+    size_t pos, avail, consumed;
+
+    pthread_mutex_lock(&sink->lock);
+    for (;;) {
+        while (sink->used == 0 && !sink->stopping)
+            pthread_cond_wait(&sink->ready_cond, &sink->lock);
+        if (sink->used == 0)
+            break;
+
+        pos = sink->head;
+        avail = sink->used;
+        pthread_mutex_unlock(&sink->lock);
+
+        for (consumed = 0; consumed < avail;) {
+            rec = (struct sink_rec *)(sink->ring + pos);
+            if (SINK_RING_SIZE - pos < sizeof(*rec) || rec->len == 0) {
+                /* Skip the unused space at the end of the ring. */
+                consumed += SINK_RING_SIZE - pos;
+                pos = 0;
+                continue;
+            }
+            sink->write_fn(sink->data, rec->type, rec->ev_success,
+                           (char *)(rec + 1));
+            consumed += rec->len;
+            pos = (pos + rec->len) % SINK_RING_SIZE;
+        }
+        if (sink->flush_fn != NULL)
+            sink->flush_fn(sink->data);
+
+        pthread_mutex_lock(&sink->lock);
+        sink->head = pos;
+        sink->used -= consumed;
+        pthread_cond_broadcast(&sink->space_cond);
+    }
+    pthread_mutex_unlock(&sink->lock);
+    return NULL;
+}
+
+krb5_error_code
+kau_sink_create(kau_sink_write_fn write_fn, kau_sink_flush_fn flush_fn,
+                void *data, kau_sink *sink_out)
+{
+    krb5_error_code ret;
+    kau_sink sink;
+
+    *sink_out = NULL;
+
+    sink = k5calloc(1, sizeof(*sink), &ret);
+    if (sink == NULL)
+        return ret;
+    sink->write_fn = write_fn;
+    sink->flush_fn = flush_fn;
+    sink->data = data;
+    sink->ring = k5alloc(SINK_RING_SIZE, &ret);
+    if (sink->ring == NULL) {
+        free(sink);
+        return ret;
+    }
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->ready_cond, NULL);
+    pthread_cond_init(&sink->space_cond, NULL);
+    ret = pthread_create(&sink->thread, NULL, sink_thread, sink);
+    if (ret) {
+        pthread_cond_destroy(&sink->space_cond);
+        pthread_cond_destroy(&sink->ready_cond);
+        pthread_mutex_destroy(&sink->lock);
+        free(sink->ring);
+        free(sink);
+        return ret;
+    }
+
+    *sink_out = sink;
+    return 0;
+}
+
+void
+kau_sink_put(kau_sink sink, int type, krb5_boolean ev_success,
+             const char *record)
+{
+    struct sink_rec *rec;
+    size_t reclen, len, pad;
+
+    reclen = strlen(record);
+    len = SINK_ALIGN(sizeof(*rec) + reclen + 1);
+
+    pthread_mutex_lock(&sink->lock);
+    if (len > SINK_RING_SIZE) {
+        /* This record can never fit; write it synchronously after the
+         * records ahead of it. */
+        while (sink->used > 0)
+            pthread_cond_wait(&sink->space_cond, &sink->lock);
+        sink->write_fn(sink->data, type, ev_success, record);
+        if (sink->flush_fn != NULL)
+            sink->flush_fn(sink->data);
+        pthread_mutex_unlock(&sink->lock);
+        return;
+    }
+
+    /* Records are contiguous, so wrap early if this one won't fit at the
+     * end.  Wait for space rather than dropping audit records. */
+    for (;;) {
+        pad = (sink->tail + len > SINK_RING_SIZE) ?
+            SINK_RING_SIZE - sink->tail : 0;
+        if (sink->used + pad + len <= SINK_RING_SIZE)
+            break;
+        pthread_cond_wait(&sink->space_cond, &sink->lock);
+    }
+    if (pad > 0) {
+        if (pad >= sizeof(*rec))
+            ((struct sink_rec *)(sink->ring + sink->tail))->len = 0;
+        sink->used += pad;
+        sink->tail = 0;
+    }
+
+    rec = (struct sink_rec *)(sink->ring + sink->tail);
+    rec->len = len;
+    rec->type = type;
+    rec->ev_success = ev_success;
+    memcpy(rec + 1, record, reclen + 1);
+    sink->tail = (sink->tail + len) % SINK_RING_SIZE;
+    sink->used += len;
+
+    pthread_cond_signal(&sink->ready_cond);
+    pthread_mutex_unlock(&sink->lock);
+}
+
+void
+kau_sink_free(kau_sink sink)
+{
+    if (sink == NULL)
+        return;
+
+    pthread_mutex_lock(&sink->lock);
+    sink->stopping = TRUE;
+    pthread_cond_signal(&sink->ready_cond);
+    pthread_mutex_unlock(&sink->lock);
+    pthread_join(sink->thread, NULL);
+
+    pthread_cond_destroy(&sink->space_cond);
+    pthread_cond_destroy(&sink->ready_cond);
+    pthread_mutex_destroy(&sink->lock);
+    free(sink->ring);
+    free(sink);
+}
+
+#else /* HAVE_PTHREAD */
+
+krb5_error_code
+kau_sink_create(kau_sink_write_fn write_fn, kau_sink_flush_fn flush_fn,
+                void *data, kau_sink *sink_out)
+{
+    krb5_error_code ret;
+    kau_sink sink;
+
+    *sink_out = NULL;
+
+    sink = k5calloc(1, sizeof(*sink), &ret);
+    if (sink == NULL)
+        return ret;
+    sink->write_fn = write_fn;
+    sink->flush_fn = flush_fn;
+    sink->data = data;
+    *sink_out = sink;
+    return 0;
+}
+
+void
+kau_sink_put(kau_sink sink, int type, krb5_boolean ev_success,
+             const char *record)
+{
+    sink->write_fn(sink->data, type, ev_success, record);
+    if (sink->flush_fn != NULL)
+        sink->flush_fn(sink->data);
+}
+
+void
+kau_sink_free(kau_sink sink)
+{
+    free(sink);
+}
+
+#endif /* HAVE_PTHREAD */
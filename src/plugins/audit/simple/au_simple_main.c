@@ -40,6 +40,7 @@
 #include <krb5/audit_plugin.h>
 #include <libaudit.h>
 #include <kdc_j_encode.h>
+#include <syslog.h>
 
 krb5_error_code
 audit_simple_initvt(krb5_context context, int maj_ver, int min_ver,
@@ -47,8 +48,33 @@ audit_simple_initvt(krb5_context context, int maj_ver, int min_ver,
 
 struct krb5_audit_moddata_st {
     int fd;
+    kau_sink sink;
+    struct k5buf buf;
+    k5_mutex_t lock;
+    unsigned long nfailed;      /* only used by the sink's writer */
 };
 
+/*
+ * Send a record to the audit system.  Called from the sink thread, so a slow
+ * audit daemon does not hold up the KDC; as a consequence, send failures
+ * cannot be reported to the caller.  Log the first failure, and count them so
+ * that close_au() can log the total.
+ */
+static void
+write_record(void *data, int type, krb5_boolean ev_success,
+             const char *record)
+{
+    krb5_audit_moddata auctx = data;
+
+    if (audit_log_user_message(auctx->fd, type, record, NULL, NULL, NULL,
+                               ev_success) > 0)
+        return;
+    if (auctx->nfailed++ == 0) {
+        syslog(LOG_ERR, "audit: cannot send record to the audit system: %s",
+               strerror(errno));
+    }
+}
+
 /* Open connection to the audit system. Returns 0 on success. */
 static krb5_error_code
 open_au(krb5_audit_moddata *auctx_out)
@@ -61,10 +87,20 @@ open_au(krb5_audit_moddata *auctx_out)
     if (ret)
         return ENOMEM;
     fd = audit_open();
-    if (fd < 0)
+    if (fd < 0) {
+        free(auctx);
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
+    }
 
     auctx->fd = fd;
+    ret = kau_sink_create(write_record, NULL, auctx, &auctx->sink);
+    if (ret) {
+        audit_close(fd);
+        free(auctx);
+        return ret;
+    }
+    k5_buf_init_dynamic(&auctx->buf);
+    k5_mutex_init(&auctx->lock);
     *auctx_out = auctx;
 
     return 0;
@@ -76,167 +112,145 @@ close_au(krb5_audit_moddata auctx)
 {
     int fd = auctx->fd;
 
+    /* Freeing the sink writes out the remaining records. */
+    kau_sink_free(auctx->sink);
+    if (auctx->nfailed > 0) {
+        syslog(LOG_ERR, "audit: %lu records could not be sent to the audit "
+               "system", auctx->nfailed);
+    }
     audit_close(fd);
+    k5_buf_free(&auctx->buf);
+    k5_mutex_destroy(&auctx->lock);
+    free(auctx);
     return 0;
 }
 
+/* Lock auctx and empty its record buffer for the next event. */
+static void
+begin_record(krb5_audit_moddata auctx)
+{
+    k5_mutex_lock(&auctx->lock);
+    if (k5_buf_status(&auctx->buf) != 0) {
+        k5_buf_free(&auctx->buf);
+        k5_buf_init_dynamic(&auctx->buf);
+    } else {
+        k5_buf_truncate(&auctx->buf, 0);
+    }
+}
+
+/* Queue the record encoded with result ret, and unlock auctx.  Returns
+ * ret. */
+static krb5_error_code
+end_record(krb5_audit_moddata auctx, int type, krb5_boolean ev_success,
+           krb5_error_code ret)
+{
+    if (!ret)
+        kau_sink_put(auctx->sink, type, ev_success, auctx->buf.data);
+    k5_mutex_unlock(&auctx->lock);
+    return ret;
+}
+
 /* Log KDC-start event. Returns 0 on success. */
 static krb5_error_code
 j_kdc_start(krb5_audit_moddata auctx, krb5_boolean ev_success)
 {
-    krb5_error_code ret = 0;
-    int local_type = AUDIT_USER_START;
-    int fd = auctx->fd;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    if (fd < 0)
+    if (auctx->fd < 0)
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
 
-    ret = kau_j_kdc_start(ev_success, &jout);
-    if (ret)
-        return ret;
-    if (audit_log_user_message(fd, local_type, jout,
-                               NULL, NULL, NULL, ev_success) <= 0)
-        ret = EIO;
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_kdc_start_buf(ev_success, &auctx->buf);
+    return end_record(auctx, AUDIT_USER_START, ev_success, ret);
 }
 
 /* Log KDC-stop event. Returns 0 on success. */
 static krb5_error_code
 j_kdc_stop(krb5_audit_moddata auctx, krb5_boolean ev_success)
 {
-    krb5_error_code ret = 0;
-    int local_type = AUDIT_USER_END;
-    int fd = auctx->fd;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    if (fd < 0)
+    if (auctx->fd < 0)
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
 
-    ret = kau_j_kdc_stop(ev_success, &jout);
-    if (ret)
-        return ret;
-    if (audit_log_user_message(fd, local_type, jout,
-                               NULL, NULL, NULL, ev_success) <= 0)
-        ret = EIO;
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_kdc_stop_buf(ev_success, &auctx->buf);
+    return end_record(auctx, AUDIT_USER_END, ev_success, ret);
 }
 
-/* Log AS_REQ event. Returns 0 on success */
+/* Log AS_REQ event. Returns 0 on success. */
 static krb5_error_code
 j_as_req(krb5_audit_moddata auctx, krb5_boolean ev_success,
          krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    int local_type = AUDIT_USER_AUTH;
-    int fd = auctx->fd;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    if (fd < 0)
+    if (auctx->fd < 0)
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
 
-    ret = kau_j_as_req(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    if (audit_log_user_message(fd, local_type, jout,
-                               NULL, NULL, NULL, ev_success) <= 0)
-        ret = EIO;
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_as_req_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, AUDIT_USER_AUTH, ev_success, ret);
 }
 
-/* Log TGS_REQ event. Returns 0 on success */
+/* Log TGS_REQ event. Returns 0 on success. */
 static krb5_error_code
 j_tgs_req(krb5_audit_moddata auctx, krb5_boolean ev_success,
           krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    int local_type = AUDIT_USER_AUTH;
-    int fd = auctx->fd;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    if (fd < 0)
+    if (auctx->fd < 0)
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
 
-    ret = kau_j_tgs_req(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    if (audit_log_user_message(fd, local_type, jout,
-                               NULL, NULL, NULL, ev_success) <= 0)
-        ret = EIO;
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_tgs_req_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, AUDIT_USER_AUTH, ev_success, ret);
 }
 
-/* Log S4U2SELF event. Returns 0 on success */
+/* Log S4U2SELF event. Returns 0 on success. */
 static krb5_error_code
 j_tgs_s4u2self(krb5_audit_moddata auctx, krb5_boolean ev_success,
                krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    int local_type = AUDIT_USER_AUTH;
-    int fd = auctx->fd;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    if (fd < 0)
+    if (auctx->fd < 0)
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
 
-    ret = kau_j_tgs_s4u2self(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    if (audit_log_user_message(fd, local_type, jout,
-                               NULL, NULL, NULL, ev_success) <= 0)
-        ret = EIO;
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_tgs_s4u2self_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, AUDIT_USER_AUTH, ev_success, ret);
 }
 
-/* Log S4U2PROXY event. Returns 0 on success */
+/* Log S4U2PROXY event. Returns 0 on success. */
 static krb5_error_code
 j_tgs_s4u2proxy(krb5_audit_moddata auctx, krb5_boolean ev_success,
                 krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    int local_type = AUDIT_USER_AUTH;
-    int fd = auctx->fd;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    if (fd < 0)
+    if (auctx->fd < 0)
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
 
-    ret = kau_j_tgs_s4u2proxy(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    if (audit_log_user_message(fd, local_type, jout,
-                               NULL, NULL, NULL, ev_success) <= 0)
-        ret = EIO;
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_tgs_s4u2proxy_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, AUDIT_USER_AUTH, ev_success, ret);
 }
 
-/* Log user-to-user event. Returns 0 on success */
+/* Log user-to-user event. Returns 0 on success. */
 static krb5_error_code
 j_tgs_u2u(krb5_audit_moddata auctx, krb5_boolean ev_success,
           krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    int local_type = AUDIT_USER_AUTH;
-    int fd = auctx->fd;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    if (fd < 0)
+    if (auctx->fd < 0)
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
 
-    ret = kau_j_tgs_u2u(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    if (audit_log_user_message(fd, local_type, jout,
-                               NULL, NULL, NULL, ev_success) <= 0)
-        ret = EIO;
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_tgs_u2u_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, AUDIT_USER_AUTH, ev_success, ret);
 }
 
 krb5_error_code
@@ -40,24 +40,56 @@
 #include "k5-thread.h"
 
 struct krb5_audit_moddata_st {
-    int au_fd;
+    FILE *fp;
+    kau_sink sink;
+    struct k5buf buf;
+    k5_mutex_t lock;
 };
 
 krb5_error_code
 audit_test_initvt(krb5_context context, int maj_ver, int min_ver,
                   krb5_plugin_vtable vtable);
 
-static FILE *au_fd;
-static k5_mutex_t lock = K5_MUTEX_PARTIAL_INITIALIZER;
+/* Write a record to the log file.  Called from the sink thread. */
+static void
+write_record(void *data, int type, krb5_boolean ev_success,
+             const char *record)
+{
+    fprintf(data, "%s\n", record);
+}
+
+/* Flush the log file after a batch of records. */
+static void
+flush_records(void *data)
+{
+    fflush(data);
+}
 
 /* Open connection to the audit system. Returns 0 on success. */
 static krb5_error_code
-open_au(krb5_audit_moddata *auctx)
+open_au(krb5_audit_moddata *auctx_out)
 {
-    au_fd = fopen("au.log", "a+");
-    if (au_fd == NULL)
+    krb5_error_code ret;
+    krb5_audit_moddata auctx;
+
+    auctx = k5calloc(1, sizeof(*auctx), &ret);
+    if (auctx == NULL)
+        return ret;
+    auctx->fp = fopen("au.log", "a+");
+    if (auctx->fp == NULL) {
+        free(auctx);
         return KRB5_PLUGIN_NO_HANDLE; /* audit module is unavailable */
-    k5_mutex_init(&lock);
+    }
+    ret = kau_sink_create(write_record, flush_records, auctx->fp,
+                          &auctx->sink);
+    if (ret) {
+        fclose(auctx->fp);
+        free(auctx);
+        return ret;
+    }
+    k5_buf_init_dynamic(&auctx->buf);
+    k5_mutex_init(&auctx->lock);
+    *auctx_out = auctx;
     return 0;
 }
 
@@ -65,45 +97,59 @@ open_au(krb5_audit_moddata *auctx)
 static krb5_error_code
 close_au(krb5_audit_moddata auctx)
 {
-    fclose(au_fd);
-    k5_mutex_destroy(&lock);
+    kau_sink_free(auctx->sink);
+    fclose(auctx->fp);
+    k5_buf_free(&auctx->buf);
+    k5_mutex_destroy(&auctx->lock);
+    free(auctx);
     return 0;
 }
 
+/* Lock auctx and empty its record buffer for the next event. */
+static void
+begin_record(krb5_audit_moddata auctx)
+{
+    k5_mutex_lock(&auctx->lock);
+    if (k5_buf_status(&auctx->buf) != 0) {
+        k5_buf_free(&auctx->buf);
+        k5_buf_init_dynamic(&auctx->buf);
+    } else {
+        k5_buf_truncate(&auctx->buf, 0);
+    }
+}
+
+/* Queue the record encoded with result ret, and unlock auctx.  Returns
+ * ret. */
+static krb5_error_code
+end_record(krb5_audit_moddata auctx, krb5_boolean ev_success,
+           krb5_error_code ret)
+{
+    if (!ret)
+        kau_sink_put(auctx->sink, 0, ev_success, auctx->buf.data);
+    k5_mutex_unlock(&auctx->lock);
+    return ret;
+}
+
 /* Log KDC-start event. Returns 0 on success. */
 static krb5_error_code
 j_kdc_start(krb5_audit_moddata auctx, krb5_boolean ev_success)
 {
-    krb5_error_code ret = 0;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    ret = kau_j_kdc_start(ev_success, &jout);
-    if (ret)
-        return ret;
-    k5_mutex_lock(&lock);
-    fprintf(au_fd,"%s\n", jout);
-    fflush(au_fd);
-    k5_mutex_unlock(&lock);
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_kdc_start_buf(ev_success, &auctx->buf);
+    return end_record(auctx, ev_success, ret);
 }
 
 /* Log KDC-stop event. Returns 0 on success. */
 static krb5_error_code
 j_kdc_stop(krb5_audit_moddata auctx, krb5_boolean ev_success)
 {
-    krb5_error_code ret = 0;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    ret = kau_j_kdc_stop(ev_success, &jout);
-    if (ret)
-        return ret;
-    k5_mutex_lock(&lock);
-    fprintf(au_fd,"%s\n", jout);
-    fflush(au_fd);
-    k5_mutex_unlock(&lock);
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_kdc_stop_buf(ev_success, &auctx->buf);
+    return end_record(auctx, ev_success, ret);
 }
 
 /* Log AS_REQ event. Returns 0 on success. */
@@ -111,18 +157,11 @@ static krb5_error_code
 j_as_req(krb5_audit_moddata auctx, krb5_boolean ev_success,
          krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    ret = kau_j_as_req(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    k5_mutex_lock(&lock);
-    fprintf(au_fd,"%s\n", jout);
-    fflush(au_fd);
-    k5_mutex_unlock(&lock);
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_as_req_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, ev_success, ret);
 }
 
 /* Log TGS_REQ event. Returns 0 on success. */
@@ -130,18 +169,11 @@ static krb5_error_code
 j_tgs_req(krb5_audit_moddata auctx, krb5_boolean ev_success,
           krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    ret = kau_j_tgs_req(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    k5_mutex_lock(&lock);
-    fprintf(au_fd,"%s\n", jout);
-    fflush(au_fd);
-    k5_mutex_unlock(&lock);
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_tgs_req_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, ev_success, ret);
 }
 
 /* Log S4U2SELF event. Returns 0 on success. */
@@ -149,18 +181,11 @@ static krb5_error_code
 j_tgs_s4u2self(krb5_audit_moddata auctx, krb5_boolean ev_success,
                krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    ret = kau_j_tgs_s4u2self(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    k5_mutex_lock(&lock);
-    fprintf(au_fd,"%s\n", jout);
-    fflush(au_fd);
-    k5_mutex_unlock(&lock);
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_tgs_s4u2self_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, ev_success, ret);
 }
 
 /* Log S4U2PROXY event. Returns 0 on success. */
@@ -168,18 +193,11 @@ static krb5_error_code
 j_tgs_s4u2proxy(krb5_audit_moddata auctx, krb5_boolean ev_success,
                 krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    ret = kau_j_tgs_s4u2proxy(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    k5_mutex_lock(&lock);
-    fprintf(au_fd,"%s\n", jout);
-    fflush(au_fd);
-    k5_mutex_unlock(&lock);
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_tgs_s4u2proxy_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, ev_success, ret);
 }
 
 /* Log user-to-user event. Returns 0 on success. */
@@ -187,18 +205,11 @@ static krb5_error_code
 j_tgs_u2u(krb5_audit_moddata auctx, krb5_boolean ev_success,
           krb5_audit_state *state)
 {
-    krb5_error_code ret = 0;
-    char *jout = NULL;
+    krb5_error_code ret;
 
-    ret = kau_j_tgs_u2u(ev_success, state, &jout);
-    if (ret)
-        return ret;
-    k5_mutex_lock(&lock);
-    fprintf(au_fd,"%s\n", jout);
-    fflush(au_fd);
-    k5_mutex_unlock(&lock);
-    free(jout);
-    return ret;
+    begin_record(auctx);
+    ret = kau_j_tgs_u2u_buf(ev_success, state, &auctx->buf);
+    return end_record(auctx, ev_success, ret);
 }
 
 krb5_error_code
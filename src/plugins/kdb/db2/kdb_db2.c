@@ -940,6 +940,10 @@ typedef struct iter_curs {
     krb5_db2_context *dbc;
     int lockmode;
     krb5_boolean islocked;
+    krb5_boolean names_only;
+    krb5_data prefix;
+    krb5_data seek;
+    const char *start;
 } iter_curs;
 
 /* Lock DB handle of curs, updating curs->islocked. */
@@ -963,20 +967,43 @@ curs_unlock(iter_curs *curs)
     curs->islocked = FALSE;
 }
 
-/* Set up curs and lock DB. */
+/* Return the lesser of two byte strings in lexical order. */
+static krb5_data
+min_data(krb5_data a, krb5_data b)
+{
+    int cmp = memcmp(a.data, b.data, (a.length < b.length) ? a.length :
+                     b.length);
+
+    if (cmp == 0)
+        return (a.length <= b.length) ? a : b;
+    return (cmp < 0) ? a : b;
+}
+
+/*
+ * Set up curs and lock DB.  If match_expr is given and the DB is a btree
+ * being iterated forwards, limit the iteration to keys beginning with the
+ * literal prefix of match_expr.  If start is given, iterate only over keys
+ * after it; this requires a btree being iterated forwards.
+ */
 static krb5_error_code
 curs_init(iter_curs *curs, krb5_context ctx, krb5_db2_context *dbc,
-          krb5_flags iterflags)
+          char *match_expr, const char *start, krb5_flags iterflags)
 {
+    krb5_error_code retval;
     int isrecurse = iterflags & KRB5_DB_ITER_RECURSE;
     unsigned int prevflag = R_PREV;
     unsigned int nextflag = R_NEXT;
+    krb5_boolean ordered;
 
     curs->keycopy.size = 0;
     curs->keycopy.data = NULL;
     curs->islocked = FALSE;
     curs->ctx = ctx;
     curs->dbc = dbc;
+    curs->names_only = (iterflags & KRB5_DB_ITER_NAMES_ONLY) != 0;
+    curs->prefix = empty_data();
+    curs->seek = empty_data();
+    curs->start = start;
 
     if (iterflags & KRB5_DB_ITER_WRITE)
         curs->lockmode = KRB5_LOCKMODE_EXCLUSIVE;
@@ -1005,18 +1032,68 @@ curs_init(iter_curs *curs, krb5_context ctx, krb5_db2_context *dbc,
         curs->startflag = R_FIRST;
         curs->stepflag = nextflag;
     }
-    return curs_lock(curs);
+    retval = curs_lock(curs);
+    if (retval)
+        return retval;
+
+    /* The database type is only certain once it has been opened. */
+    ordered = !dbc->hashfirst &&
+        !(iterflags & (KRB5_DB_ITER_REV | KRB5_DB_ITER_RECURSE));
+    if (start != NULL && !ordered) {
+        curs_unlock(curs);
+        return KRB5_PLUGIN_OP_NOTSUPP;
+    }
+    if (ordered && match_expr != NULL) {
+        curs->prefix = make_data(match_expr,
+                                 krb5_db_match_prefix_len(match_expr));
+    }
+    curs->seek = curs->prefix;
+    if (start != NULL) {
+        /* Seek to whichever of the prefix and start sorts later. */
+        if (data_eq(min_data(curs->seek, string2data((char *)start)),
+                    curs->seek))
+            curs->seek = string2data((char *)start);
+    }
+    return 0;
 }
 
-/* Get initial entry. */
+/* Get initial entry, seeking to the first key at or after curs->seek if there
+ * is one. */
 static int
 curs_start(iter_curs *curs)
 {
     DB *db = curs->dbc->db;
 
+    if (curs->seek.length > 0) {
+        curs->key.data = curs->seek.data;
+        curs->key.size = curs->seek.length;
+        return db->seq(db, &curs->key, &curs->data, R_CURSOR);
+    }
     return db->seq(db, &curs->key, &curs->data, curs->startflag);
 }
 
+/* Return true if the current key is at or before curs->start.  Keys include
+ * the name's terminating null byte, which is not compared. */
+static krb5_boolean
+curs_before_start(iter_curs *curs)
+{
+    krb5_data key = make_data(curs->key.data, curs->key.size);
+
+    if (curs->start == NULL)
+        return FALSE;
+    if (key.length > 0 && key.data[key.length - 1] == '\0')
+        key.length--;
+    return data_eq(min_data(key, string2data((char *)curs->start)), key);
+}
+
+/* Return true if the current key is within the range of the iteration. */
+static krb5_boolean
+curs_in_range(iter_curs *curs)
+{
+    return curs->key.size >= curs->prefix.length &&
+        memcmp(curs->key.data, curs->prefix.data, curs->prefix.length) == 0;
+}
+
 /* Save iteration state so DB can be unlocked/closed. */
 static krb5_error_code
 curs_save(iter_curs *curs)
@@ -1061,6 +1138,31 @@ curs_step(iter_curs *curs)
     return dbc->db->seq(dbc->db, &curs->key, &curs->data, curs->stepflag);
 }
 
+/* Create an entry containing only the principal name from the key of curs. */
+static krb5_error_code
+curs_name_entry(iter_curs *curs, krb5_db_entry **entry_out)
+{
+    krb5_error_code retval;
+    krb5_db_entry *entry;
+    char *name;
+
+    *entry_out = NULL;
+    name = k5memdup0(curs->key.data, curs->key.size, &retval);
+    if (name == NULL)
+        return retval;
+    entry = k5alloc(sizeof(*entry), &retval);
+    if (entry != NULL) {
+        retval = krb5_parse_name(curs->ctx, name, &entry->princ);
+        if (retval) {
+            free(entry);
+            entry = NULL;
+        }
+    }
+    free(name);
+    *entry_out = entry;
+    return retval;
+}
+
 /* Run one invocation of the callback, unlocking the mutex and possibly the DB
  * around the invocation. */
 static krb5_error_code
@@ -1072,8 +1174,12 @@ curs_run_cb(iter_curs *curs, ctx_iterate_cb func, krb5_pointer func_arg)
     krb5_context ctx = curs->ctx;
     krb5_data contdata;
 
-    contdata = make_data(curs->data.data, curs->data.size);
-    retval = krb5_decode_princ_entry(ctx, &contdata, &entry);
+    if (curs->names_only) {
+        retval = curs_name_entry(curs, &entry);
+    } else {
+        contdata = make_data(curs->data.data, curs->data.size);
+        retval = krb5_decode_princ_entry(ctx, &contdata, &entry);
+    }
     if (retval)
         return retval;
     /* Save libdb key across possible DB closure. */
@@ -1106,18 +1212,22 @@ curs_fini(iter_curs *curs)
 }
 
 static krb5_error_code
-ctx_iterate(krb5_context context, krb5_db2_context *dbc,
-            ctx_iterate_cb func, krb5_pointer func_arg, krb5_flags iterflags)
+ctx_iterate(krb5_context context, krb5_db2_context *dbc, char *match_expr,
+            const char *start, ctx_iterate_cb func, krb5_pointer func_arg,
+            krb5_flags iterflags)
 {
     krb5_error_code retval;
     int dbret;
     iter_curs curs;
 
-    retval = curs_init(&curs, context, dbc, iterflags);
+    retval = curs_init(&curs, context, dbc, match_expr, start, iterflags);
     if (retval)
         return retval;
     dbret = curs_start(&curs);
-    while (dbret == 0) {
+    /* The DB has not been unlocked yet, so step without curs_step(). */
+    while (dbret == 0 && curs_before_start(&curs))
+        dbret = dbc->db->seq(dbc->db, &curs.key, &curs.data, curs.stepflag);
+    while (dbret == 0 && curs_in_range(&curs)) {
         retval = curs_run_cb(&curs, func, func_arg);
         if (retval)
             goto cleanup;
@@ -1142,8 +1252,19 @@ krb5_db2_iterate(krb5_context context, char *match_expr, ctx_iterate_cb func,
 {
     if (!inited(context))
         return KRB5_KDB_DBNOTINITED;
-    return ctx_iterate(context, context->dal_handle->db_context, func,
-                       func_arg, iterflags);
+    return ctx_iterate(context, context->dal_handle->db_context, match_expr,
+                       NULL, func, func_arg, iterflags);
+}
+
+krb5_error_code
+krb5_db2_iterate_from(krb5_context context, char *match_expr,
+                      const char *start, ctx_iterate_cb func,
+                      krb5_pointer func_arg, krb5_flags iterflags)
+{
+    if (!inited(context))
+        return KRB5_KDB_DBNOTINITED;
+    return ctx_iterate(context, context->dal_handle->db_context, match_expr,
+                       start, func, func_arg, iterflags);
 }
 
 krb5_boolean
@@ -1408,7 +1529,8 @@ ctx_merge_nra(krb5_context context, krb5_db2_context *dbc_temp,
 
     nra.kcontext = context;
     nra.db_context = dbc_real;
-    return ctx_iterate(context, dbc_temp, krb5_db2_merge_nra_iterator, &nra, 0);
+    return ctx_iterate(context, dbc_temp, NULL, NULL,
+                       krb5_db2_merge_nra_iterator, &nra, 0);
 }
 
 /*
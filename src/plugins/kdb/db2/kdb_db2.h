@@ -61,6 +61,10 @@ krb5_error_code krb5_db2_iterate(krb5_context, char *,
                                  krb5_error_code (*)(krb5_pointer,
                                                      krb5_db_entry *),
                                  krb5_pointer, krb5_flags);
+krb5_error_code krb5_db2_iterate_from(krb5_context, char *, const char *,
+                                      krb5_error_code (*)(krb5_pointer,
+                                                          krb5_db_entry *),
+                                      krb5_pointer, krb5_flags);
 krb5_error_code krb5_db2_set_nonblocking(krb5_context, krb5_boolean,
                                          krb5_boolean *);
 krb5_boolean krb5_db2_set_lockmode(krb5_context, krb5_boolean);
@@ -572,6 +572,123 @@ cleanup:
     return ret;
 }
 
+/*
+ * Search each of the ntrees bases in subtrees on ld, placing the results in
+ * results.  Send all of the search requests before waiting for any replies, so
+ * that the searches are pipelined over the connection and cost one round trip
+ * rather than ntrees.  Return an LDAP result code; on failure, abandon any
+ * outstanding requests and leave no results behind.
+ */
+static int
+search_pipelined(LDAP *ld, char **subtrees, unsigned int ntrees, int scope,
+                 char *filter, char **attrs, LDAPMessage **results)
+{
+    int st = LDAP_SUCCESS, *msgids;
+    unsigned int i, nsent, nrecv = 0;
+
+    msgids = calloc(ntrees, sizeof(*msgids));
+    if (msgids == NULL)
+        return LDAP_NO_MEMORY;
+
+    for (nsent = 0; nsent < ntrees; nsent++) {
+        st = ldap_search_ext(ld, subtrees[nsent], scope, filter, attrs, 0,
+                             NULL, NULL, &timelimit, LDAP_NO_LIMIT,
+                             &msgids[nsent]);
+        if (st != LDAP_SUCCESS)
+            goto cleanup;
+    }
+
+    for (nrecv = 0; nrecv < ntrees; nrecv++) {
+        st = ldap_result(ld, msgids[nrecv], LDAP_MSG_ALL, &timelimit,
+                         &results[nrecv]);
+        if (st <= 0) {
+            results[nrecv] = NULL;
+            if (st == 0) {
+                st = LDAP_TIMEOUT;
+            } else {
+                st = LDAP_OTHER;
+                ldap_get_option(ld, LDAP_OPT_RESULT_CODE, &st);
+            }
+            nrecv++;
+            goto cleanup;
+        }
+        st = ldap_result2error(ld, results[nrecv], 0);
+        if (st != LDAP_SUCCESS) {
+            nrecv++;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    if (st != LDAP_SUCCESS) {
+        for (i = nrecv; i < nsent; i++)
+            ldap_abandon_ext(ld, msgids[i], NULL, NULL);
+        for (i = 0; i < nrecv; i++) {
+            ldap_msgfree(results[i]);
+            results[i] = NULL;
+        }
+    }
+    free(msgids);
+    return st;
+}
+
+/*
+ * Search each of the ntrees bases in subtrees using the connection in
+ * *server_handle, rebinding once (which may replace *server_handle) if the
+ * server is unreachable.  On success, set *results_out to an array of ntrees
+ * search results, to be freed with krb5_ldap_free_search_results().
+ */
+krb5_error_code
+krb5_ldap_search_subtrees(krb5_context context,
+                          krb5_ldap_context *ldap_context,
+                          krb5_ldap_server_handle **server_handle,
+                          char **subtrees, unsigned int ntrees, int scope,
+                          char *filter, char **attrs,
+                          LDAPMessage ***results_out)
+{
+    krb5_error_code ret;
+    LDAPMessage **results;
+    int st;
+
+    *results_out = NULL;
+    results = k5calloc(ntrees, sizeof(*results), &ret);
+    if (results == NULL)
+        return ret;
+
+    st = search_pipelined((*server_handle)->ldap_handle, subtrees, ntrees,
+                          scope, filter, attrs, results);
+    if (translate_ldap_error(st, OP_SEARCH) == KRB5_KDB_ACCESS_ERROR) {
+        ret = krb5_ldap_rebind(ldap_context, server_handle);
+        if (ret) {
+            k5_wrapmsg(context, st, KRB5_KDB_ACCESS_ERROR,
+                       "LDAP handle unavailable");
+            free(results);
+            return KRB5_KDB_ACCESS_ERROR;
+        }
+        st = search_pipelined((*server_handle)->ldap_handle, subtrees,
+                              ntrees, scope, filter, attrs, results);
+    }
+    if (st != LDAP_SUCCESS) {
+        free(results);
+        return set_ldap_error(context, st, OP_SEARCH);
+    }
+
+    *results_out = results;
+    return 0;
+}
+
+void
+krb5_ldap_free_search_results(LDAPMessage **results, unsigned int ntrees)
+{
+    unsigned int i;
+
+    if (results == NULL)
+        return;
+    for (i = 0; i < ntrees; i++)
+        ldap_msgfree(results[i]);
+    free(results);
+}
+
 /* Reallocate tl and return a pointer to the new space, or NULL on failure. */
 static unsigned char *
 expand_tl_data(krb5_tl_data *tl, uint16_t len)
@@ -69,6 +69,14 @@ store_tl_data(krb5_tl_data *, int, void *);
 krb5_error_code
 krb5_get_subtree_info(krb5_ldap_context *, char ***, unsigned int *);
 
+krb5_error_code
+krb5_ldap_search_subtrees(krb5_context, krb5_ldap_context *,
+                          krb5_ldap_server_handle **, char **, unsigned int,
+                          int, char *, char **, LDAPMessage ***);
+
+void
+krb5_ldap_free_search_results(LDAPMessage **, unsigned int);
+
 krb5_error_code
 krb5_ldap_parse_db_params(krb5_context, char **);
 
@@ -64,6 +64,11 @@ char     *principal_attributes[] = { "krbprincipalname",
                                      "krbPwdHistory",
                                      NULL };
 
+/* Attributes needed to iterate with KRB5_DB_ITER_NAMES_ONLY. */
+static char *principal_name_attributes[] = { "krbprincipalname",
+                                             "krbcanonicalname",
+                                             NULL };
+
 /* Must match KDB_*_ATTR macros in ldap_principal.h.  */
 static char *attributes_set[] = { "krbmaxticketlife",
                                   "krbmaxrenewableage",
@@ -138,9 +143,9 @@ krb5_ldap_iterate(krb5_context context, char *match_expr,
     krb5_principal           principal;
     char                     **subtree=NULL, *princ_name=NULL, *realm=NULL, **values=NULL, *filter=NULL;
     unsigned int             tree=0, ntree=1, i=0;
-    krb5_error_code          st=0, tempst=0;
+    krb5_error_code          st=0;
     LDAP                     *ld=NULL;
-    LDAPMessage              *result=NULL, *ent=NULL;
+    LDAPMessage              **results=NULL, *ent=NULL;
     kdb5_dal_handle          *dal_handle=NULL;
     krb5_ldap_context        *ldap_context=NULL;
     krb5_ldap_server_handle  *ldap_server_handle=NULL;
@@ -176,11 +181,19 @@ krb5_ldap_iterate(krb5_context context, char *match_expr,
         goto cleanup;
 
     GET_HANDLE();
+    st = krb5_ldap_search_subtrees(context, ldap_context, &ldap_server_handle,
+                                   subtree, ntree,
+                                   ldap_context->lrparams->search_scope,
+                                   filter,
+                                   (iterflags & KRB5_DB_ITER_NAMES_ONLY) ?
+                                   principal_name_attributes :
+                                   principal_attributes, &results);
+    if (st)
+        goto cleanup;
+    ld = ldap_server_handle->ldap_handle;
 
     for (tree=0; tree < ntree; ++tree) {
-
-        LDAP_SEARCH(subtree[tree], ldap_context->lrparams->search_scope, filter, principal_attributes);
-        for (ent=ldap_first_entry(ld, result); ent != NULL; ent=ldap_next_entry(ld, ent)) {
+        for (ent=ldap_first_entry(ld, results[tree]); ent != NULL; ent=ldap_next_entry(ld, ent)) {
             values=ldap_get_values(ld, ent, "krbcanonicalname");
             if (values == NULL)
                 values=ldap_get_values(ld, ent, "krbprincipalname");
@@ -191,8 +204,11 @@ krb5_ldap_iterate(krb5_context context, char *match_expr,
                     if (krb5_parse_name(context, princ_name, &principal) != 0)
                         continue;
                     if (is_principal_in_realm(ldap_context, principal)) {
-                        if ((st = populate_krb5_db_entry(context, ldap_context, ld, ent, principal,
-                                                         &entry)) != 0)
+                        if (iterflags & KRB5_DB_ITER_NAMES_ONLY) {
+                            entry.princ = principal;
+                            principal = NULL;
+                        } else if ((st = populate_krb5_db_entry(context, ldap_context, ld, ent, principal,
+                                                                &entry)) != 0)
                             goto cleanup;
                         (*func)(func_arg, &entry);
                         krb5_dbe_free_contents(context, &entry);
@@ -206,11 +222,10 @@ krb5_ldap_iterate(krb5_context context, char *match_expr,
                 ldap_value_free(values);
             }
         } /* end of for (ent= ... */
-        ldap_msgfree(result);
-        result = NULL;
     } /* end of for (tree= ... */
 
 cleanup:
+    krb5_ldap_free_search_results(results, ntree);
     if (filter)
         free (filter);
 
@@ -219,7 +234,6 @@ cleanup:
             free (subtree[ntree-1]);
     free(subtree);
 
-    ldap_msgfree(result);
     krb5_ldap_put_handle_to_pool(ldap_context, ldap_server_handle);
     return st;
 }
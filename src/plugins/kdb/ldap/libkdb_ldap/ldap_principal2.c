@@ -108,10 +108,10 @@ krb5_ldap_get_principal(krb5_context context, krb5_const_principal searchfor,
 {
     char                        *user=NULL, *filter=NULL, *filtuser=NULL;
     unsigned int                tree=0, ntrees=1, princlen=0;
-    krb5_error_code             tempst=0, st=0;
+    krb5_error_code             st=0;
     char                        **values=NULL, **subtree=NULL, *cname=NULL;
     LDAP                        *ld=NULL;
-    LDAPMessage                 *result=NULL, *ent=NULL;
+    LDAPMessage                 **results=NULL, *ent=NULL;
     krb5_ldap_context           *ldap_context=NULL;
     kdb5_dal_handle             *dal_handle=NULL;
     krb5_ldap_server_handle     *ldap_server_handle=NULL;
@@ -161,10 +161,15 @@ krb5_ldap_get_principal(krb5_context context, krb5_const_principal searchfor,
         goto cleanup;
 
     GET_HANDLE();
+    st = krb5_ldap_search_subtrees(context, ldap_context, &ldap_server_handle,
+                                   subtree, ntrees,
+                                   ldap_context->lrparams->search_scope,
+                                   filter, principal_attributes, &results);
+    if (st)
+        goto cleanup;
+    ld = ldap_server_handle->ldap_handle;
     for (tree=0; tree < ntrees && !found; ++tree) {
-
-        LDAP_SEARCH(subtree[tree], ldap_context->lrparams->search_scope, filter, principal_attributes);
-        for (ent=ldap_first_entry(ld, result); ent != NULL && !found; ent=ldap_next_entry(ld, ent)) {
+        for (ent=ldap_first_entry(ld, results[tree]); ent != NULL && !found; ent=ldap_next_entry(ld, ent)) {
 
             /* get the associated directory user information */
             if ((values=ldap_get_values(ld, ent, "krbprincipalname")) != NULL) {
@@ -212,8 +217,6 @@ krb5_ldap_get_principal(krb5_context context, krb5_const_principal searchfor,
                                              entry)) != 0)
                 goto cleanup;
         }
-        ldap_msgfree(result);
-        result = NULL;
     } /* for (tree=0 ... */
 
     if (found) {
@@ -223,7 +226,7 @@ krb5_ldap_get_principal(krb5_context context, krb5_const_principal searchfor,
         st = KRB5_KDB_NOENTRY;
 
 cleanup:
-    ldap_msgfree(result);
+    krb5_ldap_free_search_results(results, ntrees);
     krb5_db_free_principal(context, entry);
 
     if (filter)
@@ -49,15 +49,18 @@
  * account lockout attributes (suffix ".lockout.mdb") in the "lockout"
  * database.  The KDC only needs to write to the lockout database.
  *
- * For iteration we create a read transaction in the main environment for the
- * cursor.  Because the iteration callback might need to create its own
- * transactions for write operations (e.g. for kdb5_util
- * update_princ_encryption), we set the MDB_NOTLS flag on the main environment,
- * so that a thread can hold multiple transactions.
+ * For iteration we create a read transaction in each environment, and walk
+ * cursors over the principal and lockout databases in lockstep (both are
+ * keyed by principal name and sorted the same way), so that lockout
+ * attributes are merged in without a separate lookup per entry.  Because the
+ * iteration callback might need to create its own transactions for write
+ * operations (e.g. for kdb5_util update_princ_encryption), we set the
+ * MDB_NOTLS flag on both environments, so that a thread can hold multiple
+ * transactions.
  *
  * To mitigate the overhead from MDB_NOTLS, we keep around a read_txn handle
- * in the database context for get operations, using mdb_txn_reset() and
- * mdb_txn_renew() between calls.
+ * for each environment in the database context for get operations, using
+ * mdb_txn_reset() and mdb_txn_renew() between calls.
  *
  * For database loads, kdb5_util calls the create() method with the "temporary"
  * db_arg, and then promotes the finished contents at the end with the
@@ -69,6 +72,13 @@
  * the KDC; this isn't ideal if the load is aborted, but it shouldn't cause any
  * practical issues.
  *
+ * The lock() method opens a write transaction in the same field, which
+ * put_principal, delete_principal and the policy operations join, and which
+ * get operations and iteration read from so that they see the changes.  The
+ * matching unlock() commits it, so that a batch of changes made while the
+ * database is locked (such as by kadmind group commit) is committed with one
+ * sync.  Only exclusive locks are supported.
+ *
  * For iprop loads, kdb5_util also includes the "merge_nra" db_arg, signifying
  * that the lockout attributes from existing principal entries should be
  * preserved.  This attribute is noted in the LMDB context, and put_principal
@@ -114,10 +124,13 @@ typedef struct {
     /* Used for get operations; each transaction is short-lived but we save the
      * handle between calls to reduce overhead from MDB_NOTLS. */
     MDB_txn *read_txn;
+    MDB_txn *lockout_read_txn;
 
     /* Write transaction for load operations (create() with the "temporary"
-     * db_arg).  */
+     * db_arg), or for the changes made while the database is locked. */
     MDB_txn *load_txn;
+    unsigned int lock_count;    /* nesting depth of lock() calls */
+    krb5_boolean lock_txn;      /* load_txn was begun by lock() */
 } klmdb_context;
 
 static krb5_error_code
@@ -250,13 +263,12 @@ open_lmdb_env(krb5_context context, klmdb_context *dbc,
     flags = MDB_NOSUBDIR;
 
     /*
-     * For the primary database, tie read transaction locktable slots to the
-     * transaction and not the thread, so read transactions for iteration
-     * cursors can coexist with short-lived transactions for operations invoked
-     * by the iteration callback..
+     * Tie read transaction locktable slots to the transaction and not the
+     * thread, so read transactions for iteration cursors can coexist with
+     * short-lived transactions for operations invoked by the iteration
+     * callback, and with the saved read transactions for get operations.
      */
-    if (!is_lockout)
-        flags |= MDB_NOTLS;
+    flags |= MDB_NOTLS;
 
     if (readonly)
         flags |= MDB_RDONLY;
@@ -296,50 +308,175 @@ lmdb_error:
     return ret;
 }
 
-/* Read a key from the primary environment, using a saved read transaction from
- * the database context.  Return KRB5_KDB_NOENTRY if the key is not found. */
+/*
+ * Read a key from the primary environment, using a saved read transaction from
+ * the database context.  Return KRB5_KDB_NOENTRY if the key is not found.  On
+ * success, *val_out points into the memory map and remains valid only while
+ * the read transaction is active, so the caller must decode it before calling
+ * end_fetch().  On failure, the transaction has already been reset.
+ */
 static krb5_error_code
 fetch(krb5_context context, MDB_dbi db, MDB_val *key, MDB_val *val_out)
 {
     krb5_error_code ret = 0;
     klmdb_context *dbc = context->dal_handle->db_context;
-    int err;
+    MDB_txn *txn;
+    int err = 0;
 
-    if (dbc->read_txn == NULL)
-        err = mdb_txn_begin(dbc->env, NULL, MDB_RDONLY, &dbc->read_txn);
-    else
-        err = mdb_txn_renew(dbc->read_txn);
+    /* While the database is locked, read from the write transaction. */
+    if (dbc->lock_txn) {
+        txn = dbc->load_txn;
+    } else {
+        if (dbc->read_txn == NULL)
+            err = mdb_txn_begin(dbc->env, NULL, MDB_RDONLY, &dbc->read_txn);
+        else
+            err = mdb_txn_renew(dbc->read_txn);
+        txn = dbc->read_txn;
+    }
 
     if (!err)
-        err = mdb_get(dbc->read_txn, db, key, val_out);
+        err = mdb_get(txn, db, key, val_out);
 
     if (err == MDB_NOTFOUND)
         ret = KRB5_KDB_NOENTRY;
     else if (err)
         ret = klerr(context, err, _("LMDB read failure"));
 
-    mdb_txn_reset(dbc->read_txn);
+    if (ret && !dbc->lock_txn && dbc->read_txn != NULL)
+        mdb_txn_reset(dbc->read_txn);
     return ret;
 }
 
+/* Release the read transaction after a successful fetch(). */
+static void
+end_fetch(krb5_context context)
+{
+    klmdb_context *dbc = context->dal_handle->db_context;
+
+    if (!dbc->lock_txn)
+        mdb_txn_reset(dbc->read_txn);
+}
+
 /* If we are using a lockout database, try to fetch the lockout attributes for
  * key and set them in entry. */
 static void
 fetch_lockout(krb5_context context, MDB_val *key, krb5_db_entry *entry)
 {
     klmdb_context *dbc = context->dal_handle->db_context;
-    MDB_txn *txn = NULL;
     MDB_val val;
     int err;
 
     if (dbc->lockout_env == NULL)
         return;
-    err = mdb_txn_begin(dbc->lockout_env, NULL, MDB_RDONLY, &txn);
+    if (dbc->lockout_read_txn == NULL) {
+        err = mdb_txn_begin(dbc->lockout_env, NULL, MDB_RDONLY,
+                            &dbc->lockout_read_txn);
+    } else {
+        err = mdb_txn_renew(dbc->lockout_read_txn);
+    }
     if (!err)
-        err = mdb_get(txn, dbc->lockout_db, key, &val);
+        err = mdb_get(dbc->lockout_read_txn, dbc->lockout_db, key, &val);
     if (!err && val.mv_size >= LOCKOUT_RECORD_LEN)
         klmdb_decode_princ_lockout(context, entry, val.mv_data);
-    mdb_txn_abort(txn);
+    if (dbc->lockout_read_txn != NULL)
+        mdb_txn_reset(dbc->lockout_read_txn);
+}
+
+/* Compare two keys the way LMDB does by default. */
+static int
+compare_keys(const MDB_val *a, const MDB_val *b)
+{
+    size_t len = (a->mv_size < b->mv_size) ? a->mv_size : b->mv_size;
+    int cmp;
+
+    cmp = (len > 0) ? memcmp(a->mv_data, b->mv_data, len) : 0;
+    if (cmp != 0)
+        return cmp;
+    return (a->mv_size < b->mv_size) ? -1 : (a->mv_size > b->mv_size);
+}
+
+/* State for walking the lockout database alongside a principal iteration. */
+struct lockout_iter {
+    MDB_txn *txn;
+    MDB_cursor *cursor;
+    MDB_cursor_op op;
+    MDB_cursor_op first_op;
+    MDB_val key;
+    MDB_val val;
+    krb5_boolean started;
+    krb5_boolean done;
+};
+
+/* Begin a lockout iteration in the same direction as op, starting at the
+ * first key at or after seek if it is not NULL.  If there is no lockout
+ * database or it can't be read, leave li inactive, just as fetch_lockout()
+ * ignores lockout read failures. */
+static void
+lockout_iter_start(krb5_context context, struct lockout_iter *li,
+                   MDB_cursor_op op, const MDB_val *seek)
+{
+    klmdb_context *dbc = context->dal_handle->db_context;
+    int err;
+
+    memset(li, 0, sizeof(*li));
+    li->op = li->first_op = op;
+    if (seek != NULL) {
+        li->first_op = MDB_SET_RANGE;
+        li->key = *seek;
+    }
+    li->done = TRUE;
+    if (dbc->lockout_env == NULL)
+        return;
+    err = mdb_txn_begin(dbc->lockout_env, NULL, MDB_RDONLY, &li->txn);
+    if (!err)
+        err = mdb_cursor_open(li->txn, dbc->lockout_db, &li->cursor);
+    if (err) {
+        mdb_txn_abort(li->txn);
+        li->txn = NULL;
+        return;
+    }
+    li->done = FALSE;
+}
+
+/* Advance li's cursor to the first lockout record at or after key in the
+ * iteration order, and set the lockout attributes in entry if its key matches
+ * key. */
+static void
+lockout_iter_fetch(krb5_context context, struct lockout_iter *li,
+                   const MDB_val *key, krb5_db_entry *entry)
+{
+    int cmp;
+
+    while (!li->done) {
+        if (!li->started) {
+            if (mdb_cursor_get(li->cursor, &li->key, &li->val,
+                               li->first_op) != 0) {
+                li->done = TRUE;
+                return;
+            }
+            li->first_op = li->op;
+            li->started = TRUE;
+        }
+        cmp = compare_keys(&li->key, key);
+        if (li->op == MDB_PREV)
+            cmp = -cmp;
+        if (cmp > 0)
+            return;
+        if (cmp == 0) {
+            if (li->val.mv_size >= LOCKOUT_RECORD_LEN)
+                klmdb_decode_princ_lockout(context, entry, li->val.mv_data);
+            return;
+        }
+        /* This lockout record has no principal entry; skip it. */
+        li->started = FALSE;
+    }
+}
+
+static void
+lockout_iter_end(struct lockout_iter *li)
+{
+    mdb_cursor_close(li->cursor);
+    mdb_txn_abort(li->txn);
 }
 
 /*
@@ -394,22 +531,30 @@ error:
         return klerr(context, err, _("LMDB write failure"));
 }
 
-/* Delete an entry from the specified env and database, using a temporary write
- * transaction.  Return KRB5_KDB_NOENTRY if the key does not exist. */
+/* Delete an entry from the specified env and database, using the load or
+ * lock transaction if one is open for a delete from the primary environment,
+ * or a temporary write transaction if not.  Return KRB5_KDB_NOENTRY if the key
+ * does not exist. */
 static krb5_error_code
 del(krb5_context context, MDB_env *env, MDB_dbi db, char *keystr)
 {
     krb5_error_code ret = 0;
-    MDB_txn *txn = NULL;
+    klmdb_context *dbc = context->dal_handle->db_context;
+    MDB_txn *temp_txn = NULL, *txn;
     MDB_val key = { strlen(keystr), keystr };
     int err;
 
-    err = mdb_txn_begin(env, NULL, 0, &txn);
-    if (!err)
+    if (env == dbc->env && dbc->load_txn != NULL) {
+        txn = dbc->load_txn;
         err = mdb_del(txn, db, &key, NULL);
-    if (!err) {
-        err = mdb_txn_commit(txn);
-        txn = NULL;
+    } else {
+        err = mdb_txn_begin(env, NULL, 0, &temp_txn);
+        if (!err)
+            err = mdb_del(temp_txn, db, &key, NULL);
+        if (!err) {
+            err = mdb_txn_commit(temp_txn);
+            temp_txn = NULL;
+        }
     }
 
     if (err == MDB_NOTFOUND)
@@ -417,7 +562,7 @@ del(krb5_context context, MDB_env *env, MDB_dbi db, char *keystr)
     else if (err)
         ret = klerr(context, err, _("LMDB delete failure"));
 
-    mdb_txn_abort(txn);
+    mdb_txn_abort(temp_txn);
     return ret;
 }
 
@@ -488,6 +633,7 @@ klmdb_fini(krb5_context context)
     if (dbc == NULL)
         return 0;
     mdb_txn_abort(dbc->read_txn);
+    mdb_txn_abort(dbc->lockout_read_txn);
     mdb_txn_abort(dbc->load_txn);
     mdb_env_close(dbc->env);
     mdb_env_close(dbc->lockout_env);
@@ -731,8 +877,17 @@ klmdb_get_principal(krb5_context context, krb5_const_principal searchfor,
     if (ret)
         goto cleanup;
 
+    /*
+     * Decode directly from the memory map while the transaction pins it.  The
+     * entry is decoded in full rather than lazily: the caller owns the
+     * returned entry, reads key_data and tl_data directly, and releases it
+     * with krb5_db_free_principal(), which frees each piece separately.  So
+     * nothing in the entry may point into the map or be decoded after the
+     * transaction ends.
+     */
     ret = klmdb_decode_princ(context, name, strlen(name),
                              val.mv_data, val.mv_size, entry_out);
+    end_fetch(context);
     if (ret)
         goto cleanup;
 
@@ -836,40 +991,90 @@ klmdb_delete_principal(krb5_context context, krb5_const_principal searchfor)
     return ret;
 }
 
+/* Iterate over principal entries.  If start is not NULL, the iteration must
+ * be forwards and begins after start. */
 static krb5_error_code
-klmdb_iterate(krb5_context context, char *match_expr,
-              krb5_error_code (*func)(void *, krb5_db_entry *), void *arg,
-              krb5_flags iterflags)
+iterate_princs(krb5_context context, char *match_expr, const char *start,
+               krb5_error_code (*func)(void *, krb5_db_entry *), void *arg,
+               krb5_flags iterflags)
 {
     krb5_error_code ret;
     klmdb_context *dbc = context->dal_handle->db_context;
     krb5_db_entry *entry;
     MDB_txn *txn = NULL;
     MDB_cursor *cursor = NULL;
-    MDB_val key, val;
+    MDB_val key, val, seek = { 0 }, start_key = { 0 };
     MDB_cursor_op op = (iterflags & KRB5_DB_ITER_REV) ? MDB_PREV : MDB_NEXT;
+    MDB_cursor_op first_op = op;
+    krb5_boolean names_only = (iterflags & KRB5_DB_ITER_NAMES_ONLY) != 0;
+    struct lockout_iter li;
+    size_t prefix_len = 0;
     int err;
 
     if (dbc == NULL)
         return KRB5_KDB_DBNOTINITED;
 
-    err = mdb_txn_begin(dbc->env, NULL, MDB_RDONLY, &txn);
-    if (err)
-        goto lmdb_error;
+    /* When iterating forwards, seek to the literal prefix of match_expr (or
+     * to start, if it sorts later) and stop at the first key which doesn't
+     * begin with the prefix. */
+    if (match_expr != NULL && op == MDB_NEXT)
+        prefix_len = krb5_db_match_prefix_len(match_expr);
+    if (prefix_len > 0) {
+        seek.mv_data = match_expr;
+        seek.mv_size = prefix_len;
+        first_op = MDB_SET_RANGE;
+    }
+    if (start != NULL) {
+        start_key.mv_data = (char *)start;
+        start_key.mv_size = strlen(start);
+        if (first_op != MDB_SET_RANGE || compare_keys(&start_key, &seek) > 0) {
+            seek = start_key;
+            first_op = MDB_SET_RANGE;
+        }
+    }
+    key = seek;
+
+    /* Position the lockout cursor at the same key as the principal cursor, so
+     * that it doesn't walk the lockout records before the range. */
+    if (!names_only) {
+        lockout_iter_start(context, &li, op,
+                           (first_op == MDB_SET_RANGE) ? &seek : NULL);
+    } else {
+        memset(&li, 0, sizeof(li));
+    }
+    if (dbc->lock_txn) {
+        txn = dbc->load_txn;
+    } else {
+        err = mdb_txn_begin(dbc->env, NULL, MDB_RDONLY, &txn);
+        if (err)
+            goto lmdb_error;
+    }
     err = mdb_cursor_open(txn, dbc->princ_db, &cursor);
     if (err)
         goto lmdb_error;
     for (;;) {
-        err = mdb_cursor_get(cursor, &key, &val, op);
+        err = mdb_cursor_get(cursor, &key, &val, first_op);
+        first_op = op;
         if (err == MDB_NOTFOUND)
             break;
         if (err)
             goto lmdb_error;
-        ret = klmdb_decode_princ(context, key.mv_data, key.mv_size,
-                                 val.mv_data, val.mv_size, &entry);
+        if (key.mv_size < prefix_len ||
+            memcmp(key.mv_data, match_expr, prefix_len) != 0)
+            break;
+        if (start != NULL && compare_keys(&key, &start_key) <= 0)
+            continue;
+        if (names_only) {
+            ret = klmdb_decode_princ_name(context, key.mv_data, key.mv_size,
+                                          &entry);
+        } else {
+            ret = klmdb_decode_princ(context, key.mv_data, key.mv_size,
+                                     val.mv_data, val.mv_size, &entry);
+        }
         if (ret)
             goto cleanup;
-        fetch_lockout(context, &key, entry);
+        if (!names_only)
+            lockout_iter_fetch(context, &li, &key, entry);
         ret = (*func)(arg, entry);
         krb5_db_free_principal(context, entry);
         if (ret)
@@ -882,10 +1087,30 @@ lmdb_error:
     ret = klerr(context, err, _("LMDB principal iteration failure"));
 cleanup:
     mdb_cursor_close(cursor);
-    mdb_txn_abort(txn);
+    if (txn != dbc->load_txn)
+        mdb_txn_abort(txn);
+    lockout_iter_end(&li);
     return ret;
 }
 
+static krb5_error_code
+klmdb_iterate(krb5_context context, char *match_expr,
+              krb5_error_code (*func)(void *, krb5_db_entry *), void *arg,
+              krb5_flags iterflags)
+{
+    return iterate_princs(context, match_expr, NULL, func, arg, iterflags);
+}
+
+static krb5_error_code
+klmdb_iterate_from(krb5_context context, char *match_expr, const char *start,
+                   krb5_error_code (*func)(void *, krb5_db_entry *),
+                   void *arg, krb5_flags iterflags)
+{
+    if (iterflags & KRB5_DB_ITER_REV)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+    return iterate_princs(context, match_expr, start, func, arg, iterflags);
+}
+
 krb5_error_code
 klmdb_get_policy(krb5_context context, char *name, osa_policy_ent_t *policy)
 {
@@ -902,8 +1127,10 @@ klmdb_get_policy(krb5_context context, char *name, osa_policy_ent_t *policy)
     ret = fetch(context, dbc->policy_db, &key, &val);
     if (ret)
         return ret;
-    return klmdb_decode_policy(context, name, strlen(name),
-                               val.mv_data, val.mv_size, policy);
+    ret = klmdb_decode_policy(context, name, strlen(name),
+                              val.mv_data, val.mv_size, policy);
+    end_fetch(context);
+    return ret;
 }
 
 static krb5_error_code
@@ -959,9 +1186,13 @@ klmdb_iter_policy(krb5_context context, char *match_entry,
     if (dbc == NULL)
         return KRB5_KDB_DBNOTINITED;
 
-    err = mdb_txn_begin(dbc->env, NULL, MDB_RDONLY, &txn);
-    if (err)
-        goto lmdb_error;
+    if (dbc->lock_txn) {
+        txn = dbc->load_txn;
+    } else {
+        err = mdb_txn_begin(dbc->env, NULL, MDB_RDONLY, &txn);
+        if (err)
+            goto lmdb_error;
+    }
     err = mdb_cursor_open(txn, dbc->policy_db, &cursor);
     if (err)
         goto lmdb_error;
@@ -985,7 +1216,8 @@ lmdb_error:
     ret = klerr(context, err, _("LMDB policy iteration failure"));
 cleanup:
     mdb_cursor_close(cursor);
-    mdb_txn_abort(txn);
+    if (txn != dbc->load_txn)
+        mdb_txn_abort(txn);
     return ret;
 }
 
@@ -999,6 +1231,49 @@ klmdb_delete_policy(krb5_context context, char *policy)
     return del(context, dbc->env, dbc->policy_db, policy);
 }
 
+/* Begin a write transaction for the changes made until the matching unlock,
+ * if one is not already open. */
+static krb5_error_code
+klmdb_lock(krb5_context context, int mode)
+{
+    klmdb_context *dbc = context->dal_handle->db_context;
+    int err;
+
+    if (dbc == NULL)
+        return KRB5_KDB_DBNOTINITED;
+    if (mode != KRB5_DB_LOCKMODE_EXCLUSIVE)
+        return KRB5_PLUGIN_OP_NOTSUPP;
+    if (dbc->lock_count == 0 && dbc->load_txn == NULL) {
+        err = mdb_txn_begin(dbc->env, NULL, 0, &dbc->load_txn);
+        if (err)
+            return klerr(context, err, _("LMDB transaction begin failure"));
+        dbc->lock_txn = TRUE;
+    }
+    dbc->lock_count++;
+    return 0;
+}
+
+/* Commit the write transaction begun by the outermost lock. */
+static krb5_error_code
+klmdb_unlock(krb5_context context)
+{
+    klmdb_context *dbc = context->dal_handle->db_context;
+    int err;
+
+    if (dbc == NULL)
+        return KRB5_KDB_DBNOTINITED;
+    if (dbc->lock_count == 0)
+        return KRB5_KDB_NOTLOCKED;
+    if (--dbc->lock_count > 0 || !dbc->lock_txn)
+        return 0;
+    err = mdb_txn_commit(dbc->load_txn);
+    dbc->load_txn = NULL;
+    dbc->lock_txn = FALSE;
+    if (err)
+        return klerr(context, err, _("LMDB transaction commit failure"));
+    return 0;
+}
+
 static krb5_error_code
 klmdb_promote_db(krb5_context context, char *conf_section, char **db_args)
 {
@@ -1121,17 +1396,20 @@ cleanup:
 
 kdb_vftabl PLUGIN_SYMBOL_NAME(krb5_lmdb, kdb_function_table) = {
     .maj_ver = KRB5_KDB_DAL_MAJOR_VERSION,
-    .min_ver = 0,
+    .min_ver = 2,
     .init_library = klmdb_lib_init,
     .fini_library = klmdb_lib_cleanup,
     .init_module = klmdb_open,
     .fini_module = klmdb_fini,
     .create = klmdb_create,
     .destroy = klmdb_destroy,
+    .lock = klmdb_lock,
+    .unlock = klmdb_unlock,
     .get_principal = klmdb_get_principal,
     .put_principal = klmdb_put_principal,
     .delete_principal = klmdb_delete_principal,
     .iterate = klmdb_iterate,
+    .iterate_from = klmdb_iterate_from,
     .create_policy = klmdb_create_policy,
     .get_policy = klmdb_get_policy,
     .put_policy = klmdb_put_policy,
@@ -50,6 +50,9 @@ krb5_error_code klmdb_decode_princ(krb5_context context,
                                    const void *key, size_t key_len,
                                    const void *enc, size_t enc_len,
                                    krb5_db_entry **entry_out);
+krb5_error_code klmdb_decode_princ_name(krb5_context context,
+                                        const void *key, size_t key_len,
+                                        krb5_db_entry **entry_out);
 void klmdb_decode_princ_lockout(krb5_context context, krb5_db_entry *entry,
                                 const uint8_t buf[LOCKOUT_RECORD_LEN]);
 krb5_error_code klmdb_decode_policy(krb5_context context,
@@ -180,6 +180,52 @@ get_tl_data(struct k5input *in, size_t count, krb5_tl_data **tl)
     return 0;
 }
 
+/* Principal names which fit in this many bytes are parsed from a stack buffer
+ * rather than a heap copy of the key. */
+#define NAMEBUF_LEN 256
+
+/* Parse the principal name in key into *princ_out. */
+static krb5_error_code
+parse_key_name(krb5_context context, const void *key, size_t key_len,
+               krb5_principal *princ_out)
+{
+    krb5_error_code ret;
+    char namebuf[NAMEBUF_LEN], *princname;
+
+    /* The key is not zero-terminated, so copy it before parsing. */
+    if (key_len < sizeof(namebuf)) {
+        memcpy(namebuf, key, key_len);
+        namebuf[key_len] = '\0';
+        return krb5_parse_name(context, namebuf, princ_out);
+    }
+    princname = k5memdup0(key, key_len, &ret);
+    if (princname == NULL)
+        return ret;
+    ret = krb5_parse_name(context, princname, princ_out);
+    free(princname);
+    return ret;
+}
+
+krb5_error_code
+klmdb_decode_princ_name(krb5_context context, const void *key, size_t key_len,
+                        krb5_db_entry **entry_out)
+{
+    krb5_error_code ret;
+    krb5_db_entry *entry;
+
+    *entry_out = NULL;
+    entry = k5alloc(sizeof(*entry), &ret);
+    if (entry == NULL)
+        return ret;
+    ret = parse_key_name(context, key, key_len, &entry->princ);
+    if (ret) {
+        free(entry);
+        return ret;
+    }
+    *entry_out = entry;
+    return 0;
+}
+
 krb5_error_code
 klmdb_decode_princ(krb5_context context, const void *key, size_t key_len,
                    const void *enc, size_t enc_len, krb5_db_entry **entry_out)
@@ -187,7 +233,6 @@ klmdb_decode_princ(krb5_context context, const void *key, size_t key_len,
     krb5_error_code ret;
     struct k5input in;
     krb5_db_entry *entry = NULL;
-    char *princname = NULL;
     const uint8_t *contents;
     int i, j;
     size_t len;
@@ -199,10 +244,7 @@ klmdb_decode_princ(krb5_context context, const void *key, size_t key_len,
     if (entry == NULL)
         goto cleanup;
 
-    princname = k5memdup0(key, key_len, &ret);
-    if (princname == NULL)
-        goto cleanup;
-    ret = krb5_parse_name(context, princname, &entry->princ);
+    ret = parse_key_name(context, key, key_len, &entry->princ);
     if (ret)
         goto cleanup;
 
@@ -263,7 +305,6 @@ klmdb_decode_princ(krb5_context context, const void *key, size_t key_len,
     entry = NULL;
 
 cleanup:
-    free(princname);
     krb5_db_free_principal(context, entry);
     return ret;
 }
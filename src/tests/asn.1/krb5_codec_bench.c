@@ -0,0 +1,523 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* tests/asn.1/krb5_codec_bench.c - ASN.1 encoder and decoder microbenchmark */
+/*
+ * Copyright (C) 2020 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This program measures the cost of the ASN.1 encoders and decoders for the
+ * message types handled most often by the KDC and by application servers,
+ * using the sample values from ktest.c, enlarged to realistic sizes where the
+ * samples are unusually small.  It is not run as part of "make check".
+ *
+ * Usage: krb5_codec_bench [-n iterations] [type ...]
+ *
+ * After a header line beginning with "#", one line is written per type and
+ * operation:
+ *
+ *   type op bytes ns/op allocs/op
+ *
+ * where op is "encode", "decode" (into individually allocated objects),
+ * "arena" (into a reused arena, for types with an arena decoder), or "fuzz"
+ * (decoding the encoding with one byte corrupted, which mostly exercises the
+ * error paths).  The corruptions are generated from a fixed seed, so the
+ * output from two builds can be compared line by line (e.g. with paste).
+ * allocs/op counts calls to malloc, calloc, and realloc; it is "-" on
+ * platforms where we cannot interpose on the allocator.
+ */
+
+#include "k5-int.h"
+#include "com_err.h"
+#include "ktest.h"
+#include "utility.h"
+#include <sys/time.h>
+
+/* Typical sizes of the opaque parts of the enlarged samples. */
+#define PAC_SIZE 1400           /* AD-WIN2K-PAC for a domain user */
+#define CIPHER_OVERHEAD 28      /* aes256-cts-hmac-sha1-96 */
+#define FAST_ENC_SIZE 600       /* encrypted KrbFastReq */
+#define DH_PUBKEY_SIZE 260      /* 2048-bit Diffie-Hellman public value */
+
+krb5_context test_context;
+
+static long iterations = 100000;
+static char **selected_types;
+static int n_selected_types;
+static unsigned long alloc_count;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+
+/* Count allocations by interposing on the glibc allocator. */
+#define COUNT_ALLOCS
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *
+malloc(size_t size)
+{
+    alloc_count++;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    return __libc_realloc(ptr, size);
+}
+
+#endif /* __GLIBC__ && !__SANITIZE_ADDRESS__ */
+
+/* Type-erased encode, decode, and free functions for one ASN.1 type. */
+struct codec {
+    krb5_error_code (*encode)(const void *rep, krb5_data **code_out);
+    krb5_error_code (*decode)(const krb5_data *code, void **rep_out);
+    void (*free_rep)(void *rep);
+    krb5_error_code (*arena_decode)(k5_asn1_arena *arena,
+                                    const krb5_data *code, void **rep_out);
+};
+
+#define DEFCODECFNS(NAME, CTYPE, FREEFN)                                \
+    static krb5_error_code                                              \
+    enc_##NAME(const void *rep, krb5_data **code_out)                   \
+    {                                                                   \
+        return encode_krb5_##NAME(rep, code_out);                       \
+    }                                                                   \
+    static krb5_error_code                                              \
+    dec_##NAME(const krb5_data *code, void **rep_out)                   \
+    {                                                                   \
+        CTYPE *rep = NULL;                                              \
+        krb5_error_code ret = decode_krb5_##NAME(code, &rep);           \
+        *rep_out = rep;                                                 \
+        return ret;                                                     \
+    }                                                                   \
+    static void                                                         \
+    free_##NAME(void *rep)                                              \
+    {                                                                   \
+        FREEFN(test_context, rep);                                      \
+    }
+
+/* Define codec_NAME for a type with only a heap decoder. */
+#define DEFCODEC(NAME, CTYPE, FREEFN)                                   \
+    DEFCODECFNS(NAME, CTYPE, FREEFN)                                    \
+    static const struct codec codec_##NAME = {                          \
+        enc_##NAME, dec_##NAME, free_##NAME, NULL                       \
+    };
+
+/* Define codec_NAME for a type which also has an arena decoder. */
+#define DEFARENACODEC(NAME, CTYPE, FREEFN)                              \
+    DEFCODECFNS(NAME, CTYPE, FREEFN)                                    \
+    static krb5_error_code                                              \
+    adec_##NAME(k5_asn1_arena *arena, const krb5_data *code,            \
+                void **rep_out)                                         \
+    {                                                                   \
+        CTYPE *rep = NULL;                                              \
+        krb5_error_code ret;                                            \
+        ret = decode_krb5_##NAME##_arena(arena, code, &rep);            \
+        *rep_out = rep;                                                 \
+        return ret;                                                     \
+    }                                                                   \
+    static const struct codec codec_##NAME = {                          \
+        enc_##NAME, dec_##NAME, free_##NAME, adec_##NAME                \
+    };
+
+DEFARENACODEC(as_req, krb5_kdc_req, krb5_free_kdc_req)
+DEFARENACODEC(tgs_req, krb5_kdc_req, krb5_free_kdc_req)
+DEFARENACODEC(as_rep, krb5_kdc_rep, krb5_free_kdc_rep)
+DEFARENACODEC(tgs_rep, krb5_kdc_rep, krb5_free_kdc_rep)
+DEFARENACODEC(ap_req, krb5_ap_req, krb5_free_ap_req)
+DEFARENACODEC(authenticator, krb5_authenticator, krb5_free_authenticator)
+DEFARENACODEC(ticket, krb5_ticket, krb5_free_ticket)
+DEFARENACODEC(enc_tkt_part, krb5_enc_tkt_part, krb5_free_enc_tkt_part)
+DEFARENACODEC(padata_sequence, krb5_pa_data *, krb5_free_pa_data)
+DEFCODEC(ap_rep, krb5_ap_rep, krb5_free_ap_rep)
+DEFCODEC(enc_kdc_rep_part, krb5_enc_kdc_rep_part, krb5_free_enc_kdc_rep_part)
+DEFCODEC(error, krb5_error, krb5_free_error)
+DEFCODEC(pa_fx_fast_request, krb5_fast_armored_req,
+         krb5_free_fast_armored_req)
+
+#ifndef DISABLE_PKINIT
+
+/* The PKINIT codecs are only reachable through the accessor. */
+
+static krb5_error_code
+enc_auth_pack(const void *rep, krb5_data **code_out)
+{
+    return acc.encode_krb5_auth_pack(rep, code_out);
+}
+
+static krb5_error_code
+dec_auth_pack(const krb5_data *code, void **rep_out)
+{
+    krb5_auth_pack *rep = NULL;
+    krb5_error_code ret = acc.decode_krb5_auth_pack(code, &rep);
+
+    *rep_out = rep;
+    return ret;
+}
+
+static void
+free_auth_pack(void *rep)
+{
+    ktest_empty_auth_pack(rep);
+    free(rep);
+}
+
+static const struct codec codec_auth_pack = {
+    enc_auth_pack, dec_auth_pack, free_auth_pack, NULL
+};
+
+#endif /* not DISABLE_PKINIT */
+
+static void
+check(krb5_error_code ret, const char *what)
+{
+    if (ret) {
+        com_err("krb5_codec_bench", ret, "while processing %s", what);
+        exit(1);
+    }
+}
+
+static double
+now_ns(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+static double start_ns;
+static unsigned long start_allocs;
+
+static void
+start_op(void)
+{
+    start_allocs = alloc_count;
+    start_ns = now_ns();
+}
+
+static void
+end_op(const char *name, const char *op, const krb5_data *code)
+{
+    double ns = (now_ns() - start_ns) / iterations;
+
+#ifdef COUNT_ALLOCS
+    printf("%-20s %-6s %6u %10.1f %8.2f\n", name, op, code->length, ns,
+           (double)(alloc_count - start_allocs) / iterations);
+#else
+    printf("%-20s %-6s %6u %10.1f %8s\n", name, op, code->length, ns, "-");
+#endif
+}
+
+static krb5_boolean
+selected(const char *name)
+{
+    int i;
+
+    if (n_selected_types == 0)
+        return TRUE;
+    for (i = 0; i < n_selected_types; i++) {
+        if (strcmp(selected_types[i], name) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Run each operation of codec over sample iterations times and report the
+ * results under name. */
+static void
+bench(const char *name, const struct codec *codec, const void *sample)
+{
+    krb5_data *code, *enc, fuzz;
+    k5_asn1_arena *arena;
+    void *rep;
+    uint32_t seed = 1;
+    unsigned int pos;
+    char orig;
+    long i;
+
+    if (!selected(name))
+        return;
+    check(codec->encode(sample, &code), name);
+
+    start_op();
+    for (i = 0; i < iterations; i++) {
+        check(codec->encode(sample, &enc), name);
+        krb5_free_data(test_context, enc);
+    }
+    end_op(name, "encode", code);
+
+    start_op();
+    for (i = 0; i < iterations; i++) {
+        check(codec->decode(code, &rep), name);
+        codec->free_rep(rep);
+    }
+    end_op(name, "decode", code);
+
+    if (codec->arena_decode != NULL) {
+        check(k5_asn1_arena_create(&arena), "arena");
+        start_op();
+        for (i = 0; i < iterations; i++) {
+            check(codec->arena_decode(arena, code, &rep), name);
+            k5_asn1_arena_reset(arena);
+        }
+        end_op(name, "arena", code);
+        k5_asn1_arena_free(arena);
+    }
+
+    /* Flip some bits of one pseudo-randomly chosen byte per iteration,
+     * restoring it afterwards.  Decoding may succeed or fail. */
+    fuzz = make_data(ealloc(code->length), code->length);
+    memcpy(fuzz.data, code->data, code->length);
+    start_op();
+    for (i = 0; i < iterations; i++) {
+        seed = seed * 1103515245 + 12345;
+        pos = (seed >> 8) % fuzz.length;
+        orig = fuzz.data[pos];
+        fuzz.data[pos] ^= (seed >> 24) | 1;
+        if (codec->decode(&fuzz, &rep) == 0)
+            codec->free_rep(rep);
+        fuzz.data[pos] = orig;
+    }
+    end_op(name, "fuzz", code);
+    free(fuzz.data);
+
+    krb5_free_data(test_context, code);
+}
+
+/* Fill p with len bytes of filler standing in for opaque data. */
+static void
+fill(void *p, unsigned int len)
+{
+    uint8_t *bytes = p;
+    unsigned int i;
+
+    for (i = 0; i < len; i++)
+        bytes[i] = i * 7 + 1;
+}
+
+/* Replace the contents of d with len bytes of filler. */
+static void
+make_blob(krb5_data *d, unsigned int len)
+{
+    ktest_empty_data(d);
+    d->data = ealloc(len);
+    d->length = len;
+    fill(d->data, len);
+}
+
+/* Replace the authorization data of etp with an AD-IF-RELEVANT element
+ * containing a PAC, as a Windows or Samba KDC would issue. */
+static void
+add_pac(krb5_enc_tkt_part *etp)
+{
+    krb5_authdata pac, *list[2], *ifrel;
+    krb5_data *der;
+
+    pac.magic = KV5M_AUTHDATA;
+    pac.ad_type = KRB5_AUTHDATA_WIN2K_PAC;
+    pac.length = PAC_SIZE;
+    pac.contents = ealloc(PAC_SIZE);
+    fill(pac.contents, PAC_SIZE);
+    list[0] = &pac;
+    list[1] = NULL;
+    check(encode_krb5_authdata(list, &der), "PAC authdata");
+    free(pac.contents);
+
+    ifrel = ealloc(sizeof(*ifrel));
+    ifrel->magic = KV5M_AUTHDATA;
+    ifrel->ad_type = KRB5_AUTHDATA_IF_RELEVANT;
+    ifrel->length = der->length;
+    ifrel->contents = (uint8_t *)der->data;
+    free(der);
+
+    ktest_destroy_authorization_data(&etp->authorization_data);
+    etp->authorization_data = ealloc(2 * sizeof(*etp->authorization_data));
+    etp->authorization_data[0] = ifrel;
+}
+
+static void
+make_fast_armored_req(krb5_fast_armored_req *fr, const krb5_ap_req *armor)
+{
+    krb5_data *der;
+
+    memset(fr, 0, sizeof(*fr));
+    fr->magic = KV5M_FAST_ARMORED_REQ;
+    fr->armor = ealloc(sizeof(*fr->armor));
+    fr->armor->armor_type = KRB5_FAST_ARMOR_AP_REQUEST;
+    check(encode_krb5_ap_req(armor, &der), "FAST armor");
+    fr->armor->armor_value = *der;
+    free(der);
+    ktest_make_sample_checksum(&fr->req_checksum);
+    ktest_make_sample_enc_data(&fr->enc_part);
+    make_blob(&fr->enc_part.ciphertext, FAST_ENC_SIZE);
+}
+
+static void
+empty_fast_armored_req(krb5_fast_armored_req *fr)
+{
+    ktest_empty_data(&fr->armor->armor_value);
+    free(fr->armor);
+    free(fr->req_checksum.contents);
+    ktest_destroy_enc_data(&fr->enc_part);
+}
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr, "usage: %s [-n iterations] [type ...]\n", progname);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    krb5_kdc_req kdcreq;
+    krb5_kdc_rep kdcrep;
+    krb5_ap_req apreq, apreq_pac;
+    krb5_ap_rep aprep;
+    krb5_authenticator auth;
+    krb5_ticket tkt, tkt_pac;
+    krb5_enc_tkt_part etp, etp_pac;
+    krb5_enc_kdc_rep_part ekrp;
+    krb5_error err;
+    krb5_fast_armored_req fastreq;
+    krb5_pa_data **padata;
+    krb5_data *der;
+    const char *progname = argv[0];
+#ifndef DISABLE_PKINIT
+    krb5_auth_pack authpack;
+#endif
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        iterations = atol(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (iterations <= 0 || (argc > 1 && *argv[1] == '-'))
+        usage(progname);
+    selected_types = argv + 1;
+    n_selected_types = argc - 1;
+
+    if (krb5_init_context(&test_context) != 0)
+        abort();
+    init_access(progname);
+
+    printf("# %-18s %-6s %6s %10s %8s\n", "type", "op", "bytes", "ns/op",
+           "allocs/op");
+
+    ktest_make_sample_kdc_req(&kdcreq);
+    kdcreq.msg_type = KRB5_AS_REQ;
+    kdcreq.kdc_options &= ~KDC_OPT_ENC_TKT_IN_SKEY;
+    bench("as_req", &codec_as_req, &kdcreq);
+    kdcreq.msg_type = KRB5_TGS_REQ;
+    bench("tgs_req", &codec_tgs_req, &kdcreq);
+    ktest_empty_kdc_req(&kdcreq);
+
+    ktest_make_sample_kdc_rep(&kdcrep);
+    kdcrep.msg_type = KRB5_AS_REP;
+    bench("as_rep", &codec_as_rep, &kdcrep);
+    kdcrep.msg_type = KRB5_TGS_REP;
+    bench("tgs_rep", &codec_tgs_rep, &kdcrep);
+    ktest_empty_kdc_rep(&kdcrep);
+
+    ktest_make_sample_enc_kdc_rep_part(&ekrp);
+    bench("enc_kdc_rep_part", &codec_enc_kdc_rep_part, &ekrp);
+    ktest_empty_enc_kdc_rep_part(&ekrp);
+
+    ktest_make_sample_error(&err);
+    bench("error", &codec_error, &err);
+    ktest_empty_error(&err);
+
+    ktest_make_sample_pa_data_array(&padata);
+    bench("padata_sequence", &codec_padata_sequence, padata);
+    ktest_destroy_pa_data_array(&padata);
+
+    ktest_make_sample_ap_req(&apreq);
+    bench("ap_req", &codec_ap_req, &apreq);
+    ktest_empty_ap_req(&apreq);
+
+    ktest_make_sample_ap_rep(&aprep);
+    bench("ap_rep", &codec_ap_rep, &aprep);
+    ktest_empty_ap_rep(&aprep);
+
+    ktest_make_sample_authenticator(&auth);
+    bench("authenticator", &codec_authenticator, &auth);
+    ktest_empty_authenticator(&auth);
+
+    ktest_make_sample_ticket(&tkt);
+    bench("ticket", &codec_ticket, &tkt);
+    ktest_empty_ticket(&tkt);
+
+    ktest_make_sample_enc_tkt_part(&etp);
+    bench("enc_tkt_part", &codec_enc_tkt_part, &etp);
+    ktest_empty_enc_tkt_part(&etp);
+
+    /* A ticket carrying a PAC, with ciphertext sized to match. */
+    ktest_make_sample_enc_tkt_part(&etp_pac);
+    add_pac(&etp_pac);
+    bench("enc_tkt_part_pac", &codec_enc_tkt_part, &etp_pac);
+    check(encode_krb5_enc_tkt_part(&etp_pac, &der), "enc_tkt_part_pac");
+    ktest_make_sample_ticket(&tkt_pac);
+    make_blob(&tkt_pac.enc_part.ciphertext, der->length + CIPHER_OVERHEAD);
+    bench("ticket_pac", &codec_ticket, &tkt_pac);
+    ktest_make_sample_ap_req(&apreq_pac);
+    make_blob(&apreq_pac.ticket->enc_part.ciphertext,
+              der->length + CIPHER_OVERHEAD);
+    bench("ap_req_pac", &codec_ap_req, &apreq_pac);
+    krb5_free_data(test_context, der);
+    ktest_empty_ticket(&tkt_pac);
+    ktest_empty_enc_tkt_part(&etp_pac);
+
+    /* A FAST request armored with a PAC-bearing TGT. */
+    make_fast_armored_req(&fastreq, &apreq_pac);
+    bench("pa_fx_fast_request", &codec_pa_fx_fast_request, &fastreq);
+    empty_fast_armored_req(&fastreq);
+    ktest_empty_ap_req(&apreq_pac);
+
+#ifndef DISABLE_PKINIT
+    ktest_make_sample_auth_pack(&authpack);
+    make_blob(&authpack.clientPublicValue->subjectPublicKey, DH_PUBKEY_SIZE);
+    bench("auth_pack", &codec_auth_pack, &authpack);
+    ktest_empty_auth_pack(&authpack);
+#endif
+
+    krb5_free_context(test_context);
+    return 0;
+}
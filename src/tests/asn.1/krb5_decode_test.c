@@ -1223,6 +1223,110 @@ int main(argc, argv)
 
 #endif
 
+    /****************************************************************/
+    /* Arena decoders: round-trip the sample values through the encoders
+     * and check that the arena-allocated results match. */
+    {
+        k5_asn1_arena *arena;
+        krb5_data *enc;
+
+        retval = k5_asn1_arena_create(&arena);
+        if (retval) {
+            com_err("krb5_decode_test", retval, "while creating arena");
+            exit(1);
+        }
+
+#define arena_run(typestring,description,encoder,decoder,comparator)     \
+        retval = encoder(&ref, &enc);                                   \
+        if (retval) {                                                   \
+            com_err("krb5_decode_test", retval, "while encoding %s", typestring); \
+            exit(1);                                                    \
+        }                                                               \
+        retval = decoder(arena, enc, &var);                             \
+        if (retval) {                                                   \
+            com_err("krb5_decode_test", retval, "while decoding %s", typestring); \
+            error_count++;                                              \
+        }                                                               \
+        test(comparator(&ref,var),typestring);                          \
+        printf("%s\n",description);                                     \
+        krb5_free_data(test_context, enc);                              \
+        k5_asn1_arena_reset(arena);
+
+        {
+            setup(krb5_kdc_req,ktest_make_sample_kdc_req);
+            ref.msg_type = KRB5_AS_REQ;
+            ref.kdc_options &= ~KDC_OPT_ENC_TKT_IN_SKEY;
+            arena_run("as_req","(arena)",encode_krb5_as_req,
+                      decode_krb5_as_req_arena,ktest_equal_as_req);
+            ref.msg_type = KRB5_TGS_REQ;
+            arena_run("tgs_req","(arena)",encode_krb5_tgs_req,
+                      decode_krb5_tgs_req_arena,ktest_equal_tgs_req);
+            ktest_destroy_principal(&(ref.client));
+            arena_run("tgs_req","(arena, client NULL)",encode_krb5_tgs_req,
+                      decode_krb5_tgs_req_arena,ktest_equal_tgs_req);
+            ktest_empty_kdc_req(&ref);
+        }
+        {
+            setup(krb5_kdc_rep,ktest_make_sample_kdc_rep);
+            ref.msg_type = KRB5_AS_REP;
+            arena_run("as_rep","(arena)",encode_krb5_as_rep,
+                      decode_krb5_as_rep_arena,ktest_equal_as_rep);
+            ref.msg_type = KRB5_TGS_REP;
+            arena_run("tgs_rep","(arena)",encode_krb5_tgs_rep,
+                      decode_krb5_tgs_rep_arena,ktest_equal_tgs_rep);
+            ktest_empty_kdc_rep(&ref);
+        }
+        {
+            setup(krb5_ap_req,ktest_make_sample_ap_req);
+            arena_run("ap_req","(arena)",encode_krb5_ap_req,
+                      decode_krb5_ap_req_arena,ktest_equal_ap_req);
+            ktest_empty_ap_req(&ref);
+        }
+        {
+            setup(krb5_authenticator,ktest_make_sample_authenticator);
+            arena_run("authenticator","(arena)",encode_krb5_authenticator,
+                      decode_krb5_authenticator_arena,
+                      ktest_equal_authenticator);
+            ktest_empty_authenticator(&ref);
+        }
+        {
+            setup(krb5_ticket,ktest_make_sample_ticket);
+            arena_run("ticket","(arena)",encode_krb5_ticket,
+                      decode_krb5_ticket_arena,ktest_equal_ticket);
+            ktest_empty_ticket(&ref);
+        }
+        {
+            setup(krb5_enc_tkt_part,ktest_make_sample_enc_tkt_part);
+            arena_run("enc_tkt_part","(arena)",encode_krb5_enc_tkt_part,
+                      decode_krb5_enc_tkt_part_arena,
+                      ktest_equal_enc_tkt_part);
+            ktest_empty_enc_tkt_part(&ref);
+        }
+        {
+            krb5_pa_data **ref, **var;
+
+            ktest_make_sample_pa_data_array(&ref);
+            retval = encode_krb5_padata_sequence(ref, &enc);
+            if (retval) {
+                com_err("krb5_decode_test", retval,
+                        "while encoding padata_sequence");
+                exit(1);
+            }
+            retval = decode_krb5_padata_sequence_arena(arena, enc, &var);
+            if (retval) {
+                com_err("krb5_decode_test", retval,
+                        "while decoding padata_sequence");
+                error_count++;
+            }
+            test(ktest_equal_sequence_of_pa_data(ref,var),"pa_data");
+            printf("(arena)\n");
+            krb5_free_data(test_context, enc);
+            ktest_destroy_pa_data_array(&ref);
+        }
+
+        k5_asn1_arena_free(arena);
+    }
+
     krb5_free_context(test_context);
     exit(error_count);
     return(error_count);
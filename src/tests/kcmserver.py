@@ -13,6 +13,10 @@
 # would need to know how to match a cred tag against previously stored
 # credentials).
 
+# If the -f flag is given, the server does not implement the MIT
+# extension operations, so that the client's fallback code for older
+# KCM daemons can be exercised.
+
 # The following code is useful for debugging if anything appears to be
 # going wrong in the server, since daemon output is generally not
 # visible in Python test scripts.
@@ -23,6 +27,7 @@
 #         traceback.print_exception(etype, value, tb, file=f)
 # sys.excepthook = ehook
 
+import optparse
 import select
 import socket
 import struct
@@ -49,12 +54,15 @@ class KCMOpcodes(object):
     SET_DEFAULT_CACHE = 21
     GET_KDC_OFFSET = 22
     SET_KDC_OFFSET = 23
+    GET_CRED_LIST = 13001
+    GET_CACHE_LIST = 0xF001
 
 
 class KRB5Errors(object):
     KRB5_CC_END = -1765328242
     KRB5_CC_NOSUPP = -1765328137
     KRB5_FCC_NOFILE = -1765328189
+    KRB5_FCC_INTERNAL = -1765328188
 
 
 def make_uuid():
@@ -170,6 +178,19 @@ def op_set_default_cache(argbytes):
     return 0, b''
 
 
+def op_get_cred_list(argbytes):
+    name, rest = unmarshal_name(argbytes)
+    cache = get_cache(name)
+    creds = [cache.creds[u] for u in cache.cred_uuids]
+    return 0, (struct.pack('>L', len(creds)) +
+               b''.join(struct.pack('>L', len(c)) + c for c in creds))
+
+
+def op_get_cache_list(argbytes):
+    return 0, b''.join(c.name + b'\0' for c in caches.values()
+                       if c.princ is not None)
+
+
 def op_get_kdc_offset(argbytes):
     name, rest = unmarshal_name(argbytes)
     cache = get_cache(name)
@@ -197,9 +218,16 @@ ophandlers = {
     KCMOpcodes.GET_DEFAULT_CACHE : op_get_default_cache,
     KCMOpcodes.SET_DEFAULT_CACHE : op_set_default_cache,
     KCMOpcodes.GET_KDC_OFFSET : op_get_kdc_offset,
-    KCMOpcodes.SET_KDC_OFFSET : op_set_kdc_offset
+    KCMOpcodes.SET_KDC_OFFSET : op_set_kdc_offset,
+    KCMOpcodes.GET_CRED_LIST : op_get_cred_list,
+    KCMOpcodes.GET_CACHE_LIST : op_get_cache_list
 }
 
+def op_unsupported(argbytes):
+    # Like Heimdal's KCM daemon, report unknown operations as internal
+    # errors.
+    return KRB5Errors.KRB5_FCC_INTERNAL, b''
+
 # Read and respond to a request from the socket s.
 def service_request(s):
     lenbytes = b''
@@ -215,7 +243,7 @@ def service_request(s):
 
     majver, minver, op = struct.unpack('>BBH', req[:4])
     argbytes = req[4:]
-    code, payload = ophandlers[op](argbytes)
+    code, payload = ophandlers.get(op, op_unsupported)(argbytes)
 
     # The KCM response is the code (4 bytes) and the response payload.
     # The Heimdal IPC response is the length of the KCM response (4
@@ -227,8 +255,17 @@ def service_request(s):
     return True
 
 
+parser = optparse.OptionParser()
+parser.add_option('-f', '--fallback', action='store_true', dest='fallback',
+                  default=False,
+                  help='Do not support the MIT extension operations')
+(options, args) = parser.parse_args()
+if options.fallback:
+    del ophandlers[KCMOpcodes.GET_CRED_LIST]
+    del ophandlers[KCMOpcodes.GET_CACHE_LIST]
+
 server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
-server.bind(sys.argv[1])
+server.bind(args[0])
 server.listen(5)
 select_input = [server,]
 sys.stderr.write('starting...\n')
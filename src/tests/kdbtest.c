@@ -277,6 +277,8 @@ main()
     osa_policy_ent_t pol;
     krb5_pa_data **e_data;
     const char *status;
+    char *name;
+    krb5_error_code ret;
     int count;
 
     CHECK(krb5_init_context_profile(NULL, KRB5_INIT_CONTEXT_KDC, &ctx));
@@ -391,6 +393,30 @@ main()
     count = 0;
     CHECK(krb5_db_iterate(ctx, "xy*", iter_princ_handler, &count, 0));
     CHECK_COND(count == 1);
+    count = 0;
+    CHECK(krb5_db_iterate(ctx, "xy*", iter_princ_handler, &count,
+                          KRB5_DB_ITER_NAMES_ONLY));
+    CHECK_COND(count == 1);
+
+    /* Iterate in name order from before and at the principal name, if the
+     * module supports it. */
+    count = 0;
+    ret = krb5_db_iterate_from(ctx, "xy*", NULL, iter_princ_handler, &count,
+                               KRB5_DB_ITER_NAMES_ONLY);
+    if (ret != KRB5_PLUGIN_OP_NOTSUPP) {
+        CHECK(ret);
+        CHECK_COND(count == 1);
+        count = 0;
+        CHECK(krb5_db_iterate_from(ctx, "xy*", "xy", iter_princ_handler,
+                                   &count, KRB5_DB_ITER_NAMES_ONLY));
+        CHECK_COND(count == 1);
+        CHECK(krb5_unparse_name(ctx, &sample_princ, &name));
+        count = 0;
+        CHECK(krb5_db_iterate_from(ctx, "xy*", name, iter_princ_handler,
+                                   &count, KRB5_DB_ITER_NAMES_ONLY));
+        CHECK_COND(count == 0);
+        krb5_free_unparsed_name(ctx, name);
+    }
 
     CHECK(krb5_db_fini(ctx));
     CHECK_COND(krb5_db_inited(ctx) != 0);
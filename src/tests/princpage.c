@@ -0,0 +1,100 @@
+/* -*- mode: c; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* tests/princpage.c - List principal names a page at a time */
+/*
+ * Copyright (C) 2026 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Usage: princpage client password pattern pagesize
+ *
+ * This program is invoked from t_princpage.py.  It authenticates to kadmind
+ * as client and lists the principal names matching pattern using the
+ * GET_PRINCS_PAGE RPC, pagesize names at a time.  Each name is printed on its
+ * own line, with a "--" line between pages.
+ */
+
+#include <k5-int.h>
+#include <kadm5/admin.h>
+
+static void
+check(krb5_error_code ret)
+{
+    if (ret) {
+        fprintf(stderr, "Unexpected failure %ld, aborting\n", (long)ret);
+        abort();
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    krb5_context ctx;
+    kadm5_config_params params = { 0 };
+    krb5_boolean more;
+    void *handle;
+    char *realm, *start = NULL, **names;
+    int i, count, max;
+
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s client password pattern pagesize\n",
+                argv[0]);
+        return 1;
+    }
+    max = atoi(argv[4]);
+
+    check(krb5_init_context(&ctx));
+    check(krb5_get_default_realm(ctx, &realm));
+    params.mask |= KADM5_CONFIG_REALM;
+    params.realm = realm;
+    check(kadm5_init(ctx, argv[1], argv[2], KADM5_ADMIN_SERVICE, &params,
+                     KADM5_STRUCT_VERSION, KADM5_API_VERSION_4, NULL,
+                     &handle));
+
+    do {
+        check(kadm5_get_principals_page(handle, argv[3], start, max, &names,
+                                        &count, &more));
+        for (i = 0; i < count; i++)
+            printf("%s\n", names[i]);
+        if (more)
+            printf("--\n");
+        free(start);
+        start = NULL;
+        if (count > 0)
+            start = strdup(names[count - 1]);
+        check(kadm5_free_name_list(handle, names, count));
+        if (more && start == NULL)
+            check(ENOMEM);
+    } while (more);
+
+    free(start);
+    kadm5_destroy(handle);
+    krb5_free_default_realm(ctx, realm);
+    krb5_free_context(ctx);
+    return 0;
+}
@@ -1,8 +1,14 @@
 from k5test import *
+import json
 
 conf = {'plugins': {'audit': {
             'module': 'test:$plugins/audit/test/k5audit_test.so'}}}
 
+# The test module appends to au.log in the KDC's working directory.
+au_log = os.path.join(os.getcwd(), 'au.log')
+if os.path.exists(au_log):
+    os.remove(au_log)
+
 realm = K5Realm(krb5_conf=conf, get_creds=False)
 realm.addprinc('target')
 realm.run([kadminl, 'modprinc', '+ok_to_auth_as_delegate', realm.host_princ])
@@ -24,4 +30,16 @@ realm.start_server([uuserver, port_arg], 'Server started')
 realm.run([uuclient, hostname, 'testing message', port_arg],
           expected_msg='Hello')
 
+# Stop the KDC so that all buffered audit records are written, and
+# check that each record is a well-formed JSON object.
+realm.stop_kdc()
+events = set()
+with open(au_log, 'r') as f:
+    for line in f:
+        events.add(json.loads(line)['event_name'])
+for ev in ('KDC_START', 'AS_REQ', 'TGS_REQ', 'S4U2SELF', 'S4U2PROXY', 'U2U',
+           'KDC_STOP'):
+    if ev not in events:
+        fail('Missing %s audit record' % ev)
+
 success('Audit tests')
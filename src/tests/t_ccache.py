@@ -21,6 +21,7 @@
 # or implied warranty.
 
 from k5test import *
+import time
 
 kcm_socket_path = os.path.join(os.getcwd(), 'testdir', 'kcm')
 conf = {'libdefaults': {'kcm_socket': kcm_socket_path,
@@ -61,6 +62,28 @@ realm.addprinc('bob', password('bob'))
 realm.addprinc('carol', password('carol'))
 realm.addprinc('doug', password('doug'))
 
+# Test that lookups answered from the in-process ccache read cache
+# see credentials stored earlier in the same process.
+mark('ccache read cache')
+rconf = {'libdefaults': {'ccache_read_cache': 'true'}}
+rcenv = realm.special_env('read_cache', False, krb5_conf=rconf)
+realm.kinit(realm.user_princ, password('user'))
+out = realm.run([kvno, 'alice', 'bob', 'alice'], env=rcenv)
+if out.count('kvno = ') != 3:
+    fail('Expected three kvno results with ccache read cache')
+realm.run([klist], expected_msg='bob@')
+
+# Once the ccache is no longer being modified, repeated lookups should
+# be answered from a single snapshot of it.  (A cache modified during
+# the current second is not retained.)
+t = time.time() - 60
+os.utime(realm.ccache, (t, t))
+msgs = ('Reading snapshot of ccache FILE:' + realm.ccache,
+        'Using cached snapshot of ccache FILE:' + realm.ccache,
+        'Using cached snapshot of ccache FILE:' + realm.ccache)
+realm.run([kvno, 'alice', 'bob', 'alice'], env=rcenv, expected_trace=msgs)
+realm.run([kdestroy])
+
 def collection_test(realm, ccname):
     cctype = ccname.partition(':')[0]
     oldccname = realm.env['KRB5CCNAME']
@@ -126,7 +149,15 @@ def collection_test(realm, ccname):
 
 collection_test(realm, 'DIR:' + os.path.join(realm.testdir, 'cc'))
 kcmserver_path = os.path.join(srctop, 'tests', 'kcmserver.py')
-realm.start_server([sys.executable, kcmserver_path, kcm_socket_path],
+kcmd = realm.start_server([sys.executable, kcmserver_path, kcm_socket_path],
+                          'starting...')
+collection_test(realm, 'KCM:')
+
+# Exercise the client fallback for KCM daemons which don't implement
+# GET_CRED_LIST and GET_CACHE_LIST.
+stop_daemon(kcmd)
+os.remove(kcm_socket_path)
+realm.start_server([sys.executable, kcmserver_path, '-f', kcm_socket_path],
                    'starting...')
 collection_test(realm, 'KCM:')
 if test_keyring:
@@ -91,4 +91,24 @@ for realm in multidb_realms(start_kdc=False):
     load_dump_check_compare(realm, ['-r13'], srcdump_r13)
     load_dump_check_compare(realm, ['-b7'], srcdump_b7)
 
+    # Round-trip the database through a binary dump, and check that
+    # nothing was lost by comparing a text dump of the result.
+    mark('binary dump')
+    binfile = os.path.join(realm.testdir, 'dump.bin')
+    realm.run([kdb5_util, 'load', srcdump])
+    realm.run([kdb5_util, 'dump', '-binary', binfile])
+    realm.run([kdb5_util, 'destroy', '-f'])
+    realm.run([kdb5_util, 'load', binfile])
+    realm.run([kadminl, 'getprinc', 'nokeys'],
+              expected_msg='Number of keys: 0')
+    dump_compare(realm, [], srcdump)
+
+    # A truncated binary dump should fail to load.
+    with open(binfile, 'rb') as f:
+        contents = f.read()
+    with open(binfile, 'wb') as f:
+        f.write(contents[:-10])
+    realm.run([kdb5_util, 'load', binfile], expected_code=1,
+              expected_msg='cannot read record contents')
+
 success('Dump/load tests')
@@ -8,7 +8,7 @@ from k5test import *
 # versa.
 def wait_for_prop(kpropd, full_expected, expected_old, expected_new):
     output('*** Waiting for sync from kpropd\n')
-    full_seen = sleep_seen = False
+    full_seen = sleep_seen = partial_seen = False
     old_sno = new_sno = -1
     while True:
         line = kpropd.stdout.readline()
@@ -18,7 +18,7 @@ def wait_for_prop(kpropd, full_expected, expected_old, expected_new):
 
         m = re.match(r'Calling iprop_get_updates_1 \(sno=(\d+) ', line)
         if m:
-            if not full_seen:
+            if not full_seen and not partial_seen:
                 old_sno = int(m.group(1))
             # Also record this as the new sno, in case we get back
             # UPDATE_NIL.
@@ -28,9 +28,17 @@ def wait_for_prop(kpropd, full_expected, expected_old, expected_new):
         if m:
             new_sno = int(m.group(1))
 
-        if 'KDC is synchronized' in line or 'Incremental updates:' in line:
+        if 'KDC is synchronized' in line:
             break
 
+        # kadmind answers a waiting kpropd as soon as an update is
+        # stored, so a change made by kadmin.local as several updates
+        # (such as a rename) can arrive in more than one batch.
+        if 'Incremental updates:' in line:
+            if full_seen or new_sno >= expected_new:
+                break
+            partial_seen = True
+
         # After a full resync request, these lines could appear in
         # either order.
         if 'Waiting for' in line:
@@ -210,11 +218,13 @@ for realm in multidb_realms(kdc_conf=conf, create_user=False,
         fail('replica1 does not have all principals from master')
     check_ulog(1, 6, 6, [None], replica1)
 
-    # Make a change and check that it propagates incrementally.
+    # Make a change and check that it propagates incrementally.  kpropd
+    # is waiting on kadmind for updates, so no signal is needed to
+    # prompt it (here or for the other incremental propagations below).
+    # Changes which require a full resync still need one.
     mark('propagate M->1 incremental')
     realm.run([kadminl, 'modprinc', '-allow_tix', pr2])
     check_ulog(7, 1, 7, [None, pr1, pr3, pr2, pr2, pr2, pr2])
-    kpropd1.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd1, False, 6, 7)
     check_ulog(2, 6, 7, [None, pr2], replica1)
     realm.run([kadminl, 'getprinc', pr2], env=replica1,
@@ -250,12 +260,10 @@ for realm in multidb_realms(kdc_conf=conf, create_user=False,
     mark('propagate M->1->3 incremental')
     realm.run([kadminl, 'modprinc', '-maxlife', '20 minutes', pr1])
     check_ulog(8, 1, 8, [None, pr1, pr3, pr2, pr2, pr2, pr2, pr1])
-    kpropd1.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd1, False, 7, 8)
     check_ulog(3, 6, 8, [None, pr2, pr1], replica1)
     realm.run([kadminl, 'getprinc', pr1], env=replica1,
               expected_msg='Maximum ticket life: 0 days 00:20:00')
-    kpropd3.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd3, False, 7, 8)
     check_ulog(2, 7, 8, [None, pr1], replica3)
     realm.run([kadminl, '-r', realm.realm, 'getprinc', pr1], env=replica3,
@@ -298,12 +306,10 @@ for realm in multidb_realms(kdc_conf=conf, create_user=False,
     mark('propagate M->1->2 incremental')
     realm.run([kadminl, 'modprinc', '-maxrenewlife', '22 hours', pr1])
     check_ulog(9, 1, 9, [None, pr1, pr3, pr2, pr2, pr2, pr2, pr1, pr1])
-    kpropd1.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd1, False, 8, 9)
     check_ulog(4, 6, 9, [None, pr2, pr1, pr1], replica1)
     realm.run([kadminl, 'getprinc', pr1], env=replica1,
               expected_msg='Maximum renewable life: 0 days 22:00:00\n')
-    kpropd2.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd2, False, 8, 9)
     check_ulog(3, 7, 9, [None, pr1, pr1], replica2)
     realm.run([kadminl, 'getprinc', pr1], env=replica2,
@@ -328,12 +334,10 @@ for realm in multidb_realms(kdc_conf=conf, create_user=False,
     mark('propagate M->1->2 incremental (after reset)')
     realm.run([kadminl, 'modprinc', '+allow_tix', pr2])
     check_ulog(10, 1, 10, [None, pr1, pr3, pr2, pr2, pr2, pr2, pr1, pr1, pr2])
-    kpropd1.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd1, False, 9, 10)
     check_ulog(5, 6, 10, [None, pr2, pr1, pr1, pr2], replica1)
     realm.run([kadminl, 'getprinc', pr2], env=replica1,
               expected_msg='Attributes:\n')
-    kpropd2.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd2, False, 9, 10)
     check_ulog(4, 7, 10, [None, pr1, pr1, pr2], replica2)
     realm.run([kadminl, 'getprinc', pr2], env=replica2,
@@ -389,12 +393,10 @@ for realm in multidb_realms(kdc_conf=conf, create_user=False,
     mark('propagate M->1->2 incremental (after policy changes)')
     realm.run([kadminl, 'modprinc', '-maxlife', '10 minutes', pr1])
     check_ulog(2, 1, 2, [None, pr1])
-    kpropd1.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd1, False, 1, 2)
     check_ulog(2, 1, 2, [None, pr1], replica1)
     realm.run([kadminl, 'getprinc', pr1], env=replica1,
               expected_msg='Maximum ticket life: 0 days 00:10:00')
-    kpropd2.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd2, False, 1, 2)
     check_ulog(2, 1, 2, [None, pr1], replica2)
     realm.run([kadminl, 'getprinc', pr1], env=replica2,
@@ -404,12 +406,10 @@ for realm in multidb_realms(kdc_conf=conf, create_user=False,
     mark('propagate M->1->2 incremental (princ delete)')
     realm.run([kadminl, 'delprinc', pr3])
     check_ulog(3, 1, 3, [None, pr1, pr3])
-    kpropd1.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd1, False, 2, 3)
     check_ulog(3, 1, 3, [None, pr1, pr3], replica1)
     realm.run([kadminl, 'getprinc', pr3], env=replica1, expected_code=1,
               expected_msg='Principal does not exist')
-    kpropd2.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd2, False, 2, 3)
     check_ulog(3, 1, 3, [None, pr1, pr3], replica2)
     realm.run([kadminl, 'getprinc', pr3], env=replica2, expected_code=1,
@@ -420,13 +420,11 @@ for realm in multidb_realms(kdc_conf=conf, create_user=False,
     renpr = "quacked@" + realm.realm
     realm.run([kadminl, 'renprinc', pr1, renpr])
     check_ulog(6, 1, 6, [None, pr1, pr3, renpr, pr1, renpr])
-    kpropd1.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd1, False, 3, 6)
     check_ulog(6, 1, 6, [None, pr1, pr3, renpr, pr1, renpr], replica1)
     realm.run([kadminl, 'getprinc', pr1], env=replica1, expected_code=1,
               expected_msg='Principal does not exist')
     realm.run([kadminl, 'getprinc', renpr], env=replica1)
-    kpropd2.send_signal(signal.SIGUSR1)
     wait_for_prop(kpropd2, False, 3, 6)
     check_ulog(6, 1, 6, [None, pr1, pr3, renpr, pr1, renpr], replica2)
     realm.run([kadminl, 'getprinc', pr1], env=replica2, expected_code=1,
@@ -479,4 +477,30 @@ for realm in multidb_realms(kdc_conf=conf, create_user=False,
     realm.run([kadminl, 'getpol', 'testpol'], env=replica1,
               expected_msg='Minimum number of password character classes: 3')
 
+    # Test group commit.  Changes made through kadmind while a batch is
+    # open should be answered once it is committed, and should all be
+    # logged.
+    mark('kadmind group commit')
+    gc1 = 'gc1@' + realm.realm
+    gc2 = 'gc2@' + realm.realm
+    gcconf = {'realms': {'$realm': {'kadmind_commit_delay': '200'}}}
+    gcenv = realm.special_env('gc', True, kdc_conf=gcconf)
+    realm.stop_kadmind()
+    realm.start_kadmind(env=gcenv)
+    realm.addprinc(realm.admin_princ, password('admin'))
+    realm.prep_kadmin()
+    realm.run_kadmin([], input='addprinc -randkey gc1\n'
+                     'addprinc -randkey gc2\n'
+                     'modprinc -maxlife \"1 hour\" gc1\n')
+    check_ulog(5, 1, 5, [None, realm.admin_princ, gc1, gc2, gc1])
+    realm.run([kadminl, 'getprinc', 'gc1'],
+              expected_msg='Maximum ticket life: 0 days 01:00:00')
+
+    # A change from an AUTH_GSSAPI client cannot have its reply held,
+    # so it commits the open batch before it is answered.
+    realm.run_kadmin(['-O', 'modprinc', '-maxlife', '2 hours', 'gc2'])
+    check_ulog(6, 1, 6, [None, realm.admin_princ, gc1, gc2, gc1, gc2])
+    realm.run([kadminl, 'getprinc', 'gc2'],
+              expected_msg='Maximum ticket life: 0 days 02:00:00')
+
 success('iprop tests')
@@ -39,6 +39,8 @@ admin = make_client('user/admin')
 none = make_client('none')
 restrictions = make_client('restrictions')
 onetwothreefour = make_client('one/two/three/four')
+order_one = make_client('order/one')
+order_two = make_client('order/two')
 
 realm.run([kadminl, 'addpol', '-minlife', '1 day', 'minlife'])
 
@@ -63,6 +65,9 @@ some_rename        a   to
 restricted_add     a   *         +preauth
 restricted_modify  im  *         +preauth
 restricted_rename  ad  *         +preauth
+order/two          l
+order/*            i
+order/one          x
 
 */*                d   *2/*1
 # The next line is a regression test for #8154; it is not used directly.
@@ -282,6 +287,28 @@ kadmin_as(restrictions, ['addprinc', '-pw', 'pw', '-maxrenewlife', '1 day',
 realm.run([kadminl, 'getprinc', 'type3'],
           expected_msg='Maximum renewable life: 0 days 02:00:00')
 
+mark('batch add and modify')
+namefile = os.path.join(realm.testdir, 'names')
+with open(namefile, 'w') as f:
+    f.write('selected\n\nunselected\n')
+kadmin_as(some_add, ['addprincs', '-randkey', namefile], expected_code=1,
+          expected_msg='while creating "unselected@KRBTEST.COM"')
+realm.run([kadminl, 'getprinc', 'selected'])
+realm.run([kadminl, 'getprinc', 'unselected'], expected_code=1,
+          expected_msg='Principal does not exist')
+kadmin_as(some_modify, ['modprincs', '-maxlife', '1 hour',
+                        '+requires_preauth', namefile], expected_code=1,
+          expected_msg='while getting "unselected@KRBTEST.COM"')
+out = realm.run([kadminl, 'getprinc', 'selected'])
+if ('Maximum ticket life: 0 days 01:00:00' not in out or
+    'REQUIRES_PRE_AUTH' not in out):
+    fail('modprincs did not modify selected principal')
+realm.run([kadminl, 'addprincs', '-nokey', namefile], expected_code=1,
+          expected_msg='while creating "selected@KRBTEST.COM"')
+realm.run([kadminl, 'getprinc', 'unselected'], expected_msg='Number of keys: 0')
+realm.run([kadminl, 'delprinc', 'selected'])
+realm.run([kadminl, 'delprinc', 'unselected'])
+
 mark('extract')
 realm.run([kadminl, 'addprinc', '-pw', 'pw', 'extractkeys'])
 kadmin_as(all_wildcard, ['ktadd', '-norandkey', 'extractkeys'],
@@ -328,4 +355,42 @@ realm.run([kadmin, '-c', realm.ccache, 'cpw', '-randkey', 'none'],
 realm.run([kadmin, '-c', realm.ccache, 'cpw', '-randkey', '-e', 'aes256-cts',
            'none'], expected_code=1, expected_msg=msg)
 
+# Verify that the first matching ACL line applies, whether its client
+# principal is literal or contains wildcards.
+mark('ACL entry order')
+kadmin_as(order_one, ['getprinc', 'none'], expected_msg='Principal: none@')
+kadmin_as(order_one, ['modprinc', '-maxlife', '1 hour', 'none'],
+          expected_code=1,
+          expected_msg="Operation requires ``modify'' privilege")
+kadmin_as(order_two, ['getprinc', 'none'], expected_code=1,
+          expected_msg="Operation requires ``get'' privilege")
+kadmin_as(order_two, ['listprincs'], expected_msg='order/two@')
+
+# Verify read operations and ACL checks with kadmind worker threads, and
+# that they see changes made on the main thread.
+mark('kadmind worker threads')
+tconf = {'realms': {'$realm': {'kadmind_threads': '2'}}}
+tenv = realm.special_env('threads', True, kdc_conf=tconf)
+realm.stop_kadmind()
+realm.start_kadmind(env=tenv)
+kadmin_as(all_inquire, ['getpol', 'minlife'], expected_msg='Policy: minlife')
+kadmin_as(none, ['getpol', 'minlife'], expected_code=1,
+          expected_msg="Operation requires ``get'' privilege")
+kadmin_as(all_inquire, ['getprinc', 'none'], expected_msg='Principal: none@')
+kadmin_as(none, ['getprinc', 'all_add'], expected_code=1,
+          expected_msg="Operation requires ``get'' privilege")
+kadmin_as(all_inquire, ['getprivs'], expected_msg='INQUIRE')
+kadmin_as(none, ['getstrs', 'none'], expected_msg='(No string attributes.)')
+out = kadmin_as(all_wildcard, [], input='addprinc -nokey threadprinc\n'
+                'setstr threadprinc tkey tvalue\n'
+                'getstrs threadprinc\n'
+                'modprinc -maxlife "2 hours" threadprinc\n'
+                'getprinc threadprinc\n'
+                'delprinc -force threadprinc\n'
+                'getprinc threadprinc\n')
+if ('tkey: tvalue' not in out or
+    'Maximum ticket life: 0 days 02:00:00' not in out or
+    'Principal does not exist' not in out):
+    fail('Unexpected kadmin output with worker threads')
+
 success('kadmin ACL enforcement')
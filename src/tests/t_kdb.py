@@ -317,6 +317,31 @@ realm.kinit(realm.user_princ, password('user'))
 realm.run([kvno, realm.host_princ])
 realm.klist(realm.user_princ, realm.host_princ)
 
+# Look up principals stored under each of the realm's subtrees.  The
+# searches for all subtrees are sent before any result is read, so a
+# match in any one subtree must be found regardless of reply order.
+mark('LDAP multiple subtrees')
+realm.run([kadminl, 'ank', '-pw', password('s1'), '-x',
+           'containerdn=cn=t1,cn=krb5', 'subtree1'])
+realm.run([kadminl, 'ank', '-pw', password('s2'), '-x',
+           'containerdn=cn=t2,cn=krb5', 'subtree2'])
+out = ldap_search('(krbPrincipalName=subtree*)')
+if ('dn: krbprincipalname=subtree1@KRBTEST.COM,cn=t1,cn=krb5' not in out or
+    'dn: krbprincipalname=subtree2@KRBTEST.COM,cn=t2,cn=krb5' not in out):
+    fail('Expected subtree principal DNs not in output')
+realm.run([kadminl, 'getprinc', 'subtree1'], expected_msg='Principal: subtree1')
+realm.run([kadminl, 'getprinc', 'subtree2'], expected_msg='Principal: subtree2')
+realm.run([kadminl, 'getprinc', 'subtree3'], expected_code=1,
+          expected_msg='Principal does not exist')
+out = realm.run([kadminl, 'listprincs', 'subtree*'])
+if sorted(out.splitlines()) != ['subtree1@KRBTEST.COM',
+                               'subtree2@KRBTEST.COM']:
+    fail('Unexpected listprincs output for subtree principals')
+realm.kinit('subtree1', password('s1'))
+realm.kinit('subtree2', password('s2'))
+realm.run([kvno, realm.host_princ])
+realm.kinit(realm.user_princ, password('user'))
+
 mark('LDAP auth indicator')
 
 # Test auth indicator support
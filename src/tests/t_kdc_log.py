@@ -18,4 +18,32 @@ f.close()
 if not found_skew:
     fail('Did not find KDC log line for expired-ticket TGS request')
 
+# Wait for text to appear in a log file written by the async flusher thread.
+def wait_for_log(path, text):
+    for i in range(50):
+        if os.path.exists(path):
+            with open(path, 'r') as f:
+                if text in f.read():
+                    return
+        time.sleep(0.1)
+    fail('Did not find "%s" in %s' % (text, path))
+
+# Make an AS request with asynchronous logging, then check that the
+# KDC reopens its log file on SIGHUP.
+mark('async logging')
+aenv = realm.special_env('async', True,
+                         krb5_conf={'logging': {'async': 'true'}})
+realm.stop_kdc()
+realm.start_kdc(env=aenv)
+realm.kinit(realm.user_princ, password('user'))
+wait_for_log(kdc_logfile, 'AS_REQ')
+os.rename(kdc_logfile, kdc_logfile + '.old')
+realm._kdc_proc.send_signal(signal.SIGHUP)
+for i in range(50):
+    realm.kinit(realm.user_princ, password('user'))
+    if os.path.exists(kdc_logfile):
+        break
+    time.sleep(0.1)
+wait_for_log(kdc_logfile, 'AS_REQ')
+
 success('KDC logging tests')
@@ -1,4 +1,5 @@
 from k5test import *
+import signal
 
 conf_replica = {'dbmodules': {'db': {'database_name': '$testdir/db.replica'}}}
 
@@ -10,6 +11,7 @@ def setup_acl(realm):
 
 def check_output(kpropd):
     output('*** kpropd output follows\n')
+    streamed = False
     while True:
         line = kpropd.stdout.readline()
         if 'Database load process for full propagation completed' in line:
@@ -17,6 +19,10 @@ def check_output(kpropd):
         output('kpropd: ' + line)
         if 'Rejected connection' in line:
             fail('kpropd rejected connection from kprop')
+        if 'Using streamed full propagation' in line:
+            streamed = True
+    if not streamed:
+        fail('kprop did not use the streaming protocol')
 
 # kprop/kpropd are the only users of krb5_auth_con_initivector, so run
 # this test over all enctypes to exercise mkpriv cipher state.
@@ -44,6 +50,77 @@ for realm in multipass_realms(create_user=False):
 
     realm.run([kadminl, 'listprincs'], replica, expected_msg='wakawaka')
 
+    # Stream a dump to kprop through standard input.
+    realm.addprinc('streamed')
+    realm.run([kdb5_util, 'dump', dumpfile])
+    with open(dumpfile) as f:
+        dump = f.read()
+    realm.run([kprop, '-f', '-', '-P', str(realm.kprop_port()), hostname],
+              input=dump)
+    check_output(kpropd)
+
+    realm.run([kadminl, 'listprincs'], replica, expected_msg='streamed')
+
+    # Start a streamed propagation of one full block, and wait until kpropd
+    # has passed the block to the loading process.  The block holds a
+    # complete dump padded with whitespace, so kdb5_util would load it
+    # successfully if it mistook the end of its input for the end of the
+    # dump.  Return the kprop process and the loader PID.
+    def start_partial_prop(princname):
+        realm.addprinc(princname)
+        realm.run([kdb5_util, 'dump', dumpfile])
+        with open(dumpfile) as f:
+            dump = f.read()
+        dump += ' ' * (256 * 1024 - len(dump))
+        args = [kprop, '-f', '-', '-P', str(realm.kprop_port()), hostname]
+        proc = subprocess.Popen(args, stdin=subprocess.PIPE,
+                                stdout=subprocess.DEVNULL,
+                                stderr=subprocess.DEVNULL, env=realm.env)
+        proc.stdin.write(dump.encode())
+        proc.stdin.flush()
+        load_pid = None
+        while True:
+            line = kpropd.stdout.readline()
+            if line == '':
+                fail('kpropd exited during streamed propagation')
+            output('kpropd: ' + line)
+            if line.startswith('Load PID is '):
+                load_pid = int(line.split()[3])
+            if line == '262144 bytes received.\n':
+                return proc, load_pid
+
+    def check_not_loaded(proc, princname, msg):
+        proc.stdin.close()
+        proc.wait()
+        while True:
+            line = kpropd.stdout.readline()
+            if line == '':
+                fail('kpropd exited during streamed propagation')
+            output('kpropd: ' + line)
+            if msg in line:
+                break
+        out = realm.run([kadminl, 'listprincs'], replica)
+        if princname + '@' in out:
+            fail('partial streamed transfer reached the replica database')
+
+    # Kill kprop partway through a transfer.  kpropd should stop the
+    # loading process.
+    mark('aborted streamed propagation')
+    proc, load_pid = start_partial_prop('aborted')
+    proc.kill()
+    check_not_loaded(proc, 'aborted', 'load process for full propagation '
+                     'aborted')
+
+    # Kill the kpropd process handling a transfer.  The loading process
+    # should see the end of its input without the end-of-dump marker, and
+    # fail without making the database live.
+    mark('kpropd killed during streamed propagation')
+    proc, load_pid = start_partial_prop('orphaned')
+    ppid = int(subprocess.check_output(['ps', '-o', 'ppid=', '-p',
+                                        str(load_pid)]))
+    os.kill(ppid, signal.SIGKILL)
+    check_not_loaded(proc, 'orphaned', 'end of dump not confirmed')
+
 # default_realm tests follow.
 # default_realm and domain_realm different than realm.realm (test -r argument).
 conf_rep2 = {'dbmodules': {'db': {'database_name': '$testdir/db.replica2'}}}
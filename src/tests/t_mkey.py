@@ -126,8 +126,8 @@ count_re = {False: re.compile(r'^(\d+) principals processed: (\d+) updated, '
             True: re.compile(r'^(\d+) principals processed: (\d+) would be '
                              'updated, (\d+) already current$')}
 def update_princ_encryption(dry_run, expected_mkvno, expected_updated,
-                            expected_current):
-    opts = ['-f', '-v']
+                            expected_current, extra_opts=[]):
+    opts = ['-f', '-v'] + extra_opts
     if dry_run:
         opts += ['-n']
     out = realm.run([kdb5_util, 'update_princ_encryption'] + opts)
@@ -227,6 +227,22 @@ check_mkvno(realm.user_princ, 1)
 realm.run([kdb5_util, 'use_mkey', '2', 'now-1day'])
 update_princ_encryption(False, 2, nprincs - 1, 0)
 check_mkvno(realm.user_princ, 2)
+realm.kinit(realm.user_princ, 'user')
+
+# Repeat the back-and-forth update using batched re-encryption
+# threads, each with its own database handle.
+mark('update_princ_encryption -j')
+realm.run([kdb5_util, 'use_mkey', '2', 'now+1day'])
+update_princ_encryption(False, 1, nprincs - 1, 0, ['-j', '4'])
+check_mkvno(realm.user_princ, 1)
+check_mkvno(realm.admin_princ, 1)
+realm.run([kdb5_util, 'use_mkey', '2', 'now-1day'])
+update_princ_encryption(False, 2, nprincs - 1, 0, ['-j', '2'])
+check_mkvno(realm.user_princ, 2)
+check_mkvno(realm.admin_princ, 2)
+realm.stop_kdc()
+realm.start_kdc()
+realm.kinit(realm.user_princ, 'user')
 
 # Test the safety check for purging with an outdated stash file.
 mark('purge_mkeys (outdated stash file)')
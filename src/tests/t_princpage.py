@@ -0,0 +1,69 @@
+from k5test import *
+
+names = ['pg%02d' % i for i in range(25)] + ['pga/x', 'pgb', 'pq', 'ab+c',
+                                            'abbc']
+
+def setup(realm):
+    for name in names:
+        realm.run([kadminl, 'addprinc', '-nokey', name])
+    realm.start_kadmind()
+
+# List principals matching pattern through the GET_PRINCS_PAGE RPC,
+# pagesize names at a time, and check the result against the sorted
+# list of matching names.
+def check_pages(realm, pattern, pagesize, expected):
+    expected = sorted(x + '@' + realm.realm for x in expected)
+    pages = [expected[i:i + pagesize]
+             for i in range(0, len(expected), pagesize)]
+    lines = '--\n'.join(''.join(x + '\n' for x in page) for page in pages)
+    out = realm.run(['./princpage', realm.admin_princ, password('admin'),
+                     pattern, str(pagesize)])
+    if out != lines:
+        fail('Unexpected princpage output for %s' % pattern)
+
+def run_tests(realm):
+    pg = [x for x in names if x.startswith('pg')]
+    mark('pages of a prefix')
+    check_pages(realm, 'pg*', 10, pg)
+    check_pages(realm, 'pg*', 1, pg)
+    check_pages(realm, 'pg*', len(pg), pg)
+    check_pages(realm, 'pg*', len(pg) + 1, pg)
+    check_pages(realm, 'pg1*', 3, ['pg%02d' % i for i in range(10, 20)])
+    check_pages(realm, 'pg2?', 5, ['pg%02d' % i for i in range(20, 25)])
+    check_pages(realm, 'pg[ab]*', 1, ['pga/x', 'pgb'])
+    check_pages(realm, 'zz*', 4, [])
+
+    mark('pages of all principals')
+    out = realm.run([kadminl, 'listprincs'])
+    allnames = [x.split('@')[0] for x in out.splitlines()]
+    check_pages(realm, '*', 7, allnames)
+
+    mark('pattern with operator characters')
+    check_pages(realm, 'ab+*', 2, ['ab+c'])
+
+for realm in multidb_realms(create_host=False, get_creds=False):
+    setup(realm)
+    run_tests(realm)
+    realm.stop()
+
+# Check that skipping to the start name works with unlocked DB2
+# iteration, which saves and restores the cursor around callbacks.
+mark('DB2 unlocked iteration')
+realm = K5Realm(create_host=False, get_creds=False, bdb_only=True,
+                krb5_conf={'dbmodules': {'db': {'unlockiter': 'true'}}})
+setup(realm)
+run_tests(realm)
+realm.stop()
+
+# DB2 hash databases cannot be iterated in name order, so each page
+# visits every principal.
+mark('DB2 hash database')
+realm = K5Realm(create_kdb=False, start_kdc=False, bdb_only=True)
+realm.run([kdb5_util, '-x', 'hash=true', 'create', '-W', '-s', '-P',
+           'master'])
+realm.addprinc(realm.admin_princ, password('admin'))
+realm.start_kdc()
+setup(realm)
+run_tests(realm)
+
+success('Principal listing pages')
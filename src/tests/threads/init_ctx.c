@@ -40,6 +40,7 @@
 #define N_THREADS 4
 #define ITER_COUNT 40000
 static int init_krb5_first = 0;
+static int copy_template = 0;
 
 struct resource_info {
     struct timeval start_time, end_time;
@@ -66,6 +67,7 @@ usage ()
     fprintf (stderr, "\t-i N\tset iteration count (default %d)\n",
              ITER_COUNT);
     fprintf (stderr, "\t-K\tinitialize a krb5_context for the duration\n");
+    fprintf (stderr, "\t-C\tcopy a template context instead of initializing\n");
     fprintf (stderr, "\t-P\tpause briefly after starting, to allow attaching dtrace/strace/etc\n");
     exit (1);
 }
@@ -88,7 +90,7 @@ numarg (char *arg)
     usage ();
 }
 
-static char optstring[] = "t:i:KP";
+static char optstring[] = "t:i:KCP";
 
 static void
 process_options (int argc, char *argv[])
@@ -123,6 +125,10 @@ process_options (int argc, char *argv[])
             init_krb5_first = 1;
             break;
 
+        case 'C':
+            copy_template = 1;
+            break;
+
         case 'P':
             do_pause = 1;
             break;
@@ -151,6 +157,8 @@ now (void)
     return tv;
 }
 
+static krb5_context template_ctx;
+
 static void run_iterations (struct resource_info *r)
 {
     int i;
@@ -159,7 +167,10 @@ static void run_iterations (struct resource_info *r)
 
     r->start_time = now ();
     for (i = 0; i < iter_count; i++) {
-        err = krb5_init_context(&ctx);
+        if (copy_template)
+            err = krb5_copy_context(template_ctx, &ctx);
+        else
+            err = krb5_init_context(&ctx);
         if (err) {
             com_err(prog, err, "initializing krb5 context");
             exit(1);
@@ -198,12 +209,17 @@ main (int argc, char *argv[])
         fprintf (stderr, "krb5_init_context error\n");
         exit (1);
     }
+    if (copy_template && krb5_init_context (&template_ctx) != 0) {
+        fprintf (stderr, "krb5_init_context error\n");
+        exit (1);
+    }
     tinfo = calloc (n_threads, sizeof (*tinfo));
     if (tinfo == NULL) {
         perror ("calloc");
         exit (1);
     }
-    printf ("Threads: %d  iterations: %d\n", n_threads, iter_count);
+    printf ("Threads: %d  iterations: %d  mode: %s\n", n_threads, iter_count,
+            copy_template ? "krb5_copy_context" : "krb5_init_context");
     if (do_pause) {
         printf ("pid %lu napping...\n", (unsigned long) getpid ());
         sleep (10);
@@ -242,6 +258,8 @@ main (int argc, char *argv[])
     }
     if (init_krb5_first)
         krb5_free_context (kctx);
+    if (copy_template)
+        krb5_free_context (template_ctx);
     foreach_thread (i) {
         printf ("Thread %2d: elapsed time %Lfs\n", i,
                 tvsub (tinfo[i].r.end_time, tinfo[i].r.start_time));
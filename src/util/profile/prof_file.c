@@ -262,6 +262,35 @@ errcode_t profile_open_file(const_profile_filespec_t filespec,
     return 0;
 }
 
+/*
+ * Create a new file handle for the same file as prf.  If prf's data is shared,
+ * reference it directly instead of reopening the file, so that the copy does
+ * not need to stat or reparse it.
+ */
+errcode_t profile_copy_file(prf_file_t prf, prf_file_t *ret_prf)
+{
+    prf_file_t      new_prf;
+    prf_data_t      data = prf->data;
+
+    profile_lock_global();
+    if (!(data->flags & PROFILE_FILE_SHARED)) {
+        profile_unlock_global();
+        return profile_open_file(data->filespec, ret_prf, NULL);
+    }
+    new_prf = calloc(1, sizeof(*new_prf));
+    if (new_prf == NULL) {
+        profile_unlock_global();
+        return ENOMEM;
+    }
+    new_prf->magic = PROF_MAGIC_FILE;
+    new_prf->data = data;
+    data->refcount++;
+    profile_unlock_global();
+
+    *ret_prf = new_prf;
+    return 0;
+}
+
 errcode_t profile_update_file_data_locked(prf_data_t data, char **ret_modspec)
 {
     errcode_t retval;
@@ -303,6 +332,8 @@ errcode_t profile_update_file_data_locked(prf_data_t data, char **ret_modspec)
         profile_free_node(data->root);
         data->root = 0;
     }
+    profile_free_index(data->index);
+    data->index = NULL;
 
     /* Only try to reload regular files, not devices such as pipes. */
     if ((st.st_mode & S_IFMT) != S_IFREG)
@@ -547,6 +578,7 @@ static void profile_free_file_data(prf_data_t data)
     }
     if (data->root)
         profile_free_node(data->root);
+    profile_free_index(data->index);
     data->magic = 0;
     k5_mutex_destroy(&data->lock);
     free(data);
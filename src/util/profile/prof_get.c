@@ -152,6 +152,57 @@ get_values_vt(profile_t profile, const char *const *names, char ***ret_values)
     return retval;
 }
 
+/*
+ * Look up a relation using the per-file lookup indexes, adding each matching
+ * value to values (or only the first if first_only is set).  Return
+ * PROF_UNSUPPORTED if any file cannot be searched this way, in which case the
+ * caller should fall back to the node iterator.
+ */
+static errcode_t
+get_values_indexed(profile_t profile, const char *const *names,
+                   int first_only, struct profile_string_list *values)
+{
+    errcode_t               retval;
+    prf_file_t              file;
+    struct profile_node     *node;
+    int                     final_seen;
+
+    if (names == NULL || names[0] == NULL)
+        return PROF_BAD_NAMESET;
+
+    for (file = profile->first_file; file != NULL; file = file->next) {
+        if (!(file->data->flags & PROFILE_FILE_SHARED))
+            return PROF_UNSUPPORTED;
+    }
+
+    for (file = profile->first_file; file != NULL; file = file->next) {
+        k5_mutex_lock(&file->data->lock);
+        retval = profile_update_file_locked(file, NULL);
+        if (retval == ENOENT || retval == EACCES) {
+            k5_mutex_unlock(&file->data->lock);
+            continue;
+        } else if (retval) {
+            k5_mutex_unlock(&file->data->lock);
+            return retval;
+        }
+
+        retval = profile_index_find_relation(file->data, names, &node,
+                                             &final_seen);
+        for (; retval == 0 && node != NULL;
+             node = profile_next_relation(node)) {
+            retval = add_to_list(values, profile_get_node_value(node));
+            if (first_only)
+                break;
+        }
+        k5_mutex_unlock(&file->data->lock);
+        if (retval)
+            return retval;
+        if (final_seen || (first_only && values->num > 0))
+            break;
+    }
+    return 0;
+}
+
 errcode_t KRB5_CALLCONV
 profile_get_values(profile_t profile, const char *const *names,
                    char ***ret_values)
@@ -166,14 +217,22 @@ profile_get_values(profile_t profile, const char *const *names,
         return PROF_NO_PROFILE;
     if (profile->vt)
         return get_values_vt(profile, names, ret_values);
+    if (profile->magic != PROF_MAGIC_PROFILE)
+        return PROF_MAGIC_PROFILE;
+
+    if ((retval = init_list(&values)))
+        return retval;
+
+    retval = get_values_indexed(profile, names, 0, &values);
+    if (retval == 0)
+        goto done;
+    if (retval != PROF_UNSUPPORTED)
+        goto cleanup;
 
     if ((retval = profile_node_iterator_create(profile, names,
                                                PROFILE_ITER_RELATIONS_ONLY,
                                                &state)))
-        return retval;
-
-    if ((retval = init_list(&values)))
-        return retval;
+        goto cleanup;
 
     do {
         if ((retval = profile_node_iterator(&state, 0, 0, &value)))
@@ -182,6 +241,7 @@ profile_get_values(profile_t profile, const char *const *names,
             add_to_list(&values, value);
     } while (state);
 
+done:
     if (values.num == 0) {
         retval = PROF_NO_RELATION;
         goto cleanup;
@@ -223,12 +283,30 @@ errcode_t profile_get_value(profile_t profile, const char **names,
     errcode_t               retval;
     void                    *state;
     char                    *value;
+    struct profile_string_list values;
 
     *ret_value = NULL;
     if (!profile)
         return PROF_NO_PROFILE;
     if (profile->vt)
         return get_value_vt(profile, names, ret_value);
+    if (profile->magic != PROF_MAGIC_PROFILE)
+        return PROF_MAGIC_PROFILE;
+
+    retval = init_list(&values);
+    if (retval)
+        return retval;
+    retval = get_values_indexed(profile, names, 1, &values);
+    if (retval == 0 && values.num > 0) {
+        /* Take ownership of the single value and discard the list. */
+        *ret_value = values.list[0];
+        values.list[0] = NULL;
+    } else if (retval == 0) {
+        retval = PROF_NO_RELATION;
+    }
+    end_list(&values, NULL);
+    if (retval != PROF_UNSUPPORTED)
+        return retval;
 
     retval = profile_iterator_create(profile, names,
                                      PROFILE_ITER_RELATIONS_ONLY, &state);
@@ -279,40 +279,49 @@ copy_vtable_profile(profile_t profile, profile_t *ret_new_profile)
     return 0;
 }
 
-#define COUNT_LINKED_LIST(COUNT, PTYPE, START, FIELD)   \
-    {                                                   \
-        size_t cll_counter = 0;                         \
-        PTYPE cll_ptr = (START);                        \
-        while (cll_ptr != NULL) {                       \
-            cll_counter++;                              \
-            cll_ptr = cll_ptr->FIELD;                   \
-        }                                               \
-        (COUNT) = cll_counter;                          \
-    }
-
 errcode_t KRB5_CALLCONV
 profile_copy(profile_t old_profile, profile_t *new_profile)
 {
-    size_t size, i;
-    const_profile_filespec_t *files;
-    prf_file_t file;
-    errcode_t err;
+    profile_t profile;
+    prf_file_t file, new_file, last = NULL;
+    errcode_t err, access_err = 0;
 
     if (old_profile->vt)
         return copy_vtable_profile(old_profile, new_profile);
 
-    /* The fields we care about are read-only after creation, so
-       no locking is needed.  */
-    COUNT_LINKED_LIST (size, prf_file_t, old_profile->first_file, next);
-    files = malloc ((size+1) * sizeof(*files));
-    if (files == NULL)
+    profile = calloc(1, sizeof(*profile));
+    if (profile == NULL)
         return ENOMEM;
-    for (i = 0, file = old_profile->first_file; i < size; i++, file = file->next)
-        files[i] = file->data->filespec;
-    files[size] = NULL;
-    err = profile_init (files, new_profile);
-    free (files);
-    return err;
+    profile->magic = PROF_MAGIC_PROFILE;
+
+    /* The file list is read-only after creation, so no locking is needed to
+     * walk it.  Shared file data is referenced rather than reread; skip files
+     * which have become missing or unreadable, as profile_init() would. */
+    for (file = old_profile->first_file; file != NULL; file = file->next) {
+        err = profile_copy_file(file, &new_file);
+        if (err == ENOENT)
+            continue;
+        if (err == EACCES || err == EPERM) {
+            access_err = err;
+            continue;
+        }
+        if (err) {
+            profile_release(profile);
+            return err;
+        }
+        if (last != NULL)
+            last->next = new_file;
+        else
+            profile->first_file = new_file;
+        last = new_file;
+    }
+    if (old_profile->first_file != NULL && last == NULL) {
+        profile_release(profile);
+        return access_err ? access_err : ENOENT;
+    }
+
+    *new_profile = profile;
+    return 0;
 }
 
 errcode_t KRB5_CALLCONV
@@ -36,6 +36,7 @@ struct _prf_data_t {
 	unsigned long	frac_ts;   /* fractional part of timestamp, if any */
 	int		flags;	/* r/w, dirty */
 	int		upd_serial; /* incremented when data changes */
+	struct profile_index *index; /* lookup index for root, or NULL */
 
 	size_t		fslen;
 
@@ -206,6 +207,16 @@ errcode_t profile_set_relation_value
 errcode_t profile_rename_node
 	(struct profile_node *node, const char *new_name);
 
+void profile_free_index
+	(struct profile_index *index);
+
+errcode_t profile_index_find_relation
+	(prf_data_t data, const char *const *names,
+		   struct profile_node **ret_node, int *final_seen);
+
+struct profile_node *profile_next_relation
+	(struct profile_node *node);
+
 /* prof_file.c */
 
 errcode_t KRB5_CALLCONV profile_copy (profile_t, profile_t *);
@@ -214,6 +225,9 @@ errcode_t profile_open_file
 	(const_profile_filespec_t file, prf_file_t *ret_prof,
 	 char **ret_modspec);
 
+errcode_t profile_copy_file
+	(prf_file_t prf, prf_file_t *ret_prf);
+
 #define profile_update_file(P, M) profile_update_file_data((P)->data, M)
 errcode_t profile_update_file_data
 	(prf_data_t profile, char **ret_modspec);
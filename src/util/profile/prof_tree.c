@@ -19,6 +19,8 @@
 
 
 #include "prof_int.h"
+#include "k5-buf.h"
+#include "k5-hashtab.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -593,6 +595,236 @@ get_new_file:
     return 0;
 }
 
+/*
+ * A lookup index over a shared (read-only) parse tree.  Each section path and
+ * each relation path in the tree maps to the first matching node, so that
+ * lookups by full name don't have to walk the linked lists level by level.
+ * Keys are the path components joined by null bytes, prefixed with 'S' for
+ * sections or 'R' for relations.  Only the first section of a given name is
+ * indexed at each level, mirroring profile_node_iterator().
+ */
+struct index_entry {
+    struct profile_node *node;
+    int final_seen;             /* node's section or an ancestor is final */
+    size_t klen;
+    char *key;
+    struct index_entry *next;
+};
+
+struct profile_index {
+    int upd_serial;
+    struct k5_hashtab *ht;
+    struct index_entry *entries;
+};
+
+void profile_free_index(struct profile_index *index)
+{
+    struct index_entry *e, *next;
+
+    if (index == NULL)
+        return;
+    for (e = index->entries; e != NULL; e = next) {
+        next = e->next;
+        free(e);
+    }
+    k5_hashtab_free(index->ht);
+    free(index);
+}
+
+/* Add an entry for node at the path in buf to index, unless one is already
+ * present.  Set *added to indicate whether a new entry was created. */
+static errcode_t index_add(struct profile_index *index, struct k5buf *buf,
+                           struct profile_node *node, int final_seen,
+                           int *added)
+{
+    struct index_entry *e;
+
+    *added = 0;
+    if (k5_buf_status(buf) != 0)
+        return ENOMEM;
+    if (k5_hashtab_get(index->ht, buf->data, buf->len) != NULL)
+        return 0;
+
+    e = malloc(sizeof(*e) + buf->len);
+    if (e == NULL)
+        return ENOMEM;
+    e->node = node;
+    e->final_seen = final_seen;
+    e->klen = buf->len;
+    e->key = (char *)(e + 1);
+    memcpy(e->key, buf->data, buf->len);
+    if (k5_hashtab_add(index->ht, e->key, e->klen, e) != 0) {
+        free(e);
+        return ENOMEM;
+    }
+    e->next = index->entries;
+    index->entries = e;
+    *added = 1;
+    return 0;
+}
+
+/* Index the children of section, whose path (without a type prefix) is the
+ * current contents of path. */
+static errcode_t index_section(struct profile_index *index,
+                               struct profile_node *section, int final_seen,
+                               struct k5buf *path, struct k5buf *key)
+{
+    errcode_t retval;
+    struct profile_node *p;
+    size_t plen = path->len;
+    int added;
+
+    for (p = section->first_child; p != NULL; p = p->next) {
+        if (p->deleted)
+            continue;
+        path->len = plen;
+        if (plen > 0)
+            k5_buf_add_len(path, "", 1);
+        k5_buf_add(path, p->name);
+        if (k5_buf_status(path) != 0)
+            return ENOMEM;
+
+        k5_buf_truncate(key, 0);
+        k5_buf_add_len(key, p->value ? "R" : "S", 1);
+        k5_buf_add_len(key, path->data, path->len);
+        if (p->value != NULL) {
+            retval = index_add(index, key, p, final_seen, &added);
+            if (retval)
+                return retval;
+        } else {
+            retval = index_add(index, key, p, final_seen || p->final, &added);
+            if (retval)
+                return retval;
+            if (added) {
+                retval = index_section(index, p, final_seen || p->final,
+                                       path, key);
+                if (retval)
+                    return retval;
+            }
+        }
+    }
+    path->len = plen;
+    return 0;
+}
+
+static errcode_t build_index(prf_data_t data, struct profile_index **index_out)
+{
+    errcode_t retval;
+    struct profile_index *index;
+    struct k5buf path, key;
+
+    *index_out = NULL;
+    index = calloc(1, sizeof(*index));
+    if (index == NULL)
+        return ENOMEM;
+    index->upd_serial = data->upd_serial;
+    if (k5_hashtab_create(NULL, 64, &index->ht) != 0) {
+        free(index);
+        return ENOMEM;
+    }
+
+    k5_buf_init_dynamic(&path);
+    k5_buf_init_dynamic(&key);
+    retval = index_section(index, data->root, 0, &path, &key);
+    k5_buf_free(&path);
+    k5_buf_free(&key);
+    if (retval) {
+        profile_free_index(index);
+        return retval;
+    }
+    *index_out = index;
+    return 0;
+}
+
+/* Look up the entry for the first n components of names, with the given type
+ * prefix. */
+static struct index_entry *index_get(struct profile_index *index, char type,
+                                     const char *const *names, size_t n,
+                                     struct k5buf *key)
+{
+    size_t i;
+
+    k5_buf_truncate(key, 0);
+    k5_buf_add_len(key, &type, 1);
+    for (i = 0; i < n; i++) {
+        if (i > 0)
+            k5_buf_add_len(key, "", 1);
+        k5_buf_add(key, names[i]);
+    }
+    if (k5_buf_status(key) != 0)
+        return NULL;
+    return k5_hashtab_get(index->ht, key->data, key->len);
+}
+
+/*
+ * Find the first relation matching names within a single file's data, as
+ * profile_node_iterator() would, using the data's lookup index.  Call with
+ * data->lock held and after updating the data.  On success, set *ret_node to
+ * the first matching relation node (which remains valid while the lock is
+ * held), or to NULL if there is none; in both cases set *final_seen if the
+ * search should not continue into subsequent files.  Return PROF_UNSUPPORTED
+ * if the data is not shared and therefore might be modified in place.
+ */
+errcode_t profile_index_find_relation(prf_data_t data,
+                                      const char *const *names,
+                                      struct profile_node **ret_node,
+                                      int *final_seen)
+{
+    errcode_t retval;
+    struct index_entry *e;
+    struct k5buf key;
+    size_t n, i;
+
+    *ret_node = NULL;
+    *final_seen = 0;
+    if (!(data->flags & PROFILE_FILE_SHARED) ||
+        (data->flags & PROFILE_FILE_DIRTY))
+        return PROF_UNSUPPORTED;
+    if (data->index != NULL && data->index->upd_serial != data->upd_serial) {
+        profile_free_index(data->index);
+        data->index = NULL;
+    }
+    if (data->index == NULL) {
+        retval = build_index(data, &data->index);
+        if (retval)
+            return retval;
+    }
+
+    for (n = 0; names[n] != NULL; n++);
+    assert(n > 0);
+
+    k5_buf_init_dynamic(&key);
+    e = index_get(data->index, 'R', names, n, &key);
+    if (e != NULL) {
+        *ret_node = e->node;
+        *final_seen = e->final_seen;
+    } else {
+        /* The iterator marks the search final if any section it descends
+         * through is final, even if a deeper component is missing. */
+        for (i = n - 1; i > 0 && e == NULL; i--)
+            e = index_get(data->index, 'S', names, i, &key);
+        if (e != NULL)
+            *final_seen = e->final_seen;
+    }
+    retval = k5_buf_status(&key) ? ENOMEM : 0;
+    k5_buf_free(&key);
+    return retval;
+}
+
+/* Return the next node after node with the same name which is a relation, or
+ * NULL if there is none. */
+struct profile_node *profile_next_relation(struct profile_node *node)
+{
+    struct profile_node *p;
+
+    for (p = node->next; p != NULL && strcmp(p->name, node->name) == 0;
+         p = p->next) {
+        if (p->value != NULL && !p->deleted)
+            return p;
+    }
+    return NULL;
+}
+
 /*
  * Remove a particular node.
  *
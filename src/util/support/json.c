@@ -576,35 +576,39 @@ k5_json_number_value(k5_json_number number)
 
 static const char quotemap_json[] = "\"\\/bfnrt";
 static const char quotemap_c[] = "\"\\/\b\f\n\r\t";
-static const char needs_quote[] = "\\\"\1\2\3\4\5\6\7\10\11\12\13\14\15\16\17"
-    "\20\21\22\23\24\25\26\27\30\31\32\33\34\35\36\37";
 
 static int encode_value(struct k5buf *buf, k5_json_value val);
 
 static void
-encode_string(struct k5buf *buf, const char *str)
+encode_string_len(struct k5buf *buf, const char *str, size_t len)
 {
-    size_t n;
-    const char *p;
+    const char *end = str + len, *p, *q;
+    unsigned char c;
 
     k5_buf_add(buf, "\"");
-    while (*str != '\0') {
-        n = strcspn(str, needs_quote);
-        k5_buf_add_len(buf, str, n);
-        str += n;
-        if (*str == '\0')
-            break;
+    for (p = str; p < end; p++) {
+        c = *p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        k5_buf_add_len(buf, str, p - str);
         k5_buf_add(buf, "\\");
-        p = strchr(quotemap_c, *str);
-        if (p != NULL)
-            k5_buf_add_len(buf, quotemap_json + (p - quotemap_c), 1);
+        q = (c != '\0') ? strchr(quotemap_c, c) : NULL;
+        if (q != NULL)
+            k5_buf_add_len(buf, quotemap_json + (q - quotemap_c), 1);
         else
-            k5_buf_add_fmt(buf, "u00%02X", (unsigned int)*str);
-        str++;
+            k5_buf_add_fmt(buf, "u00%02X", (unsigned int)c);
+        str = p + 1;
     }
+    k5_buf_add_len(buf, str, end - str);
     k5_buf_add(buf, "\"");
 }
 
+static void
+encode_string(struct k5buf *buf, const char *str)
+{
+    encode_string_len(buf, str, strlen(str));
+}
+
 struct obj_ctx {
     struct k5buf *buf;
     int ret;
@@ -702,6 +706,89 @@ k5_json_encode(k5_json_value val, char **json_out)
     return 0;
 }
 
+/*** Streaming JSON encoding ***/
+
+void
+k5_json_writer_init(struct k5_json_writer *w, struct k5buf *buf)
+{
+    w->buf = buf;
+    w->first = 1;
+}
+
+/* Write the separator and key (if any) preceding a value. */
+static void
+write_key(struct k5_json_writer *w, const char *key)
+{
+    if (!w->first)
+        k5_buf_add(w->buf, ",");
+    w->first = 0;
+    if (key != NULL) {
+        encode_string(w->buf, key);
+        k5_buf_add(w->buf, ":");
+    }
+}
+
+void
+k5_json_write_begin_object(struct k5_json_writer *w, const char *key)
+{
+    write_key(w, key);
+    k5_buf_add(w->buf, "{");
+    w->first = 1;
+}
+
+void
+k5_json_write_end_object(struct k5_json_writer *w)
+{
+    k5_buf_add(w->buf, "}");
+    w->first = 0;
+}
+
+void
+k5_json_write_begin_array(struct k5_json_writer *w, const char *key)
+{
+    write_key(w, key);
+    k5_buf_add(w->buf, "[");
+    w->first = 1;
+}
+
+void
+k5_json_write_end_array(struct k5_json_writer *w)
+{
+    k5_buf_add(w->buf, "]");
+    w->first = 0;
+}
+
+void
+k5_json_write_string(struct k5_json_writer *w, const char *key,
+                     const char *str)
+{
+    write_key(w, key);
+    encode_string(w->buf, str);
+}
+
+void
+k5_json_write_string_len(struct k5_json_writer *w, const char *key,
+                         const void *str, size_t len)
+{
+    write_key(w, key);
+    encode_string_len(w->buf, str, len);
+}
+
+void
+k5_json_write_number(struct k5_json_writer *w, const char *key,
+                     long long number)
+{
+    write_key(w, key);
+    k5_buf_add_fmt(w->buf, "%lld", number);
+}
+
+void
+k5_json_write_bool(struct k5_json_writer *w, const char *key, int b)
+{
+    write_key(w, key);
+    k5_buf_add(w->buf, b ? "true" : "false");
+}
+
 /*** JSON decoding ***/
 
 struct decode_ctx {
@@ -70,6 +70,7 @@
 #include <string.h>
 
 #include <k5-json.h>
+#include <k5-buf.h>
 
 static void
 err(const char *str)
@@ -318,6 +319,54 @@ test_json(void)
     }
 }
 
+static void
+test_writer(void)
+{
+    struct k5buf buf;
+    struct k5_json_writer w;
+    k5_json_value v;
+    char *enc;
+    const char *expected = "{\"k1\":\"a\\\"b\\n\",\"k2\":[1,-2,[],{}],"
+        "\"k3\":{\"k4\":true,\"k5\":\"c\\u0000d\"},\"k6\":false}";
+
+    k5_buf_init_dynamic(&buf);
+    k5_json_writer_init(&w, &buf);
+    k5_json_write_begin_object(&w, NULL);
+    k5_json_write_string(&w, "k1", "a\"b\n");
+    k5_json_write_begin_array(&w, "k2");
+    k5_json_write_number(&w, NULL, 1);
+    k5_json_write_number(&w, NULL, -2);
+    k5_json_write_begin_array(&w, NULL);
+    k5_json_write_end_array(&w);
+    k5_json_write_begin_object(&w, NULL);
+    k5_json_write_end_object(&w);
+    k5_json_write_end_array(&w);
+    k5_json_write_begin_object(&w, "k3");
+    k5_json_write_bool(&w, "k4", 1);
+    k5_json_write_string_len(&w, "k5", "c\0d", 3);
+    k5_json_write_end_object(&w);
+    k5_json_write_bool(&w, "k6", 0);
+    k5_json_write_end_object(&w);
+    check(k5_buf_status(&buf) == 0, "writer status");
+    check(strcmp(buf.data, expected) == 0, "writer output");
+
+    /* The output should round-trip through the tree-based encoder, apart
+     * from the embedded null, which the decoder rejects. */
+    k5_buf_truncate(&buf, 0);
+    k5_json_writer_init(&w, &buf);
+    k5_json_write_begin_array(&w, NULL);
+    k5_json_write_string(&w, NULL, "\\abc\"\nde\b\r/\ff\tghi\001\037");
+    k5_json_write_number(&w, NULL, -123456789);
+    k5_json_write_end_array(&w);
+    check(k5_buf_status(&buf) == 0, "writer status 2");
+    check(k5_json_decode(buf.data, &v) == 0, "writer decode");
+    check(k5_json_encode(v, &enc) == 0, "writer reencode");
+    check(strcmp(enc, buf.data) == 0, "writer round trip");
+    free(enc);
+    k5_json_release(v);
+    k5_buf_free(&buf);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -325,5 +374,6 @@ main(int argc, char **argv)
     test_object();
     test_string();
     test_json();
+    test_writer();
     return 0;
 }